@@ -0,0 +1,123 @@
+#include "Controller.hpp"
+
+/*
+  Per-word bump arena. Everything a decode builds and throws away (the lattice's states and arcs, the search's path
+  list, the edit and merge lists, the ranked results) is allocated from the decoding session's arena through
+  ArenaAllocator, and the arena is reset when the session starts its next word. A word's worth of allocation is then a
+  few pointer bumps, and releasing all of it is one assignment, instead of a malloc/free per list node and per vector.
+
+  An arena is a list of chunks bumped in order. When the current chunk is full the next one is used, and a new chunk
+  (at least twice the last) is only malloc'd when there's no next one, so after the first few words the chunks fit the
+  largest word seen and the steady state makes no malloc calls. Reset keeps the chunks and just rewinds to the first.
+
+  The current arena is per-thread, set by an ArenaScope for the duration of a decode; containers default-constructed
+  with no arena current (everything outside a session's decode, eg twitch and the tools) use the heap as before.
+*/
+
+static thread_local Arena* currentArena = NULL;
+static std::atomic<U64> numChunks(0);  //chunks malloc'd by every arena in the process, ever
+
+Arena::Arena(size_t firstChunkSize)
+{
+  chunks.push_back((char*)malloc(firstChunkSize));
+  chunkSizes.push_back(firstChunkSize);
+  numChunks++;
+  if(chunks[0] == NULL){
+    throw std::bad_alloc();
+  }
+  current = 0;
+  cursor = chunks[0];
+  limit = cursor + firstChunkSize;
+}
+
+Arena::~Arena()
+{
+  if(currentArena == this){
+    currentArena = NULL;
+  }
+  for(int i = 0; i < chunks.size(); i++){
+    free(chunks[i]);
+  }
+}
+
+//align must be a power of two
+void* Arena::Allocate(size_t size, size_t align)
+{
+  char* p = (char*)(((uintptr_t)cursor + align - 1) & ~(uintptr_t)(align - 1));
+  size_t chunkSize;
+
+  while(p + size > limit){
+    current++;
+    if(current == chunks.size()){
+      chunkSize = std::max(2 * chunkSizes.back(),size + align);
+      chunks.push_back((char*)malloc(chunkSize));
+      chunkSizes.push_back(chunkSize);
+      numChunks++;
+      if(chunks.back() == NULL){
+        chunks.pop_back();
+        chunkSizes.pop_back();
+        current--;
+        throw std::bad_alloc();
+      }
+    }
+    cursor = chunks[current];
+    limit = cursor + chunkSizes[current];
+    p = (char*)(((uintptr_t)cursor + align - 1) & ~(uintptr_t)(align - 1));
+  }
+  cursor = p + size;
+
+  return p;
+}
+
+//frees everything allocated since the last Reset, keeping the chunks
+void Arena::Reset(void)
+{
+  current = 0;
+  cursor = chunks[0];
+  limit = cursor + chunkSizes[0];
+}
+
+//total bytes in the arena's chunks
+size_t Arena::Capacity(void)
+{
+  size_t total = 0;
+
+  for(int i = 0; i < chunkSizes.size(); i++){
+    total += chunkSizes[i];
+  }
+
+  return total;
+}
+
+//the chunks malloc'd by every arena so far; they bypass operator new, so a count of heap allocations has to add these
+U64 Arena::NumChunks(void)
+{
+  return numChunks;
+}
+
+//this thread's current arena, or NULL
+Arena* Arena::Current(void)
+{
+  return currentArena;
+}
+
+//returns the previous current arena
+Arena* Arena::SetCurrent(Arena* arena)
+{
+  Arena* previous = currentArena;
+
+  currentArena = arena;
+
+  return previous;
+}
+
+ArenaScope::ArenaScope(Arena* arena)
+{
+  arena->Reset();
+  previous = Arena::SetCurrent(arena);
+}
+
+ArenaScope::~ArenaScope()
+{
+  Arena::SetCurrent(previous);
+}
@@ -0,0 +1,439 @@
+#include "Controller.hpp"
+
+/*
+  End-to-end latency benchmark over the recorded traces. Replaces eyeballing the single DiffTimeSpecs figures
+  printed by Controller::PerformanceTest and SmokeTest.
+
+  Usage: bench [repeats=20] [outFile=bench.json] [baselineFile] [tolerance=0.10]
+  eg:
+    ./bench 20 ../bench_baseline.json      (save a baseline)
+    ./bench 20 bench.json ../bench_baseline.json    (compare against it; exits 2 on a regression)
+
+  Every trace (wordk.txt, k=1...) in each of BENCH_TRACE_DIRS is loaded once, then run through each stage of the
+  pipeline 'repeats' times, after one untimed warm-up pass: SingularityBuilder::Process3, DirectInference::Process,
+  LatticeBuilder::BuildStaticLattice, SearchEngine::Process, LanguageModel::Process. Each stage's samples are pooled
+  over all traces and reported as median/p99/mean in microseconds, along with the per-trace median of the whole pipeline.
+
+  The components' own console output is part of what they cost, so it isn't removed, but stdout is pointed at
+  /dev/null while they run so the report stays readable.
+
+  The stages run the way a DecodeSession runs them: the lattice and result lists are allocated from an Arena, reset
+  before each run. Every operator new call is counted, and so is every chunk an arena mallocs, and each stage's mean
+  allocations per word are reported next to its latency; with the arena warmed up, a stage that still allocates is doing
+  per-word heap work it shouldn't, and a stage that outgrows the arena shows up as chunk allocations. The arena's
+  chunks and capacity at the end are reported too.
+
+  Next to the pipeline, each trace's clusters are also run through the alternative direct inference paths (the edit
+  index lookup and the batch string-distance kernels) and its points through the window feature kernels. These are
+  timed as stages of their own, but left out of the pipeline total. Once per trace, the string and feature kernels are
+  also checked against the scalar functions they replace, and any mismatch fails the run.
+
+  A stage regresses if its median is more than 'tolerance' (fractional) above the baseline's median, and more than
+  BENCH_NOISE_FLOOR_US above it in absolute terms, since the fastest stages are only a few microseconds.
+*/
+
+#define NUM_BENCH_STAGES 8
+#define NUM_TOTALED_STAGES 5  //the first stages, whose times sum to a trace's total
+#define BENCH_NOISE_FLOOR_US 5.0
+
+static const char* BENCH_STAGES[NUM_BENCH_STAGES] = {
+  "SingularityBuilder::Process3",
+  "DirectInference::Process",
+  "LatticeBuilder::BuildStaticLattice",
+  "SearchEngine::Process",
+  "LanguageModel::Process",
+  "DirectInference::EditDistInference",
+  "DirectInference::StringDistInference",
+  "WindowFeatures::Compute"
+};
+static const char* BENCH_TRACE_DIRS[] = {"../TestInput/EyeInputs/Test1/", "../TestInput/EyeInputs/Test2/"};
+static const int NUM_BENCH_TRACE_DIRS = sizeof(BENCH_TRACE_DIRS) / sizeof(char*);
+
+//every operator new call in the process. The arena's chunks are malloc'd directly, so HeapAllocations adds them
+static U64 numAllocations = 0;
+
+void* operator new(size_t size)
+{
+  void* p;
+
+  numAllocations++;
+  p = malloc(size ? size : 1);
+  if(p == NULL){
+    throw std::bad_alloc();
+  }
+
+  return p;
+}
+
+void operator delete(void* p) noexcept
+{
+  free(p);
+}
+
+//operator new calls plus arena chunks: every heap allocation a stage can make
+static U64 HeapAllocations(void)
+{
+  return numAllocations + Arena::NumChunks();
+}
+
+class Bench{
+  public:
+    LayoutManager* layoutManager;
+    SingularityBuilder* sb;
+    DirectInference* di;
+    LatticeBuilder* lb;
+    SearchEngine* se;
+    LanguageModel* lm;
+    int repeats;
+    vector<Point> sensorData;   //per-run buffers, kept across runs and traces like a DecodeSession's
+    vector<PointMu> pointMeans;
+    Lattice lattice;
+    Arena arena;
+    SearchResults diResults;    //in the arena
+    SearchResults editResults;
+    SearchResults stringResults;
+    WindowFeatures windowFeatures;
+    LatticePaths strings;
+    vector<string> traces;
+    vector<double> stageSamples[NUM_BENCH_STAGES];  //in microseconds, pooled over all traces
+    U64 stageAllocations[NUM_BENCH_STAGES];         //operator new calls, summed over the recorded runs
+    vector<double> traceMedians;                    //median total pipeline time per trace, in microseconds
+    int kernelMismatches;                           //string kernel distances that differ from the scalar functions'
+    int featureMismatches;                          //window features that differ from the scalar LayoutManager functions'
+
+    Bench(const string& keyMapFile, int numRepeats);
+    ~Bench();
+
+    void FindTraces(const string& dir);
+    void RunTrace(const string& fname, vector<double>& totals, bool record);
+    void Run(void);
+    double Mean(const vector<double>& samples);
+    bool WriteReport(const string& jsonFile);
+    int CompareBaseline(const string& baselineFile, double tolerance);
+};
+
+Bench::Bench(const string& keyMapFile, int numRepeats)
+  : lattice(ArenaAllocator<Cluster>(NULL)), diResults(ArenaAllocator<SearchResult>(&arena)), editResults(ArenaAllocator<SearchResult>(&arena)),
+    stringResults(ArenaAllocator<SearchResult>(&arena)), strings(ArenaAllocator<LatticePath>(&arena))
+{
+  repeats = numRepeats;
+  kernelMismatches = featureMismatches = 0;
+  layoutManager = new LayoutManager(keyMapFile);
+  sb = new SingularityBuilder(0,layoutManager->GetWidth(),0,layoutManager->GetHeight(),layoutManager);
+  sb->LoadParameters(CLUSTER_PARAMS_FILE);
+  lb = new LatticeBuilder(layoutManager);
+  se = new SearchEngine();
+  lm = new LanguageModel();
+  lm->BuildModels();
+  string vocab = "../vocabModel.txt";
+  di = new DirectInference(vocab,layoutManager);
+  di->BuildEditIndex(MAX_EDIT_DIST);
+  lm->SetEditIndex(&di->editIndex);
+
+  for(int i = 0; i < NUM_BENCH_STAGES; i++){
+    stageAllocations[i] = 0;
+  }
+
+}
+
+Bench::~Bench()
+{
+  delete sb;
+  delete lb;
+  delete se;
+  delete lm;
+  delete di;
+  delete layoutManager;
+}
+
+//appends dir/word1.txt, dir/word2.txt... up to the first missing one
+void Bench::FindTraces(const string& dir)
+{
+  string fname;
+  std::ifstream probe;
+
+  for(int i = 1; ; i++){
+    fname = dir + "word" + std::to_string(i) + ".txt";
+    probe.open(fname.c_str());
+    if(!probe.is_open()){
+      break;
+    }
+    probe.close();
+    traces.push_back(fname);
+  }
+}
+
+/*
+  Runs one trace through every stage, repeats times. The trace is parsed once, outside the timed region. If record is
+  false this is just a warm-up.
+*/
+void Bench::RunTrace(const string& fname, vector<double>& totals, bool record)
+{
+  int i, stage, numRuns = record ? repeats : 1;
+  double elapsed[NUM_BENCH_STAGES], total;
+  U64 allocations[NUM_BENCH_STAGES];
+  string delimiter = "\t";
+  string edit;
+  struct timespec begin, end;
+
+  sensorData.clear();
+  sb->BuildTestData(fname,sensorData,delimiter);
+
+  for(i = 0; i < numRuns; i++){
+    pointMeans.clear();
+    diResults.clear();
+    editResults.clear();
+    stringResults.clear();
+    lattice.clear();
+    strings.clear();
+    ArenaScope scope(&arena);
+
+    allocations[0] = HeapAllocations();
+    clock_gettime(CLOCK_MONOTONIC,&begin);
+    sb->Process3(sensorData,pointMeans);
+    clock_gettime(CLOCK_MONOTONIC,&end);
+    elapsed[0] = DiffTimeSpecs(&begin,&end);
+    allocations[0] = HeapAllocations() - allocations[0];
+
+    if(pointMeans.size() > 0){
+      allocations[1] = HeapAllocations();
+      clock_gettime(CLOCK_MONOTONIC,&begin);
+      di->Process(pointMeans,diResults);
+      clock_gettime(CLOCK_MONOTONIC,&end);
+      elapsed[1] = DiffTimeSpecs(&begin,&end);
+      allocations[1] = HeapAllocations() - allocations[1];
+
+      allocations[2] = HeapAllocations();
+      clock_gettime(CLOCK_MONOTONIC,&begin);
+      lb->BuildStaticLattice(pointMeans,lattice);
+      clock_gettime(CLOCK_MONOTONIC,&end);
+      elapsed[2] = DiffTimeSpecs(&begin,&end);
+      allocations[2] = HeapAllocations() - allocations[2];
+
+      allocations[3] = HeapAllocations();
+      clock_gettime(CLOCK_MONOTONIC,&begin);
+      se->Process(lattice,strings);
+      clock_gettime(CLOCK_MONOTONIC,&end);
+      elapsed[3] = DiffTimeSpecs(&begin,&end);
+      allocations[3] = HeapAllocations() - allocations[3];
+
+      allocations[4] = HeapAllocations();
+      clock_gettime(CLOCK_MONOTONIC,&begin);
+      lm->Process(strings);
+      clock_gettime(CLOCK_MONOTONIC,&end);
+      elapsed[4] = DiffTimeSpecs(&begin,&end);
+      allocations[4] = HeapAllocations() - allocations[4];
+
+      allocations[5] = HeapAllocations();
+      clock_gettime(CLOCK_MONOTONIC,&begin);
+      di->EditDistInference(pointMeans,editResults);
+      clock_gettime(CLOCK_MONOTONIC,&end);
+      elapsed[5] = DiffTimeSpecs(&begin,&end);
+      allocations[5] = HeapAllocations() - allocations[5];
+
+      allocations[6] = HeapAllocations();
+      clock_gettime(CLOCK_MONOTONIC,&begin);
+      di->StringDistInference(pointMeans,stringResults);
+      clock_gettime(CLOCK_MONOTONIC,&end);
+      elapsed[6] = DiffTimeSpecs(&begin,&end);
+      allocations[6] = HeapAllocations() - allocations[6];
+    }
+    else{
+      for(stage = 1; stage < NUM_BENCH_STAGES - 1; stage++){
+        elapsed[stage] = 0.0;
+        allocations[stage] = 0;
+      }
+    }
+
+    allocations[7] = HeapAllocations();
+    clock_gettime(CLOCK_MONOTONIC,&begin);
+    windowFeatures.Compute(sensorData,3,FEATURE_ALL);
+    clock_gettime(CLOCK_MONOTONIC,&end);
+    elapsed[7] = DiffTimeSpecs(&begin,&end);
+    allocations[7] = HeapAllocations() - allocations[7];
+
+    if(record){
+      total = 0.0;
+      for(stage = 0; stage < NUM_BENCH_STAGES; stage++){
+        stageSamples[stage].push_back(elapsed[stage] * 1.0e6);
+        stageAllocations[stage] += allocations[stage];
+        if(stage < NUM_TOTALED_STAGES){
+          total += elapsed[stage] * 1.0e6;
+        }
+      }
+      totals.push_back(total);
+    }
+  }
+
+  //once per trace, check the kernels against the scalar functions
+  if(record){
+    featureMismatches += windowFeatures.Test(sensorData,3,layoutManager);
+    if(pointMeans.size() > 0){
+      di->MeansToString(pointMeans,edit);
+      kernelMismatches += di->TestStringKernels(edit);
+    }
+  }
+}
+
+void Bench::Run(void)
+{
+  vector<double> totals;
+
+  for(int i = 0; i < NUM_BENCH_TRACE_DIRS; i++){
+    FindTraces(BENCH_TRACE_DIRS[i]);
+  }
+  cout << "benchmarking " << traces.size() << " traces, " << repeats << " repeats each..." << endl;
+
+  for(int i = 0; i < traces.size(); i++){
+    totals.clear();
+    Silence(true);
+    RunTrace(traces[i],totals,false);
+    RunTrace(traces[i],totals,true);
+    Silence(false);
+    traceMedians.push_back(Percentile(totals,0.5));
+  }
+}
+
+double Bench::Mean(const vector<double>& samples)
+{
+  double sum = 0.0;
+
+  for(int i = 0; i < samples.size(); i++){
+    sum += samples[i];
+  }
+
+  return samples.empty() ? 0.0 : (sum / samples.size());
+}
+
+/*
+  Prints the report and writes it as json. Each stage is kept on one line, which is all CompareBaseline needs
+  to parse it back.
+*/
+bool Bench::WriteReport(const string& jsonFile)
+{
+  int i;
+  double allocsPerWord;
+  FILE* ofile;
+
+  ofile = fopen(jsonFile.c_str(),"w");
+  if(ofile == NULL){
+    cout << "ERROR could not open file: " << jsonFile << endl;
+    return false;
+  }
+
+  fprintf(ofile,"{\n  \"repeats\": %d,\n  \"traces\": %d,\n  \"stages\": [\n",repeats,(int)traces.size());
+  for(i = 0; i < NUM_BENCH_STAGES; i++){
+    allocsPerWord = stageSamples[i].empty() ? 0.0 : ((double)stageAllocations[i] / stageSamples[i].size());
+    fprintf(ofile,"    {\"stage\": \"%s\", \"samples\": %d, \"median_us\": %.3f, \"p99_us\": %.3f, \"mean_us\": %.3f, \"allocs_per_word\": %.2f}%s\n",
+      BENCH_STAGES[i],(int)stageSamples[i].size(),Percentile(stageSamples[i],0.5),Percentile(stageSamples[i],0.99),Mean(stageSamples[i]),allocsPerWord,(i < NUM_BENCH_STAGES - 1) ? "," : "");
+    printf("%-36s median %10.3f us  p99 %10.3f us  mean %10.3f us  allocs/word %8.2f\n",BENCH_STAGES[i],Percentile(stageSamples[i],0.5),Percentile(stageSamples[i],0.99),Mean(stageSamples[i]),allocsPerWord);
+  }
+  fprintf(ofile,"  ],\n  \"trace_medians\": [\n");
+  for(i = 0; i < traces.size(); i++){
+    fprintf(ofile,"    {\"trace\": \"%s\", \"total_us\": %.3f}%s\n",traces[i].c_str(),traceMedians[i],(i < traces.size() - 1) ? "," : "");
+    printf("%-44s total median %10.3f us\n",traces[i].c_str(),traceMedians[i]);
+  }
+  fprintf(ofile,"  ],\n  \"kernel_mismatches\": %d,\n  \"feature_mismatches\": %d,\n  \"edit_index_kb\": %zu,\n  \"arena_chunks\": %zu,\n  \"arena_kb\": %zu\n}\n",
+    kernelMismatches,featureMismatches,di->editIndex.MemoryUsage() / 1024,arena.chunks.size(),arena.Capacity() / 1024);
+  fclose(ofile);
+  printf("string kernel mismatches vs scalar: %d  window feature mismatches vs scalar: %d  edit index memory: %zukb\n",kernelMismatches,featureMismatches,
+    di->editIndex.MemoryUsage() / 1024);
+  printf("arena: %zu chunks, %zukb\n",arena.chunks.size(),arena.Capacity() / 1024);
+
+  cout << "wrote " << jsonFile << endl;
+  if(kernelMismatches > 0 || featureMismatches > 0){
+    cout << "ERROR kernels disagree with the scalar functions they replace" << endl;
+    return false;
+  }
+  return true;
+}
+
+/*
+  Compares this run's stage medians against a report previously written by WriteReport. Returns the number of
+  regressed stages, or -1 if the baseline couldn't be read.
+*/
+int Bench::CompareBaseline(const string& baselineFile, double tolerance)
+{
+  int i, regressions = 0, found = 0;
+  double baseMedian, median;
+  char stage[SMALL_BUFSIZE];
+  const char* pos;
+  string line;
+  std::ifstream infile(baselineFile.c_str());
+
+  if(!infile.is_open()){
+    cout << "ERROR could not open baseline file: " << baselineFile << endl;
+    return -1;
+  }
+
+  while(getline(infile,line)){
+    if(sscanf(line.c_str()," {\"stage\": \"%255[^\"]\"",stage) != 1 || (pos = strstr(line.c_str(),"\"median_us\":")) == NULL){
+      continue;
+    }
+    baseMedian = atof(pos + strlen("\"median_us\":"));
+    for(i = 0; i < NUM_BENCH_STAGES; i++){
+      if(strcmp(stage,BENCH_STAGES[i]) == 0){
+        found++;
+        median = Percentile(stageSamples[i],0.5);
+        printf("%-36s baseline %10.3f us  now %10.3f us  (%+.1f%%)",stage,baseMedian,median,(baseMedian > 0.0) ? (100.0 * (median - baseMedian) / baseMedian) : 0.0);
+        if(median > baseMedian * (1.0 + tolerance) && median - baseMedian > BENCH_NOISE_FLOOR_US){
+          printf("  REGRESSION");
+          regressions++;
+        }
+        printf("\n");
+      }
+    }
+  }
+
+  if(found == 0){
+    cout << "ERROR no stages found in baseline file: " << baselineFile << endl;
+    return -1;
+  }
+
+  return regressions;
+}
+
+int main(int argc, char* argv[])
+{
+  int repeats = 20, regressions;
+  double tolerance = 0.10;
+  string jsonFile = "bench.json";
+  string baselineFile;
+
+  if(argc >= 2){
+    repeats = atoi(argv[1]);
+  }
+  if(argc >= 3){
+    jsonFile = argv[2];
+  }
+  if(argc >= 4){
+    baselineFile = argv[3];
+  }
+  if(argc >= 5){
+    tolerance = atof(argv[4]);
+  }
+  if(repeats <= 0){
+    cout << "usage: " << argv[0] << " [repeats=20] [outFile=bench.json] [baselineFile] [tolerance=0.10]" << endl;
+    return 1;
+  }
+
+  Bench bench("../TestInput/EyeInputs/Test1/keyMap.txt",repeats);
+  bench.Run();
+  if(!bench.WriteReport(jsonFile)){
+    return 1;
+  }
+
+  if(!baselineFile.empty()){
+    regressions = bench.CompareBaseline(baselineFile,tolerance);
+    if(regressions < 0){
+      return 1;
+    }
+    if(regressions > 0){
+      cout << regressions << " stage(s) regressed more than " << (tolerance * 100.0) << "% against " << baselineFile << endl;
+      return 2;
+    }
+    cout << "no regressions against " << baselineFile << endl;
+  }
+
+  return 0;
+}
@@ -0,0 +1,193 @@
+#include "Controller.hpp"
+
+/*
+  Side-by-side benchmark of the clustering strategies in the ClusterRegistry. Every strategy decodes every word of a
+  gaze trace file, on its own thread and its own DecodeSession, all at once, and each is reported with its throughput,
+  the time spent clustering and decoding a word, the clusters it finds per word, and the recall of the decode
+  downstream of it: how often the word's label is the top result, or in the top 5. Words without labels are timed but
+  not scored.
+
+    clusterBench file.gzt [path=direct|lattice] [strategies=all|name,name,...] [repeats=1] [filter=default|on|off|both]
+
+  filter=both runs each strategy twice, on the raw points and on the points smoothed by a GazeFilter (see GazeFilter.cpp),
+  as "name" and "name+f".
+
+  The strategies share the machine, so with more strategies than cores the throughputs are relative, not absolute.
+*/
+
+#define CLUSTER_BENCH_TOP_N 5
+
+//one strategy's thread, and its totals
+struct StrategyRun{
+  const ClusterStrategy* strategy;
+  DecodeSession* session;
+  bool filtering;
+  U64 numWords;
+  U64 numClusters;
+  U64 numLabeled;
+  U64 top1;
+  U64 topN;
+  double clusterUs;
+  double decodeUs;
+  double wallSeconds;
+};
+
+class ClusterBench{
+  public:
+    DecoderModels* models;
+    GazeTraceFile trace;
+    int path;
+    vector<StrategyRun> runs;
+
+    ClusterBench(int decodePath);
+    ~ClusterBench();
+
+    bool Run(const string& traceFile, const vector<string>& names, const vector<bool>& filters, int repeats);
+    void RunStrategy(StrategyRun* run, int repeats);
+    void Print(void);
+};
+
+ClusterBench::ClusterBench(int decodePath)
+{
+  path = decodePath;
+
+  Silence(true);
+  models = new DecoderModels("../TestInput/EyeInputs/Test1/keyMap.txt","../vocabModel.txt");
+  Silence(false);
+}
+
+ClusterBench::~ClusterBench()
+{
+  for(size_t i = 0; i < runs.size(); i++){
+    delete runs[i].session;
+  }
+  delete models;
+}
+
+//runs each strategy in names once per setting in filters
+bool ClusterBench::Run(const string& traceFile, const vector<string>& names, const vector<bool>& filters, int repeats)
+{
+  vector<std::thread> threads;
+
+  if(!trace.Open(traceFile)){
+    return false;
+  }
+
+  runs.resize(names.size() * filters.size());
+  for(size_t i = 0; i < runs.size(); i++){
+    StrategyRun& run = runs[i];
+    memset(&run,0,sizeof(run));
+    run.session = new DecodeSession(models,i);
+    if(!run.session->SetClusterStrategy(names[i / filters.size()])){
+      return false;
+    }
+    run.strategy = run.session->clusterer;
+    run.filtering = run.session->filtering = filters[i % filters.size()];
+  }
+
+  //the clusterers print as they go
+  Silence(true);
+  for(size_t i = 0; i < runs.size(); i++){
+    threads.push_back(std::thread(&ClusterBench::RunStrategy,this,&runs[i],repeats));
+  }
+  for(size_t i = 0; i < threads.size(); i++){
+    threads[i].join();
+  }
+  Silence(false);
+
+  Print();
+
+  return true;
+}
+
+void ClusterBench::RunStrategy(StrategyRun* run, int repeats)
+{
+  struct timespec begin, end;
+  SearchResultIt it;
+  int rank;
+
+  clock_gettime(CLOCK_MONOTONIC,&begin);
+  for(int r = 0; r < repeats; r++){
+    for(size_t i = 0; i < trace.words.size(); i++){
+      const GazeWord& word = trace.words[i];
+      run->session->Decode(word.points,path);
+      run->numWords++;
+      run->numClusters += run->session->pointMeans.size();
+      run->clusterUs += run->session->lastClusterUs;
+      run->decodeUs += run->session->lastDecodeUs;
+
+      if(word.label[0] == 0){
+        continue;
+      }
+      run->numLabeled++;
+      for(it = run->session->results.begin(), rank = 0; it != run->session->results.end() && rank < CLUSTER_BENCH_TOP_N; ++it, rank++){
+        if(it->first == word.label){
+          run->top1 += (rank == 0);
+          run->topN++;
+          break;
+        }
+      }
+    }
+  }
+  clock_gettime(CLOCK_MONOTONIC,&end);
+
+  run->wallSeconds = DiffTimeSpecs(&begin,&end);
+}
+
+void ClusterBench::Print(void)
+{
+  printf("%zu words, %s path, %zu strategies on %u cores\n",trace.words.size(),path == DECODE_LATTICE_LM ? "lattice" : "direct",runs.size(),
+    std::max(1u,std::thread::hardware_concurrency()));
+  printf("%-10s %10s %12s %12s %10s %8s %8s\n","strategy","words/s","cluster us","decode us","clusters","top1","top5");
+  for(size_t i = 0; i < runs.size(); i++){
+    StrategyRun& run = runs[i];
+    double words = std::max((U64)1,run.numWords), labeled = std::max((U64)1,run.numLabeled);
+    printf("%-10s %10.1f %12.1f %12.1f %10.2f %7.1f%% %7.1f%%\n",(run.strategy->name + (run.filtering ? "+f" : "")).c_str(),run.wallSeconds > 0.0 ? run.numWords / run.wallSeconds : 0.0,
+      run.clusterUs / words,run.decodeUs / words,run.numClusters / words,100.0 * run.top1 / labeled,100.0 * run.topN / labeled);
+  }
+  printf("cluster and decode us are per word; decode includes clustering. top1/top5 are over the %llu labeled words\n",runs.empty() ? 0ULL : runs[0].numLabeled);
+  for(size_t i = 0; i < runs.size(); i++){
+    if(i == 0 || runs[i].strategy != runs[i-1].strategy){
+      printf("  %-10s %s\n",runs[i].strategy->name.c_str(),runs[i].strategy->description.c_str());
+    }
+  }
+  if(runs.size() > 0 && (runs[0].filtering || runs[runs.size()-1].filtering)){
+    printf("  +f         smoothed with a GazeFilter first\n");
+  }
+}
+
+int main(int argc, char* argv[])
+{
+  int path = DECODE_DIRECT, repeats = 1;
+  vector<string> names = ClusterRegistry::Names();
+  vector<bool> filters(1,GAZE_FILTER_DEFAULT);
+  string name;
+
+  if(argc >= 3){
+    path = strcmp(argv[2],"lattice") ? DECODE_DIRECT : DECODE_LATTICE_LM;
+  }
+  if(argc >= 4 && strcmp(argv[3],"all")){
+    std::istringstream list(argv[3]);
+    names.clear();
+    while(std::getline(list,name,',')){
+      names.push_back(name);
+    }
+  }
+  if(argc >= 5){
+    repeats = atoi(argv[4]);
+  }
+  if(argc >= 6 && !strcmp(argv[5],"both")){
+    filters.assign(1,false);
+    filters.push_back(true);
+  }
+  else if(argc >= 6 && strcmp(argv[5],"default")){
+    filters.assign(1,!strcmp(argv[5],"on"));
+  }
+  if(argc < 2 || repeats < 1 || names.empty()){
+    cout << "usage: " << argv[0] << " file" << GAZE_TRACE_EXT << " [path=direct|lattice] [strategies=all|name,name,...] [repeats=1] [filter=default|on|off|both]" << endl;
+    return 1;
+  }
+
+  ClusterBench bench(path);
+  return bench.Run(argv[1],names,filters,repeats) ? 0 : 1;
+}
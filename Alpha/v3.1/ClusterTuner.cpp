@@ -0,0 +1,388 @@
+#include "Controller.hpp"
+
+/*
+  Offline tool for tuning SingularityBuilder's event parameters (ClusterParams), which were hand-picked. Searches them
+  over the labeled words of a gaze trace file and writes the best to a parameter file that DecoderModels (and the other
+  drivers) load at startup, as lambdaOptimizer does for the char n-gram lambdas.
+
+  Usage: clusterTuner file.gzt [outFile=../clusterParams.txt] [search=grid|random] [trials=300] [threads=ncores] [cluster=process3] [path=direct|lattice]
+
+  Only the parameters the strategy reads are searched (see TUNED_PARAMS); the others keep their current values.
+  search=grid tries every combination of each parameter's grid values, and search=random samples trials sets uniformly
+  between each one's smallest and largest grid value. The current parameters (the defaults, or the loaded file's) are
+  always tried first, so the result is never worse than what's there on this corpus.
+
+  Objective: top-1 recall of the decode downstream of the clusters, then top-5 recall, then the mean latency per word
+  (clustering plus decoding). Candidates are evaluated on every thread at once, each with its own DecodeSession. Many
+  parameter sets cluster a word the same way, and decoding costs far more than clustering, so decodes are cached by
+  the word and its clusters and shared between the threads; a cached decode is charged the latency it took the first
+  time.
+
+  The corpus is small, so a tuned profile is only as general as the traces it was tuned on; check it with recall or
+  clusterBench on other traces before keeping it.
+*/
+
+#define TUNER_TOP_N 5
+#define TUNER_RANDOM_SEED 1
+#define TUNER_BUILT_IN_STRATEGIES ",process,process2,process3,process4,simple,"
+
+//a searchable ClusterParams member, in the order ClusterTuner::SetParam numbers them, and the strategies that read it
+struct TunedParam{
+  const char* name;
+  const char* strategies;  //comma separated
+  bool integer;
+  double grid[6];
+  int gridSize;
+};
+
+static const TunedParam TUNED_PARAMS[] = {
+  {"dxThreshold",      "process",          true,  {8, 11, 14, 18, 24},             5},
+  {"innerDxThreshold", "process",          true,  {10, 13, 16, 20, 26},            5},
+  {"triggerThreshold", "process,process3", true,  {2, 3, 4, 5, 6, 8},              6},
+  {"highFocus",        "process3",         true,  {25, 35, 45, 60, 80},            5},
+  {"stDevHardTrigger", "process3",         false, {150, 190, 225, 270, 320, 400},  6},
+  {"stDevSoftTrigger", "process3",         false, {7, 10, 14, 18, 24},             5}
+};
+static const int NUM_TUNED_PARAMS = sizeof(TUNED_PARAMS) / sizeof(TunedParam);
+
+//one candidate's totals over the corpus
+struct TunerScore{
+  U32 numLabeled;
+  U32 top1;
+  U32 topN;
+  U64 numClusters;
+  double latencyUs;
+};
+
+//a decode of one word's clusters: where its label ranked (-1 if not in the top N), and what it cost
+struct CachedDecode{
+  int rank;
+  double decodeUs;
+};
+
+class ClusterTuner{
+  public:
+    DecoderModels* models;
+    GazeTraceFile trace;
+    vector<const GazeWord*> words;  //the labeled ones
+    string strategy;
+    int path;
+    int numThreads;
+    vector<int> tuned;  //indices into TUNED_PARAMS
+    vector<ClusterParams> candidates;
+    vector<TunerScore> scores;
+    std::atomic<U32> nextCandidate;
+    std::mutex cacheMutex;
+    unordered_map<string,CachedDecode> cache;
+    std::atomic<U64> cacheHits;
+
+    ClusterTuner(const string& strategyName, int decodePath, int nThreads);
+    ~ClusterTuner();
+
+    bool Open(const string& traceFile);
+    void SetParam(ClusterParams& params, int p, double value);
+    void BuildGrid(void);
+    void BuildRandom(int trials);
+    void Search(void);
+    void Worker(void);
+    void Evaluate(DecodeSession* session, const ClusterParams& params, TunerScore& score);
+    bool Better(const TunerScore& a, const TunerScore& b);
+    void Print(U32 best);
+};
+
+ClusterTuner::ClusterTuner(const string& strategyName, int decodePath, int nThreads)
+{
+  strategy = strategyName;
+  path = decodePath;
+  numThreads = (nThreads > 0) ? nThreads : std::max(1u,std::thread::hardware_concurrency());
+  nextCandidate = 0;
+  cacheHits = 0;
+
+  Silence(true);
+  models = new DecoderModels("../TestInput/EyeInputs/Test1/keyMap.txt","../vocabModel.txt");
+  Silence(false);
+
+  //a strategy that isn't a built-in could read any of them
+  bool builtIn = string(TUNER_BUILT_IN_STRATEGIES).find("," + strategy + ",") != string::npos;
+  for(int p = 0; p < NUM_TUNED_PARAMS; p++){
+    if(!builtIn || (string(",") + TUNED_PARAMS[p].strategies + ",").find("," + strategy + ",") != string::npos){
+      tuned.push_back(p);
+    }
+  }
+}
+
+ClusterTuner::~ClusterTuner()
+{
+  delete models;
+}
+
+bool ClusterTuner::Open(const string& traceFile)
+{
+  if(ClusterRegistry::Find(strategy) == NULL){
+    cout << "ERROR unknown cluster strategy: " << strategy << endl;
+    return false;
+  }
+  if(!trace.Open(traceFile)){
+    return false;
+  }
+  for(size_t i = 0; i < trace.words.size(); i++){
+    if(trace.words[i].label[0] != 0){
+      words.push_back(&trace.words[i]);
+    }
+  }
+  if(words.empty()){
+    cout << "ERROR no labeled words in " << traceFile << endl;
+    return false;
+  }
+
+  return true;
+}
+
+void ClusterTuner::SetParam(ClusterParams& params, int p, double value)
+{
+  switch(p){
+    case 0: params.dxThreshold = (int)value; break;
+    case 1: params.innerDxThreshold = (int)value; break;
+    case 2: params.triggerThreshold = (int)value; break;
+    case 3: params.highFocus = (int)value; break;
+    case 4: params.stDevHardTrigger = value; break;
+    default: params.stDevSoftTrigger = value; break;
+  }
+}
+
+//every combination of the tuned parameters' grid values, after the current parameters
+void ClusterTuner::BuildGrid(void)
+{
+  vector<int> digits(tuned.size(),0);
+  ClusterParams params = models->clusterParams;
+  size_t d;
+
+  candidates.push_back(models->clusterParams);
+  while(true){
+    for(d = 0; d < tuned.size(); d++){
+      SetParam(params,tuned[d],TUNED_PARAMS[tuned[d]].grid[digits[d]]);
+    }
+    candidates.push_back(params);
+
+    //odometer increment
+    for(d = 0; d < tuned.size() && ++digits[d] == TUNED_PARAMS[tuned[d]].gridSize; d++){
+      digits[d] = 0;
+    }
+    if(d == tuned.size()){
+      break;
+    }
+  }
+}
+
+//trials random parameter sets, after the current parameters
+void ClusterTuner::BuildRandom(int trials)
+{
+  std::mt19937 rng(TUNER_RANDOM_SEED);
+  ClusterParams params = models->clusterParams;
+
+  candidates.push_back(models->clusterParams);
+  for(int t = 0; t < trials; t++){
+    for(size_t d = 0; d < tuned.size(); d++){
+      const TunedParam& param = TUNED_PARAMS[tuned[d]];
+      if(param.integer){
+        std::uniform_int_distribution<int> value((int)param.grid[0],(int)param.grid[param.gridSize-1]);
+        SetParam(params,tuned[d],value(rng));
+      }
+      else{
+        std::uniform_real_distribution<double> value(param.grid[0],param.grid[param.gridSize-1]);
+        SetParam(params,tuned[d],value(rng));
+      }
+    }
+    candidates.push_back(params);
+  }
+}
+
+void ClusterTuner::Search(void)
+{
+  vector<std::thread> threads;
+
+  scores.assign(candidates.size(),TunerScore());
+  Silence(true);
+  for(int t = 0; t < numThreads; t++){
+    threads.push_back(std::thread(&ClusterTuner::Worker,this));
+  }
+  for(size_t t = 0; t < threads.size(); t++){
+    threads[t].join();
+  }
+  Silence(false);
+}
+
+//evaluates candidates until there are none left
+void ClusterTuner::Worker(void)
+{
+  DecodeSession session(models,0);
+  U32 c;
+
+  session.SetClusterStrategy(strategy);
+  while((c = nextCandidate++) < candidates.size()){
+    Evaluate(&session,candidates[c],scores[c]);
+  }
+}
+
+void ClusterTuner::Evaluate(DecodeSession* session, const ClusterParams& params, TunerScore& score)
+{
+  struct timespec begin, clustered, end;
+  string key;
+  CachedDecode decode;
+  unordered_map<string,CachedDecode>::iterator it;
+  SearchResultIt result;
+  bool found;
+
+  memset(&score,0,sizeof(score));
+  session->sb.SetParameters(params);
+  for(size_t w = 0; w < words.size(); w++){
+    const GazeWord& word = *words[w];
+
+    clock_gettime(CLOCK_MONOTONIC,&begin);
+    session->pointMeans.clear();
+    if(session->filtering){
+      session->filter.FilterWord(word.points,1000000 / GAZE_FILTER_SAMPLE_HZ,session->filtered);
+      session->clusterer->cluster(&session->sb,session->filtered,session->pointMeans);
+    }
+    else{
+      session->clusterer->cluster(&session->sb,word.points,session->pointMeans);
+    }
+    clock_gettime(CLOCK_MONOTONIC,&clustered);
+
+    //the word, and its clusters as the decoders see them
+    key.assign((const char*)&w,sizeof(w));
+    for(size_t i = 0; i < session->pointMeans.size(); i++){
+      const PointMu& mu = session->pointMeans[i];
+      key.append((const char*)&mu.pt.X,sizeof(mu.pt.X));
+      key.append((const char*)&mu.pt.Y,sizeof(mu.pt.Y));
+      key.append((const char*)&mu.ticks,sizeof(mu.ticks));
+      key.push_back(mu.alpha);
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(cacheMutex);
+      it = cache.find(key);
+      found = (it != cache.end());
+      if(found){
+        decode = it->second;
+      }
+    }
+    if(found){
+      cacheHits++;
+    }
+    else{
+      session->DecodeClusters(path);
+      clock_gettime(CLOCK_MONOTONIC,&end);
+      decode.rank = -1;
+      decode.decodeUs = DiffTimeSpecs(&clustered,&end) * 1.0e6;
+      result = session->results.begin();
+      for(int rank = 0; rank < TUNER_TOP_N && result != session->results.end(); rank++, ++result){
+        if(result->first == word.label){
+          decode.rank = rank;
+          break;
+        }
+      }
+      std::lock_guard<std::mutex> lock(cacheMutex);
+      cache[key] = decode;
+    }
+
+    score.numLabeled++;
+    score.top1 += (decode.rank == 0);
+    score.topN += (decode.rank >= 0);
+    score.numClusters += session->pointMeans.size();
+    score.latencyUs += DiffTimeSpecs(&begin,&clustered) * 1.0e6 + decode.decodeUs;
+  }
+}
+
+//whether a scores strictly better than b
+bool ClusterTuner::Better(const TunerScore& a, const TunerScore& b)
+{
+  if(a.top1 != b.top1){
+    return a.top1 > b.top1;
+  }
+  if(a.topN != b.topN){
+    return a.topN > b.topN;
+  }
+  return a.latencyUs < b.latencyUs;
+}
+
+void ClusterTuner::Print(U32 best)
+{
+  vector<U32> order;
+  double n = words.size();
+
+  for(U32 c = 0; c < candidates.size(); c++){
+    order.push_back(c);
+  }
+  std::sort(order.begin(),order.end(),[this](U32 a, U32 b){ return Better(scores[a],scores[b]); });
+
+  printf("%zu candidates over %zu labeled words, %s path, %s clusterer, %d threads; %zu distinct decodes, %llu cached\n",candidates.size(),words.size(),
+    path == DECODE_LATTICE_LM ? "lattice" : "direct",strategy.c_str(),numThreads,cache.size(),cacheHits.load());
+  printf("%7s %7s %9s %11s  %s\n","top1","top5","clusters","latency us","parameters");
+  for(size_t i = 0; i < order.size() && i < 10; i++){
+    TunerScore& score = scores[order[i]];
+    printf("%6.1f%% %6.1f%% %9.2f %11.1f  %s%s\n",100.0 * score.top1 / n,100.0 * score.topN / n,score.numClusters / n,score.latencyUs / n,
+      candidates[order[i]].ToString().c_str(),order[i] == 0 ? "  (current)" : "");
+  }
+  if(best != 0){
+    printf("current: %.1f%% top1, %.1f%% top5, %.1f us; %s\n",100.0 * scores[0].top1 / n,100.0 * scores[0].topN / n,scores[0].latencyUs / n,
+      candidates[0].ToString().c_str());
+  }
+}
+
+int main(int argc, char* argv[])
+{
+  string outFile = CLUSTER_PARAMS_FILE, search = "random", strategy = DEFAULT_CLUSTER_STRATEGY;
+  int trials = 300, numThreads = 0, path = DECODE_DIRECT;
+  U32 best = 0;
+
+  if(argc < 2){
+    cout << "usage: " << argv[0] << " file" << GAZE_TRACE_EXT << " [outFile=" << CLUSTER_PARAMS_FILE << "] [search=grid|random] [trials=300] [threads=ncores] [cluster="
+         << DEFAULT_CLUSTER_STRATEGY << "] [path=direct|lattice]" << endl;
+    return 1;
+  }
+  if(argc >= 3){
+    outFile = argv[2];
+  }
+  if(argc >= 4){
+    search = argv[3];
+  }
+  if(argc >= 5){
+    trials = atoi(argv[4]);
+  }
+  if(argc >= 6){
+    numThreads = atoi(argv[5]);
+  }
+  if(argc >= 7){
+    strategy = argv[6];
+  }
+  if(argc >= 8){
+    path = strcmp(argv[7],"lattice") ? DECODE_DIRECT : DECODE_LATTICE_LM;
+  }
+
+  ClusterTuner tuner(strategy,path,numThreads);
+  if(!tuner.Open(argv[1])){
+    return 1;
+  }
+  if(search == "grid"){
+    tuner.BuildGrid();
+  }
+  else{
+    tuner.BuildRandom(trials);
+  }
+  tuner.Search();
+
+  for(U32 c = 1; c < tuner.candidates.size(); c++){
+    if(tuner.Better(tuner.scores[c],tuner.scores[best])){
+      best = c;
+    }
+  }
+  tuner.Print(best);
+
+  if(!tuner.candidates[best].Save(outFile)){
+    return 1;
+  }
+  cout << "wrote " << outFile << ": " << tuner.candidates[best].ToString() << endl;
+
+  return 0;
+}
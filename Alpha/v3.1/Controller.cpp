@@ -7,12 +7,14 @@ Controller::Controller()
   string s = "../TestInput/EyeInputs/keyMap.txt";
   lmgr = new LayoutManager(s);
   sb = new SingularityBuilder(0,lmgr->GetWidth(),0,lmgr->GetHeight(),lmgr);
+  sb->LoadParameters(CLUSTER_PARAMS_FILE);
   lb = new LatticeBuilder(lmgr);
   se = new SearchEngine();
   lm = new LanguageModel();
   //lm->BuildModels();
   string vocab = "../vocabModel.txt";
   di = new DirectInference(vocab,lmgr);
+  BuildEditIndex();
 }
 
 //TODO: if we keep DirectInference, change its ctor parameters here
@@ -20,11 +22,59 @@ Controller::Controller(const string& keyFileName)
 {
   lmgr = new LayoutManager(keyFileName);
   sb = new SingularityBuilder(0,lmgr->GetWidth(),0,lmgr->GetHeight(),lmgr);
+  sb->LoadParameters(CLUSTER_PARAMS_FILE);
   lb = new LatticeBuilder(lmgr);
   se = new SearchEngine();
   lm = new LanguageModel();
   string vocab = "../vocabModel.txt";
   di = new DirectInference(vocab,lmgr);
+  BuildEditIndex();
+}
+
+//builds the vocabulary edit index and hands it to the language model. Reports build time and memory, since these are a tradeoff against lookup speed.
+void Controller::BuildEditIndex(void)
+{
+  struct timespec begin, end;
+
+  clock_gettime(CLOCK_MONOTONIC,&begin);
+  di->BuildEditIndex(MAX_EDIT_DIST);
+  clock_gettime(CLOCK_MONOTONIC,&end);
+  cout << "edit index build: " << DiffTimeSpecs(&begin,&end) << " (s)  memory: " << (di->editIndex.MemoryUsage() / 1024) << "kb  postings: " << di->editIndex.NumPostings() << endl;
+  lm->SetEditIndex(&di->editIndex);
+}
+
+//merged stage latencies and counters over every thread that has run a stage
+void Controller::SnapshotMetrics(MetricsSnapshot& snapshot)
+{
+  StageMetrics::Snapshot(snapshot);
+}
+
+void Controller::DumpMetrics(void)
+{
+  int i;
+  MetricsSnapshot snapshot;
+
+  if(!USE_STAGE_METRICS){
+    cout << "stage metrics are compiled out (USE_STAGE_METRICS=0)" << endl;
+    return;
+  }
+
+  SnapshotMetrics(snapshot);
+  cout << "stage metrics (us):" << endl;
+  for(i = 0; i < NUM_METRIC_STAGES; i++){
+    StageSnapshot& stage = snapshot.stages[i];
+    printf("  %-18s n=%-6llu p50=%-10.1f p90=%-10.1f p99=%-10.1f max=%-10.1f mean=%.1f\n",StageMetrics::StageName(i),stage.count,stage.p50Us,stage.p90Us,stage.p99Us,stage.maxUs,stage.meanUs);
+  }
+  for(i = 0; i < NUM_METRIC_COUNTERS; i++){
+    printf("  %-18s %llu\n",StageMetrics::CounterName(i),snapshot.counters[i]);
+  }
+  fflush(stdout);
+}
+
+//writes the trace ring's events to a binary file (layout in TraceRing.cpp)
+bool Controller::DumpTrace(const string& traceFile)
+{
+  return TraceRing::Dump(traceFile);
 }
 
 Controller::~Controller()
@@ -70,6 +120,8 @@ void Controller::PerformanceTest(const string& srcDir)
     cout << "Next test file: " << fname << endl;
     TestWordStream(fname,delim);
   }
+
+  DumpMetrics();
 }
 
 /*
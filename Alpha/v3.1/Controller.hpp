@@ -8,6 +8,155 @@
 #ifndef CONTROLLER_HPP
 #define CONTROLLER_HPP
 
+enum MetricStage{
+  STAGE_CLUSTERING,
+  STAGE_LATTICE_BUILD,
+  STAGE_SEARCH,
+  STAGE_LM_RESCORE,
+  STAGE_DIRECT_INFERENCE,
+  NUM_METRIC_STAGES
+};
+
+enum MetricCounter{
+  COUNTER_CANDIDATES_SCORED,  //vocabulary words given a distance by a DirectInference path or the edit index
+  COUNTER_PATHS_ENUMERATED,   //lattice paths output by the SearchEngine
+  NUM_METRIC_COUNTERS
+};
+
+struct StageSnapshot{
+  U64 count;
+  double p50Us;
+  double p90Us;
+  double p99Us;
+  double maxUs;
+  double meanUs;
+};
+
+struct MetricsSnapshot{
+  StageSnapshot stages[NUM_METRIC_STAGES];
+  U64 counters[NUM_METRIC_COUNTERS];
+};
+
+//one thread's latency histograms and counters. Each thread writes only its own block; see StageMetrics.cpp.
+class StageMetrics{
+  public:
+    std::atomic<U64> buckets[NUM_METRIC_STAGES][METRICS_HISTOGRAM_BUCKETS];
+    std::atomic<U64> counts[NUM_METRIC_STAGES];
+    std::atomic<U64> totalNs[NUM_METRIC_STAGES];
+    std::atomic<U64> maxNs[NUM_METRIC_STAGES];
+    std::atomic<U64> counters[NUM_METRIC_COUNTERS];
+
+    StageMetrics();
+    void Clear(void);
+    void Record(int stage, U64 ns);
+    void Count(int counter, U64 n);
+
+    static StageMetrics& Local(void);
+    static void Snapshot(MetricsSnapshot& snapshot);
+    static void Reset(void);
+    static int BucketOf(U64 ns);
+    static double BucketValue(int bucket);
+    static const char* StageName(int stage);
+    static const char* CounterName(int counter);
+};
+
+//records the time from its construction to the end of its scope into the calling thread's histogram for stage
+class StageTimer{
+  public:
+    int stage;
+    struct timespec begin;
+
+    StageTimer(int stageIndex);
+    ~StageTimer();
+};
+
+#if USE_STAGE_METRICS
+#define METRICS_SCOPE(stage) StageTimer stageTimer_(stage)
+#define METRICS_COUNT(counter,n) StageMetrics::Local().Count(counter,n)
+#else
+#define METRICS_SCOPE(stage)
+#define METRICS_COUNT(counter,n)
+#endif
+
+enum TraceEventId{
+  TRACE_CLUSTER_HIT,      //a: alpha, b: ticks
+  TRACE_CLUSTERS_MERGED,  //a: clusters before merging, b: after
+  TRACE_LATTICE_BUILT,    //a: columns
+  TRACE_SEARCH_DONE,      //a: paths, b: best path score
+  TRACE_LM_DONE,          //a: paths, b: best path score
+  TRACE_DI_DONE,          //a: results, b: best result distance
+  NUM_TRACE_EVENTS
+};
+
+struct TraceEvent{
+  U64 timestampNs;  //CLOCK_MONOTONIC
+  U32 event;
+  U32 a;
+  double b;
+};
+
+//process-wide ring buffer of the most recent TRACE_RING_SIZE trace events. See TraceRing.cpp.
+class TraceRing{
+  public:
+    static void Record(U32 event, U32 a, double b);
+    static U64 Snapshot(vector<TraceEvent>& events);
+    static bool Dump(const string& traceFile);
+    static void Print(void);
+    static const char* EventName(U32 event);
+};
+
+#if USE_TRACE_RING
+#define TRACE_EVENT(event,a,b) TraceRing::Record(event,(U32)(a),(double)(b))
+#else
+#define TRACE_EVENT(event,a,b)
+#endif
+
+/*
+  Wire format of the decoder daemon (see Daemon.cpp). Every message is a DaemonFrameHeader followed by 'length' bytes
+  of payload. Fields are in host byte order, since the socket is local.
+    FRAME_DECODE_REQUEST:  DaemonDecodeRequest, then numPoints x {S16 x, S16 y}
+    FRAME_DECODE_RESPONSE: DaemonDecodeResponse, then numResults x {float score, U8 length, char word[length]}
+    FRAME_PING/FRAME_PONG: no payload
+    FRAME_ERROR:           an error message, not null-terminated
+*/
+#define DAEMON_MAGIC 0x31445754  //"TWD1"
+#define DAEMON_DEFAULT_SOCKET "/tmp/twitch.sock"
+#define DAEMON_MAX_POINTS 65536
+#define DAEMON_MAX_RESULTS 255
+
+enum DaemonFrameType{
+  FRAME_DECODE_REQUEST = 1,
+  FRAME_DECODE_RESPONSE,
+  FRAME_PING,
+  FRAME_PONG,
+  FRAME_ERROR
+};
+
+//decoder paths of DecodeSession::Decode, and of daemon requests
+enum DecodePath{
+  DECODE_DIRECT = 0,  //DirectInference::Process
+  DECODE_LATTICE_LM   //LatticeBuilder -> SearchEngine -> LanguageModel
+};
+
+struct DaemonFrameHeader{
+  U32 magic;
+  U16 type;
+  U16 reserved;
+  U32 length;
+};
+
+struct DaemonDecodeRequest{
+  U16 path;
+  U16 topN;
+  U32 numPoints;
+};
+
+struct DaemonDecodeResponse{
+  U32 decodeUs;  //server-side decode time, so clients can measure the protocol overhead
+  U16 numResults;
+  U16 reserved;
+};
+
 //manages the key-map, dist functions, etc. Anything that needs to be aggregated (called by) other classes
 class LayoutManager{
   public:
@@ -15,6 +164,10 @@ class LayoutManager{
     KeyMap keyMap;
     double minKeyRadius; //minimum radius between the two nearest keys (eg, this distance/2)
     double minKeyDiameter;
+    U64 minKeyRadiusSq;  //a squared distance is under minKeyRadius iff it's under this
+    U64 minSeparationSq;  //likewise for 1.5 * minKeyDiameter, SingularityBuilder::MinSeparation's threshold
+    vector<char> keyChars;    //keyMap's keys and their points, in its order, for scanning
+    vector<Point> keyPoints;
     int layoutWidth;
     int layoutHeight;
 
@@ -33,6 +186,8 @@ class LayoutManager{
     void BuildKeyMapClusters(void);
     void BuildKeyMapCoordinates(const string& keyFileName);
     void SetMinKeyDists(void);
+    U64 SquaredThreshold(double dist);
+    void BuildKeyArrays(void);
     char FindNearestKey(const Point& p);
     void SearchForNeighborKeys(const Point& p, vector<State>& neighbors);  //might be obsolete
     vector<char>* GetNeighborPtr(char index);    
@@ -40,23 +195,64 @@ class LayoutManager{
 
     //TODO: static?
     double DyDx(const Point& p1, const Point& p2);
-    double AvgDyDx(vector<Point>& pts, int start, int npts);
+    double AvgDyDx(const PointSpan& pts, int start, int npts);
     int AbsDiff(int i, int j);
     double DoubleDistance(const Point& p1, const Point& p2);
     int IntDistance(const Point& p1, const Point& p2);
-    double AvgDistance(vector<Point>& pts, int begin, int nPts);
-    double CoVariance(vector<Point>& pts, int begin, int nPts);
-    double CoStdDeviation(vector<Point>& pts, int begin, int nPts);
-		double StDev_X(vector<Point>& pts, int begin, int nPts);
-		double StDev_Y(vector<Point>& pts, int begin, int nPts);
+    U64 SquaredDistance(const Point& p1, const Point& p2);
+    void KeyDistances(const Point& p, double* row);
+    void KeyDistanceTable(const vector<PointMu>& pointMeans, vector<double>& table);
+    double AvgDistance(const PointSpan& pts, int begin, int nPts);
+    double CoVariance(const PointSpan& pts, int begin, int nPts);
+    double CoStdDeviation(const PointSpan& pts, int begin, int nPts);
+		double StDev_X(const PointSpan& pts, int begin, int nPts);
+		double StDev_Y(const PointSpan& pts, int begin, int nPts);
 		double VecLength(double x, double y);
-		double AvgTheta(vector<Point>& inData, int start, int npts);
+		double AvgTheta(const PointSpan& inData, int start, int npts);
 		double DotProduct(const Point& v1, const Point& v2);
     double CosineSimilarity(const Point& v1, const Point& v2);
     //double AvgDyDx(vector<Point>& inData, int start, int npts);
 };
 
 
+enum WindowFeatureMask{
+  FEATURE_STDEV = 1,       //sigmaX, sigmaY and coStdDev
+  FEATURE_COVARIANCE = 2,
+  FEATURE_DISTANCE = 4,
+  FEATURE_DYDX = 8,
+  FEATURE_THETA = 16,
+  FEATURE_ALL = 31
+};
+
+//the LayoutManager window statistics for every sliding window of a trace at once, as structure-of-arrays (one entry
+//per window start). Computed by SIMD kernels, bit-identical to the scalar functions. See FeatureKernels.cpp.
+class WindowFeatures{
+  public:
+    int width;
+    size_t numWindows;
+    vector<double> xs;  //the trace
+    vector<double> ys;
+    vector<double> dxs;  //steps between consecutive samples
+    vector<double> dys;
+    vector<double> stepDistances;
+    vector<double> stepSlopes;
+    vector<double> stepThetas;
+    vector<double> sigmaX;      //spread of x; what LayoutManager::StDev_Y returns
+    vector<double> sigmaY;      //spread of y; what LayoutManager::StDev_X returns
+    vector<double> coStdDev;    //CoStdDeviation
+    vector<double> coVariance;  //CoVariance
+    vector<double> avgDistance; //AvgDistance
+    vector<double> avgDyDx;     //AvgDyDx
+    vector<double> avgTheta;    //AvgTheta
+
+    WindowFeatures();
+
+    void Compute(const PointSpan& pts, int windowWidth, int mask);
+    void ComputeSpread(int mask);
+    void ComputeSteps(int mask);
+    int Test(const PointSpan& pts, int windowWidth, LayoutManager* layoutManager);
+};
+
 class SearchEngine{
   public:
 		SearchEngine();
@@ -77,16 +273,121 @@ class SearchEngine{
 		void PrintResultList(LatticePaths& results);
 };
 
+//symmetric-deletion (SymSpell-style) index over the vocabulary, for sublinear edit-distance lookups. See EditIndex.cpp.
+class EditIndex{
+  public:
+    int maxEdits;                 //deletion depth the index was built with; queries can't search deeper than this
+    vector<string> words;         //vocabulary in WordModel order; a word's index here is its id
+    vector<string> collapsedWords;  //repeat-collapsed form of each word, as compared by the index
+    vector<U64> keyHashes;        //sorted hashes of all deletion-variants...
+    vector<U32> keyWordIds;       //...and the word id each one came from (parallel to keyHashes)
+
+    EditIndex();
+    EditIndex(WordModel& wordModel, int maxEditDist);
+    ~EditIndex();
+
+    void Build(WordModel& wordModel, int maxEditDist);
+    void Clear(void);
+    void Search(const string& query, int maxDist, SearchResults& results);
+    int EditDistance(const string& s1, const string& s2, int bound);
+    string CollapseRepeats(const string& s);
+    void GenerateDeletes(const string& s, int depth, vector<string>& deletes);
+    U64 HashKey(const string& s);
+    int AbsDiff(int i, int j);
+    size_t MemoryUsage(void);
+    U32 NumPostings(void);
+};
+
+//batch (SIMD) versions of the DirectInference string distance functions, scoring every vocabulary word at once. See StringKernels.cpp.
+class StringKernels{
+  public:
+    U32 numWords;
+    U32 numBlocks;                //blocks of KERNEL_LANES words
+    vector<string> words;         //vocabulary in WordModel order; a word's index here is its id
+    vector<string> collapsedWords;  //repeat-collapsed words, for SkipChar and Levenshtein
+    vector<U8> fwdColumns;        //halved words (as StringDist_HammingFwd sees them), block-column-major, zero padded
+    vector<U8> bkwdColumns;       //same, but each word reversed, for StringDist_HammingBkwd
+    vector<U8> skipColumns;       //collapsed words, block-column-major
+    vector<U32> fwdOffsets;       //start of each block in the corresponding column buffer, plus an end offset
+    vector<U32> bkwdOffsets;
+    vector<U32> skipOffsets;
+    vector<U16> collapsedLengths;
+    vector<U16> runEnds;          //per word, the raw index just past each run of repeated chars...
+    vector<U32> runEndOffsets;    //...and where each word's entries start in runEnds
+
+    StringKernels();
+    StringKernels(WordModel& wordModel);
+    ~StringKernels();
+
+    void Build(WordModel& wordModel);
+    void Clear(void);
+    string HalveRepeats(const string& s);
+    string CollapseRepeats(const string& s);
+    void BuildColumns(const vector<string>& strs, bool reversed, vector<U8>& columns, vector<U32>& offsets);
+    void MismatchKernel(const vector<U8>& columns, const vector<U32>& offsets, const string& query, vector<U16>& scores);
+    //each of these fills scores[wordId] for every word
+    void HammingFwd(const string& query, vector<U16>& scores);
+    void HammingBkwd(const string& query, vector<U16>& scores);
+    void HammingFwdBkwd(const string& query, vector<U16>& scores);
+    void HammingSkipChar(const string& query, vector<U16>& scores);
+    void Levenshtein(const string& query, vector<U16>& scores);
+    int ScalarLevenshtein(const string& s1, const string& s2);
+    size_t MemoryUsage(void);
+};
+
+//file header and slot layout of a GramHash table; these are mmap'ed directly, so don't reorder them
+struct GramHashHeader{
+  U32 magic;
+  U32 numKeys;
+  U32 numBuckets;
+  U32 reserved;
+  U64 seed;
+  double minValue;  //value = minValue + step * quantized value
+  double step;
+};
+struct GramHashSlot{
+  U8 fingerprint;
+  U8 value;
+};
+
+//static minimal perfect hash table for sparse n-gram models, with quantized values. Built offline, mmap'ed at runtime. See GramHash.cpp.
+class GramHash{
+  public:
+    const GramHashHeader* header;  //all three point into the mapping; NULL if not loaded
+    const U32* pilots;
+    const GramHashSlot* slots;
+    void* mapping;
+    size_t mappingSize;
+
+    GramHash();
+    ~GramHash();
+
+    bool Build(CharGramModel& model, const string& mphFile);
+    bool FindPilots(const vector<U32>& keys, U64 seed, U32 numBuckets, vector<U32>& pilotsOut, vector<U32>& slotOf);
+    bool Load(const string& mphFile);
+    void Unload(void);
+    bool IsLoaded(void);
+    bool Find(U32 key, double& value);
+    U32 Size(void);
+    size_t MemoryUsage(void);
+    U64 Mix(U64 x);
+    U64 Hash(U32 key, U64 seed);
+    U8 Fingerprint(U64 hash);
+};
+
 class LanguageModel{
   public:
     LanguageModel();
     ~LanguageModel();
-    U8 charMap[SMALL_BUFSIZE];    //data structure for majority voting filter method
+    EditIndex* editIndex;         //vocabulary edit index, owned by DirectInference. NULL disables SearchForEdits
     CharGramModel unigramModel;
     CharGramModel bigramModel;
     CharGramModel trigramModel;
     CharGramModel quadgramModel;
     CharGramModel pentagramModel;
+    GramHash quadgramHash;        //if loaded, these replace quadgramModel and pentagramModel
+    GramHash pentagramHash;
+    double charLambdas[MAX_CHAR_GRAM];  //interpolation weights of the unigram...pentagram models; defaults are the CHAR_*_LAMBDA defines
 
     /*
     TODO
@@ -94,7 +395,6 @@ class LanguageModel{
     WordGramModel wordBigramModel;
     WordGramModel wordTrigramModel;   
 
-    //SearchForEdits(edits, 2); //edit distance processing. second parameter is max edit-distances to search for.
     //ReconditionByWordGrams(list<string> usersPreviousInputs, edits);  
     */
 
@@ -116,12 +416,34 @@ class LanguageModel{
     void TruncateResults(LatticePaths& edits, int depth);
     void BuildModels(void);
     void BuildCharacterNgramModel(const string& ngramFile);
+    bool LoadCharLambdas(const string& lambdaFile);
+    bool SaveCharLambdas(const string& lambdaFile);
+    void CharGramFeatures(const string& s, double features[MAX_CHAR_GRAM]);
+    double CharGramScore(const string& s);
 
     //core functionality
     void ReconditionByCharGrams(LatticePaths& edits);
+    void SetEditIndex(EditIndex* editIndexPtr);
+    double EditPenalty(void);
+    void SearchForEdits(LatticePaths& edits, int maxEdits);
     void Process(LatticePaths& edits);
 };
 
+//SingularityBuilder's event detection parameters: the CLUSTER_* defaults, or tuned ones from a file written by clusterTuner
+struct ClusterParams{
+  int dxThreshold;          //Process: distance between samples three apart under which a trigger advances
+  int innerDxThreshold;     //Process: the distance over which an event ends
+  int triggerThreshold;     //Process, Process3: trigger count that starts an event
+  int highFocus;            //Process3: stDev under which a window advances the trigger twice
+  double stDevHardTrigger;  //Process3: stDev under which a window advances the trigger, and over which an event ends
+  double stDevSoftTrigger;  //Process3: stDev under which an event holds even when the nearest key changes
+
+  ClusterParams();
+  bool Load(const string& fname);
+  bool Save(const string& fname);
+  string ToString(void);
+};
+
 class SingularityBuilder
 {
   public:
@@ -130,12 +452,17 @@ class SingularityBuilder
     int dxThreshold;        //higher threshold means more precision, higher density clusters, but with fewer members, lower likelihood of "elbow" effect
     int innerDxThreshold;   // a softer theshold once we're in the event state
     int triggerThreshold;      //receive this many trigger before throwing. may also need to correlate these as consecutive triggers
+    int highFocus;             //Process3's event parameters; see ClusterParams
+    double stDev_HardTrigger;
+    double stDev_SoftTrigger;
 
     //UI boundary parameters. The important thing is that we recognize when user is targeting the stop/start state region (space bar).
     int activeRegion_Left;
     int activeRegion_Right;
     int activeRegion_Top;
     int activeRegion_Bottom;
+    vector<PointMu> midData;  //Process3's clusters before merging
+    WindowFeatures features;  //Process2 and Process3's per-window statistics
 
     SingularityBuilder();
     SingularityBuilder(int left, int right, int top, int bottom, LayoutManager* layoutManagerPtr);
@@ -143,6 +470,9 @@ class SingularityBuilder
 
     void SetLayoutManager(LayoutManager* layoutManager);
     void SetEventParameters(int dxThresh, int innerDxThresh, int triggerThresh);
+    void SetParameters(const ClusterParams& params);
+    ClusterParams GetParameters(void);
+    bool LoadParameters(const string& fname);
     void SetUiBoundaries(int left, int right, int top, int bottom);
 
     //testing
@@ -152,35 +482,77 @@ class SingularityBuilder
     short int RandomizeVal(short int n, short int error);
 
     //some clustering tasks
-    void SimpleClustering(vector<Point>& inData, vector<PointMu>& outData);
-    void Process4(vector<Point>& inData, vector<PointMu>& outData);
+    void SimpleClustering(const PointSpan& inData, vector<PointMu>& outData);
+    void Process4(const PointSpan& inData, vector<PointMu>& outData);
 
     bool MinSeparation(const PointMu& mu1, const PointMu& mu2);
     void MergeClusters(vector<PointMu>& rawClusters, vector<PointMu>& mergedData);
     bool InBounds(const Point& p);
     void PrintInData(vector<Point>& inData);
     void PrintOutData(vector<PointMu>& outData);
-    void Process(vector<Point>& inData, vector<PointMu>& outData);
-    void Process2(vector<Point>& inData, vector<PointMu>& outData); //a multi-attribute event detector
-    void Process3(vector<Point>& inData, vector<PointMu>& outData);
-    void CalculateMean(int begin, int end, const vector<Point>& coorList, PointMu& pointMean);
+    void Process(const PointSpan& inData, vector<PointMu>& outData);
+    void Process2(const PointSpan& inData, vector<PointMu>& outData); //a multi-attribute event detector
+    void Process3(const PointSpan& inData, vector<PointMu>& outData);
+    void CalculateMean(int begin, int end, const PointSpan& coorList, PointMu& pointMean);
     double CalculateDeltaTheta(double theta1, double theta2, int dt);  //returns angular velocity as a secondary event trigger
 
 
 };
 
+//clusters one word's points into outData, using a session's SingularityBuilder (its parameters and buffers)
+typedef std::function<void(SingularityBuilder* sb, const PointSpan& inData, vector<PointMu>& outData)> ClusterFunction;
+
+struct ClusterStrategy{
+  string name;
+  string description;
+  ClusterFunction cluster;
+};
+
+//one-euro smoothing of a gaze stream, one sample at a time; see GazeFilter.cpp
+class GazeFilter{
+  public:
+    double minCutoff;  //Hz
+    double beta;       //Hz per px/s
+    double dCutoff;    //Hz
+    bool primed;
+    double x, y;       //the filtered position
+    double speed;      //the filtered speed, px/s
+    U64 lastUs;
+
+    GazeFilter(double minCutoffHz = GAZE_FILTER_MIN_CUTOFF, double betaParam = GAZE_FILTER_BETA, double dCutoffHz = GAZE_FILTER_D_CUTOFF);
+
+    void Reset(void);
+    static double Alpha(double cutoffHz, double dt);
+    Point Filter(const Point& p, U64 timeUs);
+    void FilterWord(const PointSpan& points, U64 samplePeriodUs, vector<Point>& out);
+};
+
+//the clustering strategies a DecodeSession can be set to, by name. The built-in ones are registered on first use.
+class ClusterRegistry{
+  public:
+    static bool Register(const string& name, const string& description, ClusterFunction cluster);
+    static const ClusterStrategy* Find(const string& name);  //NULL if there's none; strategies are never removed
+    static vector<string> Names(void);
+
+    static map<string,ClusterStrategy>& Strategies(void);
+    static std::mutex& Mutex(void);
+};
+
 //THE DATA MODEL OF THIS CLASS IS PURELY A PROTOTYPE
 class DirectInference{  //class which attempts to map cluster input (as a vector) to the nearest word (also as a vector)
   public:
 		//set was only used here for prototyping reasons, as a "bag of words". A much better data structure could be devised. 
 		WordModel wordModel;
 		LayoutManager* layoutManager;
+    EditIndex editIndex;  //deletion-neighborhood index over wordModel, for EditDistInference
+    StringKernels stringKernels;  //batch string distance kernels over wordModel, for StringDistInference
 
 		DirectInference();
 		DirectInference(const string& vocabFile, LayoutManager* layoutManagerPtr);
 		~DirectInference();
 
 		void BuildWordModel(const string& vocabFile);
+    void BuildEditIndex(int maxEdits);
     void MeansToString(vector<PointMu>& pointMeans, string& output);
     void MeansToEditList(vector<PointMu>& pointMeans, vector<string>& stringList);
     void Strip(char buf[], char toChar);
@@ -188,16 +560,19 @@ class DirectInference{  //class which attempts to map cluster input (as a vector
     void RevPointMeans(const vector<PointMu>& pointMeans, vector<PointMu>& revPointMeans); 
     string ReverseString(const string& str);
     void SetLayoutManager(LayoutManager* layoutManagerPtr);
-		double VectorDistance(vector<PointMu>& pointMeans, WordModelIt it);
+		double VectorDistance(vector<PointMu>& pointMeans, const vector<double>& table, WordModelIt it);
     double VectorDistance(vector<PointMu>& pointMeans, vector<PointMu>& revPointMeans, WordModelIt it);
     //double SumDistMetric(vector<PointMu>& pointMeans, WordModelIt it);
 		void Process(vector<PointMu>& pointMeans, SearchResults& results);
     void MergeInference(vector<PointMu>& pointMeans, SearchResults& results);
     //string distance approximation
     void StringDistInference(vector<PointMu>& pointMeans, SearchResults& results);
+    //string distance approximation via the edit index; sublinear in the vocabulary size
+    void EditDistInference(vector<PointMu>& pointMeans, SearchResults& results);
     //geometric distance approximation (far more brute force than previous)
 		void VectorDistInference(vector<PointMu>& pointMeans, SearchResults& results);
 		double SumDistMetric_Aligned(vector<PointMu>& pointMeans, const string& candidate);
+    double SumDistMetric_Aligned(vector<PointMu>& pointMeans, const vector<double>& table, const string& candidate);
     double SumDistMetric_Aligned_FwdBkwd(vector<PointMu>& pointMeans, vector<PointMu>& revPointMeans, const string& candidate);
 		double SumDistMetric_Unaligned(vector<PointMu>& pointMeans, const string& candidate);
     double SumDistMetric_Unaligned_FwdBkwd(vector<PointMu>& pointMeans, const string& candidate);
@@ -210,6 +585,8 @@ class DirectInference{  //class which attempts to map cluster input (as a vector
 		double StringDist_HammingFwdBkwd(const string& s1, const string& s2);
 		double StringDist_HammingBkwd(const string& s1, const string& s2);
 		double StringDist_HammingFwd(const string& s1, const string& s2);
+    double StringDist_Levenshtein(const string& s1, const string& s2);
+    int TestStringKernels(const string& query);
 };
 
 class LatticeBuilder{
@@ -234,6 +611,490 @@ class LatticeBuilder{
     bool MaxArcLlikelihood(const Arc& left, const Arc& right);
 };
 
+//one vocabulary word's progress through DirectInference::SumDistMetric_Aligned, as the clusters arrive
+struct PrefixCandidate{
+  U32 wordId;      //index into StringKernels::words, which are in WordModel order
+  U32 i;           //the next cluster to align
+  U32 j;           //the next char of the word to align
+  U32 rpts;        //repeated chars skipped
+  double sumDist;  //only ever grows
+};
+
+//"so far" decoding along the direct path: scores the vocabulary against a word's clusters one cluster at a time, as they're found. See PrefixDecoder.cpp.
+class PrefixDecoder{
+  public:
+    DirectInference* di;
+    LayoutManager* layoutManager;
+    const vector<string>* words;
+    vector<PrefixCandidate> live;  //the words that can still be results, in vocabulary order
+    vector<PointMu> means;         //the clusters pushed so far
+    vector<double> keyDists;       //their LayoutManager::KeyDistances rows
+    U64 numUpdates;                //candidates advanced since the last Reset, over all the pushes
+
+    PrefixDecoder(DirectInference* diPtr);
+    ~PrefixDecoder();
+
+    void Reset(void);
+    void Push(const PointMu& mu);
+    void Advance(void);
+    bool Resync(const vector<PointMu>& finalMeans);
+    void Completions(size_t k, vector<SearchResult>& completions);
+    void Finish(SearchResults& results);
+    void Align(PrefixCandidate& c, bool final);
+};
+
+//immutable models shared by every DecodeSession: key layout, vocabulary (with its edit index and kernels) and char-grams. See Session.cpp.
+class DecoderModels{
+  public:
+    LayoutManager* layoutManager;
+    LanguageModel* lm;
+    DirectInference* di;
+    ClusterParams clusterParams;  //every session's SingularityBuilder starts with these
+
+    DecoderModels(const string& keyMapFile, const string& vocabFile);
+    ~DecoderModels();
+};
+
+class DecodeSession;
+typedef std::function<void(DecodeSession* session, SearchResults& results)> DecodeCallback;  //results are valid until the session's next decode
+
+//one queued decode request of a session
+struct DecodeJob{
+  vector<Point> points;
+  int path;  //a DecodePath
+  DecodeCallback done;  //called on the worker thread with the results
+};
+
+//per-user decoding context over shared DecoderModels. Cheap to create; a session must only decode on one thread at a time.
+class DecodeSession{
+  public:
+    U32 id;
+    DecoderModels* models;
+    SingularityBuilder sb;
+    LatticeBuilder lb;
+    SearchEngine se;
+    vector<Point> sensorData;   //per-request buffers, kept to reuse their capacity
+    vector<PointMu> pointMeans;
+    Lattice lattice;
+    Arena arena;                //the transient state of the current word, reset when the next one starts
+    SearchResults results;      //the last word's, in the arena
+    const ClusterStrategy* clusterer;  //from the ClusterRegistry, DEFAULT_CLUSTER_STRATEGY unless set
+    GazeFilter filter;
+    bool filtering;             //smooth each word's points with filter before clustering them; GAZE_FILTER_DEFAULT
+    vector<Point> filtered;
+    double lastDecodeUs;
+    double lastClusterUs;       //the clustering part of lastDecodeUs
+    U64 numDecodes;
+    //scheduling state, guarded by the owning SessionPool's mutex
+    deque<DecodeJob> pending;
+    bool scheduled;  //queued or running on a worker
+
+    DecodeSession(DecoderModels* modelsPtr, U32 sessionId);
+    ~DecodeSession();
+
+    bool SetClusterStrategy(const string& name);
+    void Decode(const PointSpan& points, int path);
+    void DecodeClusters(int path);
+    void DecodeSensorData(int path);
+};
+
+//runs the decode requests of many sessions on a fixed set of worker threads; each session's requests run in order, one at a time
+class SessionPool{
+  public:
+    DecoderModels* models;
+    vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable workReady;    //a session was queued, or the pool is stopping
+    std::condition_variable sessionIdle;  //a session ran out of pending requests
+    deque<DecodeSession*> readySessions;  //sessions with pending requests, not running on a worker
+    set<DecodeSession*> sessions;
+    U32 nextSessionId;
+    U32 busySessions;  //sessions with scheduled == true
+    bool stopping;
+
+    SessionPool(DecoderModels* modelsPtr, int numThreads);
+    ~SessionPool();
+
+    DecodeSession* OpenSession(void);
+    void CloseSession(DecodeSession* session);
+    void Submit(DecodeSession* session, const PointSpan& points, int path, DecodeCallback done);
+    void WaitIdle(DecodeSession* session);
+    void Drain(void);
+    int NumThreads(void);
+    void Worker(void);
+};
+
+//blocking FIFO of at most 'capacity' items, linking the stages of a DecodePipeline. A template, so it's defined here.
+template<typename T>
+class BoundedQueue{
+  public:
+    deque<T> items;
+    size_t capacity;
+    bool closed;
+    std::mutex mutex;
+    std::condition_variable notFull;
+    std::condition_variable notEmpty;
+
+    BoundedQueue(size_t maxItems)
+    {
+      capacity = std::max(maxItems,(size_t)1);
+      closed = false;
+    }
+
+    //blocks while full. Returns false, dropping item, if the queue has been closed.
+    bool Push(const T& item)
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      while(items.size() >= capacity && !closed){
+        notFull.wait(lock);
+      }
+      if(closed){
+        return false;
+      }
+      items.push_back(item);
+      notEmpty.notify_one();
+      return true;
+    }
+
+    //blocks while empty. Returns false once the queue is closed and drained.
+    bool Pop(T& item)
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      while(items.empty() && !closed){
+        notEmpty.wait(lock);
+      }
+      if(items.empty()){
+        return false;
+      }
+      item = items.front();
+      items.pop_front();
+      notFull.notify_one();
+      return true;
+    }
+
+    //no more pushes; items already queued can still be popped
+    void Close(void)
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      closed = true;
+      notFull.notify_all();
+      notEmpty.notify_all();
+    }
+};
+
+enum PipelineStage{
+  PIPELINE_CLUSTER = 0,  //SingularityBuilder::Process3
+  PIPELINE_CANDIDATES,   //lattice build and search, or DirectInference::Process
+  PIPELINE_RESCORE,      //LanguageModel::Process; a pass-through on the direct path
+  NUM_PIPELINE_STAGES
+};
+
+//one word in flight through a DecodePipeline
+struct PipelineWord{
+  U64 seq;  //submission order, from 0
+  vector<Point> points;
+  vector<PointMu> pointMeans;
+  SearchResults results;
+  double stageUs[NUM_PIPELINE_STAGES];
+};
+
+//a session's decode stages on their own threads, linked by bounded queues, so consecutive words overlap. See Pipeline.cpp.
+class DecodePipeline{
+  public:
+    DecoderModels* models;
+    int path;  //a DecodePath
+    SingularityBuilder sb;  //each stage's component is only touched by that stage's thread
+    GazeFilter filter;      //the cluster stage's, used if filtering
+    bool filtering;
+    LatticeBuilder lb;
+    SearchEngine se;
+    BoundedQueue<PipelineWord*> clusterQueue;    //submitted words, to be clustered
+    BoundedQueue<PipelineWord*> candidateQueue;  //clustered words
+    BoundedQueue<PipelineWord*> rescoreQueue;    //words with candidates
+    BoundedQueue<PipelineWord*> outputQueue;     //finished words
+    vector<std::thread> stages;
+    U64 nextSeq;
+
+    DecodePipeline(DecoderModels* modelsPtr, int decodePath, int queueDepth);
+    ~DecodePipeline();
+
+    bool Submit(const vector<Point>& points);
+    void Close(void);
+    bool Next(PipelineWord*& word);
+    void ClusterStage(void);
+    void CandidateStage(void);
+    void RescoreStage(void);
+};
+
+//a word cut from a continuous stream: its samples, including the dwells that bound it, and the times of its first and last
+typedef std::function<void(const PointSpan& points, U64 startUs, U64 endUs)> SegmentCallback;
+
+//cuts one continuous sensor stream into words, at dwells off the keys' active region. See Segmenter.cpp.
+class WordSegmenter{
+  public:
+    SingularityBuilder* sb;  //its InBounds is the keys' region
+    U64 dwellUs;
+    U64 minWordUs;
+    SegmentCallback done;   //called on the pushing thread, as each word is cut
+    vector<Point> samples;  //since the last cut, or the last dwellUs of them between words
+    vector<U64> timesUs;
+    bool inWord;     //the gaze entered the keys' region since the last cut
+    U64 wordStartUs; //first in-region sample of the word
+    U64 wordEndUs;   //last in-region sample of the word
+    size_t outStart; //index in samples of the current run off the keys, or samples.size() if the gaze is on them
+    U64 numWords;
+
+    WordSegmenter(SingularityBuilder* sbPtr, SegmentCallback callback, U64 dwellMs = SEGMENT_DWELL_MS, U64 minWordMs = SEGMENT_MIN_WORD_MS);
+
+    void Push(const Point& p, U64 timeUs);
+    void Flush(void);
+    void Reset(void);
+    void Cut(size_t end);
+    void TrimLead(U64 nowUs);
+};
+
+//a sensor sample, stamped on CLOCK_MONOTONIC when it was captured
+struct SensorSample{
+  Point point;
+  U64 timeUs;
+};
+
+//called on a pool worker with each word's results. startUs and endUs are the capture times of the word's first and last
+//samples; cutUs is when the segmenter cut it, on the NowUs clock, which the replaying sources' stamps run ahead of.
+typedef std::function<void(SearchResults& results, U64 startUs, U64 endUs, U64 cutUs)> StreamCallback;
+
+//the engine's live input: sensor sources push samples into its queue, and its own thread segments them into words and
+//decodes each word on a SessionPool while more samples arrive. See SensorSource.cpp.
+class GazeStream{
+  public:
+    SessionPool* pool;
+    DecodeSession* session;
+    int path;  //a DecodePath
+    StreamCallback done;
+    SingularityBuilder sb;  //only its InBounds, for the segmenter
+    GazeFilter filter;      //smooths the samples as they arrive, on their own timestamps, if filtering
+    bool filtering;         //GAZE_FILTER_DEFAULT; the stream's session doesn't filter again
+    WordSegmenter segmenter;
+    BoundedQueue<SensorSample> queue;
+    std::thread consumer;
+    U64 numSamples;  //popped from the queue
+
+    GazeStream(SessionPool* poolPtr, int decodePath, StreamCallback callback);
+    ~GazeStream();
+
+    void Close(void);
+    void Consume(void);
+};
+
+//knobs of the synthetic gaze model; times in milliseconds, distances in pixels
+struct TraceGenParams{
+  double sampleHz;
+  double dwellMs;            //mean fixation time per key
+  double dwellStdMs;
+  double edgeDwellMs;        //fixation on the space bar before and after the word
+  double saccadePxPerSec;    //eye travel speed between keys
+  double fixationErrorPx;    //std dev of where a fixation lands relative to the key center, fixed per fixation
+  double jitterPx;           //std dev of per-sample tracker noise within a fixation
+  double overshootProb;      //chance a saccade lands past its key first, then corrects
+  double overshootFrac;      //how far past, as a fraction of the saccade's length
+  double insertionProb;      //chance of a stray glance at a neighbor key before each key
+  double insertionDwellMs;
+
+  TraceGenParams();
+  bool Set(const string& name, double value);
+};
+
+//turns words into synthetic gaze traces over a key layout, for load testing. See TraceGenerator.cpp.
+class TraceGenerator{
+  public:
+    LayoutManager* layoutManager;
+    TraceGenParams params;
+    std::mt19937 rng;
+
+    TraceGenerator(LayoutManager* layoutManagerPtr, const TraceGenParams& genParams, U32 seed);
+
+    bool OnLayout(const string& word);
+    bool Generate(const string& word, vector<Point>& points);
+    void Saccade(const Point& from, const Point& to, vector<Point>& points);
+    void Fixate(const Point& key, double ms, vector<Point>& points);
+    int Samples(double ms);
+    double Gaussian(double mean, double stdDev);
+    Point Clamp(double x, double y);
+};
+
+//gaze trace files: recorded or generated sessions of timestamped samples, mapped for replay. See GazeTrace.cpp.
+#define GAZE_TRACE_MAGIC 0x52545a47  //"GZTR"
+#define GAZE_TRACE_VERSION 1
+#define GAZE_TRACE_LABEL_SIZE 32  //including the null; longer labels are truncated
+#define GAZE_TRACE_EXT ".gzt"
+
+enum GazeBlockType{
+  GAZE_BLOCK_SESSION = 1,  //starts a session; the words after it belong to it
+  GAZE_BLOCK_WORD          //one word's samples
+};
+
+struct GazeTraceHeader{
+  U32 magic;
+  U16 version;
+  U16 blockHeaderSize;  //sizeof(GazeBlockHeader), so a reader can detect a layout change
+  U32 numSessions;
+  U32 numWords;
+  U64 numSamples;
+};
+
+struct GazeBlockHeader{
+  U32 type;        //a GazeBlockType
+  U32 sessionId;
+  U32 numSamples;  //words only: followed by numSamples Points, then numSamples U32 sample-to-sample deltas in us
+  U32 reserved;
+  U64 startUs;     //the session's start, or the word's first sample, in us on the file's clock
+  char label[GAZE_TRACE_LABEL_SIZE];  //the session's name, or the word intended; empty if unknown
+};
+
+//one word of a mapped GazeTraceFile. Points into the mapping, so it's only valid while the file is open.
+struct GazeWord{
+  U32 sessionId;
+  U64 startUs;
+  const char* label;
+  PointSpan points;
+  const U32* deltaUs;  //deltaUs[0] is 0; deltaUs[i] is sample i's time after sample i-1
+};
+
+class GazeTraceWriter{
+  public:
+    FILE* file;
+    GazeTraceHeader header;
+    U32 sessionId;
+    bool inSession;
+    vector<U32> deltas;
+
+    GazeTraceWriter();
+    ~GazeTraceWriter();
+
+    bool Open(const string& fname);
+    bool BeginSession(const string& name, U64 startUs);
+    bool AppendWord(const string& label, const PointSpan& points, const U64* timesUs);
+    bool Close(void);
+    void SetLabel(GazeBlockHeader& block, const string& label);
+};
+
+//read-only mapping of a gaze trace file, indexed by word. Nothing is copied or parsed per sample.
+class GazeTraceFile{
+  public:
+    int fd;
+    const char* base;
+    size_t length;
+    GazeTraceHeader header;
+    vector<const char*> sessionNames;  //by session id
+    vector<GazeWord> words;            //in file order
+
+    GazeTraceFile();
+    ~GazeTraceFile();
+
+    bool Open(const string& fname);
+    void Close(void);
+};
+
+//a thread capturing samples from one input device or file into a GazeStream's queue. Subclasses implement Open and
+//Capture, and their destructors must Stop the thread, before the members Capture uses are destroyed.
+class SensorSource{
+  public:
+    BoundedQueue<SensorSample>* queue;
+    std::thread thread;
+    std::atomic<bool> stopping;
+    U64 numSamples;  //pushed to the queue
+
+    SensorSource();
+    virtual ~SensorSource();
+
+    bool Start(BoundedQueue<SensorSample>* ingestQueue);
+    void Stop(void);
+    void Join(void);
+    bool Emit(const Point& p, U64 timeUs);
+    static U64 NowUs(void);
+    static void SleepUntil(U64 timeUs);
+    bool WaitReadable(int fd);
+
+    virtual bool Open(void) = 0;  //on the calling thread, so errors are reported before Start returns
+    virtual void Capture(void) = 0;  //on the source's thread, until the input ends or stopping is set
+    virtual void Close(void) {}
+};
+
+//"x y" lines from a file descriptor, eg stdin piped from xLibListener ("x 12 y 34") or mouseListener.py ("12 34")
+class StdinSensorSource : public SensorSource{
+  public:
+    int fd;
+    string pending;  //a partial line
+
+    StdinSensorSource(int inputFd = 0);  //stdin
+    ~StdinSensorSource();
+
+    bool Open(void);
+    void Capture(void);
+    bool ParseLine(const string& line, Point& p);
+};
+
+//the samples of a gaze trace file, at speed times their recorded pace (0 for as fast as possible)
+class GazeTraceSensorSource : public SensorSource{
+  public:
+    string fname;
+    double speed;
+    GazeTraceFile trace;
+
+    GazeTraceSensorSource(const string& traceFile, double replaySpeed);
+    ~GazeTraceSensorSource();
+
+    bool Open(void);
+    void Capture(void);
+};
+
+//synthetic traces of a list of words, back to back, at speed times the generator's sample rate (0 for as fast as possible)
+class SyntheticSensorSource : public SensorSource{
+  public:
+    TraceGenerator generator;
+    vector<string> words;
+    double speed;
+
+    SyntheticSensorSource(LayoutManager* layoutManager, const TraceGenParams& params, U32 seed, const vector<string>& wordList, double replaySpeed);
+    ~SyntheticSensorSource();
+
+    bool Open(void);
+    void Capture(void);
+};
+
+//a Linux input device (/dev/input/eventN): relative motion (a mouse) moves a point around a width x height screen,
+//absolute axes (a tablet, touchscreen or tracker) are scaled onto it. Needs read access to the device.
+class EvdevSensorSource : public SensorSource{
+  public:
+    string device;
+    int fd;
+    int width;
+    int height;
+    int absMin[2];  //device range of ABS_X and ABS_Y, if it has them
+    int absMax[2];
+    bool stampOnRead;  //the device won't stamp events on CLOCK_MONOTONIC, so they're stamped as they're read
+
+    EvdevSensorSource(const string& devicePath, int screenWidth, int screenHeight);
+    ~EvdevSensorSource();
+
+    bool Open(void);
+    void Capture(void);
+    void Close(void);
+};
+
+//pointer motion over the X root window, as in listenerTesting/xLibListener.c. Only built with SENSOR_X11 (see makefile).
+class X11SensorSource : public SensorSource{
+  public:
+    void* display;  //a Display*, kept opaque so Xlib.h stays out of this header
+
+    X11SensorSource();
+    ~X11SensorSource();
+
+    bool Open(void);
+    void Capture(void);
+    void Close(void);
+};
+
 
 class Controller{
   private:
@@ -255,6 +1116,11 @@ class Controller{
     Controller(const string& keyFileName);
     ~Controller();
 
+    void BuildEditIndex(void);
+    void SnapshotMetrics(MetricsSnapshot& snapshot);
+    void DumpMetrics(void);
+    bool DumpTrace(const string& traceFile);
+
     //testing
     void SmokeTest(void);
     void PerformanceTest(const string& srcDir);
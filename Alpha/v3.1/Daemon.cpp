@@ -0,0 +1,374 @@
+#include "Controller.hpp"
+#include <cerrno>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+
+/*
+  Decoder daemon. Loads the layout, vocabulary and language models once, then serves decode requests over a Unix domain
+  socket, so a UI process and any number of test clients share one warm engine instead of each rebuilding the models.
+  The framing is in Controller.hpp; DaemonClient.cpp is a reference client.
+
+  Usage: twitchd [socketPath=/tmp/twitch.sock] [keyMapFile=../TestInput/EyeInputs/Test1/keyMap.txt] [threads=#cores]
+  SIGINT/SIGTERM shut it down and remove the socket.
+
+  Connections are multiplexed with poll() on the serving thread, which reads the frames. Each connection is a
+  DecodeSession, and its decode requests run on a SessionPool (see Session.cpp), whose workers send the responses; a
+  connection's requests are answered in order. A client is expected to write each frame in full; a client that stalls
+  mid-frame stalls the reading of the others until DAEMON_IO_TIMEOUT_MS, after which it's dropped. Likewise a client
+  that keeps sending requests without reading the responses is dropped once it has DAEMON_MAX_PENDING of them queued,
+  rather than queueing work for it without bound.
+*/
+
+#define DAEMON_BACKLOG 64
+#define DAEMON_IO_TIMEOUT_MS 1000
+#define DAEMON_MAX_PENDING 64  //decode requests a connection can have queued or running
+
+static volatile sig_atomic_t stopRequested = 0;
+
+static void OnStopSignal(int)
+{
+  stopRequested = 1;
+}
+
+//a client connection; the serving thread reads it, and pool workers (as well as the serving thread) write it
+struct DaemonConnection{
+  int fd;
+  DecodeSession* session;
+  std::mutex writeMutex;  //one frame at a time
+  std::atomic<U32> pending;  //decode requests submitted and not yet answered
+};
+
+class DecoderDaemon{
+  public:
+    DecoderModels* models;
+    SessionPool* pool;
+    string socketPath;
+    int listenFd;
+    vector<struct pollfd> fds;  //[0] is the listening socket
+    vector<DaemonConnection*> connections;  //connections[i] is fds[i + 1]
+    std::atomic<U64> requestsServed;
+
+    DecoderDaemon(const string& keyMapFile, const string& socketFile, int numThreads);
+    ~DecoderDaemon();
+
+    bool Listen(void);
+    void Serve(void);
+    void CloseConnection(int index);
+    bool HandleFrame(DaemonConnection* conn);
+    void BuildResponse(SearchResults& results, U32 topN, double decodeUs, vector<char>& response);
+    bool ReadFull(int fd, void* buf, size_t n);
+    bool WriteFull(int fd, const void* buf, size_t n);
+    bool SendFrame(DaemonConnection* conn, U16 type, const void* payload, U32 length);
+};
+
+DecoderDaemon::DecoderDaemon(const string& keyMapFile, const string& socketFile, int numThreads)
+{
+  socketPath = socketFile;
+  listenFd = -1;
+  requestsServed = 0;
+
+  models = new DecoderModels(keyMapFile,"../vocabModel.txt");
+  pool = new SessionPool(models,numThreads);
+}
+
+DecoderDaemon::~DecoderDaemon()
+{
+  while(!connections.empty()){
+    CloseConnection(connections.size() - 1);
+  }
+  if(listenFd >= 0){
+    close(listenFd);
+    unlink(socketPath.c_str());
+  }
+
+  delete pool;
+  delete models;
+}
+
+bool DecoderDaemon::Listen(void)
+{
+  struct sockaddr_un addr;
+  struct pollfd pfd;
+
+  if(socketPath.size() >= sizeof(addr.sun_path)){
+    cout << "ERROR socket path too long: " << socketPath << endl;
+    return false;
+  }
+
+  listenFd = socket(AF_UNIX,SOCK_STREAM,0);
+  if(listenFd < 0){
+    cout << "ERROR could not create socket" << endl;
+    return false;
+  }
+
+  memset(&addr,0,sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strncpy(addr.sun_path,socketPath.c_str(),sizeof(addr.sun_path) - 1);
+  unlink(socketPath.c_str());  //a stale socket from a previous run
+  if(bind(listenFd,(struct sockaddr*)&addr,sizeof(addr)) != 0 || listen(listenFd,DAEMON_BACKLOG) != 0){
+    cout << "ERROR could not listen on " << socketPath << endl;
+    close(listenFd);
+    listenFd = -1;
+    return false;
+  }
+
+  pfd.fd = listenFd;
+  pfd.events = POLLIN;
+  pfd.revents = 0;
+  fds.push_back(pfd);
+  cout << "listening on " << socketPath << " with " << pool->NumThreads() << " decoder threads" << endl;
+
+  return true;
+}
+
+//reads exactly n bytes, waiting at most DAEMON_IO_TIMEOUT_MS for each chunk. False on eof, error or timeout.
+bool DecoderDaemon::ReadFull(int fd, void* buf, size_t n)
+{
+  ssize_t got;
+  struct pollfd pfd;
+
+  while(n > 0){
+    got = recv(fd,buf,n,MSG_DONTWAIT);
+    if(got > 0){
+      buf = (char*)buf + got;
+      n -= got;
+    }
+    else if(got < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)){
+      pfd.fd = fd;
+      pfd.events = POLLIN;
+      if(poll(&pfd,1,DAEMON_IO_TIMEOUT_MS) <= 0){
+        return false;
+      }
+    }
+    else if(got < 0 && errno == EINTR){
+      continue;
+    }
+    else{
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool DecoderDaemon::WriteFull(int fd, const void* buf, size_t n)
+{
+  ssize_t sent;
+
+  while(n > 0){
+    sent = send(fd,buf,n,MSG_NOSIGNAL);
+    if(sent < 0 && errno == EINTR){
+      continue;
+    }
+    if(sent <= 0){
+      return false;
+    }
+    buf = (const char*)buf + sent;
+    n -= sent;
+  }
+
+  return true;
+}
+
+//header and payload go out in one write, so a small response is one syscall
+bool DecoderDaemon::SendFrame(DaemonConnection* conn, U16 type, const void* payload, U32 length)
+{
+  vector<char> frame(sizeof(DaemonFrameHeader) + length);
+  DaemonFrameHeader* header = (DaemonFrameHeader*)&frame[0];
+
+  header->magic = DAEMON_MAGIC;
+  header->type = type;
+  header->reserved = 0;
+  header->length = length;
+  if(length > 0){
+    memcpy(&frame[sizeof(DaemonFrameHeader)],payload,length);
+  }
+
+  std::lock_guard<std::mutex> lock(conn->writeMutex);
+  return WriteFull(conn->fd,&frame[0],frame.size());
+}
+
+//writes a FRAME_DECODE_RESPONSE payload (DaemonDecodeResponse and the top results) into response
+void DecoderDaemon::BuildResponse(SearchResults& results, U32 topN, double decodeUs, vector<char>& response)
+{
+  U32 i;
+  U8 len;
+  float score;
+  DaemonDecodeResponse summary;
+
+  topN = std::min(topN,(U32)DAEMON_MAX_RESULTS);
+  memset(&summary,0,sizeof(summary));
+  summary.decodeUs = (U32)decodeUs;
+  summary.numResults = std::min(topN,(U32)results.size());
+
+  response.resize(sizeof(summary));
+  memcpy(&response[0],&summary,sizeof(summary));
+  i = 0;
+  for(SearchResultIt it = results.begin(); it != results.end() && i < summary.numResults; ++it, i++){
+    score = (float)it->second;
+    len = (U8)std::min(it->first.size(),(size_t)255);
+    response.insert(response.end(),(char*)&score,(char*)&score + sizeof(score));
+    response.push_back((char)len);
+    response.insert(response.end(),it->first.begin(),it->first.begin() + len);
+  }
+}
+
+/*
+  Reads one frame from conn and answers it: pings directly, decode requests by submitting them to the pool, whose
+  worker sends the response. Returns false if the connection should be closed.
+*/
+bool DecoderDaemon::HandleFrame(DaemonConnection* conn)
+{
+  U32 i, topN;
+  DaemonFrameHeader header;
+  DaemonDecodeRequest request;
+  vector<char> payload;
+  vector<Point> points;
+  string error;
+  const short int* coords;
+
+  if(!ReadFull(conn->fd,&header,sizeof(header))){
+    return false;  //usually just the client hanging up
+  }
+  if(header.magic != DAEMON_MAGIC || header.length > sizeof(DaemonDecodeRequest) + DAEMON_MAX_POINTS * 2 * sizeof(short int)){
+    error = "bad frame header";
+    SendFrame(conn,FRAME_ERROR,error.c_str(),error.size());
+    return false;
+  }
+  payload.resize(header.length);
+  if(header.length > 0 && !ReadFull(conn->fd,&payload[0],header.length)){
+    return false;
+  }
+
+  switch(header.type){
+    case FRAME_PING:
+        return SendFrame(conn,FRAME_PONG,NULL,0);
+    case FRAME_DECODE_REQUEST:
+        if(header.length < sizeof(request)){
+          error = "short decode request";
+          break;
+        }
+        memcpy(&request,&payload[0],sizeof(request));
+        if(request.path != DECODE_DIRECT && request.path != DECODE_LATTICE_LM){
+          error = "unknown decode path";
+          break;
+        }
+        if(request.numPoints > DAEMON_MAX_POINTS || header.length != sizeof(request) + request.numPoints * 2 * sizeof(short int)){
+          error = "decode request length does not match numPoints";
+          break;
+        }
+        coords = (const short int*)&payload[sizeof(request)];
+        points.reserve(request.numPoints);
+        for(i = 0; i < request.numPoints; i++){
+          points.push_back(Point(coords[2*i],coords[2*i+1]));
+        }
+        if(conn->pending >= DAEMON_MAX_PENDING){
+          error = "too many pending decode requests";
+          break;
+        }
+        topN = request.topN;
+        conn->pending++;
+        pool->Submit(conn->session,points,request.path,[this,conn,topN](DecodeSession* session, SearchResults& results){
+          vector<char> response;
+          BuildResponse(results,topN,session->lastDecodeUs,response);
+          SendFrame(conn,FRAME_DECODE_RESPONSE,&response[0],response.size());
+          requestsServed++;
+          conn->pending--;
+        });
+        return true;
+    default:
+        error = "unknown frame type";
+      break;
+  }
+
+  SendFrame(conn,FRAME_ERROR,error.c_str(),error.size());
+  return false;
+}
+
+//waits out the connection's queued requests, since their responses go to its fd, then closes it
+void DecoderDaemon::CloseConnection(int index)
+{
+  DaemonConnection* conn = connections[index];
+
+  pool->CloseSession(conn->session);
+  close(conn->fd);
+  delete conn;
+  connections.erase(connections.begin() + index);
+  fds.erase(fds.begin() + index + 1);
+}
+
+void DecoderDaemon::Serve(void)
+{
+  int i, clientFd;
+  struct pollfd pfd;
+  DaemonConnection* conn;
+
+  while(!stopRequested){
+    if(poll(&fds[0],fds.size(),-1) < 0){
+      if(errno == EINTR){
+        continue;
+      }
+      cout << "ERROR poll failed in DecoderDaemon::Serve" << endl;
+      break;
+    }
+
+    //serve existing clients first, then accept, so the fds vector isn't grown while it's being scanned
+    for(i = fds.size() - 1; i >= 1; i--){
+      if(fds[i].revents != 0 && ((fds[i].revents & (POLLERR | POLLNVAL)) || !HandleFrame(connections[i - 1]))){
+        CloseConnection(i - 1);
+      }
+    }
+    if(fds[0].revents & POLLIN){
+      clientFd = accept(listenFd,NULL,NULL);
+      if(clientFd >= 0){
+        conn = new DaemonConnection();
+        conn->fd = clientFd;
+        conn->session = pool->OpenSession();
+        conn->pending = 0;
+        connections.push_back(conn);
+        pfd.fd = clientFd;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        fds.push_back(pfd);
+      }
+    }
+  }
+
+  pool->Drain();
+  cout << "shutting down after " << requestsServed.load() << " requests" << endl;
+}
+
+int main(int argc, char* argv[])
+{
+  string socketPath = DAEMON_DEFAULT_SOCKET;
+  string keyMapFile = "../TestInput/EyeInputs/Test1/keyMap.txt";
+  int numThreads = 0;
+  struct sigaction action;
+
+  if(argc >= 2){
+    socketPath = argv[1];
+  }
+  if(argc >= 3){
+    keyMapFile = argv[2];
+  }
+  if(argc >= 4){
+    numThreads = atoi(argv[3]);
+  }
+
+  memset(&action,0,sizeof(action));
+  action.sa_handler = OnStopSignal;  //no SA_RESTART, so poll() returns EINTR
+  sigaction(SIGINT,&action,NULL);
+  sigaction(SIGTERM,&action,NULL);
+  signal(SIGPIPE,SIG_IGN);
+
+  DecoderDaemon daemon(keyMapFile,socketPath,numThreads);
+  if(!daemon.Listen()){
+    return 1;
+  }
+  daemon.Serve();
+
+  return 0;
+}
@@ -0,0 +1,283 @@
+#include "Controller.hpp"
+#include <cerrno>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/*
+  Reference client for twitchd (Daemon.cpp). Sends each trace file (one "x<TAB>y" sample per line) as a decode request
+  and prints the ranked words, then reports the round-trip time of a ping and of each decode against the server-side
+  decode time, so the protocol overhead can be read off directly.
+
+  Usage: twitchClient [-s socketPath] [-p direct|lattice] [-n topN] [-r repeats] trace1 [trace2 ...]
+*/
+
+class DaemonClient{
+  public:
+    int fd;
+
+    DaemonClient();
+    ~DaemonClient();
+
+    bool Connect(const string& socketPath);
+    bool ReadFull(void* buf, size_t n);
+    bool WriteFull(const void* buf, size_t n);
+    bool Exchange(U16 type, const vector<char>& payload, DaemonFrameHeader& replyHeader, vector<char>& reply);
+    bool Ping(double& rttUs);
+    bool Decode(const vector<short int>& coords, U16 path, U16 topN, U32& decodeUs, SearchResults& results);
+    bool LoadTrace(const string& traceFile, vector<short int>& coords);
+};
+
+DaemonClient::DaemonClient()
+{
+  fd = -1;
+}
+
+DaemonClient::~DaemonClient()
+{
+  if(fd >= 0){
+    close(fd);
+  }
+}
+
+bool DaemonClient::Connect(const string& socketPath)
+{
+  struct sockaddr_un addr;
+
+  if(socketPath.size() >= sizeof(addr.sun_path)){
+    cout << "ERROR socket path too long: " << socketPath << endl;
+    return false;
+  }
+
+  fd = socket(AF_UNIX,SOCK_STREAM,0);
+  memset(&addr,0,sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strncpy(addr.sun_path,socketPath.c_str(),sizeof(addr.sun_path) - 1);
+  if(fd < 0 || connect(fd,(struct sockaddr*)&addr,sizeof(addr)) != 0){
+    cout << "ERROR could not connect to " << socketPath << " (is twitchd running?)" << endl;
+    return false;
+  }
+
+  return true;
+}
+
+bool DaemonClient::ReadFull(void* buf, size_t n)
+{
+  ssize_t got;
+
+  while(n > 0){
+    got = recv(fd,buf,n,0);
+    if(got < 0 && errno == EINTR){
+      continue;
+    }
+    if(got <= 0){
+      return false;
+    }
+    buf = (char*)buf + got;
+    n -= got;
+  }
+
+  return true;
+}
+
+bool DaemonClient::WriteFull(const void* buf, size_t n)
+{
+  ssize_t sent;
+
+  while(n > 0){
+    sent = send(fd,buf,n,MSG_NOSIGNAL);
+    if(sent < 0 && errno == EINTR){
+      continue;
+    }
+    if(sent <= 0){
+      return false;
+    }
+    buf = (const char*)buf + sent;
+    n -= sent;
+  }
+
+  return true;
+}
+
+//sends one frame and waits for the reply frame
+bool DaemonClient::Exchange(U16 type, const vector<char>& payload, DaemonFrameHeader& replyHeader, vector<char>& reply)
+{
+  vector<char> frame(sizeof(DaemonFrameHeader) + payload.size());
+  DaemonFrameHeader* header = (DaemonFrameHeader*)&frame[0];
+
+  header->magic = DAEMON_MAGIC;
+  header->type = type;
+  header->reserved = 0;
+  header->length = payload.size();
+  if(!payload.empty()){
+    memcpy(&frame[sizeof(DaemonFrameHeader)],&payload[0],payload.size());
+  }
+
+  if(!WriteFull(&frame[0],frame.size()) || !ReadFull(&replyHeader,sizeof(replyHeader)) || replyHeader.magic != DAEMON_MAGIC){
+    cout << "ERROR lost connection to the daemon" << endl;
+    return false;
+  }
+  reply.resize(replyHeader.length);
+  if(replyHeader.length > 0 && !ReadFull(&reply[0],replyHeader.length)){
+    cout << "ERROR lost connection to the daemon" << endl;
+    return false;
+  }
+  if(replyHeader.type == FRAME_ERROR){
+    cout << "ERROR daemon replied: " << string(reply.begin(),reply.end()) << endl;
+    return false;
+  }
+
+  return true;
+}
+
+bool DaemonClient::Ping(double& rttUs)
+{
+  vector<char> empty, reply;
+  DaemonFrameHeader replyHeader;
+  struct timespec begin, end;
+
+  clock_gettime(CLOCK_MONOTONIC,&begin);
+  if(!Exchange(FRAME_PING,empty,replyHeader,reply) || replyHeader.type != FRAME_PONG){
+    return false;
+  }
+  clock_gettime(CLOCK_MONOTONIC,&end);
+  rttUs = DiffTimeSpecs(&begin,&end) * 1.0e6;
+
+  return true;
+}
+
+//coords holds x0,y0,x1,y1...
+bool DaemonClient::Decode(const vector<short int>& coords, U16 path, U16 topN, U32& decodeUs, SearchResults& results)
+{
+  U32 i, offset;
+  U8 len;
+  float score;
+  DaemonDecodeRequest request;
+  DaemonDecodeResponse response;
+  DaemonFrameHeader replyHeader;
+  vector<char> payload(sizeof(request) + coords.size() * sizeof(short int)), reply;
+
+  request.path = path;
+  request.topN = topN;
+  request.numPoints = coords.size() / 2;
+  memcpy(&payload[0],&request,sizeof(request));
+  if(!coords.empty()){
+    memcpy(&payload[sizeof(request)],&coords[0],coords.size() * sizeof(short int));
+  }
+
+  if(!Exchange(FRAME_DECODE_REQUEST,payload,replyHeader,reply) || replyHeader.type != FRAME_DECODE_RESPONSE || reply.size() < sizeof(response)){
+    return false;
+  }
+  memcpy(&response,&reply[0],sizeof(response));
+  decodeUs = response.decodeUs;
+
+  results.clear();
+  offset = sizeof(response);
+  for(i = 0; i < response.numResults && offset + sizeof(score) + 1 <= reply.size(); i++){
+    memcpy(&score,&reply[offset],sizeof(score));
+    len = (U8)reply[offset + sizeof(score)];
+    offset += sizeof(score) + 1;
+    if(offset + len > reply.size()){
+      break;
+    }
+    results.push_back(SearchResult(string(&reply[offset],len),score));
+    offset += len;
+  }
+
+  return true;
+}
+
+bool DaemonClient::LoadTrace(const string& traceFile, vector<short int>& coords)
+{
+  int x, y;
+  char buf[BUFSIZE];
+  FILE* ifile = fopen(traceFile.c_str(),"r");
+
+  if(ifile == NULL){
+    cout << "ERROR could not open trace file: " << traceFile << endl;
+    return false;
+  }
+
+  coords.clear();
+  while(fgets(buf,BUFSIZE,ifile) != NULL){
+    if(sscanf(buf,"%d %d",&x,&y) == 2){
+      coords.push_back((short int)x);
+      coords.push_back((short int)y);
+    }
+  }
+  fclose(ifile);
+
+  return true;
+}
+
+int main(int argc, char* argv[])
+{
+  int i, j, rank, repeats = 1;
+  U16 path = DECODE_DIRECT, topN = 5;
+  U32 decodeUs;
+  double rttUs, overheadUs, maxOverheadUs = 0.0, sumOverheadUs = 0.0;
+  U64 numDecodes = 0;
+  string socketPath = DAEMON_DEFAULT_SOCKET;
+  vector<string> traces;
+  vector<short int> coords;
+  SearchResults results;
+  DaemonClient client;
+  struct timespec begin, end;
+
+  for(i = 1; i < argc; i++){
+    if(!strcmp(argv[i],"-s") && i + 1 < argc){
+      socketPath = argv[++i];
+    }
+    else if(!strcmp(argv[i],"-p") && i + 1 < argc){
+      path = strcmp(argv[++i],"lattice") ? DECODE_DIRECT : DECODE_LATTICE_LM;
+    }
+    else if(!strcmp(argv[i],"-n") && i + 1 < argc){
+      topN = (U16)atoi(argv[++i]);
+    }
+    else if(!strcmp(argv[i],"-r") && i + 1 < argc){
+      repeats = std::max(1,atoi(argv[++i]));
+    }
+    else{
+      traces.push_back(argv[i]);
+    }
+  }
+  if(traces.empty()){
+    cout << "usage: twitchClient [-s socketPath] [-p direct|lattice] [-n topN] [-r repeats] trace1 [trace2 ...]" << endl;
+    return 1;
+  }
+
+  if(!client.Connect(socketPath) || !client.Ping(rttUs)){
+    return 1;
+  }
+  printf("ping round trip %.1f us\n",rttUs);
+
+  for(i = 0; i < traces.size(); i++){
+    if(!client.LoadTrace(traces[i],coords)){
+      continue;
+    }
+    for(j = 0; j < repeats; j++){
+      clock_gettime(CLOCK_MONOTONIC,&begin);
+      if(!client.Decode(coords,path,topN,decodeUs,results)){
+        return 1;
+      }
+      clock_gettime(CLOCK_MONOTONIC,&end);
+      rttUs = DiffTimeSpecs(&begin,&end) * 1.0e6;
+      overheadUs = std::max(0.0,rttUs - decodeUs);
+      maxOverheadUs = std::max(maxOverheadUs,overheadUs);
+      sumOverheadUs += overheadUs;
+      numDecodes++;
+    }
+
+    printf("%s: %d points, round trip %.1f us, decode %u us, overhead %.1f us\n",traces[i].c_str(),(int)coords.size() / 2,rttUs,decodeUs,overheadUs);
+    rank = 1;
+    for(SearchResultIt it = results.begin(); it != results.end(); ++it, rank++){
+      printf("  %2d  %-20s %f\n",rank,it->first.c_str(),it->second);
+    }
+  }
+
+  if(numDecodes > 0){
+    printf("%llu decodes, protocol overhead mean %.1f us, max %.1f us\n",(unsigned long long)numDecodes,sumOverheadUs / numDecodes,maxOverheadUs);
+  }
+
+  return 0;
+}
@@ -42,6 +42,9 @@
   Could also partition by key regions, somehow.
 */
 
+static thread_local vector<double> keyDists;  //VectorDistInference's KeyDistanceTable of the current word's clusters; per thread, since the model is shared
+static thread_local vector<U16> stringScores;  //StringDistInference's kernel scores, kept so a word doesn't malloc them; likewise per thread
+
 DirectInference::DirectInference()
 {
   cout << "ERROR building DirectInference model using default constructor, not built yet. Expect crash..." << endl;
@@ -61,6 +64,8 @@ DirectInference::DirectInference(const string& vocabFile, LayoutManager* layoutM
   cout << "Building DirectInference model..." << endl;
   layoutManager = layoutManagerPtr;
   BuildWordModel(vocabFile);
+  stringKernels.Build(wordModel);
+  cout << "String kernels built, " << (stringKernels.MemoryUsage() / 1024) << "kb" << endl;
 }
 
 DirectInference::~DirectInference()
@@ -114,6 +119,17 @@ void DirectInference::BuildWordModel(const string& vocabFile)
   infile.close();
 }
 
+/*
+  Builds the deletion-neighborhood index over the current word model. This is a few seconds of work and ~30MB
+  for the COCA vocab at maxEdits=2, so it's left to the caller to decide when (or if) to pay for it.
+*/
+void DirectInference::BuildEditIndex(int maxEdits)
+{
+  cout << "Building edit index, maxEdits=" << maxEdits << "..." << endl;
+  editIndex.Build(wordModel,maxEdits);
+  cout << "Building edit index completed. postings=" << editIndex.NumPostings() << " memory=" << (editIndex.MemoryUsage() / 1024) << "kb" << endl;
+}
+
 /*
   Given a set of mean points, generates a raw string from them.
   This gives the DIRECT parse of the clusters, w/out accounting for possible insertions.
@@ -127,7 +143,7 @@ void DirectInference::MeansToString(vector<PointMu>& pointMeans, string& output)
   for(int i = 0; i < pointMeans.size(); i++){
     output += layoutManager->FindNearestKey(pointMeans[i].pt);
   }
-  cout << "returning " << output << " from Controller::MeansToString" << endl;
+  LOG_DEBUG("returning " << output << " from Controller::MeansToString");
 }
 
 /*
@@ -158,7 +174,7 @@ void DirectInference::MeansToEditList(vector<PointMu>& pointMeans, vector<string
   //vector<string> prefixList;
   string s;
 
-  cout << "in meanstoeditlist" << endl;
+  LOG_DEBUG("in meanstoeditlist");
   s += layoutManager->FindNearestKey(pointMeans[0].pt);  
   stringList.push_back(s);
   insertCt = 0;
@@ -182,9 +198,9 @@ void DirectInference::MeansToEditList(vector<PointMu>& pointMeans, vector<string
       insertCt++;
     }
   }
-  cout << "after means to string list, there are " << stringList.size() << " edits: (insertCt=" << insertCt << ")" << endl;
+  LOG_DEBUG("after means to string list, there are " << stringList.size() << " edits: (insertCt=" << insertCt << ")");
   for(i = 0; i < stringList.size(); i++){
-    cout << " > " << stringList[i] << endl;
+    LOG_DEBUG(" > " << stringList[i]);
   }
 }
 
@@ -196,18 +212,28 @@ void DirectInference::MeansToEditList(vector<PointMu>& pointMeans, vector<string
 void DirectInference::StringDistInference(vector<PointMu>& pointMeans, SearchResults& results)
 {
   int i, diff;
+  U32 id;
   double dist, minDist;
   WordModelIt minIt, it;
   string edit;
+  vector<U16>& scores = stringScores;
   //vector<string> edits;
 
   //get the character representation of the cluster. note how this flattens the possible coordinate distances.
   MeansToString(pointMeans,edit);
   //MeansToEditList(pointMeans,edits);  //Obsolete, if non-unique filter method is used (secret sauce)
-  cout << "done with means to edit" << endl;
+  LOG_DEBUG("done with means to edit");
+
+  //score the entire wordModel at once; scores[id] is the distance to the id-th word, in wordModel order
+  //choose a string-distance kernel to test (each is identical to the scalar StringDist_ function of the same name)
+  //stringKernels.Levenshtein(edit,scores);
+  //stringKernels.HammingSkipChar(edit,scores); //A hamming distance, but one that compares only the unique character sequences of each string
+  stringKernels.HammingFwdBkwd(edit,scores);
+  METRICS_COUNT(COUNTER_CANDIDATES_SCORED,wordModel.size());
+
   minDist = 99999;
   //iterates ENTIRE wordModel
-  for(WordModelIt it = wordModel.begin(); it != wordModel.end(); ++it){
+  for(id = 0, it = wordModel.begin(); it != wordModel.end(); ++it, id++){
     diff = it->size() - edit.size();
 		//optimization: only compare strings of roughly equal length (+-1 char)
     //check verifies diff is in range [-1,5], meaning edit can be longer by 1 char, or shorter by 5 (due to compression of rpt chars)
@@ -215,11 +241,8 @@ void DirectInference::StringDistInference(vector<PointMu>& pointMeans, SearchRes
     //      be built (containing all words with repeate sequences removed: MISSISSIPPI -> MISISIPI).
     //      This generous search radius (of word lengths) indeed slows query times, which is an argument in favor.
 		if((diff >= -1) && (diff <= 5)){  //this tolerance must account for the number of chars potentially squeezed in edit string
-      //choose a string-distance function to test
-			//dist = StringDist_Levenshtein(edit,*it);
-			//dist = StringDist_Hamming(edits[i],*it);
-      //dist = StringDist_HammingSkipChar(edit,*it); //A hamming distance, but one that compares only the unique character sequences of each string
-      dist = StringDist_HammingFwdBkwd(edit,*it);
+      //scalar equivalent: dist = StringDist_HammingFwdBkwd(edit,*it);
+      dist = scores[id];
 
 			//punish the difference in string length
 			dist += layoutManager->AbsDiff(edit.size(),it->size());
@@ -228,7 +251,7 @@ void DirectInference::StringDistInference(vector<PointMu>& pointMeans, SearchRes
 				minDist = dist;
 				minIt = it;
 			}
-			results.push_back({*it,dist});
+			results.push_back({*it,dist});  //the node is in the arena, but a word over 15 chars outgrows std::string's inline buffer, so copying it mallocs
 	  }
     
     /* Use for checking list of possible edits; look for ways to avoid having to do so, due to added complexity
@@ -249,11 +272,74 @@ void DirectInference::StringDistInference(vector<PointMu>& pointMeans, SearchRes
     */
   }
   results.sort(ByDistance);
-  cout << "StringDistInference complete. Min-dist string is: " << *minIt << endl;
+  LOG_DEBUG("StringDistInference complete. Min-dist string is: " << *minIt);
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
   SearchResultIt mit;
   for(i = 0, mit = results.begin(); mit != results.end() && i < 50; i++, ++mit ){
     cout << i << ": " << mit->first << "|" << mit->second << endl;
   }
+#endif
+}
+
+/*
+  Checks that every StringKernels batch function returns exactly what its scalar StringDist_ counterpart returns,
+  for query against every word in the vocabulary. Returns the number of disagreements (should be zero).
+*/
+int DirectInference::TestStringKernels(const string& query)
+{
+  int mismatches = 0;
+  U32 id;
+  WordModelIt it;
+  vector<U16> fwd, bkwd, skip, lev;
+
+  stringKernels.HammingFwd(query,fwd);
+  stringKernels.HammingBkwd(query,bkwd);
+  stringKernels.HammingSkipChar(query,skip);
+  stringKernels.Levenshtein(query,lev);
+
+  for(id = 0, it = wordModel.begin(); it != wordModel.end(); ++it, id++){
+    if(fwd[id] != StringDist_HammingFwd(query,*it)){
+      cout << "ERROR HammingFwd kernel mismatch for " << query << "/" << *it << endl;
+      mismatches++;
+    }
+    if(bkwd[id] != StringDist_HammingBkwd(query,*it)){
+      cout << "ERROR HammingBkwd kernel mismatch for " << query << "/" << *it << endl;
+      mismatches++;
+    }
+    if(skip[id] != StringDist_HammingSkipChar(query,*it)){
+      cout << "ERROR HammingSkipChar kernel mismatch for " << query << "/" << *it << endl;
+      mismatches++;
+    }
+    if(lev[id] != StringDist_Levenshtein(query,stringKernels.collapsedWords[id])){
+      cout << "ERROR Levenshtein kernel mismatch for " << query << "/" << *it << endl;
+      mismatches++;
+    }
+  }
+
+  return mismatches;
+}
+
+/*
+  Same idea as StringDistInference, but instead of scanning the entire word model, looks up every word within
+  MAX_EDIT_DIST edits of the cluster string in the edit index. Repeated chars are collapsed on both sides (the index
+  stores collapsed words), so this has the same "secret sauce" behavior as StringDist_HammingSkipChar, but also
+  tolerates insertions and deletions in the cluster sequence, which Hamming distance does not.
+
+  Returns an empty list if the cluster string is more than MAX_EDIT_DIST edits from every word; callers may want
+  to fall back to one of the brute force methods in that case.
+*/
+void DirectInference::EditDistInference(vector<PointMu>& pointMeans, SearchResults& results)
+{
+  string edit;
+
+  if(editIndex.words.empty()){
+    cout << "ERROR EditDistInference called before BuildEditIndex()" << endl;
+    return;
+  }
+
+  MeansToString(pointMeans,edit);
+  editIndex.Search(edit,MAX_EDIT_DIST,results);
+  LOG_DEBUG("EditDistInference complete, " << results.size() << " words within " << MAX_EDIT_DIST << " edits of " << edit);
 }
 
 /*
@@ -322,6 +408,28 @@ double DirectInference::StringDist_HammingBkwd(const string& s1, const string& s
   return diff;
 }
 
+//Levenshtein distance: unit cost insertions, deletions, and substitutions. Full-matrix DP, kept simple as a reference.
+double DirectInference::StringDist_Levenshtein(const string& s1, const string& s2)
+{
+  int i, j, cost;
+  vector<vector<int> > d(s1.size() + 1, vector<int>(s2.size() + 1));
+
+  for(i = 0; i <= s1.size(); i++){
+    d[i][0] = i;
+  }
+  for(j = 0; j <= s2.size(); j++){
+    d[0][j] = j;
+  }
+  for(i = 1; i <= s1.size(); i++){
+    for(j = 1; j <= s2.size(); j++){
+      cost = (s1[i-1] == s2[j-1]) ? 0 : 1;
+      d[i][j] = std::min(d[i-1][j-1] + cost, std::min(d[i-1][j] + 1, d[i][j-1] + 1));
+    }
+  }
+
+  return (double)d[s1.size()][s2.size()];
+}
+
 //Hamming dist, forward only
 double DirectInference::StringDist_Hamming(const string& s1, const string& s2)
 {
@@ -412,6 +520,7 @@ double DirectInference::StringDist_HammingSkipChar(const string& s1, const strin
 */
 void DirectInference::Process(vector<PointMu>& pointMeans, SearchResults& results)
 {
+  METRICS_SCOPE(STAGE_DIRECT_INFERENCE);
 
   if(results.size() > 0){
     results.clear();
@@ -423,11 +532,14 @@ void DirectInference::Process(vector<PointMu>& pointMeans, SearchResults& result
   VectorDistInference(pointMeans,results);
   //MergeInference(pointMeans,results);  //merges multiple inference models' results: in this case, fast string-dist and geometric approaches 
 
+  TRACE_EVENT(TRACE_DI_DONE,results.size(),results.empty() ? 0.0 : results.begin()->second);
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
   int i;
   SearchResultIt it;
   for(i = 0, it = results.begin(); i < 75 && it != results.end(); ++it, i++){
     cout << i << ": " << it->first << "|" << it->second << endl;
   }
+#endif
 }
 
 /*
@@ -497,26 +609,29 @@ void DirectInference::VectorDistInference(vector<PointMu>& pointMeans, SearchRes
   //build reversal of pointMeans, for inference procedures that run backward-forward logic
   //RevPointMeans(pointMeans,revPointMeans);
 
-  cout << "In DirectInference, process..." << endl;
+  LOG_DEBUG("In DirectInference, process...");
 
   if(results.size() > 0){
     results.clear();
     //results.reserve(wordModel.size() * 4);
   }
 
+  //every candidate char is charged against some cluster's distance to its key, so table those once per word
+  layoutManager->KeyDistanceTable(pointMeans,keyDists);
   min = 99999;
   for(WordModelIt it = wordModel.begin(); it != wordModel.end(); ++it){
-    dist = VectorDistance(pointMeans,it);
+    dist = VectorDistance(pointMeans,keyDists,it);
     //dist = VectorDistance(pointMeans,revPointMeans,it);  //overload for fwd-bkwd versions
     if(dist < min){
       min = dist;
       minIt = it;
     }
-    if(dist < 1500){  //push threshold: near words
+    if(dist < DIRECT_MAX_DISTANCE){  //push threshold: near words
 		  //cout << "pushing >" << *it << "," << dist << "<" << endl;
 		  results.push_back(SearchResult{*it,dist});
     }
   }
+  METRICS_COUNT(COUNTER_CANDIDATES_SCORED,wordModel.size());
   results.sort(ByDistance);
 
 /*
@@ -533,18 +648,18 @@ void DirectInference::VectorDistInference(vector<PointMu>& pointMeans, SearchRes
   
   Distance metric currently assumes that at least the first cluster aligns with the first letter's coordinates.
 */
-double DirectInference::VectorDistance(vector<PointMu>& pointMeans, WordModelIt it)
+double DirectInference::VectorDistance(vector<PointMu>& pointMeans, const vector<double>& table, WordModelIt it)
 {
   double dist;
 
   //small optmization to only compare words within +/- k character length of eachother
-  if(layoutManager->AbsDiff(pointMeans.size(),it->size()) > 4){
+  if(layoutManager->AbsDiff(pointMeans.size(),it->size()) > DIRECT_MAX_LENGTH_DIFF){
     return 99999;
   }
 
   //dist = SumDistMetric_Unaligned(pointMeans, *it);
   //dist = SumDistMetric_Unaligned_FwdBkwd(pointMeans, *it);
-  dist = SumDistMetric_Aligned(pointMeans, *it);
+  dist = SumDistMetric_Aligned(pointMeans, table, *it);
 
   return dist;
 }
@@ -811,7 +926,7 @@ string DirectInference::ReverseString(const string& str)
   such that each successive measure only re-ranks items within some subgrouping.
 
 */
-double DirectInference::SumDistMetric_Aligned(vector<PointMu>& pointMeans, const string& candidate)
+double DirectInference::SumDistMetric_Aligned(vector<PointMu>& pointMeans, const vector<double>& table, const string& candidate)
 {
   double sumDist, dist;
   int i, j, rpts, edts;
@@ -831,7 +946,7 @@ double DirectInference::SumDistMetric_Aligned(vector<PointMu>& pointMeans, const
           sumDist += InsertionError(pointMeans[i].pt, layoutManager->GetPoint(candidate[j-1]), layoutManager->GetPoint(candidate[j]));
         }
         else{ //the first is just an exception case, when we don't have two points to compare. so just compare char i to j
-          sumDist += layoutManager->DoubleDistance(pointMeans[i].pt, layoutManager->GetPoint(candidate[j]));
+          sumDist += table[i * KEY_TABLE_SIZE + (U8)candidate[j]];
         }
         i++;  //skip the input error
         edts++;
@@ -843,12 +958,12 @@ double DirectInference::SumDistMetric_Aligned(vector<PointMu>& pointMeans, const
         //when char i is detected, but i+1 is not, since its just too near to detect. Thus, the distance should be assessed wrt i,
         //instead of the midpoint (as for insertion error).
         if(i > 0 && pointMeans.size() > 1){
-          sumDist += layoutManager->DoubleDistance(pointMeans[i-1].pt, layoutManager->GetPoint(candidate[j]));
+          sumDist += table[(i-1) * KEY_TABLE_SIZE + (U8)candidate[j]];
           //sumDist += InsertionError(layoutManager->GetPoint(candidate[j]), pointMeans[i].pt, pointMeans[i-1].pt);
         }
         //just an exception case, protecting the pointMeans bounds i and i-1
         else{
-          sumDist += layoutManager->DoubleDistance(pointMeans[i].pt, layoutManager->GetPoint(candidate[j]));
+          sumDist += table[i * KEY_TABLE_SIZE + (U8)candidate[j]];
         }
         j++;
         edts++;
@@ -856,7 +971,7 @@ double DirectInference::SumDistMetric_Aligned(vector<PointMu>& pointMeans, const
       //else, assume we're just off the mark, and let distance accumulate
       //note we hit this case either if the next letters also differ, or if the current (differing) letters includes the last letter of candidate
       else{
-        sumDist += layoutManager->DoubleDistance(pointMeans[i].pt, layoutManager->GetPoint(candidate[j]));
+        sumDist += table[i * KEY_TABLE_SIZE + (U8)candidate[j]];
       }
     }
 
@@ -874,11 +989,11 @@ double DirectInference::SumDistMetric_Aligned(vector<PointMu>& pointMeans, const
   //natural metric: continue summing distance for remaining characters in either string
   //only one or neither of these loops will execute, since either (or both) i or j is at end of its sequence
   while(i < pointMeans.size()){
-    sumDist +=  layoutManager->DoubleDistance(pointMeans[i].pt, layoutManager->GetPoint(candidate[j-1]));
+    sumDist +=  table[i * KEY_TABLE_SIZE + (U8)candidate[j-1]];
     i++;
   }
   while(j < candidate.size()){
-    sumDist +=  layoutManager->DoubleDistance(pointMeans[i-1].pt, layoutManager->GetPoint(candidate[j]));
+    sumDist +=  table[(i-1) * KEY_TABLE_SIZE + (U8)candidate[j]];
     while(j < candidate.size()-1 && candidate[j] == candidate[j+1]){  //chew up repeated chars in candidate
       j++;
       rpts++;
@@ -896,6 +1011,16 @@ double DirectInference::SumDistMetric_Aligned(vector<PointMu>& pointMeans, const
   return sumDist;
 }
 
+//SumDistMetric_Aligned, for callers without a KeyDistanceTable of pointMeans
+double DirectInference::SumDistMetric_Aligned(vector<PointMu>& pointMeans, const string& candidate)
+{
+  vector<double> table;
+
+  layoutManager->KeyDistanceTable(pointMeans,table);
+
+  return SumDistMetric_Aligned(pointMeans,table,candidate);
+}
+
 
 
 
@@ -0,0 +1,283 @@
+#include "Controller.hpp"
+
+/*
+  A symmetric-deletion index over the vocabulary, for finding every word within some small edit distance
+  of a decoded string without scanning the entire word model. This is the SymSpell trick: if two strings are
+  within edit distance k, then some string made by deleting at most k chars from the first is equal to some string
+  made by deleting at most k chars from the second. So at build time every word is expanded into all of its
+  deletion-variants (up to maxEdits deletions), and at query time the query is expanded the same way; any
+  word sharing a variant with the query is a candidate, which is then verified with a real edit-distance.
+
+  Words are indexed by their repeat-collapsed form (MISSISSIPPI -> MISISIPI), which is how StringDist_HammingSkipChar
+  compares them, and how the SingularityBuilder emits clusters (it never emits repeated chars). So "MISISIPI" and
+  "MISSISSIPPI" are distance zero, and the index stays much smaller since repeated chars generate redundant deletes.
+
+  Data model: rather than a map of string->postings (string keys and hash nodes are most of the memory), each
+  deletion-variant is hashed to 64 bits and stored as a sorted (hash,wordId) pair in two parallel arrays. A lookup
+  is a binary search per variant, so query cost is O(variants * log(postings)), independent of vocabulary size
+  aside from the log. Hash collisions only generate extra candidates, which verification throws out.
+
+  Memory is 12 bytes per posting, plus each word and its collapsed form; for the COCA vocab (~60k words) and maxEdits=2,
+  that's 2,121,507 postings, about 25MB of them, and 30,527kb in all by MemoryUsage.
+
+  The index is immutable once built, so any number of threads can Search it at once; the per-query scratch (the
+  candidate dedupe stamps, and the query's deletes and candidates) is thread-local, and reused so a query doesn't allocate.
+*/
+
+//per-thread query stamp of each word id, for deduping candidates without a set. Shared by every index the thread
+//searches; a stamp is never reused by a thread, so one index's stamps can't be mistaken for another's.
+static thread_local vector<U32> stamps;
+static thread_local U32 queryStamp = 0;
+static thread_local vector<string> queryDeletes;
+static thread_local vector<U32> queryCandidates;
+
+EditIndex::EditIndex()
+{
+  maxEdits = 0;
+}
+
+EditIndex::EditIndex(WordModel& wordModel, int maxEditDist)
+{
+  Build(wordModel,maxEditDist);
+}
+
+EditIndex::~EditIndex()
+{
+  Clear();
+}
+
+void EditIndex::Clear(void)
+{
+  words.clear();
+  collapsedWords.clear();
+  keyHashes.clear();
+  keyWordIds.clear();
+}
+
+//returns s with every run of repeated chars squeezed to a single char: MISSISSIPPI -> MISISIPI
+string EditIndex::CollapseRepeats(const string& s)
+{
+  string collapsed;
+
+  collapsed.reserve(s.size());
+  for(int i = 0; i < s.size(); i++){
+    if(i == 0 || s[i] != s[i-1]){
+      collapsed += s[i];
+    }
+  }
+
+  return collapsed;
+}
+
+//FNV-1a. Only needs to be fast and well-distributed; collisions are caught by verification.
+U64 EditIndex::HashKey(const string& s)
+{
+  U64 hash = 14695981039346656037ULL;
+
+  for(int i = 0; i < s.size(); i++){
+    hash ^= (U64)(U8)s[i];
+    hash *= 1099511628211ULL;
+  }
+
+  return hash;
+}
+
+/*
+  Appends all strings generated by deleting up to 'depth' chars from s (s itself included) to deletes.
+  Output may contain duplicates (eg, deleting either S from "MESS"); caller is responsible for uniquing them.
+*/
+void EditIndex::GenerateDeletes(const string& s, int depth, vector<string>& deletes)
+{
+  string del;
+
+  deletes.push_back(s);
+  if(depth <= 0 || s.empty()){
+    return;
+  }
+
+  for(int i = 0; i < s.size(); i++){
+    del = s;
+    del.erase(i,1);
+    GenerateDeletes(del,depth-1,deletes);
+  }
+}
+
+/*
+  Builds the index from the vocabulary. Word ids are assigned in WordModel (set) order, so results can be
+  mapped back to the same order as the brute-force scans in DirectInference.
+*/
+void EditIndex::Build(WordModel& wordModel, int maxEditDist)
+{
+  U32 i, j, id;
+  vector<string> deletes;
+  vector<pair<U64,U32> > postings;
+
+  Clear();
+  maxEdits = maxEditDist;
+
+  words.reserve(wordModel.size());
+  collapsedWords.reserve(wordModel.size());
+  for(WordModelIt it = wordModel.begin(); it != wordModel.end(); ++it){
+    words.push_back(*it);
+    collapsedWords.push_back(CollapseRepeats(*it));
+  }
+
+  postings.reserve(words.size() * 24);
+  for(id = 0; id < collapsedWords.size(); id++){
+    deletes.clear();
+    GenerateDeletes(collapsedWords[id],maxEdits,deletes);
+    std::sort(deletes.begin(),deletes.end());
+    deletes.erase(std::unique(deletes.begin(),deletes.end()),deletes.end());
+    for(j = 0; j < deletes.size(); j++){
+      postings.push_back(pair<U64,U32>(HashKey(deletes[j]),id));
+    }
+  }
+
+  //sorting by (hash,id) keeps each hash's postings contiguous, and in word-model order
+  std::sort(postings.begin(),postings.end());
+
+  keyHashes.resize(postings.size());
+  keyWordIds.resize(postings.size());
+  for(i = 0; i < postings.size(); i++){
+    keyHashes[i] = postings[i].first;
+    keyWordIds[i] = postings[i].second;
+  }
+}
+
+//approximate heap footprint of the index, in bytes
+size_t EditIndex::MemoryUsage(void)
+{
+  size_t bytes = 0;
+
+  bytes += keyHashes.capacity() * sizeof(U64);
+  bytes += keyWordIds.capacity() * sizeof(U32);
+  for(U32 i = 0; i < words.size(); i++){
+    bytes += sizeof(string) * 2 + words[i].capacity() + collapsedWords[i].capacity();
+  }
+
+  return bytes;
+}
+
+U32 EditIndex::NumPostings(void)
+{
+  return keyHashes.size();
+}
+
+/*
+  Plain Levenshtein distance (unit cost insert/delete/substitute), with an early exit: once every cell
+  in a row exceeds bound, the result can only grow, so bound+1 is returned. Two-row dynamic programming.
+*/
+int EditIndex::EditDistance(const string& s1, const string& s2, int bound)
+{
+  int i, j, rowMin, cost;
+  int prev[BUFSIZE], cur[BUFSIZE];
+
+  if(s1.size() >= BUFSIZE || s2.size() >= BUFSIZE){
+    return bound + 1;
+  }
+  if(AbsDiff(s1.size(),s2.size()) > bound){
+    return bound + 1;
+  }
+
+  for(j = 0; j <= s2.size(); j++){
+    prev[j] = j;
+  }
+
+  for(i = 1; i <= s1.size(); i++){
+    cur[0] = i;
+    rowMin = cur[0];
+    for(j = 1; j <= s2.size(); j++){
+      cost = (s1[i-1] == s2[j-1]) ? 0 : 1;
+      cur[j] = prev[j-1] + cost;
+      if(prev[j] + 1 < cur[j]){
+        cur[j] = prev[j] + 1;
+      }
+      if(cur[j-1] + 1 < cur[j]){
+        cur[j] = cur[j-1] + 1;
+      }
+      if(cur[j] < rowMin){
+        rowMin = cur[j];
+      }
+    }
+    if(rowMin > bound){
+      return bound + 1;
+    }
+    for(j = 0; j <= s2.size(); j++){
+      prev[j] = cur[j];
+    }
+  }
+
+  return prev[s2.size()];
+}
+
+int EditIndex::AbsDiff(int i, int j)
+{
+  return (i >= j) ? (i - j) : (j - i);
+}
+
+/*
+  Returns every vocabulary word within maxDist edits of query (compared in repeat-collapsed form),
+  as <word,distance> pairs sorted by distance. Ties keep word-model order.
+
+  maxDist is clamped to the depth the index was built with; searching deeper than that can miss words.
+*/
+void EditIndex::Search(const string& query, int maxDist, SearchResults& results)
+{
+  int dist;
+  U32 i, j, id;
+  U64 hash;
+  string collapsed;
+  vector<U64>::iterator lo, hi;
+
+  if(words.empty()){
+    cout << "ERROR EditIndex::Search called on an empty index" << endl;
+    return;
+  }
+  if(maxDist > maxEdits){
+    maxDist = maxEdits;
+  }
+
+  collapsed = CollapseRepeats(query);
+  for(i = 0; i < collapsed.size(); i++){  //vocabulary is upper case
+    collapsed[i] = ToUpper(collapsed[i]);
+  }
+  queryDeletes.clear();
+  queryCandidates.clear();
+  GenerateDeletes(collapsed,maxDist,queryDeletes);
+  std::sort(queryDeletes.begin(),queryDeletes.end());
+  queryDeletes.erase(std::unique(queryDeletes.begin(),queryDeletes.end()),queryDeletes.end());
+
+  //stamps let us dedupe candidates without clearing a visited-set per query
+  if(stamps.size() < words.size()){
+    stamps.resize(words.size(),0);
+  }
+  queryStamp++;
+  if(queryStamp == 0){
+    std::fill(stamps.begin(),stamps.end(),0);
+    queryStamp = 1;
+  }
+
+  for(i = 0; i < queryDeletes.size(); i++){
+    hash = HashKey(queryDeletes[i]);
+    lo = std::lower_bound(keyHashes.begin(),keyHashes.end(),hash);
+    for(hi = lo; hi != keyHashes.end() && *hi == hash; ++hi){
+      id = keyWordIds[hi - keyHashes.begin()];
+      if(stamps[id] != queryStamp){
+        stamps[id] = queryStamp;
+        queryCandidates.push_back(id);
+      }
+    }
+  }
+
+  //verify candidates, in word-model order so the output is deterministic
+  std::sort(queryCandidates.begin(),queryCandidates.end());
+  METRICS_COUNT(COUNTER_CANDIDATES_SCORED,queryCandidates.size());
+  for(j = 0; j < queryCandidates.size(); j++){
+    dist = EditDistance(collapsed,collapsedWords[queryCandidates[j]],maxDist);
+    if(dist <= maxDist){
+      results.push_back(SearchResult(words[queryCandidates[j]],(double)dist));
+    }
+  }
+
+  results.sort(ByDistance);
+}
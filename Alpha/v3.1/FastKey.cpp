@@ -0,0 +1,224 @@
+#include "Controller.hpp"
+#include "fastkey.h"
+
+/*
+  The libfastkey C ABI (see fastkey.h) over a DecoderModels and a DecodeSession (see Session.cpp). The current
+  word's samples accumulate directly in the session's sensorData, which fk_end_word decodes in place, so
+  fk_point_buffer hands out memory the clusterer reads without another copy. fk_decode_points skips sensorData
+  altogether, and decodes a PointSpan over the caller's own buffer. The results are the session's own, in its
+  arena, so fk_get_results copies straight out of the decode's memory. No exception crosses the ABI; they're
+  caught at each entry point and reported through fk_last_error.
+*/
+
+static_assert(sizeof(fk_point) == sizeof(Point), "fk_point must be layout-compatible with Point");
+
+struct fk_engine{
+  DecoderModels* models;
+  DecodeSession* session;
+  int path;
+  size_t committed;   //samples of the current word in session->sensorData; anything past this is an uncommitted fk_point_buffer
+  string lastError;
+};
+
+static int Fail(fk_engine* engine, int status, const string& error)
+{
+  if(engine != NULL){
+    engine->lastError = error;
+  }
+  return status;
+}
+
+int fk_abi_version(void)
+{
+  return FK_ABI_VERSION;
+}
+
+fk_engine* fk_create(const char* keyMapFile, const char* vocabFile, int path)
+{
+  fk_engine* engine = NULL;
+
+  if(keyMapFile == NULL || vocabFile == NULL || (path != FK_PATH_DIRECT && path != FK_PATH_LATTICE_LM)){
+    return NULL;
+  }
+
+  try{
+    engine = new fk_engine();
+    engine->models = new DecoderModels(keyMapFile,vocabFile);
+    engine->session = new DecodeSession(engine->models,0);
+    engine->path = (path == FK_PATH_LATTICE_LM) ? DECODE_LATTICE_LM : DECODE_DIRECT;
+    engine->committed = 0;
+  }
+  catch(...){
+    if(engine != NULL){
+      delete engine->session;
+      delete engine->models;
+      delete engine;
+    }
+    return NULL;
+  }
+
+  //the loaders report errors on cout rather than failing, so check that something was actually loaded
+  if(engine->models->layoutManager->keyMap.empty() || engine->models->di->wordModel.empty()){
+    fk_destroy(engine);
+    return NULL;
+  }
+
+  return engine;
+}
+
+void fk_destroy(fk_engine* engine)
+{
+  if(engine != NULL){
+    delete engine->session;
+    delete engine->models;
+    delete engine;
+  }
+}
+
+int fk_feed_points(fk_engine* engine, const fk_point* points, size_t count)
+{
+  if(engine == NULL || (points == NULL && count > 0)){
+    return Fail(engine,FK_ERROR_ARGUMENT,"fk_feed_points: null engine or points");
+  }
+
+  vector<Point>& sensorData = engine->session->sensorData;
+  try{
+    sensorData.resize(engine->committed + count);
+    for(size_t i = 0; i < count; i++){
+      sensorData[engine->committed + i] = Point(points[i].x,points[i].y);
+    }
+    engine->committed += count;
+  }
+  catch(std::exception& e){
+    sensorData.resize(engine->committed);
+    return Fail(engine,FK_ERROR_INTERNAL,e.what());
+  }
+  catch(...){
+    sensorData.resize(engine->committed);
+    return Fail(engine,FK_ERROR_INTERNAL,"unknown exception");
+  }
+
+  return FK_OK;
+}
+
+fk_point* fk_point_buffer(fk_engine* engine, size_t count)
+{
+  if(engine == NULL || count == 0){
+    Fail(engine,FK_ERROR_ARGUMENT,"fk_point_buffer: null engine or zero count");
+    return NULL;
+  }
+
+  try{
+    engine->session->sensorData.resize(engine->committed + count);
+  }
+  catch(std::exception& e){
+    Fail(engine,FK_ERROR_INTERNAL,e.what());
+    return NULL;
+  }
+  catch(...){
+    Fail(engine,FK_ERROR_INTERNAL,"unknown exception");
+    return NULL;
+  }
+
+  return (fk_point*)&engine->session->sensorData[engine->committed];
+}
+
+int fk_commit_points(fk_engine* engine, size_t count)
+{
+  if(engine == NULL || engine->committed + count > engine->session->sensorData.size()){
+    return Fail(engine,FK_ERROR_ARGUMENT,"fk_commit_points: more points than the last fk_point_buffer");
+  }
+
+  engine->committed += count;
+  engine->session->sensorData.resize(engine->committed);
+
+  return FK_OK;
+}
+
+int fk_reset_word(fk_engine* engine)
+{
+  if(engine == NULL){
+    return FK_ERROR_ARGUMENT;
+  }
+
+  engine->committed = 0;
+  engine->session->sensorData.clear();
+
+  return FK_OK;
+}
+
+int fk_end_word(fk_engine* engine)
+{
+  if(engine == NULL){
+    return FK_ERROR_ARGUMENT;
+  }
+
+  try{
+    engine->session->sensorData.resize(engine->committed);  //drops an uncommitted fk_point_buffer
+    engine->session->DecodeSensorData(engine->path);
+  }
+  catch(std::exception& e){
+    engine->session->results.clear();
+    fk_reset_word(engine);
+    return Fail(engine,FK_ERROR_INTERNAL,e.what());
+  }
+  catch(...){
+    engine->session->results.clear();
+    fk_reset_word(engine);
+    return Fail(engine,FK_ERROR_INTERNAL,"unknown exception");
+  }
+  fk_reset_word(engine);
+
+  return (int)engine->session->results.size();
+}
+
+int fk_get_results(fk_engine* engine, fk_result* results, size_t maxResults)
+{
+  size_t i;
+  SearchResultIt it;
+
+  if(engine == NULL || (results == NULL && maxResults > 0)){
+    return Fail(engine,FK_ERROR_ARGUMENT,"fk_get_results: null engine or results");
+  }
+
+  SearchResults& decoded = engine->session->results;
+  for(i = 0, it = decoded.begin(); i < maxResults && it != decoded.end(); ++it, i++){
+    strncpy(results[i].word,it->first.c_str(),FK_MAX_WORD_LENGTH - 1);
+    results[i].word[FK_MAX_WORD_LENGTH - 1] = '\0';
+    results[i].score = (float)it->second;
+  }
+
+  return (int)i;
+}
+
+int fk_decode_points(fk_engine* engine, const fk_point* points, size_t count)
+{
+  if(engine == NULL || (points == NULL && count > 0)){
+    return Fail(engine,FK_ERROR_ARGUMENT,"fk_decode_points: null engine or points");
+  }
+
+  fk_reset_word(engine);
+  try{
+    engine->session->Decode(PointSpan((const Point*)points,count),engine->path);
+  }
+  catch(std::exception& e){
+    engine->session->results.clear();
+    return Fail(engine,FK_ERROR_INTERNAL,e.what());
+  }
+  catch(...){
+    engine->session->results.clear();
+    return Fail(engine,FK_ERROR_INTERNAL,"unknown exception");
+  }
+
+  return (int)engine->session->results.size();
+}
+
+double fk_last_decode_us(fk_engine* engine)
+{
+  return (engine != NULL) ? engine->session->lastDecodeUs : 0.0;
+}
+
+const char* fk_last_error(fk_engine* engine)
+{
+  return (engine != NULL) ? engine->lastError.c_str() : "null engine";
+}
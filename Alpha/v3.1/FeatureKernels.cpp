@@ -0,0 +1,277 @@
+#include "Controller.hpp"
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/*
+  Kinematic features of every sliding window of a trace, in one pass. The LayoutManager functions (StDev_X/Y,
+  CoStdDeviation, CoVariance, AvgDistance, AvgDyDx, AvgTheta) each take one window of a vector<Point> and loop over it
+  on their own, so Process2 walks every window three times and Process3 recomputes CoStdDeviation for windows it has
+  already seen.
+
+  Data model: the trace is copied once into structure-of-arrays xs/ys (doubles, so the arithmetic is exactly the
+  scalar functions'), and the per-sample deltas into dxs/dys. Window k covers samples [k, k+width). The kernels run
+  FEATURE_LANES windows at a time, one window per lane, with unaligned loads at k+j for each j < width; every lane does
+  the same adds, in the same order, as the scalar loop does for its window, so the results are bit-identical, not
+  just close. WindowFeatures::Test checks this.
+
+  There is a window for every sample. Windows that run off the end of the trace are truncated but still divided by
+  width, as the scalar functions do. The delta features (distance, dydx, theta) of window k sum the steps k..k+width-1
+  that exist; the scalar functions read one sample past the end of the trace for the last window instead.
+
+  atan2 has no SSE/AVX instruction, so the step angles are the one scalar loop, and only computed when asked for.
+
+  x86-64 always has SSE2, so that path is the default; the AVX one is only compiled in with -mavx (make SIMDFLAGS=-mavx).
+*/
+
+#if defined(__AVX__)
+#define FEATURE_LANES 4
+typedef __m256d Lanes;
+static inline Lanes Load(const double* p){ return _mm256_loadu_pd(p); }
+static inline void Store(double* p, Lanes v){ _mm256_storeu_pd(p,v); }
+static inline Lanes Splat(double d){ return _mm256_set1_pd(d); }
+static inline Lanes Add(Lanes a, Lanes b){ return _mm256_add_pd(a,b); }
+static inline Lanes Sub(Lanes a, Lanes b){ return _mm256_sub_pd(a,b); }
+static inline Lanes Mul(Lanes a, Lanes b){ return _mm256_mul_pd(a,b); }
+static inline Lanes Div(Lanes a, Lanes b){ return _mm256_div_pd(a,b); }
+static inline Lanes Sqrt(Lanes a){ return _mm256_sqrt_pd(a); }
+static inline Lanes SlopeOrZero(Lanes dy, Lanes dx){ return _mm256_and_pd(_mm256_cmp_pd(dx,_mm256_setzero_pd(),_CMP_NEQ_UQ),_mm256_div_pd(dy,dx)); }
+#elif defined(__SSE2__)
+#define FEATURE_LANES 2
+typedef __m128d Lanes;
+static inline Lanes Load(const double* p){ return _mm_loadu_pd(p); }
+static inline void Store(double* p, Lanes v){ _mm_storeu_pd(p,v); }
+static inline Lanes Splat(double d){ return _mm_set1_pd(d); }
+static inline Lanes Add(Lanes a, Lanes b){ return _mm_add_pd(a,b); }
+static inline Lanes Sub(Lanes a, Lanes b){ return _mm_sub_pd(a,b); }
+static inline Lanes Mul(Lanes a, Lanes b){ return _mm_mul_pd(a,b); }
+static inline Lanes Div(Lanes a, Lanes b){ return _mm_div_pd(a,b); }
+static inline Lanes Sqrt(Lanes a){ return _mm_sqrt_pd(a); }
+static inline Lanes SlopeOrZero(Lanes dy, Lanes dx){ return _mm_and_pd(_mm_cmpneq_pd(dx,_mm_setzero_pd()),_mm_div_pd(dy,dx)); }
+#else
+#define FEATURE_LANES 1
+typedef double Lanes;
+static inline Lanes Load(const double* p){ return *p; }
+static inline void Store(double* p, Lanes v){ *p = v; }
+static inline Lanes Splat(double d){ return d; }
+static inline Lanes Add(Lanes a, Lanes b){ return a + b; }
+static inline Lanes Sub(Lanes a, Lanes b){ return a - b; }
+static inline Lanes Mul(Lanes a, Lanes b){ return a * b; }
+static inline Lanes Div(Lanes a, Lanes b){ return a / b; }
+static inline Lanes Sqrt(Lanes a){ return sqrt(a); }
+static inline Lanes SlopeOrZero(Lanes dy, Lanes dx){ return (dx != 0.0) ? dy / dx : 0.0; }
+#endif
+
+WindowFeatures::WindowFeatures()
+{
+  width = 0;
+  numWindows = 0;
+}
+
+//computes the features in the mask (WindowFeatureMask bits) for every window of pts; the others are left empty
+void WindowFeatures::Compute(const PointSpan& pts, int windowWidth, int mask)
+{
+  size_t n = pts.size(), i;
+
+  width = windowWidth;
+  numWindows = n;
+  xs.resize(n);
+  ys.resize(n);
+  for(i = 0; i < n; i++){
+    xs[i] = pts[i].X;
+    ys[i] = pts[i].Y;
+  }
+
+  sigmaX.clear();
+  sigmaY.clear();
+  coStdDev.clear();
+  coVariance.clear();
+  avgDistance.clear();
+  avgDyDx.clear();
+  avgTheta.clear();
+  if(n == 0 || width <= 0){
+    return;
+  }
+
+  if(mask & (FEATURE_STDEV | FEATURE_COVARIANCE)){
+    ComputeSpread(mask);
+  }
+  if(mask & (FEATURE_DISTANCE | FEATURE_DYDX | FEATURE_THETA)){
+    ComputeSteps(mask);
+  }
+}
+
+//the per-axis standard deviations, their product, and the covariance
+void WindowFeatures::ComputeSpread(int mask)
+{
+  size_t n = numWindows, k, full = (n >= width) ? n - width + 1 : 0;
+  int j;
+  bool stDev = (mask & FEATURE_STDEV) != 0, coVar = (mask & FEATURE_COVARIANCE) != 0;
+  Lanes w = Splat((double)width), muX, muY, ssX, ssY, cv, dx, dy;
+
+  if(stDev){
+    sigmaX.resize(n);
+    sigmaY.resize(n);
+    coStdDev.resize(n);
+  }
+  if(coVar){
+    coVariance.resize(n);
+  }
+
+  for(k = 0; k + FEATURE_LANES <= full; k += FEATURE_LANES){
+    muX = muY = Splat(0.0);
+    for(j = 0; j < width; j++){
+      muX = Add(muX,Load(&xs[k+j]));
+      muY = Add(muY,Load(&ys[k+j]));
+    }
+    muX = Div(muX,w);
+    muY = Div(muY,w);
+
+    ssX = ssY = cv = Splat(0.0);
+    for(j = 0; j < width; j++){
+      dx = Sub(Load(&xs[k+j]),muX);
+      dy = Sub(Load(&ys[k+j]),muY);
+      ssX = Add(ssX,Mul(dx,dx));
+      ssY = Add(ssY,Mul(dy,dy));
+      cv = Add(cv,Mul(dx,dy));
+    }
+    if(stDev){
+      ssX = Sqrt(ssX);
+      ssY = Sqrt(ssY);
+      Store(&sigmaX[k],ssX);
+      Store(&sigmaY[k],ssY);
+      Store(&coStdDev[k],Mul(ssX,ssY));
+    }
+    if(coVar){
+      Store(&coVariance[k],Div(cv,w));
+    }
+  }
+
+  //the windows left over from the last full block, and the truncated ones
+  for(; k < n; k++){
+    double mx = 0.0, my = 0.0, sx = 0.0, sy = 0.0, c = 0.0;
+    size_t end = std::min(k + width,n), i;
+    for(i = k; i < end; i++){
+      mx += xs[i];
+      my += ys[i];
+    }
+    mx /= width;
+    my /= width;
+    for(i = k; i < end; i++){
+      sx += (xs[i] - mx) * (xs[i] - mx);
+      sy += (ys[i] - my) * (ys[i] - my);
+      c += (xs[i] - mx) * (ys[i] - my);
+    }
+    if(stDev){
+      sigmaX[k] = sqrt(sx);
+      sigmaY[k] = sqrt(sy);
+      coStdDev[k] = sigmaX[k] * sigmaY[k];
+    }
+    if(coVar){
+      coVariance[k] = c / width;
+    }
+  }
+}
+
+//the mean step length, slope and direction over each window's steps
+void WindowFeatures::ComputeSteps(int mask)
+{
+  size_t n = numWindows, steps = n - 1, k, i, full = (steps >= width) ? steps - width + 1 : 0;
+  int j;
+  bool distance = (mask & FEATURE_DISTANCE) != 0, dydx = (mask & FEATURE_DYDX) != 0, theta = (mask & FEATURE_THETA) != 0;
+  Lanes w = Splat((double)width), dx, dy, sumDist, sumSlope, sumTheta;
+
+  dxs.resize(steps);
+  dys.resize(steps);
+  stepDistances.resize(steps);
+  stepSlopes.resize(steps);
+  stepThetas.resize(theta ? steps : 0);
+  for(i = 0; i < steps; i++){
+    dxs[i] = xs[i+1] - xs[i];
+    dys[i] = ys[i+1] - ys[i];
+  }
+  for(i = 0; i + FEATURE_LANES <= steps; i += FEATURE_LANES){
+    dx = Load(&dxs[i]);
+    dy = Load(&dys[i]);
+    Store(&stepDistances[i],Sqrt(Add(Mul(dx,dx),Mul(dy,dy))));
+    Store(&stepSlopes[i],SlopeOrZero(dy,dx));
+  }
+  for(; i < steps; i++){
+    stepDistances[i] = sqrt(dxs[i] * dxs[i] + dys[i] * dys[i]);
+    stepSlopes[i] = (dxs[i] != 0.0) ? dys[i] / dxs[i] : 0.0;
+  }
+  for(i = 0; theta && i < steps; i++){
+    stepThetas[i] = (dxs[i] != 0.0) ? atan2(dys[i],dxs[i]) : 0.0;
+  }
+
+  avgDistance.resize(distance ? n : 0);
+  avgDyDx.resize(dydx ? n : 0);
+  avgTheta.resize(theta ? n : 0);
+
+  for(k = 0; k + FEATURE_LANES <= full; k += FEATURE_LANES){
+    sumDist = sumSlope = sumTheta = Splat(0.0);
+    for(j = 0; j < width; j++){
+      sumDist = Add(sumDist,Load(&stepDistances[k+j]));
+      sumSlope = Add(sumSlope,Load(&stepSlopes[k+j]));
+      if(theta){
+        sumTheta = Add(sumTheta,Load(&stepThetas[k+j]));
+      }
+    }
+    if(distance){
+      Store(&avgDistance[k],Div(sumDist,w));
+    }
+    if(dydx){
+      Store(&avgDyDx[k],Div(sumSlope,w));
+    }
+    if(theta){
+      Store(&avgTheta[k],Div(sumTheta,w));
+    }
+  }
+
+  for(; k < n; k++){
+    double d = 0.0, s = 0.0, t = 0.0;
+    for(i = k; i < steps && i < k + width; i++){
+      d += stepDistances[i];
+      s += stepSlopes[i];
+      t += theta ? stepThetas[i] : 0.0;
+    }
+    if(distance){
+      avgDistance[k] = d / width;
+    }
+    if(dydx){
+      avgDyDx[k] = s / width;
+    }
+    if(theta){
+      avgTheta[k] = t / width;
+    }
+  }
+}
+
+/*
+  Computes every feature of pts, and compares each window's against the LayoutManager function for the same window.
+  Returns the number that differ at all. Windows whose last step would read past the end of pts, for the scalar step
+  functions, aren't compared for those features.
+*/
+int WindowFeatures::Test(const PointSpan& pts, int windowWidth, LayoutManager* layoutManager)
+{
+  int mismatches = 0;
+
+  Compute(pts,windowWidth,FEATURE_ALL);
+  for(size_t k = 0; k < numWindows; k++){
+    //StDev_X is the spread of the y values, and StDev_Y of the x values
+    mismatches += (sigmaX[k] != layoutManager->StDev_Y(pts,k,width));
+    mismatches += (sigmaY[k] != layoutManager->StDev_X(pts,k,width));
+    mismatches += (coStdDev[k] != layoutManager->CoStdDeviation(pts,k,width));
+    mismatches += (coVariance[k] != layoutManager->CoVariance(pts,k,width));
+    if(k + width < numWindows){
+      mismatches += (avgDistance[k] != layoutManager->AvgDistance(pts,k,width));
+      mismatches += (avgDyDx[k] != layoutManager->AvgDyDx(pts,k,width));
+      mismatches += (avgTheta[k] != layoutManager->AvgTheta(pts,k,width));
+    }
+  }
+
+  return mismatches;
+}
@@ -0,0 +1,82 @@
+#include "Controller.hpp"
+
+/*
+  Online smoothing of gaze samples ahead of clustering: a one-euro filter (Casiez, Roussel and Vogel, CHI 2012).
+  Tracker jitter during a fixation is what makes Process3's spread trigger flicker and emit spurious clusters, which
+  MergeClusters then only partly cleans up. A fixed low-pass would smooth the jitter but lag the saccades, and the lag
+  smears each fixation's samples into the next key. The one-euro filter is a low-pass whose cutoff rises with speed:
+
+    speed    = low-pass of |p - prev| / dt, at dCutoff
+    cutoff   = minCutoff + beta * speed
+    filtered = filtered + alpha(cutoff) * (p - filtered),   alpha(f) = dt / (dt + 1 / (2 pi f))
+
+  so a fixation (low speed) is smoothed hard, and a saccade (high speed) passes with little lag. The two axes share
+  one cutoff, from the 2D speed, so a diagonal saccade isn't lagged more on one axis than the other.
+
+  Each sample is O(1): a few multiplies and adds, one sqrt and two divides, with no history beyond the last sample, so
+  it runs as samples arrive (GazeStream) as well as over a whole word (DecodeSession). At a fixed sample rate the
+  speed's alpha is a constant, and the position's alpha only depends on the speed, so the divides could be a table
+  lookup in a fixed-point port.
+*/
+
+GazeFilter::GazeFilter(double minCutoffHz, double betaParam, double dCutoffHz)
+{
+  minCutoff = minCutoffHz;
+  beta = betaParam;
+  dCutoff = dCutoffHz;
+  Reset();
+}
+
+//forgets the stream so far; the next sample passes unfiltered
+void GazeFilter::Reset(void)
+{
+  primed = false;
+  x = y = 0.0;
+  speed = 0.0;
+  lastUs = 0;
+}
+
+//the smoothing factor of a first-order low-pass at cutoffHz, for a step of dt seconds
+double GazeFilter::Alpha(double cutoffHz, double dt)
+{
+  return dt / (dt + 1.0 / (2.0 * M_PI * cutoffHz));
+}
+
+//filters the sample taken at timeUs (any clock, but increasing)
+Point GazeFilter::Filter(const Point& p, U64 timeUs)
+{
+  double dt, dx, dy, cutoff, a;
+
+  if(!primed || timeUs <= lastUs){
+    //the first sample, or a repeated timestamp, which carries no speed information
+    if(!primed){
+      x = p.X;
+      y = p.Y;
+      primed = true;
+      lastUs = timeUs;
+    }
+    return Point((short int)lround(x),(short int)lround(y));
+  }
+
+  dt = (timeUs - lastUs) / 1.0e6;
+  lastUs = timeUs;
+  dx = p.X - x;
+  dy = p.Y - y;
+  speed += Alpha(dCutoff,dt) * (sqrt(dx * dx + dy * dy) / dt - speed);
+  cutoff = minCutoff + beta * speed;
+  a = Alpha(cutoff,dt);
+  x += a * dx;
+  y += a * dy;
+
+  return Point((short int)lround(x),(short int)lround(y));
+}
+
+//filters a whole word, sampled every samplePeriodUs, from a fresh state into out
+void GazeFilter::FilterWord(const PointSpan& points, U64 samplePeriodUs, vector<Point>& out)
+{
+  Reset();
+  out.resize(points.size());
+  for(size_t i = 0; i < points.size(); i++){
+    out[i] = Filter(points[i],i * samplePeriodUs);
+  }
+}
@@ -0,0 +1,230 @@
+#include "Controller.hpp"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/*
+  Binary gaze trace files. The text traces (TestInput/EyeInputs/Test1/word1.txt...) hold one word each, as x<TAB>y
+  lines with no timestamps, and SingularityBuilder::BuildTestData parses them a line at a time. A gaze trace file holds
+  any number of sessions of any number of words, with the time of every sample, in a layout the engine reads in place:
+
+    GazeTraceHeader
+    GazeBlockHeader (GAZE_BLOCK_SESSION)
+    GazeBlockHeader (GAZE_BLOCK_WORD) | Point points[n] | U32 deltaUs[n]
+    GazeBlockHeader (GAZE_BLOCK_WORD) | ...
+    GazeBlockHeader (GAZE_BLOCK_SESSION)
+    ...
+
+  Points are int16 x/y, layout-compatible with Point. Times are deltas in microseconds from the previous sample, and a
+  word block's startUs is the absolute time of its first sample, so gaps between words cost nothing. Every block is a
+  multiple of 8 bytes, so everything in the file stays aligned. Multi-byte fields are in host (little-endian) order.
+
+  GazeTraceFile maps the file read-only and walks the block headers once to index the words. A word's points are then
+  a PointSpan straight into the mapping, which DecodeSession::Decode and SingularityBuilder::Process3 read in place, so
+  replaying a large corpus costs page faults rather than parsing.
+*/
+
+GazeTraceWriter::GazeTraceWriter()
+{
+  file = NULL;
+  sessionId = 0;
+  inSession = false;
+}
+
+GazeTraceWriter::~GazeTraceWriter()
+{
+  if(file != NULL){
+    Close();
+  }
+}
+
+bool GazeTraceWriter::Open(const string& fname)
+{
+  file = fopen(fname.c_str(),"wb");
+  if(file == NULL){
+    cout << "ERROR could not open file: " << fname << endl;
+    return false;
+  }
+
+  //the counts are filled in by Close
+  memset(&header,0,sizeof(header));
+  header.magic = GAZE_TRACE_MAGIC;
+  header.version = GAZE_TRACE_VERSION;
+  header.blockHeaderSize = sizeof(GazeBlockHeader);
+  inSession = false;
+
+  return fwrite(&header,sizeof(header),1,file) == 1;
+}
+
+bool GazeTraceWriter::BeginSession(const string& name, U64 startUs)
+{
+  GazeBlockHeader block;
+
+  memset(&block,0,sizeof(block));
+  block.type = GAZE_BLOCK_SESSION;
+  block.sessionId = sessionId = header.numSessions++;
+  block.startUs = startUs;
+  SetLabel(block,name);
+  inSession = true;
+
+  return fwrite(&block,sizeof(block),1,file) == 1;
+}
+
+//timesUs holds each point's time, in us on the file's clock; a word before any BeginSession starts an unnamed session
+bool GazeTraceWriter::AppendWord(const string& label, const PointSpan& points, const U64* timesUs)
+{
+  GazeBlockHeader block;
+
+  if(!inSession && !BeginSession("",points.empty() ? 0 : timesUs[0])){
+    return false;
+  }
+
+  deltas.resize(points.size());
+  for(size_t i = 0; i < points.size(); i++){
+    deltas[i] = (i == 0) ? 0 : (U32)(timesUs[i] - timesUs[i-1]);
+  }
+
+  memset(&block,0,sizeof(block));
+  block.type = GAZE_BLOCK_WORD;
+  block.sessionId = sessionId;
+  block.numSamples = points.size();
+  block.startUs = points.empty() ? 0 : timesUs[0];
+  SetLabel(block,label);
+
+  header.numWords++;
+  header.numSamples += points.size();
+  if(fwrite(&block,sizeof(block),1,file) != 1){
+    return false;
+  }
+  if(points.empty()){
+    return true;
+  }
+
+  return fwrite(points.data,sizeof(Point),points.size(),file) == points.size() && fwrite(&deltas[0],sizeof(U32),deltas.size(),file) == deltas.size();
+}
+
+//writes the final counts into the header. False if any write failed.
+bool GazeTraceWriter::Close(void)
+{
+  bool ok;
+
+  ok = fseek(file,0,SEEK_SET) == 0 && fwrite(&header,sizeof(header),1,file) == 1;
+  ok = (fclose(file) == 0) && ok;
+  file = NULL;
+  if(!ok){
+    cout << "ERROR failed writing gaze trace file" << endl;
+  }
+
+  return ok;
+}
+
+void GazeTraceWriter::SetLabel(GazeBlockHeader& block, const string& label)
+{
+  strncpy(block.label,label.c_str(),GAZE_TRACE_LABEL_SIZE - 1);
+  block.label[GAZE_TRACE_LABEL_SIZE - 1] = '\0';
+}
+
+GazeTraceFile::GazeTraceFile()
+{
+  fd = -1;
+  base = NULL;
+  length = 0;
+}
+
+GazeTraceFile::~GazeTraceFile()
+{
+  Close();
+}
+
+//maps fname and indexes its words. False, with nothing mapped, if the file is malformed.
+bool GazeTraceFile::Open(const string& fname)
+{
+  struct stat st;
+  size_t pos;
+  const GazeBlockHeader* block;
+  GazeWord word;
+  U64 numSamples = 0;
+
+  static_assert(sizeof(Point) == 2 * sizeof(short int), "gaze trace points must be layout-compatible with Point");
+  static_assert(sizeof(GazeBlockHeader) % 8 == 0, "gaze trace blocks must keep 8-byte alignment");
+
+  Close();
+  fd = open(fname.c_str(),O_RDONLY);
+  if(fd < 0 || fstat(fd,&st) != 0){
+    cout << "ERROR could not open gaze trace file: " << fname << endl;
+    Close();
+    return false;
+  }
+  length = st.st_size;
+  if(length < sizeof(GazeTraceHeader)){
+    cout << "ERROR not a gaze trace file: " << fname << endl;
+    Close();
+    return false;
+  }
+  base = (const char*)mmap(NULL,length,PROT_READ,MAP_PRIVATE,fd,0);
+  if(base == (const char*)MAP_FAILED){
+    base = NULL;
+    cout << "ERROR could not map gaze trace file: " << fname << endl;
+    Close();
+    return false;
+  }
+  madvise((void*)base,length,MADV_SEQUENTIAL);
+
+  memcpy(&header,base,sizeof(header));
+  if(header.magic != GAZE_TRACE_MAGIC || header.version != GAZE_TRACE_VERSION || header.blockHeaderSize != sizeof(GazeBlockHeader)){
+    cout << "ERROR not a gaze trace file, or an unsupported version: " << fname << endl;
+    Close();
+    return false;
+  }
+
+  words.reserve(header.numWords);
+  sessionNames.reserve(header.numSessions);
+  for(pos = sizeof(GazeTraceHeader); pos + sizeof(GazeBlockHeader) <= length; ){
+    block = (const GazeBlockHeader*)(base + pos);
+    pos += sizeof(GazeBlockHeader);
+    if(block->label[GAZE_TRACE_LABEL_SIZE - 1] != '\0'){
+      break;
+    }
+    if(block->type == GAZE_BLOCK_SESSION && block->sessionId == sessionNames.size()){
+      sessionNames.push_back(block->label);
+    }
+    else if(block->type == GAZE_BLOCK_WORD && block->sessionId < sessionNames.size() && block->numSamples <= (length - pos) / (sizeof(Point) + sizeof(U32))){
+      word.sessionId = block->sessionId;
+      word.startUs = block->startUs;
+      word.label = block->label;
+      word.points = PointSpan((const Point*)(base + pos),block->numSamples);
+      word.deltaUs = (const U32*)(base + pos + block->numSamples * sizeof(Point));
+      words.push_back(word);
+      numSamples += block->numSamples;
+      pos += block->numSamples * (sizeof(Point) + sizeof(U32));
+    }
+    else{
+      break;
+    }
+  }
+
+  //an unfinished file (the writer never got to Close) has zero counts in its header
+  if(pos != length || words.size() != header.numWords || sessionNames.size() != header.numSessions || numSamples != header.numSamples){
+    cout << "ERROR gaze trace file is truncated or corrupt at byte " << pos << ": " << fname << endl;
+    Close();
+    return false;
+  }
+
+  return true;
+}
+
+void GazeTraceFile::Close(void)
+{
+  if(base != NULL){
+    munmap((void*)base,length);
+  }
+  if(fd >= 0){
+    close(fd);
+  }
+  fd = -1;
+  base = NULL;
+  length = 0;
+  words.clear();
+  sessionNames.clear();
+}
@@ -1,6 +1,8 @@
 #ifndef HEADER_HPP
 #include "Header.hpp"
 #endif
+#include <fcntl.h>
+#include <unistd.h>
 
 char ToLower(char c)
 {
@@ -141,3 +143,44 @@ int Tokenize(char* ptrs[], char buf[BUFSIZE], const string& delims)
   return tokCt;
 }
 
+
+//nearest-rank percentile, p in [0,1]. Takes a copy, since it sorts.
+double Percentile(vector<double> samples, double p)
+{
+  int rank;
+
+  if(samples.empty()){
+    return 0.0;
+  }
+  std::sort(samples.begin(),samples.end());
+  rank = (int)ceil(p * samples.size()) - 1;
+  if(rank < 0){
+    rank = 0;
+  }
+
+  return samples[rank];
+}
+
+static int realStdoutFd = -1;  //the real stdout, while it's redirected
+static int nullFd = -1;
+
+/*
+  Points stdout (both cout and printf) at /dev/null, or back. The tools use it to keep the models' load messages and
+  the decoders' per-word prints out of their reports; what they do want printed meanwhile can go to RealStdout.
+*/
+void Silence(bool silent)
+{
+  if(realStdoutFd < 0){
+    realStdoutFd = dup(STDOUT_FILENO);
+    nullFd = open("/dev/null",O_WRONLY);
+  }
+  cout << flush;
+  fflush(stdout);
+  dup2(silent ? nullFd : realStdoutFd, STDOUT_FILENO);
+}
+
+//the real stdout, even while Silenced
+int RealStdout(void)
+{
+  return realStdoutFd < 0 ? STDOUT_FILENO : realStdoutFd;
+}
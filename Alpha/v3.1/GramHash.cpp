@@ -0,0 +1,278 @@
+#include "Controller.hpp"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+/*
+  A static, minimal perfect hash table for the sparse char n-gram orders (quadgrams, pentagrams), as a compact
+  alternative to CharGramModel (unordered_map), which spends ~40 bytes per gram on buckets and nodes.
+
+  The hash function is "hash and displace" (CHD/PTHash style): keys are hashed into buckets of ~GRAM_HASH_BUCKET_SIZE keys,
+  and each bucket stores a pilot, chosen at build time so that (keyHash ^ Mix(pilot)) % numKeys sends every key in the
+  bucket to a distinct free slot. Over all buckets that's a bijection of the keys onto [0,numKeys), so there's no
+  collision handling and no empty slots. A lookup is one pilot read and one slot read.
+
+  Since a perfect hash maps ANY key to some slot, each slot also holds an 8-bit fingerprint of its key. Grams not in
+  the model are rejected unless their fingerprint happens to match (1 in 256), in which case they get some other gram's
+  probability instead of DEFAULT_LOG_PROB. Values are quantized to 8 bits, linearly over the model's -log2 range, so the
+  error is at most half a step (about 0.04 bits for a 0-20 bit range).
+
+  Memory is 4 bytes per bucket (1 per key) plus 2 per key, about 3 bytes per gram. The table is built offline by
+  gramHashBuilder and saved in a flat format, which Load() maps directly (read-only, shared between processes).
+
+  File layout: GramHashHeader | U32 pilots[numBuckets] | GramHashSlot slots[numKeys]
+*/
+
+#define GRAM_HASH_MAGIC 0x48504D47  //"GMPH"
+#define GRAM_HASH_MAX_PILOT (1U << 24)  //if some bucket can't be placed with a pilot below this, retry with a new seed
+#define GRAM_HASH_MAX_SEEDS 16
+
+GramHash::GramHash()
+{
+  header = NULL;
+  pilots = NULL;
+  slots = NULL;
+  mapping = NULL;
+  mappingSize = 0;
+}
+
+GramHash::~GramHash()
+{
+  Unload();
+}
+
+void GramHash::Unload(void)
+{
+  if(mapping != NULL){
+    munmap(mapping,mappingSize);
+  }
+  mapping = NULL;
+  mappingSize = 0;
+  header = NULL;
+  pilots = NULL;
+  slots = NULL;
+}
+
+bool GramHash::IsLoaded(void)
+{
+  return header != NULL;
+}
+
+U32 GramHash::Size(void)
+{
+  return (header != NULL) ? header->numKeys : 0;
+}
+
+size_t GramHash::MemoryUsage(void)
+{
+  return mappingSize;
+}
+
+//splitmix64 finalizer: a bijection on 64 bits, so distinct keys never share a hash
+U64 GramHash::Mix(U64 x)
+{
+  x ^= x >> 30;
+  x *= 0xbf58476d1ce4e5b9ULL;
+  x ^= x >> 27;
+  x *= 0x94d049bb133111ebULL;
+  x ^= x >> 31;
+  return x;
+}
+
+U64 GramHash::Hash(U32 key, U64 seed)
+{
+  return Mix((U64)key + seed);
+}
+
+U8 GramHash::Fingerprint(U64 hash)
+{
+  return (U8)Mix(hash ^ 0x9e3779b97f4a7c15ULL);
+}
+
+/*
+  Looks up key, returning false if it's not in the table (up to fingerprint collisions). On success, value is the
+  dequantized -log2 probability.
+*/
+bool GramHash::Find(U32 key, double& value)
+{
+  U64 hash;
+  U32 slot;
+
+  hash = Hash(key,header->seed);
+  slot = (U32)((hash ^ Mix(pilots[(hash >> 32) % header->numBuckets])) % header->numKeys);
+  if(slots[slot].fingerprint != Fingerprint(hash)){
+    return false;
+  }
+
+  value = header->minValue + header->step * (double)slots[slot].value;
+  return true;
+}
+
+/*
+  Tries to find pilots placing every key, for one seed. Buckets are placed largest first, while the table is
+  still mostly empty, which is what keeps the search fast; the last buckets are singletons that only need one free slot.
+*/
+bool GramHash::FindPilots(const vector<U32>& keys, U64 seed, U32 numBuckets, vector<U32>& pilotsOut, vector<U32>& slotOf)
+{
+  U32 i, j, b, pilot, n = keys.size();
+  U64 pilotHash;
+  vector<U64> hashes(n);
+  vector<vector<U32> > buckets(numBuckets);
+  vector<pair<U32,U32> > order(numBuckets);  //<bucket size, bucket>
+  vector<bool> taken(n,false);
+  vector<U32> positions;
+  bool ok;
+
+  for(i = 0; i < n; i++){
+    hashes[i] = Hash(keys[i],seed);
+    buckets[(hashes[i] >> 32) % numBuckets].push_back(i);
+  }
+  for(b = 0; b < numBuckets; b++){
+    order[b] = pair<U32,U32>(buckets[b].size(),b);
+  }
+  std::sort(order.rbegin(),order.rend());
+
+  pilotsOut.assign(numBuckets,0);
+  slotOf.assign(n,0);
+  for(b = 0; b < numBuckets && order[b].first > 0; b++){
+    vector<U32>& bucket = buckets[order[b].second];
+    for(pilot = 0; pilot < GRAM_HASH_MAX_PILOT; pilot++){
+      pilotHash = Mix(pilot);
+      positions.clear();
+      ok = true;
+      for(j = 0; ok && j < bucket.size(); j++){
+        positions.push_back((U32)((hashes[bucket[j]] ^ pilotHash) % n));
+        ok = !taken[positions[j]] && std::find(positions.begin(),positions.begin() + j,positions[j]) == positions.begin() + j;
+      }
+      if(ok){
+        break;
+      }
+    }
+    if(pilot == GRAM_HASH_MAX_PILOT){
+      return false;
+    }
+
+    pilotsOut[order[b].second] = pilot;
+    for(j = 0; j < bucket.size(); j++){
+      taken[positions[j]] = true;
+      slotOf[bucket[j]] = positions[j];
+    }
+  }
+
+  return true;
+}
+
+/*
+  Builds a table from a CharGramModel and writes it to mphFile. Keys are whatever key scheme the model uses
+  (eg GetQuadgramKey), so lookups just pass the same key. Returns false on failure.
+*/
+bool GramHash::Build(CharGramModel& model, const string& mphFile)
+{
+  U32 i, numBuckets, attempt;
+  U64 seed = 0;
+  double minValue, maxValue, step;
+  vector<U32> keys;
+  vector<double> values;
+  vector<U32> pilotsOut, slotOf;
+  vector<GramHashSlot> slotsOut;
+  GramHashHeader hdr;
+  FILE* ofile;
+  bool found = false, written;
+
+  if(model.empty()){
+    cout << "ERROR GramHash::Build called with an empty model" << endl;
+    return false;
+  }
+
+  minValue = maxValue = model.begin()->second;
+  for(CharGramIt it = model.begin(); it != model.end(); ++it){
+    keys.push_back(it->first);
+    values.push_back(it->second);
+    minValue = std::min(minValue,it->second);
+    maxValue = std::max(maxValue,it->second);
+  }
+  step = (maxValue > minValue) ? ((maxValue - minValue) / 255.0) : 1.0;
+
+  numBuckets = keys.size() / GRAM_HASH_BUCKET_SIZE + 1;
+  for(attempt = 0; !found && attempt < GRAM_HASH_MAX_SEEDS; attempt++){
+    seed = Mix(0x5eed + attempt);
+    found = FindPilots(keys,seed,numBuckets,pilotsOut,slotOf);
+  }
+  if(!found){
+    cout << "ERROR GramHash::Build could not place all keys after " << GRAM_HASH_MAX_SEEDS << " seeds" << endl;
+    return false;
+  }
+
+  slotsOut.resize(keys.size());
+  for(i = 0; i < keys.size(); i++){
+    slotsOut[slotOf[i]].fingerprint = Fingerprint(Hash(keys[i],seed));
+    slotsOut[slotOf[i]].value = (U8)std::min(255.0,floor((values[i] - minValue) / step + 0.5));
+  }
+
+  memset(&hdr,0,sizeof(hdr));
+  hdr.magic = GRAM_HASH_MAGIC;
+  hdr.numKeys = keys.size();
+  hdr.numBuckets = numBuckets;
+  hdr.seed = seed;
+  hdr.minValue = minValue;
+  hdr.step = step;
+
+  ofile = fopen(mphFile.c_str(),"wb");
+  if(ofile == NULL){
+    cout << "ERROR could not open file: " << mphFile << endl;
+    return false;
+  }
+  written = fwrite(&hdr,sizeof(hdr),1,ofile) == 1;
+  written = written && fwrite(&pilotsOut[0],sizeof(U32),pilotsOut.size(),ofile) == pilotsOut.size();
+  written = written && fwrite(&slotsOut[0],sizeof(GramHashSlot),slotsOut.size(),ofile) == slotsOut.size();
+  written = (fclose(ofile) == 0) && written;
+  if(!written){
+    cout << "ERROR could not write file (a partial table is rejected by Load): " << mphFile << endl;
+    return false;
+  }
+
+  return true;
+}
+
+//maps a table written by Build(). Returns false (leaving the table unloaded) if the file is missing or malformed.
+bool GramHash::Load(const string& mphFile)
+{
+  int fd;
+  struct stat st;
+  const GramHashHeader* hdr;
+
+  Unload();
+  fd = open(mphFile.c_str(),O_RDONLY);
+  if(fd < 0){
+    return false;
+  }
+  if(fstat(fd,&st) != 0 || st.st_size < sizeof(GramHashHeader)){
+    cout << "ERROR malformed gram hash file: " << mphFile << endl;
+    close(fd);
+    return false;
+  }
+
+  mappingSize = st.st_size;
+  mapping = mmap(NULL,mappingSize,PROT_READ,MAP_SHARED,fd,0);
+  close(fd);
+  if(mapping == MAP_FAILED){
+    cout << "ERROR could not mmap gram hash file: " << mphFile << endl;
+    mapping = NULL;
+    mappingSize = 0;
+    return false;
+  }
+
+  hdr = (const GramHashHeader*)mapping;
+  if(hdr->magic != GRAM_HASH_MAGIC || hdr->numKeys == 0 || hdr->numBuckets == 0 || mappingSize != sizeof(GramHashHeader) + (size_t)hdr->numBuckets * sizeof(U32) + (size_t)hdr->numKeys * sizeof(GramHashSlot)){
+    cout << "ERROR malformed gram hash file: " << mphFile << endl;
+    Unload();
+    return false;
+  }
+
+  header = hdr;
+  pilots = (const U32*)((const U8*)mapping + sizeof(GramHashHeader));
+  slots = (const GramHashSlot*)(pilots + header->numBuckets);
+
+  return true;
+}
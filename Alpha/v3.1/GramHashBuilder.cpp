@@ -0,0 +1,143 @@
+#include "Controller.hpp"
+
+/*
+  Offline tool for converting a char n-gram file (eg, ../quadgrams.txt) to a GramHash table, which LanguageModel::BuildModels
+  then maps in place of the CharGramModel when USE_GRAM_HASH is set.
+
+  Usage: gramHashBuilder ngramFile [outFile=ngramFile with .mph extension]
+  eg, ./gramHashBuilder ../quadgrams.txt && ./gramHashBuilder ../pentagrams.txt
+
+  After building, the table is reloaded from disk and checked against the source model: every gram must be found, with
+  its value within half a quantization step. Then memory and lookup latency are compared against the CharGramModel, for
+  grams in the model and for random grams (mostly not in the model, which is the common case for the upper orders).
+*/
+
+#define GRAM_HASH_BENCH_LOOKUPS 4000000
+
+//approximate heap footprint of an unordered_map: a bucket pointer per bucket, and a malloc'ed node (next ptr, key, value) per entry
+size_t CharGramModelMemory(CharGramModel& model)
+{
+  return model.bucket_count() * sizeof(void*) + model.size() * (sizeof(void*) + sizeof(pair<U32,double>) + 8);
+}
+
+//times GRAM_HASH_BENCH_LOOKUPS lookups of keys against both structures, and prints ns/lookup
+void BenchLookups(CharGramModel& model, GramHash& gramHash, vector<U32>& keys, const string& desc)
+{
+  U32 i, found = 0;
+  double value, sum = 0.0, mapTime, hashTime;
+  struct timespec begin, end;
+
+  clock_gettime(CLOCK_MONOTONIC,&begin);
+  for(i = 0; i < GRAM_HASH_BENCH_LOOKUPS; i++){
+    CharGramIt it = model.find(keys[i % keys.size()]);
+    if(it != model.end()){
+      sum += it->second;
+      found++;
+    }
+  }
+  clock_gettime(CLOCK_MONOTONIC,&end);
+  mapTime = DiffTimeSpecs(&begin,&end);
+
+  clock_gettime(CLOCK_MONOTONIC,&begin);
+  for(i = 0; i < GRAM_HASH_BENCH_LOOKUPS; i++){
+    if(gramHash.Find(keys[i % keys.size()],value)){
+      sum += value;
+      found++;
+    }
+  }
+  clock_gettime(CLOCK_MONOTONIC,&end);
+  hashTime = DiffTimeSpecs(&begin,&end);
+
+  cout << desc << ": map " << (mapTime * 1.0e9 / GRAM_HASH_BENCH_LOOKUPS) << " ns/lookup  gram hash " << (hashTime * 1.0e9 / GRAM_HASH_BENCH_LOOKUPS) << " ns/lookup  (checksum " << (found + (U32)sum) << ")" << endl;
+}
+
+int main(int argc, char* argv[])
+{
+  int n;
+  U32 i, missing = 0, badValues = 0, falsePositives = 0;
+  double value, maxError = 0.0;
+  string ngramFile, mphFile;
+  char gram[8];
+  CharGramModel* model = NULL;
+  vector<U32> memberKeys, randomKeys;
+  struct timespec begin, end;
+
+  if(argc < 2){
+    cout << "usage: " << argv[0] << " ngramFile [outFile=ngramFile.mph]" << endl;
+    return 1;
+  }
+  ngramFile = argv[1];
+  if(argc >= 3){
+    mphFile = argv[2];
+  }
+  else{
+    mphFile = ngramFile.substr(0,ngramFile.rfind('.')) + ".mph";
+  }
+
+  LanguageModel lm;
+  lm.BuildCharacterNgramModel(ngramFile);
+  //the file's gram length determines which model it landed in
+  CharGramModel* models[] = {&lm.unigramModel, &lm.bigramModel, &lm.trigramModel, &lm.quadgramModel, &lm.pentagramModel};
+  for(n = 0; n < 5 && model == NULL; n++){
+    if(!models[n]->empty()){
+      model = models[n];
+    }
+  }
+  if(model == NULL){
+    cout << "ERROR no grams read from " << ngramFile << endl;
+    return 1;
+  }
+  cout << "read " << model->size() << " " << n << "-grams from " << ngramFile << endl;
+
+  GramHash gramHash;
+  clock_gettime(CLOCK_MONOTONIC,&begin);
+  if(!gramHash.Build(*model,mphFile)){
+    return 1;
+  }
+  clock_gettime(CLOCK_MONOTONIC,&end);
+  cout << "built " << mphFile << " in " << DiffTimeSpecs(&begin,&end) << " (s)" << endl;
+
+  //verify the table as written to disk, not as built
+  if(!gramHash.Load(mphFile)){
+    cout << "ERROR could not reload " << mphFile << endl;
+    return 1;
+  }
+  for(CharGramIt it = model->begin(); it != model->end(); ++it){
+    memberKeys.push_back(it->first);
+    if(!gramHash.Find(it->first,value)){
+      missing++;
+    }
+    else{
+      maxError = std::max(maxError,fabs(value - it->second));
+      if(fabs(value - it->second) > gramHash.header->step * 0.5 + 1.0e-9){
+        badValues++;
+      }
+    }
+  }
+  cout << "verified: " << missing << " missing, " << badValues << " out of tolerance, max quantization error " << maxError << " (step " << gramHash.header->step << ")" << endl;
+  if(missing > 0 || badValues > 0){
+    cout << "ERROR gram hash does not match " << ngramFile << endl;
+    return 1;
+  }
+
+  //random upper case grams of the same length, for measuring the fingerprint false positive rate
+  srand(1);
+  gram[n] = '\0';
+  for(i = 0; i < 1000000; i++){
+    for(int j = 0; j < n; j++){
+      gram[j] = 'A' + rand() % 26;
+    }
+    randomKeys.push_back(lm.GetCharGramKey(gram));
+    if(model->find(randomKeys.back()) == model->end() && gramHash.Find(randomKeys.back(),value)){
+      falsePositives++;
+    }
+  }
+  cout << "false positive rate on random grams: " << ((double)falsePositives / randomKeys.size()) << endl;
+
+  cout << "memory: map ~" << (CharGramModelMemory(*model) / 1024) << "kb  gram hash " << (gramHash.MemoryUsage() / 1024) << "kb" << endl;
+  std::random_shuffle(memberKeys.begin(),memberKeys.end());
+  BenchLookups(*model,gramHash,memberKeys,"member grams");
+  BenchLookups(*model,gramHash,randomKeys,"random grams");
+
+  return 0;
+}
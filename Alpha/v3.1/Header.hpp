@@ -16,6 +16,7 @@
 #include <set>
 #include <unordered_map>
 #include <cmath>
+#include <climits>
 #include <fstream>
 #include <sstream>
 #include <iostream>
@@ -25,6 +26,13 @@
 //#include <string.h>
 #include <algorithm>
 #include <ctime>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <functional>
+#include <deque>
+#include <random>
 
 //OS and machine specific stuff
 #ifdef __WINDOWS__
@@ -60,9 +68,45 @@
 #define CHAR_TRIGRAM_LAMBDA 42.666666    //as shown, the analysis showed that its more less best to let the most confident model dominate 
 #define CHAR_QUADGRAM_LAMBDA 3413.333333 //except for the penta/quad gram models.
 #define CHAR_PENTAGRAM_LAMBDA 1820.444444
+#define MAX_CHAR_GRAM 5  //highest order char n-gram model. The lambdas above are only defaults; LanguageModel loads tuned ones from ../charLambdas.txt (see LambdaOptimizer.cpp)
 #define DEFAULT_LOG_PROB 15.0  //a default, punitive log-probability for sequences not found in a model (which therefore have the least likelihood)
 #define SMALL_BUFSIZE 256
 #define SKIPCHAR true
+#define MAX_EDIT_DIST 2  //depth of the symmetric-deletion edit index. Index size grows roughly as wordLength^MAX_EDIT_DIST per word
+#define EDIT_DIST_PENALTY 32.0  //-log2 cost, under each char model, of each edit when vocabulary words are substituted for lattice paths in LanguageModel::SearchForEdits; see EditPenalty
+#define EDIT_SEARCH_DEPTH 20  //only the top k lattice paths are expanded into vocabulary edits
+#define USE_GRAM_HASH 1  //load the quad/pentagram models from minimal perfect hash files (../quadgrams.mph) when present, instead of CharGramModel
+#define GRAM_HASH_BUCKET_SIZE 4  //avg keys per pilot in a GramHash; larger is smaller but slower to build
+#define USE_STAGE_METRICS 1  //compile per-stage latency histograms and work counters into the engine (see StageMetrics.cpp). 0 removes them entirely
+#define METRICS_HISTOGRAM_BUCKETS 256
+#define USE_TRACE_RING 1  //record trace events (TRACE_EVENT) into an in-memory ring buffer, dumped on demand (see TraceRing.cpp). 0 removes them entirely
+#define TRACE_RING_SIZE 4096  //events kept; must be a power of two
+#define PIPELINE_QUEUE_DEPTH 4  //words each DecodePipeline queue holds before the stage feeding it blocks
+#define KERNEL_LANES 32  //words per block in the StringKernels buffers; one AVX2 register, or two SSE2 registers, of chars
+#define TRACE_GEN_SAMPLE_HZ 30  //sample rate of the synthetic traces; the recorded ones were taken at 30 or 60 Hz
+#define ARENA_CHUNK_SIZE 65536  //bytes in an Arena's first chunk; a word's lattice and results normally fit in one
+#define SEGMENT_DWELL_MS 250  //time the gaze must rest off the keys (on the space bar, or off the layout) to end a word in a continuous stream
+#define SEGMENT_MIN_WORD_MS 300  //shorter visits to the keys are stray glances, not words
+#define SENSOR_QUEUE_DEPTH 1024  //samples a GazeStream buffers before its sensor sources block; about 30s at 30 Hz
+#define SENSOR_POLL_MS 100  //how often a sensor source blocked on input checks whether it's been stopped
+#define DEFAULT_CLUSTER_STRATEGY "process3"  //the ClusterRegistry strategy new DecodeSessions use
+#define CLUSTER_DX_THRESHOLD 14  //SingularityBuilder's hand-picked event parameters; only defaults, see CLUSTER_PARAMS_FILE
+#define CLUSTER_INNER_DX_THRESHOLD 16
+#define CLUSTER_TRIGGER_THRESHOLD 4
+#define CLUSTER_HIGH_FOCUS 45
+#define CLUSTER_STDEV_HARD_TRIGGER 225.0
+#define CLUSTER_STDEV_SOFT_TRIGGER 14.0
+#define CLUSTER_PARAMS_FILE "../clusterParams.txt"  //tuned event parameters (see ClusterTuner.cpp), loaded at startup when present
+#define GAZE_FILTER_DEFAULT 0  //whether sessions, pipelines and streams smooth samples with a GazeFilter before clustering
+#define GAZE_FILTER_MIN_CUTOFF 1.0  //Hz; the one-euro filter's cutoff at rest. Lower smooths fixations more
+#define GAZE_FILTER_BETA 0.03  //cutoff Hz per px/s of gaze speed. Higher lags saccades less
+#define GAZE_FILTER_D_CUTOFF 1.0  //Hz; the cutoff of the speed estimate
+#define GAZE_FILTER_SAMPLE_HZ 30  //the rate assumed for a word's points, which carry no timestamps
+#define DIRECT_MAX_DISTANCE 1500  //DirectInference only returns words whose aligned distance to the clusters is under this...
+#define DIRECT_MAX_LENGTH_DIFF 4  //...and whose length is within this many of the number of clusters
+#define PREFIX_TOP_N 5  //completions a PrefixDecoder publishes after each cluster
+#define PREFIX_SETTLE_CLUSTERS 2  //clusters a prefix's clustering must have found after a cluster before it's decoded; later ones can still merge
+#define KEY_TABLE_SIZE 256  //entries in a LayoutManager::KeyDistances row, one per (U8) char
 
 using std::list;
 using std::vector;
@@ -81,11 +125,87 @@ using std::sort;
 using std::pow;
 using std::sqrt;
 using std::set;
+using std::deque;
 
 
 typedef unsigned char U8;
 typedef unsigned short int U16;
 typedef unsigned int U32;
+typedef unsigned long long U64;
+
+/*
+  Bump allocator for the transient state of one word's decode (see Arena.cpp). Allocate is a pointer bump, freeing is
+  a no-op, and Reset rewinds the whole arena in O(1) while keeping its chunks, so once the chunks have grown to fit a
+  word, decoding the next one doesn't touch malloc.
+*/
+class Arena{
+  public:
+    vector<char*> chunks;
+    vector<size_t> chunkSizes;
+    size_t current;   //index of the chunk being bumped
+    char* cursor;
+    char* limit;
+
+    Arena(size_t firstChunkSize = ARENA_CHUNK_SIZE);
+    ~Arena();
+
+    void* Allocate(size_t size, size_t align);
+    void Reset(void);
+    size_t Capacity(void);
+    static U64 NumChunks(void);
+    static Arena* Current(void);
+    static Arena* SetCurrent(Arena* arena);
+};
+
+//resets arena and makes it this thread's current arena, until the scope ends
+class ArenaScope{
+  public:
+    Arena* previous;
+
+    ArenaScope(Arena* arena);
+    ~ArenaScope();
+};
+
+/*
+  STL allocator over an Arena. A default-constructed one takes the thread's current arena, or the heap if there isn't
+  one, so the lattice and result containers built during a decode land in the decode's arena without any signature
+  changing. deallocate is a no-op for arena memory; it's all reclaimed by the next Reset.
+
+  Only node containers (the result lists) may outlive a Reset, and only if they're cleared first. A vector that keeps
+  its capacity across words must be on the heap (constructed outside any ArenaScope), or its buffer would be handed
+  out again after the reset.
+*/
+template<typename T>
+class ArenaAllocator{
+  public:
+    typedef T value_type;
+    typedef std::true_type propagate_on_container_move_assignment;
+    typedef std::true_type propagate_on_container_swap;
+    template<typename U> struct rebind{ typedef ArenaAllocator<U> other; };
+
+    Arena* arena;  //NULL for the heap
+
+    ArenaAllocator() : arena(Arena::Current()) {}
+    explicit ArenaAllocator(Arena* arenaPtr) : arena(arenaPtr) {}
+    template<typename U> ArenaAllocator(const ArenaAllocator<U>& rhs) : arena(rhs.arena) {}
+
+    T* allocate(size_t n){
+      if(arena != NULL){
+        return (T*)arena->Allocate(n * sizeof(T),alignof(T));
+      }
+      return (T*)::operator new(n * sizeof(T));
+    }
+    void deallocate(T* p, size_t){
+      if(arena == NULL){
+        ::operator delete(p);
+      }
+    }
+};
+
+template<typename T, typename U>
+bool operator==(const ArenaAllocator<T>& lhs, const ArenaAllocator<U>& rhs){ return lhs.arena == rhs.arena; }
+template<typename T, typename U>
+bool operator!=(const ArenaAllocator<T>& lhs, const ArenaAllocator<U>& rhs){ return lhs.arena != rhs.arena; }
 
 /*
   TODO: 
@@ -177,6 +297,22 @@ class Point{
 };
 
 
+//read-only view of samples stored elsewhere: a vector<Point>, or a mapped gaze trace file (see GazeTrace.cpp)
+class PointSpan{
+  public:
+    const Point* data;
+    size_t n;
+
+    PointSpan() : data(NULL), n(0) {}
+    PointSpan(const Point* points, size_t numPoints) : data(points), n(numPoints) {}
+    PointSpan(const vector<Point>& points) : data(points.data()), n(points.size()) {}
+
+    size_t size() const { return n; }
+    bool empty() const { return n == 0; }
+    const Point& operator[](size_t i) const { return data[i]; }
+};
+
+
 /*
 short int IntDistance(const point& p1, const point& p2);
 double DoubleDistance(const point& p1, const point& p2);
@@ -241,7 +377,7 @@ typedef struct arc{
 typedef struct state{
   double pState;
   char symbol;
-  vector<Arc> arcs;  //each outgoing arc is the index of the next state, and the char-id of that state
+  vector<Arc,ArenaAllocator<Arc> > arcs;  //each outgoing arc is the index of the next state, and the char-id of that state
   double viterbiMax;  //solely for Viterbi algorithm route-finding
   State* maxPrev;     // ditto. TODO: handle the exception where there is no previous column of states (col=0)
 } State;
@@ -249,22 +385,23 @@ typedef struct state{
 
 //each column of the Lattice is a Cluster with alphas (keys/characters) and a vector of transitions. the [0] transition is always reflexive
 typedef struct cluster{
-  vector<State> alphas;
+  vector<State,ArenaAllocator<State> > alphas;
   double pReflexive;  //reflexive transition probability of this cluster.
 } Cluster;
 
-typedef vector<Cluster> Lattice;
+typedef vector<Cluster,ArenaAllocator<Cluster> > Lattice;
 //typedef pair<char,char> Transition;
 //typedef vector< vector<Transition> > TransitionModel; // index with [nextstate][alpha]
 // these are compressible, eg, assign some default low probability to very uncommon sequences like "ZDQ"
 typedef unordered_map<U32,double> CharGramModel;
 typedef CharGramModel::iterator CharGramIt;
 typedef pair<string,double> LatticePath;  // <object,tempScore,cumulativeRank>
-typedef list<LatticePath> LatticePaths;  //output of Viterbi stage is a list of strings paired with some probability for that path
+typedef list<LatticePath,ArenaAllocator<LatticePath> > LatticePaths;  //output of Viterbi stage is a list of strings paired with some probability for that path
 typedef LatticePaths::iterator LatticePathsIt;
 typedef LatticePath SearchResult;  //all aliases for the previous types...
-typedef list<SearchResult> SearchResults;
+typedef list<SearchResult,ArenaAllocator<SearchResult> > SearchResults;
 typedef SearchResults::iterator SearchResultIt;
+typedef unordered_map<string,double,std::hash<string>,std::equal_to<string>,ArenaAllocator<pair<const string,double> > > WordScores;  //best score of each word, eg across edit searches
 
 //ui key map
 //TODO: The keymap could be reduced to a static array of objects, which would yield vastly faster queries, though its still a quite small rb-tree (map).
@@ -288,6 +425,55 @@ char ToUpper(char c);
 void StrToUpper(char str[]);
 bool IsDelimiter(const char c, const string& delims);
 long double DiffTimeSpecs(struct timespec* begin, struct timespec* end);
+double Percentile(vector<double> samples, double p);
+void Silence(bool silent);
+int RealStdout(void);
+
+/*
+  Leveled console logging. Anything above LOG_LEVEL compiles to nothing, arguments included, so per-query and per-sample
+  logging costs nothing in a release build. Build with eg "make twitch LOGFLAGS=-DLOG_LEVEL=5" to get it back.
+  DEBUG is for per-query output (candidate lists, lattices), TRACE for per-sample or inner-loop output.
+  The stream forms take a << chain: LOG_DEBUG("n=" << n); the F forms take printf arguments.
+*/
+#define LOG_LEVEL_NONE 0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN 2
+#define LOG_LEVEL_INFO 3
+#define LOG_LEVEL_DEBUG 4
+#define LOG_LEVEL_TRACE 5
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_ERROR
+#define LOG_ERROR(msg) (cout << "ERROR " << msg << endl)
+#else
+#define LOG_ERROR(msg)
+#endif
+#if LOG_LEVEL >= LOG_LEVEL_WARN
+#define LOG_WARN(msg) (cout << "WARN " << msg << endl)
+#else
+#define LOG_WARN(msg)
+#endif
+#if LOG_LEVEL >= LOG_LEVEL_INFO
+#define LOG_INFO(msg) (cout << msg << endl)
+#else
+#define LOG_INFO(msg)
+#endif
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(msg) (cout << msg << endl)
+#define LOG_DEBUGF(...) printf(__VA_ARGS__)
+#else
+#define LOG_DEBUG(msg)
+#define LOG_DEBUGF(...)
+#endif
+#if LOG_LEVEL >= LOG_LEVEL_TRACE
+#define LOG_TRACE(msg) (cout << msg << endl)
+#define LOG_TRACEF(...) printf(__VA_ARGS__)
+#else
+#define LOG_TRACE(msg)
+#define LOG_TRACEF(...)
+#endif
 
 #endif
 
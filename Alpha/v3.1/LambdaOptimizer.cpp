@@ -0,0 +1,337 @@
+#include "Controller.hpp"
+#include <thread>
+
+/*
+  Offline tool for tuning the char n-gram interpolation weights (LanguageModel::charLambdas), replacing
+  optimizeCharNgramLambdas.py. Writes a lambda file that LanguageModel::BuildModels loads at startup, so tuning
+  no longer means editing the CHAR_*_LAMBDA defines and recompiling.
+
+  Usage: lambdaOptimizer heldOutWords [outFile=../charLambdas.txt] [keyMapFile=../TestInput/EyeInputs/Test1/keyMap.txt] [numThreads=ncores]
+  heldOutWords is one word per line, optionally "word<TAB>count" (eg, ngramCounter's wordCounts.txt), in which case words are weighted by count.
+  Run from v3.1, like twitch, since LanguageModel loads its n-gram files from "../".
+
+  Objective: decoding accuracy. The lattice hands the language model strings that differ from the intended word by
+  keyboard-neighbor substitutions, so for each held-out word the confusers are every string made by substituting one
+  char with one of its neighbor keys (from the LayoutManager keymap). A word is decoded correctly if it has a strictly
+  better (lower) char-gram score than all of its confusers. Ties in accuracy are broken by the conditional log-likelihood
+  of the true word within its confusion set, with P(s) proportional to 2^-score(s).
+
+  Since the score is linear in the lambdas, each string's five per-model sums (LanguageModel::CharGramFeatures) are
+  computed once up front, in parallel, and scoring under any lambdas is then a dot product. The search is coordinate
+  descent over multiplicative steps: for each model order, try scaling its lambda by each of LAMBDA_STEPS, keep the best,
+  and sweep until nothing improves. Each evaluation is split across threads by word.
+
+  Accuracy only depends on the ratios between the lambdas, but the likelihood also depends on their overall scale, so
+  the search settles the scale where the char-gram scores are calibrated -log2 probabilities. That's also the right
+  scale for adding them to the lattice path scores. Models that aren't loaded (eg, no quadgram file) score every
+  same-length string the same, so they never change either measure, and their lambdas are left alone.
+*/
+
+#define LAMBDA_MAX_SWEEPS 20
+#define LAMBDA_MIN 1.0e-6  //keeps a lambda from collapsing to exactly zero
+
+static const double LAMBDA_STEPS[] = {0.0625, 0.25, 0.5, 0.8, 1.25, 2.0, 4.0, 16.0};
+static const int NUM_LAMBDA_STEPS = sizeof(LAMBDA_STEPS) / sizeof(double);
+
+class LambdaOptimizer{
+  public:
+    LanguageModel* lm;
+    LayoutManager* layoutManager;
+    int numThreads;
+    vector<string> words;
+    vector<double> weights;        //per word, from the counts in the word file (1.0 if none)
+    vector<float> features;        //MAX_CHAR_GRAM per string, minus the true word's; strings are grouped by word, the true word first, then its confusers
+    vector<U32> groupOffsets;      //groupOffsets[w] is the index of word w's first string; plus an end offset
+    double totalWeight;
+
+    LambdaOptimizer(LanguageModel* lmPtr, LayoutManager* layoutManagerPtr, int nThreads);
+    ~LambdaOptimizer();
+
+    bool LoadWords(const string& wordFile);
+    void BuildConfusers(const string& word, vector<string>& confusers);
+    void BuildFeatures(void);
+    void BuildFeatureSlice(U32 wordBegin, U32 wordEnd, vector<vector<float> >* sliceFeatures);
+    void EvaluateSlice(const double lambdas[], U32 wordBegin, U32 wordEnd, double* accuracy, double* logLikelihood);
+    void Evaluate(const double lambdas[], double& accuracy, double& logLikelihood);
+    void Optimize(double lambdas[]);
+};
+
+LambdaOptimizer::LambdaOptimizer(LanguageModel* lmPtr, LayoutManager* layoutManagerPtr, int nThreads)
+{
+  lm = lmPtr;
+  layoutManager = layoutManagerPtr;
+  numThreads = nThreads;
+  totalWeight = 0.0;
+}
+
+LambdaOptimizer::~LambdaOptimizer()
+{
+  words.clear();
+  features.clear();
+}
+
+//reads the held-out words, uppercased like the engine's models. Words with chars not on the keyboard are skipped.
+bool LambdaOptimizer::LoadWords(const string& wordFile)
+{
+  int ntoks, i;
+  char buf[BUFSIZE];
+  char* tokens[8] = {NULL,NULL,NULL,NULL,NULL,NULL,NULL,NULL};
+  fstream infile(wordFile.c_str(), ios::in);
+  string delims = "\t";
+  string word;
+  bool valid;
+
+  if(!infile){
+    cout << "ERROR could not open file: " << wordFile << endl;
+    return false;
+  }
+
+  while(infile.getline(buf,BUFSIZE)){
+    StrToUpper(buf);
+    ntoks = Tokenize(tokens,buf,delims);
+    if(ntoks < 1){
+      continue;
+    }
+    word = tokens[0];
+    for(i = 0, valid = true; valid && i < word.size(); i++){
+      valid = layoutManager->keyMap.find(word[i]) != layoutManager->keyMap.end();
+    }
+    if(valid && word.size() > 1){
+      words.push_back(word);
+      weights.push_back((ntoks >= 2) ? atof(tokens[1]) : 1.0);
+      totalWeight += weights.back();
+    }
+  }
+  infile.close();
+
+  cout << "Loaded " << words.size() << " held-out words from " << wordFile << endl;
+  return words.size() > 0;
+}
+
+//every string one keyboard-neighbor substitution away from word
+void LambdaOptimizer::BuildConfusers(const string& word, vector<string>& confusers)
+{
+  int i, j;
+  vector<char>* neighbors;
+  string confuser;
+
+  for(i = 0; i < word.size(); i++){
+    neighbors = &layoutManager->keyMap.find(word[i])->second.second;
+    for(j = 0; j < neighbors->size(); j++){
+      if((*neighbors)[j] != word[i]){
+        confuser = word;
+        confuser[i] = (*neighbors)[j];
+        confusers.push_back(confuser);
+      }
+    }
+  }
+}
+
+//computes the features of words [wordBegin,wordEnd) and their confusers, one vector per word. Only reads the LanguageModel.
+void LambdaOptimizer::BuildFeatureSlice(U32 wordBegin, U32 wordEnd, vector<vector<float> >* sliceFeatures)
+{
+  U32 w, j, k;
+  double f[MAX_CHAR_GRAM], wordF[MAX_CHAR_GRAM];
+  vector<string> confusers;
+
+  for(w = wordBegin; w < wordEnd; w++){
+    vector<float>& out = (*sliceFeatures)[w - wordBegin];
+    confusers.clear();
+    BuildConfusers(words[w],confusers);
+
+    //stored relative to the true word, so it scores exactly zero, and features that are the same for the whole group
+    //(eg, an unloaded model's default probabilities) cancel exactly instead of adding rounding noise
+    lm->CharGramFeatures(words[w],wordF);
+    out.insert(out.end(),MAX_CHAR_GRAM,0.0f);
+    for(j = 0; j < confusers.size(); j++){
+      lm->CharGramFeatures(confusers[j],f);
+      for(k = 0; k < MAX_CHAR_GRAM; k++){
+        out.push_back(f[k] - wordF[k]);
+      }
+    }
+  }
+}
+
+void LambdaOptimizer::BuildFeatures(void)
+{
+  int t;
+  U32 w, begin, end, sliceSize;
+  vector<std::thread> threads;
+  vector<vector<vector<float> > > slices(numThreads);
+
+  sliceSize = (words.size() + numThreads - 1) / numThreads;
+  for(t = 0; t < numThreads; t++){
+    begin = std::min((U32)words.size(),t * sliceSize);
+    end = std::min((U32)words.size(),begin + sliceSize);
+    slices[t].resize(end - begin);
+    threads.push_back(std::thread(&LambdaOptimizer::BuildFeatureSlice,this,begin,end,&slices[t]));
+  }
+
+  features.clear();
+  groupOffsets.clear();
+  for(t = 0; t < numThreads; t++){
+    threads[t].join();
+    for(w = 0; w < slices[t].size(); w++){
+      groupOffsets.push_back(features.size() / MAX_CHAR_GRAM);
+      features.insert(features.end(),slices[t][w].begin(),slices[t][w].end());
+    }
+    slices[t].clear();
+  }
+  groupOffsets.push_back(features.size() / MAX_CHAR_GRAM);
+
+  cout << "Built features for " << groupOffsets.back() << " strings (" << (features.size() * sizeof(float) >> 20) << "MB)" << endl;
+}
+
+/*
+  Weighted accuracy and conditional log2-likelihood of words [wordBegin,wordEnd). Log-likelihood uses the usual
+  log-sum-exp shift by the best score, so it stays finite for large lambdas.
+*/
+void LambdaOptimizer::EvaluateSlice(const double lambdas[], U32 wordBegin, U32 wordEnd, double* accuracy, double* logLikelihood)
+{
+  U32 w, s, k;
+  double score, trueScore, minScore, sum, acc = 0.0, ll = 0.0;
+  vector<double> scores;
+  bool correct;
+  const float* f;
+
+  for(w = wordBegin; w < wordEnd; w++){
+    scores.clear();
+    minScore = 0.0;
+    for(s = groupOffsets[w]; s < groupOffsets[w+1]; s++){
+      f = &features[s * MAX_CHAR_GRAM];
+      score = 0.0;
+      for(k = 0; k < MAX_CHAR_GRAM; k++){
+        score += lambdas[k] * f[k];
+      }
+      scores.push_back(score);
+      if(s == groupOffsets[w] || score < minScore){
+        minScore = score;
+      }
+    }
+
+    trueScore = scores[0];
+    correct = true;
+    sum = 0.0;
+    for(s = 0; s < scores.size(); s++){
+      if(s > 0 && scores[s] <= trueScore){
+        correct = false;
+      }
+      sum += pow(2.0,-(scores[s] - minScore));
+    }
+    if(correct){
+      acc += weights[w];
+    }
+    ll += weights[w] * (-(trueScore - minScore) - log2(sum));
+  }
+
+  *accuracy = acc;
+  *logLikelihood = ll;
+}
+
+void LambdaOptimizer::Evaluate(const double lambdas[], double& accuracy, double& logLikelihood)
+{
+  int t;
+  U32 begin, end, sliceSize;
+  vector<std::thread> threads;
+  vector<double> accs(numThreads,0.0), lls(numThreads,0.0);
+
+  sliceSize = (words.size() + numThreads - 1) / numThreads;
+  for(t = 0; t < numThreads; t++){
+    begin = std::min((U32)words.size(),t * sliceSize);
+    end = std::min((U32)words.size(),begin + sliceSize);
+    threads.push_back(std::thread(&LambdaOptimizer::EvaluateSlice,this,lambdas,begin,end,&accs[t],&lls[t]));
+  }
+
+  accuracy = 0.0;
+  logLikelihood = 0.0;
+  for(t = 0; t < numThreads; t++){
+    threads[t].join();
+    accuracy += accs[t];
+    logLikelihood += lls[t];
+  }
+  accuracy /= totalWeight;
+  logLikelihood /= totalWeight;
+}
+
+void LambdaOptimizer::Optimize(double lambdas[])
+{
+  int sweep, k, step;
+  double bestAcc, bestLL, acc, ll;
+  double trial[MAX_CHAR_GRAM], best[MAX_CHAR_GRAM];
+  bool improved = true;
+
+  std::copy(lambdas,lambdas + MAX_CHAR_GRAM,best);
+  Evaluate(best,bestAcc,bestLL);
+  cout << "initial lambdas: accuracy=" << bestAcc << " log2-likelihood=" << bestLL << endl;
+
+  for(sweep = 0; improved && sweep < LAMBDA_MAX_SWEEPS; sweep++){
+    improved = false;
+    for(k = 0; k < MAX_CHAR_GRAM; k++){
+      for(step = 0; step < NUM_LAMBDA_STEPS; step++){
+        std::copy(best,best + MAX_CHAR_GRAM,trial);
+        trial[k] = std::max(trial[k] * LAMBDA_STEPS[step],LAMBDA_MIN);
+        Evaluate(trial,acc,ll);
+        if(acc > bestAcc || (acc == bestAcc && ll > bestLL)){
+          std::copy(trial,trial + MAX_CHAR_GRAM,best);
+          bestAcc = acc;
+          bestLL = ll;
+          improved = true;
+        }
+      }
+    }
+    cout << "sweep " << sweep << ": accuracy=" << bestAcc << " log2-likelihood=" << bestLL << " lambdas:";
+    for(k = 0; k < MAX_CHAR_GRAM; k++){
+      cout << " " << best[k];
+    }
+    cout << endl;
+  }
+
+  std::copy(best,best + MAX_CHAR_GRAM,lambdas);
+}
+
+int main(int argc, char* argv[])
+{
+  int numThreads = std::thread::hardware_concurrency();
+  string lambdaFile = "../charLambdas.txt";
+  string keyMapFile = "../TestInput/EyeInputs/Test1/keyMap.txt";
+  struct timespec begin, end;
+
+  if(argc < 2){
+    cout << "usage: " << argv[0] << " heldOutWords [outFile=" << lambdaFile << "] [keyMapFile=" << keyMapFile << "] [numThreads=" << numThreads << "]" << endl;
+    return 1;
+  }
+  if(argc >= 3){
+    lambdaFile = argv[2];
+  }
+  if(argc >= 4){
+    keyMapFile = argv[3];
+  }
+  if(argc >= 5){
+    numThreads = atoi(argv[4]);
+  }
+  if(numThreads <= 0){
+    numThreads = 1;
+  }
+
+  LayoutManager layoutManager(keyMapFile);
+  LanguageModel lm;
+  lm.BuildModels();  //also loads any existing lambda file, so repeated runs continue from the last result
+
+  LambdaOptimizer optimizer(&lm,&layoutManager,numThreads);
+  if(!optimizer.LoadWords(argv[1])){
+    return 1;
+  }
+
+  clock_gettime(CLOCK_MONOTONIC,&begin);
+  optimizer.BuildFeatures();
+  optimizer.Optimize(lm.charLambdas);
+  clock_gettime(CLOCK_MONOTONIC,&end);
+  cout << "optimization complete in " << DiffTimeSpecs(&begin,&end) << " (s) with " << numThreads << " threads" << endl;
+
+  if(!lm.SaveCharLambdas(lambdaFile)){
+    return 1;
+  }
+  cout << "wrote " << lambdaFile << endl;
+
+  return 0;
+}
@@ -11,6 +11,13 @@ LanguageModel::LanguageModel()
   /*
     TODO: build word n-gram models from COCA or other n-gram source data
   */
+  editIndex = NULL;
+
+  charLambdas[0] = CHAR_UNIGRAM_LAMBDA;
+  charLambdas[1] = CHAR_BIGRAM_LAMBDA;
+  charLambdas[2] = CHAR_TRIGRAM_LAMBDA;
+  charLambdas[3] = CHAR_QUADGRAM_LAMBDA;
+  charLambdas[4] = CHAR_PENTAGRAM_LAMBDA;
 }
 
 LanguageModel::~LanguageModel()
@@ -37,12 +44,20 @@ void LanguageModel::BuildModels(void)
   cout << " > building trigram language models..." << endl;
   s = "../trigrams.txt";
   BuildCharacterNgramModel(s);
+  //the sparse upper orders come from prebuilt minimal perfect hash tables if available (see gramHashBuilder), which are far smaller
   cout << " > building quadgram language models..." << endl;
-  s = "../quadgrams.txt";
-  BuildCharacterNgramModel(s);
+  if(!USE_GRAM_HASH || !quadgramHash.Load("../quadgrams.mph")){
+    s = "../quadgrams.txt";
+    BuildCharacterNgramModel(s);
+  }
   cout << " > building pentagram language models..." << endl;
-  s = "../pentagrams.txt";
-  BuildCharacterNgramModel(s);
+  if(!USE_GRAM_HASH || !pentagramHash.Load("../pentagrams.mph")){
+    s = "../pentagrams.txt";
+    BuildCharacterNgramModel(s);
+  }
+  //tuned interpolation weights, if the lambda optimizer has been run; otherwise the compiled defaults stand
+  s = "../charLambdas.txt";
+  LoadCharLambdas(s);
   cout << "...complete." << endl;
 
 }
@@ -54,44 +69,127 @@ void LanguageModel::BuildModels(void)
   Uses a linear interpolation aross n-gram models: lambda1 * unigramProb(d) + lambda2 * bigramProb(d|c) + lambda3 * trigram...
   See Jurafsky SLP for details on linear interpolation in ngram models.
 
-  TODO: determine optimal n-gram lambdas.
+  The lambdas are charLambdas: the CHAR_*_LAMBDA defaults, or whatever the lambda optimizer wrote to ../charLambdas.txt.
 */
 void LanguageModel::ReconditionByCharGrams(LatticePaths& edits)
+{
+  for(LatticePathsIt it = edits.begin(); it != edits.end(); ++it){
+    it->second += (CharGramScore(it->first) * CHAR_NGRAM_MODEL_WEIGHT);
+  }
+}
+
+/*
+  The per-model sums that ReconditionByCharGrams weights by the lambdas: features[n-1] is the sum of the
+  -log2 n-gram probabilities over every n-gram in s. Broken out so the lambda optimizer can precompute these
+  once per string, after which scoring under any set of lambdas is just a dot product.
+*/
+void LanguageModel::CharGramFeatures(const string& s, double features[MAX_CHAR_GRAM])
 {
   int i;
-  double ngram_val;
 
-  for(LatticePathsIt it = edits.begin(); it != edits.end(); ++it){
-    ngram_val = 0.0;
-    //unigram conditioning
-    for(i = 0; i < it->first.size(); i++){
-      //cout << "here1" << endl;
-      ngram_val += (CHAR_UNIGRAM_LAMBDA * GetUnigramProbability(it->first[i]));
-    }
-    //bigram conditioning
-    for(i = 1; i < it->first.size(); i++){
-      //cout << "here2" << endl;
-      //cout << "adding " << (CHAR_BIGRAM_LAMBDA * GetBigramProbability(it->first[i],it->first[i+1])) << endl;
-      ngram_val += (CHAR_BIGRAM_LAMBDA * GetBigramProbability(it->first[i-1],it->first[i]));
-    }
-    //trigram conditioning
-    for(i = 2; i < it->first.size(); i++){
-      //cout << "here3" << endl;
-      ngram_val += (CHAR_TRIGRAM_LAMBDA * GetTrigramProbability(it->first[i-2],it->first[i-1],it->first[i]));
+  for(i = 0; i < MAX_CHAR_GRAM; i++){
+    features[i] = 0.0;
+  }
+  //unigram conditioning
+  for(i = 0; i < s.size(); i++){
+    features[0] += GetUnigramProbability(s[i]);
+  }
+  //bigram conditioning
+  for(i = 1; i < s.size(); i++){
+    features[1] += GetBigramProbability(s[i-1],s[i]);
+  }
+  //trigram conditioning
+  for(i = 2; i < s.size(); i++){
+    features[2] += GetTrigramProbability(s[i-2],s[i-1],s[i]);
+  }
+  //quadgram conditioning
+  for(i = 3; i < s.size(); i++){
+    features[3] += GetQuadgramProbability(s[i-3],s[i-2],s[i-1],s[i]);
+  }
+  //pentagram conditioning
+  for(i = 4; i < s.size(); i++){
+    features[4] += GetPentagramProbability(s[i-4],s[i-3],s[i-2],s[i-1],s[i]);
+  }
+}
+
+//linear interpolation of the char n-gram models, in -log2 space: lambda1 * unigramSum + lambda2 * bigramSum + ...
+double LanguageModel::CharGramScore(const string& s)
+{
+  double features[MAX_CHAR_GRAM], score = 0.0;
+
+  CharGramFeatures(s,features);
+  for(int i = 0; i < MAX_CHAR_GRAM; i++){
+    score += charLambdas[i] * features[i];
+  }
+
+  return score;
+}
+
+/*
+  Lambda file format is one "n<TAB>lambda" line per model order, eg "3\t42.666666" for the trigram weight.
+  Orders missing from the file keep their current value. Returns false (and leaves the lambdas alone) if the file
+  can't be read, which is normal if the optimizer has never been run.
+*/
+bool LanguageModel::LoadCharLambdas(const string& lambdaFile)
+{
+  int ntoks, n, loaded = 0;
+  char buf[BUFSIZE];
+  char* tokens[8] = {NULL,NULL,NULL,NULL,NULL,NULL,NULL,NULL};
+  fstream infile(lambdaFile.c_str(), ios::in);
+  string delims = "\t";
+
+  if(!infile){
+    cout << " > no lambda file " << lambdaFile << ", using default char n-gram lambdas" << endl;
+    return false;
+  }
+
+  while(infile.getline(buf,BUFSIZE)){
+    if(buf[0] == '#' || buf[0] == '\0'){
+      continue;
     }
-    //quadgram conditioning
-    for(i = 3; i < it->first.size(); i++){
-      //cout << "here4" << endl;
-      ngram_val += (CHAR_QUADGRAM_LAMBDA * GetQuadgramProbability(it->first[i-3],it->first[i-2],it->first[i-1],it->first[i]));
+    ntoks = Tokenize(tokens,buf,delims);
+    if(ntoks == 2){
+      n = atoi(tokens[0]);
+      if(n >= 1 && n <= MAX_CHAR_GRAM){
+        charLambdas[n-1] = atof(tokens[1]);
+        loaded++;
+      }
+      else{
+        cout << "WARNING n-gram order " << tokens[0] << " out of range in lambda file: " << lambdaFile << endl;
+      }
     }
-    //pentagram conditioning
-    for(i = 4; i < it->first.size(); i++){
-      //cout << "here5" << endl;
-      ngram_val += (CHAR_PENTAGRAM_LAMBDA * GetPentagramProbability(it->first[i-4],it->first[i-3],it->first[i-2],it->first[i-1],it->first[i]));
+    else{
+      cout << "WARNING incorrect number of tokens found in lambda file: " << lambdaFile << endl;
     }
-    it->second += (ngram_val * CHAR_NGRAM_MODEL_WEIGHT);
-    //cout << "here6..." << endl;
   }
+  infile.close();
+
+  cout << " > loaded " << loaded << " char n-gram lambdas from " << lambdaFile << ":";
+  for(n = 0; n < MAX_CHAR_GRAM; n++){
+    cout << " " << charLambdas[n];
+  }
+  cout << endl;
+
+  return loaded > 0;
+}
+
+bool LanguageModel::SaveCharLambdas(const string& lambdaFile)
+{
+  fstream outfile(lambdaFile.c_str(), ios::out);
+
+  if(!outfile){
+    cout << "ERROR could not open file: " << lambdaFile << endl;
+    return false;
+  }
+
+  outfile.precision(10);
+  outfile << "#char n-gram interpolation weights: order<TAB>lambda" << endl;
+  for(int n = 0; n < MAX_CHAR_GRAM; n++){
+    outfile << (n + 1) << "\t" << charLambdas[n] << endl;
+  }
+  outfile.close();
+
+  return true;
 }
 
 /*
@@ -168,6 +266,7 @@ void LanguageModel::MajorityVoteFilter(LatticePaths& paths, int topN, int k, vec
   int col, i, j, max, latticeWidth = paths.begin()->first.length();
   LatticePathsIt inner;
   char maxChar;
+  U8 charMap[SMALL_BUFSIZE];  //per call, so concurrent sessions can share the model
   string s;
 
   //TODO: get this to run faster. Its a bit of a puzzle.
@@ -185,17 +284,17 @@ void LanguageModel::MajorityVoteFilter(LatticePaths& paths, int topN, int k, vec
     max = -1;
     for(j = 0, inner = paths.begin(); inner != paths.end() && j < topN; ++inner, j++){
       ++charMap[ (int)inner->first[col] ];
-      cout << "val=" << (U32)inner->first[col] << endl;
+      LOG_TRACE("val=" << (U32)inner->first[col]);
       if(charMap[ (int)inner->first[col] ] > max){
         max = charMap[ (int)inner->first[col] ];
         maxChar = inner->first[col];
       }
     }
-    cout << "max is: " << maxChar << endl;
+    LOG_TRACE("max is: " << maxChar);
     s += maxChar;
   }
 
-  cout << "majority string=" << s << " of the top " << k << " results" << endl;
+  LOG_DEBUG("majority string=" << s << " of the top " << k << " results");
   output.push_back(s);
 
   //TODO: top-k, using std-dev
@@ -204,7 +303,8 @@ void LanguageModel::MajorityVoteFilter(LatticePaths& paths, int topN, int k, vec
 
 void LanguageModel::Process(LatticePaths& edits)
 {
-  cout << "lm.process()..." << endl;
+  METRICS_SCOPE(STAGE_LM_RESCORE);
+  LOG_DEBUG("lm.process()...");
   //TruncateResults(edits, 100);
   ReconditionByCharGrams(edits);
 
@@ -212,11 +312,85 @@ void LanguageModel::Process(LatticePaths& edits)
   //So eliminate candidates in the [100:end] range to reduce search complexity
   //TruncateResults(edits, 100);
 
+  if(editIndex != NULL){
+    SearchForEdits(edits, MAX_EDIT_DIST); //edit distance processing. second parameter is max edit-distances to search for.
+  }
   //TODO
-  //SearchForEdits(edits, 2); //edit distance processing. second parameter is max edit-distances to search for.
   //ReconditionByWordGrams(list<string> usersPreviousInputs, edits);  
-  cout << "sorting lm results..." << endl;
+  LOG_DEBUG("sorting lm results...");
   edits.sort(ByLogProb);
+  TRACE_EVENT(TRACE_LM_DONE,edits.size(),edits.empty() ? 0.0 : edits.begin()->second);
+}
+
+void LanguageModel::SetEditIndex(EditIndex* editIndexPtr)
+{
+  editIndex = editIndexPtr;
+}
+
+/*
+  The cost of one edit in SearchForEdits: EDIT_DIST_PENALTY bits under every char model, weighted as
+  ReconditionByCharGrams weights them, so it's on the same scale as the char-gram part of a path's score.
+*/
+double LanguageModel::EditPenalty(void)
+{
+  double lambdaSum = 0.0;
+
+  for(int i = 0; i < MAX_CHAR_GRAM; i++){
+    lambdaSum += charLambdas[i];
+  }
+
+  return EDIT_DIST_PENALTY * lambdaSum * CHAR_NGRAM_MODEL_WEIGHT;
+}
+
+/*
+  Maps the top lattice paths onto real vocabulary words. Lattice paths are just character strings, most of
+  which aren't words; each of the top EDIT_SEARCH_DEPTH paths is looked up in the edit index, and every word within
+  maxEdits of it is rescored: the path's lattice score (its score less its own char-gram score), plus the word's
+  char-gram score, plus EditPenalty per edit. A word reachable from several paths keeps its best score. The output
+  replaces the input list, in word order, so that the caller's stable sort breaks ties the same way every time.
+
+  Precondition: edits are sorted, and have already been conditioned by char-grams, so the top paths are the best ones.
+*/
+void LanguageModel::SearchForEdits(LatticePaths& edits, int maxEdits)
+{
+  int i;
+  double score, latticeScore, penalty = EditPenalty();
+  LatticePathsIt it;
+  SearchResults neighbors;
+  SearchResultIt nit;
+  WordScores bestScores;
+  WordScores gramScores;  //each word's char-gram score, which doesn't depend on the path
+  WordScores::iterator bit;
+
+  edits.sort(ByLogProb);
+  for(i = 0, it = edits.begin(); i < EDIT_SEARCH_DEPTH && it != edits.end(); ++it, i++){
+    neighbors.clear();
+    editIndex->Search(it->first,maxEdits,neighbors);
+    latticeScore = it->second - CharGramScore(it->first) * CHAR_NGRAM_MODEL_WEIGHT;
+    for(nit = neighbors.begin(); nit != neighbors.end(); ++nit){
+      bit = gramScores.find(nit->first);
+      if(bit == gramScores.end()){
+        bit = gramScores.insert(std::make_pair(nit->first,CharGramScore(nit->first) * CHAR_NGRAM_MODEL_WEIGHT)).first;
+      }
+      score = latticeScore + bit->second + nit->second * penalty;
+      bit = bestScores.find(nit->first);
+      if(bit == bestScores.end() || score < bit->second){
+        bestScores[nit->first] = score;
+      }
+    }
+  }
+
+  //if no path is near any word, leave the paths as they were, rather than return nothing
+  if(bestScores.empty()){
+    LOG_WARN("no vocabulary words within " << maxEdits << " edits of the top lattice paths");
+    return;
+  }
+
+  edits.clear();
+  for(bit = bestScores.begin(); bit != bestScores.end(); ++bit){
+    edits.push_back(LatticePath(bit->first,bit->second));
+  }
+  edits.sort();
 }
 
 /*
@@ -436,6 +610,12 @@ double LanguageModel::GetTrigramProbability(char a, char b, char c)
 //return probability of d, given abc
 double LanguageModel::GetQuadgramProbability(char a, char b, char c, char d)
 {
+  double prob;
+
+  if(quadgramHash.IsLoaded()){
+    return quadgramHash.Find(GetQuadgramKey(a,b,c,d),prob) ? prob : DEFAULT_LOG_PROB * 1.5;
+  }
+
   CharGramIt it = quadgramModel.find( GetQuadgramKey(a,b,c,d) );  //returns zero if these elements are new to the model, which they never should be
 
   if(it != quadgramModel.end()){
@@ -451,6 +631,12 @@ double LanguageModel::GetQuadgramProbability(char a, char b, char c, char d)
 //which requires a compression scheme of converting a char to 6-bit encoding. This is handled by CompressedChar().
 double LanguageModel::GetPentagramProbability(char a, char b, char c, char d, char e)
 {
+  double prob;
+
+  if(pentagramHash.IsLoaded()){
+    return pentagramHash.Find(GetPentagramKey(a,b,c,d,e),prob) ? prob : DEFAULT_LOG_PROB * 1.5;
+  }
+
   CharGramIt it = pentagramModel.find( GetPentagramKey(a,b,c,d,e) );
 
   if(it != pentagramModel.end()){
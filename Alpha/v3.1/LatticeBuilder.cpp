@@ -326,17 +326,21 @@ void PrintLattice(const Lattice& lattice)
 */
 void LatticeBuilder::BuildStaticLattice(vector<PointMu>& pointMeans, Lattice& lattice)
 {
-  cout << "in BuildStaticLattice(), inData.size()=" << pointMeans.size() << endl;
+  METRICS_SCOPE(STAGE_LATTICE_BUILD);
+  LOG_DEBUG("in BuildStaticLattice(), inData.size()=" << pointMeans.size());
 
   //for each point in inData, map it to a collection of immediate neighbors (keys), each with a probability with respect to its distance from the point
   for(int i = 0; i < pointMeans.size(); i++){
-    cout << "appending mean: <" << pointMeans[i].pt.X << "," << pointMeans[i].pt.Y << ">" << endl;
+    LOG_DEBUG("appending mean: <" << pointMeans[i].pt.X << "," << pointMeans[i].pt.Y << ">");
     AppendCluster(pointMeans[i], lattice);
     //these types are wrong. this should be some graph/lattice type
     //SearchForNeighborKeys(inData[i],neighbors);  //gets all the neighbors and assigns physical probabilities to each one
     //lattice.push_back(neighbors);
   }
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
   PrintLattice(lattice);
+#endif
+  TRACE_EVENT(TRACE_LATTICE_BUILT,lattice.size(),0);
 }
 
 /*
@@ -387,7 +391,7 @@ void LatticeBuilder::InitCluster(Cluster& newCluster, PointMu& mu)
   Point tempPt;
   //lookup nearest neighbors
   char nearest = layoutManager->FindNearestKey(mu.pt);
-  cout << "nearest=" << nearest << endl;
+  LOG_DEBUG("nearest=" << nearest);
   vector<char>* neighbors = layoutManager->GetNeighborPtr(nearest);
 
   //get the likelihood of a reflexive arc on this cluster
@@ -23,7 +23,7 @@ LayoutManager::~LayoutManager()
 //Finds the avg direction for a sequence of vectors. This is given by the average of the normalized components
 // StackOverflow: Compute unit vectors from the angles and take the angle of their average.
 // Avg is over the velocity vectors <dx,dy> for that point-set. So if there are n points, then there are n-1 direction/velocity vectors in the average.
-double LayoutManager::AvgTheta(vector<Point>& inData, int start, int npts)
+double LayoutManager::AvgTheta(const PointSpan& inData, int start, int npts)
 {
   //double xSum, ySum, len, muTheta;
   double muTheta, vX, vY; //velocity vector components
@@ -64,7 +64,7 @@ double LayoutManager::AvgTheta(vector<Point>& inData, int start, int npts)
 }
 
 //averages dydx over some segment of a point sequence
-double LayoutManager::AvgDyDx(vector<Point>& pts, int start, int npts)
+double LayoutManager::AvgDyDx(const PointSpan& pts, int start, int npts)
 {
   double avgDyDx = 0.0;
 
@@ -150,16 +150,56 @@ int LayoutManager::AbsDiff(int i, int j)
 }
 
 
+/*
+  Exact squared pixel distance, which orders points the same as the real distance does, which is all a nearest-point
+  search needs. Raw samples can be any shorts (nothing range-checks the daemon's frames, libfastkey's points or a
+  stdin stream), so a difference can be up to 65535 and its square overflows an int; the squares are summed in 64 bits.
+*/
+U64 LayoutManager::SquaredDistance(const Point& p1, const Point& p2)
+{
+  long long dx = p1.X - p2.X, dy = p1.Y - p2.Y;
+
+  return (U64)(dx * dx + dy * dy);
+}
+
 //for integer pixel distances
 int LayoutManager::IntDistance(const Point& p1, const Point& p2)
 {
-  return (short int)sqrt(pow((double)(p1.X - p2.X),2.0) + pow((double)(p1.Y - p2.Y),2.0));
+  return (short int)sqrt((double)SquaredDistance(p1,p2));
 }
 
 //for real-valued distances, e.g. when mapping distances to a probability in range 0-1
 double LayoutManager::DoubleDistance(const Point& p1, const Point& p2)
 {
-  return sqrt(pow((double)(p1.X - p2.X),2.0) + pow((double)(p1.Y - p2.Y),2.0));
+  double dx = p1.X - p2.X, dy = p1.Y - p2.Y;
+
+  return sqrt(dx * dx + dy * dy);
+}
+
+/*
+  Fills row, indexed by (U8) char, with p's distance to every char's key; chars without a key get GetPoint's default,
+  as a GetPoint lookup would. A word's metrics charge each of its chars against one of the clusters, so tabling the
+  clusters' rows once per word (KeyDistanceTable) replaces a map lookup and a sqrt per candidate char with a load.
+*/
+void LayoutManager::KeyDistances(const Point& p, double* row)
+{
+  double noKey = DoubleDistance(p,Point());
+
+  for(int c = 0; c < KEY_TABLE_SIZE; c++){
+    row[c] = noKey;
+  }
+  for(size_t k = 0; k < keyChars.size(); k++){
+    row[(U8)keyChars[k]] = DoubleDistance(p,keyPoints[k]);
+  }
+}
+
+//the KeyDistances rows of every mean, one after another: mean i's distance to char c is table[i * KEY_TABLE_SIZE + (U8)c]
+void LayoutManager::KeyDistanceTable(const vector<PointMu>& pointMeans, vector<double>& table)
+{
+  table.resize(pointMeans.size() * KEY_TABLE_SIZE);
+  for(size_t i = 0; i < pointMeans.size(); i++){
+    KeyDistances(pointMeans[i].pt,&table[i * KEY_TABLE_SIZE]);
+  }
 }
 
 void LayoutManager::BuildKeyMap(const string& keyFileName)
@@ -170,6 +210,7 @@ void LayoutManager::BuildKeyMap(const string& keyFileName)
 
   BuildKeyMapCoordinates(keyFileName);
   BuildKeyMapClusters();
+  BuildKeyArrays();
   SetMinKeyDists();
   InitLayoutDimensions();
 }
@@ -470,7 +511,7 @@ void LayoutManager::BuildKeyMapClusters(void)
   keyMap['?'].second.push_back('"');
 }
 
-double LayoutManager::AvgDistance(vector<Point>& pts, int begin, int nPts)
+double LayoutManager::AvgDistance(const PointSpan& pts, int begin, int nPts)
 {
   double dist = 0.0;
 
@@ -483,14 +524,14 @@ double LayoutManager::AvgDistance(vector<Point>& pts, int begin, int nPts)
 }
 
 //return covariance of a set of (x,y) points
-double LayoutManager::CoVariance(vector<Point>& pts, int begin, int nPts)
+double LayoutManager::CoVariance(const PointSpan& pts, int begin, int nPts)
 {
   int i, j;
   double muX, muY, cv;
 
   //get the means  
   muX = muY = 0.0;
-  for(i = begin; i < pts.size() && i < (i+nPts); i++){
+  for(i = begin; i < pts.size() && i < (begin+nPts); i++){
     muX += pts[i].X;
     muY += pts[i].Y;
   }
@@ -498,7 +539,7 @@ double LayoutManager::CoVariance(vector<Point>& pts, int begin, int nPts)
   muY /= (double)nPts;
 
   cv = 0.0;
-  for(i = begin; i < pts.size() && i < (i+nPts); i++){
+  for(i = begin; i < pts.size() && i < (begin+nPts); i++){
     cv += ((pts[i].X - muX)*(pts[i].Y - muY));
   }
   cv /= (double)nPts;
@@ -507,7 +548,7 @@ double LayoutManager::CoVariance(vector<Point>& pts, int begin, int nPts)
 }
 
 //returns standard deviation of x values in some sequence of (x,y) coordinates
-double LayoutManager::StDev_X(vector<Point>& pts, int begin, int nPts)
+double LayoutManager::StDev_X(const PointSpan& pts, int begin, int nPts)
 {
   int i;
   double muY = 0.0, sum = 0.0;
@@ -519,14 +560,14 @@ double LayoutManager::StDev_X(vector<Point>& pts, int begin, int nPts)
   muY /= nPts;
 
   for(i = begin; i < pts.size() && i < (begin+nPts); i++){
-    sum += pow((pts[i].Y - muY),2.0);
+    sum += (pts[i].Y - muY) * (pts[i].Y - muY);
   }
 
-  sum = pow(sum,0.5);
+  sum = sqrt(sum);
   return sum;
 }
 //returns standard deviation of y values in some sequence of (x,y) coordinates
-double LayoutManager::StDev_Y(vector<Point>& pts, int begin, int nPts)
+double LayoutManager::StDev_Y(const PointSpan& pts, int begin, int nPts)
 {
   int i;
   double muX = 0.0, sum = 0.0;
@@ -538,15 +579,15 @@ double LayoutManager::StDev_Y(vector<Point>& pts, int begin, int nPts)
   muX /= nPts;
 
   for(i = begin; i < pts.size() && i < (begin+nPts); i++){
-    sum += pow((pts[i].X - muX),2.0);
+    sum += (pts[i].X - muX) * (pts[i].X - muX);
   }
   
-  sum = pow(sum,0.5);
+  sum = sqrt(sum);
   return sum;
 }
 
 //returns sigmaX*sigmaY across the (X,Y) vals in a sequence
-double LayoutManager::CoStdDeviation(vector<Point>& pts, int begin, int nPts)
+double LayoutManager::CoStdDeviation(const PointSpan& pts, int begin, int nPts)
 {
   return StDev_Y(pts,begin,nPts) * StDev_X(pts,begin,nPts);
 }
@@ -565,11 +606,12 @@ void LayoutManager::SearchForNeighborKeys(const Point& p, vector<State>& neighbo
   double logProbability;
   double minDist = 999999;
   char c = FindNearestKey(p);
+  KeyMapIt key = keyMap.find(c);
 
-  for(int i = 0; i < keyMap[c].second.size(); i++){
+  for(int i = 0; key != keyMap.end() && i < key->second.second.size(); i++){
     State s;
-    s.symbol = keyMap[c].second[i];
-    s.pState = DoubleDistance(p,keyMap[c].first);
+    s.symbol = key->second.second[i];
+    s.pState = DoubleDistance(p,key->second.first);
     if(s.pState < minDist){
       minDist = s.pState;
     }
@@ -667,11 +709,13 @@ void LayoutManager::PrintKeyMap(void)
 */
 void LayoutManager::SetMinKeyDists(void)
 {
-  double dist, min = 99999;
+  U64 dist, min = ULLONG_MAX;
 
   if(keyMap.empty()){
     cout << "ERROR keyMap empty in SetMinKeyDists" << endl;
     this->minKeyRadius = 0;
+    this->minKeyRadiusSq = 0;
+    this->minSeparationSq = 0;
     return;
   }
 
@@ -682,7 +726,7 @@ void LayoutManager::SetMinKeyDists(void)
       //added this to skip omitted chars, like punctuation, when these aren't in the model
       if(tortoise->second.first.X != 0 && tortoise->second.first.Y != 0 && hare->second.first.X && hare->second.first.Y != 0){
         if(tortoise != hare && hare->first != tortoise->first){
-		      dist = DoubleDistance(tortoise->second.first,hare->second.first);
+		      dist = SquaredDistance(tortoise->second.first,hare->second.first);
 		      if(dist < min){
             cout << tortoise->second.first.X << "," << tortoise->second.first.Y << " " << hare->second.first.X << "," << hare->second.first.Y << endl;
             //cout << "dist=" << dist << endl;
@@ -693,36 +737,67 @@ void LayoutManager::SetMinKeyDists(void)
     }
   }
 
-  cout << "min diameter: " << min << endl;
-  this->minKeyDiameter = min;
-  this->minKeyRadius = min / 2.0;
+  this->minKeyDiameter = sqrt((double)min);
+  this->minKeyRadius = this->minKeyDiameter / 2.0;
+  cout << "min diameter: " << this->minKeyDiameter << endl;
+
+  minKeyRadiusSq = SquaredThreshold(minKeyRadius);
+  minSeparationSq = SquaredThreshold(minKeyDiameter * 1.5);
 
   cout << "min diameter: " << this->minKeyDiameter << "  minkey radius: " << this->minKeyRadius << endl;
 }
 
+//the least s with sqrt(s) >= dist, so the squared distances under s are exactly those whose real distance is under dist
+U64 LayoutManager::SquaredThreshold(double dist)
+{
+  U64 s = (U64)ceil(dist * dist);
+
+  while(s > 0 && sqrt((double)(s - 1)) >= dist){
+    s--;
+  }
+  while(sqrt((double)s) < dist){
+    s++;
+  }
+
+  return s;
+}
+
+//copies the keys' chars and points out of keyMap, in its order, for the searches that scan every key
+void LayoutManager::BuildKeyArrays(void)
+{
+  keyChars.clear();
+  keyPoints.clear();
+  for(KeyMapIt it = keyMap.begin(); it != keyMap.end(); ++it){
+    keyChars.push_back(it->first);
+    keyPoints.push_back(it->second.first);
+  }
+}
+
 /*
-  Iterate over the map looking for key nearest to some point p.
+  Iterate over the keys looking for key nearest to some point p.
   
   TODO: This could be a lot faster than linear search. It will be called for every mean from
   the SingularityBuilder, so eliminating it might speed things a bit.  Could at least return 
   as soon as we find a min-distance that is less than the key width (or width/2), such that
   no other key could be closer than this value.
+
+  Compares squared distances, in integers, over the flat key arrays; same keys, same order and same early exit as
+  comparing the real distances over keyMap, so the same key wins.
 */
 char LayoutManager::FindNearestKey(const Point& p)
 {
   char c;
-  double dist, min = 99999;
+  U64 dist, min = ULLONG_MAX;
 
   //rather inefficiently searches over the entire keyboard... this could be improved with another lookup datastructure
-  for(KeyMapIt it = this->keyMap.begin(); it != this->keyMap.end(); ++it){
-    dist = DoubleDistance(it->second.first,p);
-    //cout << "dist(" << it->first << ",pt)=" << dist << endl;
+  for(size_t k = 0; k < keyPoints.size(); k++){
+    dist = SquaredDistance(keyPoints[k],p);
     if(min > dist){
       min = dist;
-      if(min < this->minKeyRadius){  //small, dumb optimization. return when dist is below some threshold, such that no other key could be nearer
-        return it->first;
+      if(min < minKeyRadiusSq){  //small, dumb optimization. return when dist is below some threshold, such that no other key could be nearer
+        return keyChars[k];
       }
-      c = it->first;
+      c = keyChars[k];
     }
   }
 
@@ -739,13 +814,22 @@ double LayoutManager::GetMinKeyDiameter(void)
   return minKeyDiameter;
 }
 
+/*
+  The key-map is shared by every decoding session, so these lookups must never insert (as keyMap[] would on a symbol
+  that isn't a key, eg from an accented vocabulary word); unknown symbols get an empty neighbor list and the origin.
+*/
 vector<char>* LayoutManager::GetNeighborPtr(char index)
 {
-  return &keyMap[index].second;
+  static vector<char> noNeighbors;  //always empty
+  KeyMapIt it = keyMap.find(index);
+
+  return (it != keyMap.end()) ? &it->second.second : &noNeighbors;
 }
 Point LayoutManager::GetPoint(char symbol)
 {
-  return keyMap[symbol].first;
+  KeyMapIt it = keyMap.find(symbol);
+
+  return (it != keyMap.end()) ? it->second.first : Point();
 }
 
 
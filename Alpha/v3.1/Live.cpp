@@ -0,0 +1,202 @@
+#include "Controller.hpp"
+#include <unistd.h>
+#include <signal.h>
+
+/*
+  Live decoding from a sensor source (see SensorSource.cpp): samples go straight from the source's thread into a
+  GazeStream, which cuts them into words and decodes each one as soon as it's cut. Each word is printed as it's
+  decoded, with its latency from the cut (the end of the dwell that ended it) to its results.
+
+    live x11                       pointer motion over the X root window (build with SENSORFLAGS, see makefile)
+    live evdev /dev/input/eventN   a mouse, tablet or tracker device
+    live stdin                     "x y" lines, eg  ../../listenerTesting/xLibListener | ./live stdin
+    live trace file.gzt            a gaze trace file's sessions, back to back
+    live synth [sentence]          synthetic traces of the sentence's words (default LIVE_SENTENCE)
+
+  Any argument name=value sets an option:
+    speed=1        pace of the trace and synth sources, as a multiple of real time; 0 for as fast as possible
+    path=direct    or lattice
+    cluster=       the ClusterRegistry strategy to cluster with (default DEFAULT_CLUSTER_STRATEGY)
+    filter=on      or off: smooth the samples with a GazeFilter as they arrive (default GAZE_FILTER_DEFAULT)
+    seed=1         for synth
+    width=, height=  the screen an evdev device's motion is mapped onto (default the layout's, plus the space bar)
+
+  The device sources run until interrupted (Ctrl-C), the others until their input ends.
+*/
+
+#define LIVE_SENTENCE "THE QUICK BROWN FOX JUMPED OVER THE LAZY DOG"
+
+static volatile sig_atomic_t interrupted = 0;
+
+static void OnInterrupt(int)
+{
+  interrupted = 1;
+}
+
+class Live{
+  public:
+    DecoderModels* models;
+    std::mutex mutex;  //serializes the stream's output with the main thread's
+    U64 numWords;
+    double latencySumMs;
+
+    Live();
+    ~Live();
+
+    void Decoded(SearchResults& results, U64 startUs, U64 endUs, U64 cutUs);
+    bool Run(SensorSource* source, int path, const string& clusterer, bool filtering, bool untilInterrupted);
+};
+
+Live::Live()
+{
+  numWords = 0;
+  latencySumMs = 0.0;
+
+  Silence(true);
+  models = new DecoderModels("../TestInput/EyeInputs/Test1/keyMap.txt","../vocabModel.txt");
+  Silence(false);
+}
+
+Live::~Live()
+{
+  delete models;
+}
+
+//a StreamCallback; the decoder's own output is silenced, so this writes to the real stdout
+void Live::Decoded(SearchResults& results, U64 startUs, U64 endUs, U64 cutUs)
+{
+  char line[BUFSIZE];
+  int n;
+  double latencyMs = (SensorSource::NowUs() - cutUs) / 1000.0;
+  SearchResultIt it = results.begin();
+
+  std::lock_guard<std::mutex> lock(mutex);
+  numWords++;
+  latencySumMs += latencyMs;
+  n = snprintf(line,BUFSIZE,"%-16s %7.1f ms  (%.2f s of gaze)  next:",results.empty() ? "?" : it->first.c_str(),latencyMs,(endUs - startUs) / 1.0e6);
+  for(int i = 0; i < 4 && !results.empty() && ++it != results.end() && n < BUFSIZE; i++){
+    n += snprintf(line + n,BUFSIZE - n," %s",it->first.c_str());
+  }
+  n = std::min(n,BUFSIZE - 2);
+  line[n++] = '\n';
+  write(RealStdout(),line,n);
+}
+
+bool Live::Run(SensorSource* source, int path, const string& clusterer, bool filtering, bool untilInterrupted)
+{
+  SessionPool pool(models,0);
+  GazeStream stream(&pool,path,[this](SearchResults& results, U64 startUs, U64 endUs, U64 cutUs){
+    Decoded(results,startUs,endUs,cutUs);
+  });
+
+  stream.filtering = filtering;
+  if(!stream.session->SetClusterStrategy(clusterer) || !source->Start(&stream.queue)){
+    return false;
+  }
+  Silence(true);
+  if(untilInterrupted){
+    signal(SIGINT,OnInterrupt);
+    while(!interrupted){
+      usleep(SENSOR_POLL_MS * 1000);
+    }
+    source->Stop();
+  }
+  else{
+    source->Join();
+  }
+  stream.Close();
+  Silence(false);
+
+  printf("%llu samples, %llu words, mean latency %.1f ms\n",stream.numSamples,numWords,numWords ? latencySumMs / numWords : 0.0);
+
+  return true;
+}
+
+int main(int argc, char* argv[])
+{
+  int path = DECODE_DIRECT, width = 0, height = 0, seed = 1;
+  double speed = 1.0;
+  bool untilInterrupted = false, filtering = GAZE_FILTER_DEFAULT;
+  string mode, arg, name, sentence = LIVE_SENTENCE, word, clusterer = DEFAULT_CLUSTER_STRATEGY;
+  vector<string> positional, words;
+  SensorSource* source = NULL;
+
+  for(int i = 1; i < argc; i++){
+    arg = argv[i];
+    if(arg.find('=') == string::npos){
+      positional.push_back(arg);
+      continue;
+    }
+    name = arg.substr(0,arg.find('='));
+    arg = arg.substr(arg.find('=') + 1);
+    if(name == "speed"){
+      speed = atof(arg.c_str());
+    }
+    else if(name == "path"){
+      path = (arg == "lattice") ? DECODE_LATTICE_LM : DECODE_DIRECT;
+    }
+    else if(name == "cluster"){
+      clusterer = arg;
+    }
+    else if(name == "filter"){
+      filtering = (arg == "on");
+    }
+    else if(name == "seed"){
+      seed = atoi(arg.c_str());
+    }
+    else if(name == "width"){
+      width = atoi(arg.c_str());
+    }
+    else if(name == "height"){
+      height = atoi(arg.c_str());
+    }
+    else{
+      cout << "ERROR unknown option: " << name << endl;
+      return 1;
+    }
+  }
+  mode = positional.empty() ? "" : positional[0];
+
+  Live live;
+  if(width <= 0){
+    width = live.models->layoutManager->GetWidth();
+  }
+  if(height <= 0){
+    height = live.models->layoutManager->GetPoint(' ').Y + (int)live.models->layoutManager->minKeyRadius;
+  }
+
+  if(mode == "x11"){
+    source = new X11SensorSource();
+    untilInterrupted = true;
+  }
+  else if(mode == "evdev" && positional.size() >= 2){
+    source = new EvdevSensorSource(positional[1],width,height);
+    untilInterrupted = true;
+  }
+  else if(mode == "stdin"){
+    source = new StdinSensorSource();
+  }
+  else if(mode == "trace" && positional.size() >= 2){
+    source = new GazeTraceSensorSource(positional[1],speed);
+  }
+  else if(mode == "synth"){
+    if(positional.size() >= 2){
+      sentence = positional[1];
+    }
+    std::transform(sentence.begin(),sentence.end(),sentence.begin(),::toupper);
+    std::istringstream tokens(sentence);
+    while(tokens >> word){
+      words.push_back(word);
+    }
+    source = new SyntheticSensorSource(live.models->layoutManager,TraceGenParams(),seed,words,speed);
+  }
+  else{
+    cout << "usage: " << argv[0] << " x11 | evdev /dev/input/eventN | stdin | trace file" << GAZE_TRACE_EXT << " | synth [sentence]  [speed=1] [path=direct|lattice] [cluster=" << DEFAULT_CLUSTER_STRATEGY << "] [filter=on|off] [seed=1] [width=] [height=]" << endl;
+    return 1;
+  }
+
+  bool ok = live.Run(source,path,clusterer,filtering,untilInterrupted);
+  delete source;
+
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,581 @@
+#include "Header.hpp"
+#include <thread>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+/*
+  Offline tool for building our own character n-gram models (and vocabulary) from a raw text corpus, instead of the
+  practicalcryptography/COCA derived files massaged by parseGram.py. See the IP note in Header.hpp.
+
+  Usage: ngramCounter corpusFile [outputDir=.] [numThreads=ncores] [minWordCount=1]
+
+  Writes, to outputDir:
+    unigrams.txt ... pentagrams.txt   "gram<TAB>-log2 P(last char | previous chars)", exactly as LanguageModel::BuildCharacterNgramModel reads them
+    vocabModel.txt                    one word per line, as DirectInference::BuildWordModel reads it
+    wordCounts.txt                    "word<TAB>count", most frequent first
+    checkThese.txt                    improbable short words that were left out of the vocab, for manual checking (as in filterLexicon.py)
+
+  Method: n-grams are bounded by words (never spanning a space), so the n-gram counts of the corpus are exactly the
+  n-gram counts of each distinct word times its frequency. So the expensive pass over the corpus only tokenizes and
+  counts words, and the char-grams are counted afterward from the (much smaller) word table.
+    1) the corpus is mmap'ed and cut into one slice per thread, each slice starting and ending on whitespace
+    2) each thread tokenizes its slice, filters tokens like filterLexicon.py, and counts words into its own hash
+       tables, one per shard (by word hash, one shard per thread). No locks or shared writes.
+    3) thread s merges shard s from every thread, then counts the char-grams of its merged shard into its own tables
+    4) the per-shard gram tables are summed, normalized to conditional -log2 probabilities, and written out
+  1-4 grams are dense arrays indexed in base 26 (26^4 = 456976 entries); 5-grams are too sparse for that and are hashed.
+*/
+
+#define NGRAM_MAX_N 5
+#define NGRAM_MAX_WORD_LEN 64
+#define SHORT_WORD_LEN 4  //words shorter than this are filtered by probability, as in filterLexicon.py
+#define SHORT_WORD_LOG_THRESHOLD 22.0  //-log2 probability (among short words) above which short words go to checkThese.txt
+//char class flags, so the per-byte tests in the tokenizer are table lookups instead of strchr()
+#define CC_STRIP 1   //punctuation stripped from either end of a token
+#define CC_VOWEL 2   //aeiou (filterLexicon.py also counts y as a vowel, but not as a non-consonant)
+#define CC_Y 4
+
+//open-addressing hash table of lowercase words -> counts. Keys live in a flat char arena, so inserts don't allocate per word.
+class WordTable{
+  public:
+    struct Entry{
+      U32 offset;  //key offset in arena
+      U32 len;
+      U64 hash;
+      U64 count;   //0 means empty slot
+    };
+    vector<Entry> slots;
+    vector<char> arena;
+    U32 used;
+    U32 mask;
+
+    WordTable();
+    void Add(const char* key, U32 len, U64 hash, U64 count);
+    void Grow(void);
+    string Key(const Entry& e);
+};
+
+class NgramCounter{
+  public:
+    const char* corpus;   //the mmap'ed corpus
+    size_t corpusSize;
+    int numThreads;
+    U64 minWordCount;
+    vector<vector<WordTable> > threadShards;  //threadShards[t][s]: words counted by thread t, in shard s
+    vector<WordTable> mergedShards;           //mergedShards[s]: shard s over all threads
+    vector<vector<U64> > shardGrams;          //shardGrams[s]: dense 1-4 gram counts from shard s, all n in one array
+    vector<unordered_map<U32,U64> > shardPentagrams;
+    vector<U64> tokenCounts;                  //per thread, for reporting
+    vector<U64> validCounts;
+    U32 gramOffsets[NGRAM_MAX_N];             //start of each n's counts in the dense arrays (n-1 indexed)
+    U8 charClass[256];
+
+    NgramCounter(int nThreads, U64 minCount);
+    ~NgramCounter();
+
+    bool Run(const string& corpusFile, const string& outDir);
+    void CountSlice(int thread, size_t begin, size_t end);
+    void MergeShard(int shard);
+    void CountWordGrams(int shard, const char* word, U32 len, U64 count);
+    bool IsValid(const char* word, int len);
+    U64 HashWord(const char* word, U32 len);
+    void WriteGrams(const string& outDir);
+    void WriteVocab(const string& outDir);
+};
+
+WordTable::WordTable()
+{
+  used = 0;
+  slots.resize(1024);
+  mask = slots.size() - 1;
+  for(U32 i = 0; i < slots.size(); i++){
+    slots[i].count = 0;
+  }
+}
+
+string WordTable::Key(const Entry& e)
+{
+  return string(&arena[e.offset],e.len);
+}
+
+void WordTable::Grow(void)
+{
+  U32 i, slot;
+  vector<Entry> old;
+
+  old.swap(slots);
+  slots.resize(old.size() * 2);
+  mask = slots.size() - 1;
+  for(i = 0; i < slots.size(); i++){
+    slots[i].count = 0;
+  }
+  for(i = 0; i < old.size(); i++){
+    if(old[i].count > 0){
+      for(slot = old[i].hash & mask; slots[slot].count > 0; slot = (slot + 1) & mask);
+      slots[slot] = old[i];
+    }
+  }
+}
+
+void WordTable::Add(const char* key, U32 len, U64 hash, U64 count)
+{
+  U32 slot;
+  Entry* e;
+
+  for(slot = hash & mask; slots[slot].count > 0; slot = (slot + 1) & mask){
+    e = &slots[slot];
+    if(e->hash == hash && e->len == len && memcmp(&arena[e->offset],key,len) == 0){
+      e->count += count;
+      return;
+    }
+  }
+
+  e = &slots[slot];
+  e->offset = arena.size();
+  e->len = len;
+  e->hash = hash;
+  e->count = count;
+  arena.insert(arena.end(),key,key + len);
+  used++;
+  //keep load under 1/2, so probe sequences stay short
+  if(used * 2 > slots.size()){
+    Grow();
+  }
+}
+
+NgramCounter::NgramCounter(int nThreads, U64 minCount)
+{
+  int n;
+  U32 size = 1;
+  const char* c;
+
+  memset(charClass,0,sizeof(charClass));
+  for(c = "\"'`([{<.,;:!?)]}>"; *c != '\0'; c++){
+    charClass[(U8)*c] |= CC_STRIP;
+  }
+  for(c = "aeiou"; *c != '\0'; c++){
+    charClass[(U8)*c] |= CC_VOWEL;
+  }
+  charClass[(U8)'y'] |= CC_Y;
+
+  corpus = NULL;
+  corpusSize = 0;
+  numThreads = nThreads;
+  minWordCount = minCount;
+
+  //dense layout: [26 unigrams][26^2 bigrams][26^3 trigrams][26^4 quadgrams]
+  gramOffsets[0] = 0;
+  for(n = 1; n < NGRAM_MAX_N; n++){
+    size *= 26;
+    gramOffsets[n] = gramOffsets[n-1] + size;
+  }
+
+  threadShards.resize(numThreads,vector<WordTable>(numThreads));
+  mergedShards.resize(numThreads);
+  shardGrams.resize(numThreads,vector<U64>(gramOffsets[NGRAM_MAX_N-1],0));
+  shardPentagrams.resize(numThreads);
+  tokenCounts.resize(numThreads,0);
+  validCounts.resize(numThreads,0);
+}
+
+NgramCounter::~NgramCounter()
+{
+  if(corpus != NULL){
+    munmap((void*)corpus,corpusSize);
+  }
+}
+
+//FNV-1a over the (already lowercased) word
+U64 NgramCounter::HashWord(const char* word, U32 len)
+{
+  U64 hash = 14695981039346656037ULL;
+
+  for(U32 i = 0; i < len; i++){
+    hash ^= (U64)(U8)word[i];
+    hash *= 1099511628211ULL;
+  }
+
+  return hash;
+}
+
+/*
+  Port of IsValid() in filterLexicon.py, for a lowercased word. Additionally, words must be all a-z, since
+  that is the only alphabet the engine models. Note the roman numeral check is case sensitive in the script
+  (it tests lowercased words against "XCIV."), so it never fires there; it's kept that way here, so this
+  tool reproduces the vocab the script built. Real words like "civic" would otherwise be dropped.
+*/
+bool NgramCounter::IsValid(const char* word, int len)
+{
+  int i;
+  bool hasVowel = false, hasConsonant = false, repeater = true;
+  static const char* validTwoChar[] = {"an","is","we","ac","dr","tv","cd","be","by","mr","ms","ok","jr","pc","so","me","to","it","he","ay","ya","as","at","do","ef","ex","go","if","in","ma","my","no","ow","of","oh","oi","on","oo","or","os","oy","pa","ew","mm","uh","up","ur","us","ax",NULL};
+
+  if(len <= 0 || len > NGRAM_MAX_WORD_LEN){
+    return false;
+  }
+
+  for(i = 0; i < len; i++){
+    //HasPunct, and the engine's alphabet
+    if(word[i] < 'a' || word[i] > 'z'){
+      return false;
+    }
+    if(charClass[(U8)word[i]] & (CC_VOWEL | CC_Y)){
+      hasVowel = true;
+    }
+    if(!(charClass[(U8)word[i]] & CC_VOWEL)){
+      hasConsonant = true;
+    }
+    if(i > 0 && word[i] != word[i-1]){
+      repeater = false;
+    }
+  }
+
+  //ValidOneChar
+  if(len == 1){
+    return word[0] == 'a' || word[0] == 'i';
+  }
+  //ValidTwoChar
+  if(len == 2){
+    for(i = 0; validTwoChar[i] != NULL; i++){
+      if(word[0] == validTwoChar[i][0] && word[1] == validTwoChar[i][1]){
+        return !repeater;  //the script still applies NotRepeater, so "mm" and "oo" are out
+      }
+    }
+    return false;
+  }
+  //NotRepeater
+  if(repeater){
+    return false;
+  }
+
+  //longer strings need a mixture of vowels and consonants
+  return hasVowel && hasConsonant;
+}
+
+/*
+  Tokenizes corpus[begin,end) on whitespace, strips surrounding punctuation from each token ("dog." -> "dog"),
+  and counts the valid words into this thread's shard tables.
+*/
+void NgramCounter::CountSlice(int thread, size_t begin, size_t end)
+{
+  size_t i, tokBegin, tokEnd;
+  int len;
+  U64 hash, tokens = 0, valid = 0;
+  char word[NGRAM_MAX_WORD_LEN];
+  vector<WordTable>& shards = threadShards[thread];
+
+  i = begin;
+  while(i < end){
+    //consume whitespace, then find the end of the token
+    for( ; i < end && (U8)corpus[i] <= ' '; i++);
+    for(tokBegin = i; i < end && (U8)corpus[i] > ' '; i++);
+    tokEnd = i;
+    if(tokBegin == tokEnd){
+      continue;
+    }
+    tokens++;
+
+    for( ; tokBegin < tokEnd && (charClass[(U8)corpus[tokBegin]] & CC_STRIP); tokBegin++);
+    for( ; tokEnd > tokBegin && (charClass[(U8)corpus[tokEnd-1]] & CC_STRIP); tokEnd--);
+    len = tokEnd - tokBegin;
+    if(len <= 0 || len > NGRAM_MAX_WORD_LEN){
+      continue;
+    }
+
+    for(int j = 0; j < len; j++){
+      word[j] = ToLower(corpus[tokBegin + j]);
+    }
+    if(IsValid(word,len)){
+      valid++;
+      hash = HashWord(word,len);
+      //shard on the high bits; the low bits pick the slot within a table
+      shards[(hash >> 32) % numThreads].Add(word,len,hash,1);
+    }
+  }
+
+  tokenCounts[thread] = tokens;
+  validCounts[thread] = valid;
+}
+
+//adds count to every 1-5 gram of word (grams never span words)
+void NgramCounter::CountWordGrams(int shard, const char* word, U32 len, U64 count)
+{
+  U32 i, n, index, place;
+  vector<U64>& grams = shardGrams[shard];
+
+  for(i = 0; i < len; i++){
+    index = 0;
+    for(n = 1, place = 1; n <= NGRAM_MAX_N && n <= i + 1; n++, place *= 26){
+      //index of the n-gram ending at i, in base 26 with the first char as the high digit, so index / 26 is the (n-1)-char prefix
+      index += (U32)(word[i-n+1] - 'a') * place;
+      if(n < NGRAM_MAX_N){
+        grams[gramOffsets[n-1] + index] += count;
+      }
+      else{
+        shardPentagrams[shard][index] += count;
+      }
+    }
+  }
+}
+
+//merges shard s of every thread's tables into mergedShards[s], then counts that shard's char-grams
+void NgramCounter::MergeShard(int shard)
+{
+  int t;
+  U32 i;
+  WordTable& merged = mergedShards[shard];
+
+  for(t = 0; t < numThreads; t++){
+    WordTable& table = threadShards[t][shard];
+    for(i = 0; i < table.slots.size(); i++){
+      if(table.slots[i].count > 0){
+        merged.Add(&table.arena[table.slots[i].offset],table.slots[i].len,table.slots[i].hash,table.slots[i].count);
+      }
+    }
+    //release the thread table as soon as it's merged
+    vector<WordTable::Entry>().swap(table.slots);
+    vector<char>().swap(table.arena);
+  }
+
+  for(i = 0; i < merged.slots.size(); i++){
+    if(merged.slots[i].count > 0){
+      CountWordGrams(shard,&merged.arena[merged.slots[i].offset],merged.slots[i].len,merged.slots[i].count);
+    }
+  }
+}
+
+/*
+  Sums the per-shard gram counts and writes each n-gram model as conditional -log2 probabilities, normalized the
+  same way as parseGram.py: P(gram) = count(gram) / (sum of counts of n-grams sharing its (n-1)-char prefix).
+  Unigrams are normalized by the total.
+*/
+void NgramCounter::WriteGrams(const string& outDir)
+{
+  int s, n, k;
+  U32 i, index, numGrams;
+  double normal;
+  char gram[NGRAM_MAX_N + 1];
+  vector<U64> grams(gramOffsets[NGRAM_MAX_N-1],0);
+  vector<U64> normals;
+  map<U32,U64> pentagrams;  //ordered, so the file is alphabetical like the others
+  static const char* fileNames[NGRAM_MAX_N] = {"unigrams.txt","bigrams.txt","trigrams.txt","quadgrams.txt","pentagrams.txt"};
+  FILE* ofile;
+
+  for(s = 0; s < numThreads; s++){
+    for(i = 0; i < grams.size(); i++){
+      grams[i] += shardGrams[s][i];
+    }
+    for(unordered_map<U32,U64>::iterator it = shardPentagrams[s].begin(); it != shardPentagrams[s].end(); ++it){
+      pentagrams[it->first] += it->second;
+    }
+  }
+
+  for(n = 1, numGrams = 26; n <= NGRAM_MAX_N; n++, numGrams *= 26){
+    string path = outDir + PATH_ESCAPE + fileNames[n-1];
+    ofile = fopen(path.c_str(),"w");
+    if(ofile == NULL){
+      cout << "ERROR could not open file: " << path << endl;
+      return;
+    }
+
+    //normals[prefix] = sum of counts of n-grams starting with prefix; for unigrams the prefix is empty, so this is the total
+    normals.assign(numGrams / 26,0);
+    if(n < NGRAM_MAX_N){
+      for(i = 0; i < numGrams; i++){
+        normals[i / 26] += grams[gramOffsets[n-1] + i];
+      }
+    }
+    else{
+      for(map<U32,U64>::iterator it = pentagrams.begin(); it != pentagrams.end(); ++it){
+        normals[it->first / 26] += it->second;
+      }
+    }
+
+    gram[n] = '\0';
+    if(n < NGRAM_MAX_N){
+      for(i = 0; i < numGrams; i++){
+        if(grams[gramOffsets[n-1] + i] > 0){
+          for(k = n - 1, index = i; k >= 0; k--, index /= 26){
+            gram[k] = 'a' + index % 26;
+          }
+          normal = (double)normals[i / 26];
+          fprintf(ofile,"%s\t%.6g\n",gram,-log2((double)grams[gramOffsets[n-1] + i] / normal));
+        }
+      }
+    }
+    else{
+      for(map<U32,U64>::iterator it = pentagrams.begin(); it != pentagrams.end(); ++it){
+        for(k = n - 1, index = it->first; k >= 0; k--, index /= 26){
+          gram[k] = 'a' + index % 26;
+        }
+        normal = (double)normals[it->first / 26];
+        fprintf(ofile,"%s\t%.6g\n",gram,-log2((double)it->second / normal));
+      }
+    }
+    fclose(ofile);
+    cout << " > wrote " << path << endl;
+  }
+}
+
+bool ByCountDesc(const pair<string,U64>& left, const pair<string,U64>& right)
+{
+  return (left.second > right.second) || (left.second == right.second && left.first < right.first);
+}
+
+/*
+  Writes the vocab. Short words are filtered by probability among short words, as in filterLexicon.py:
+  improbable ones are usually acronyms or junk, so they go to checkThese.txt for a human to decide.
+*/
+void NgramCounter::WriteVocab(const string& outDir)
+{
+  int s;
+  U32 i, nVocab = 0, nCheck = 0;
+  double shortTotal = 0.0, logProb;
+  vector<pair<string,U64> > words;
+  string path;
+  FILE *vocabFile, *countFile, *checkFile;
+
+  for(s = 0; s < numThreads; s++){
+    WordTable& table = mergedShards[s];
+    for(i = 0; i < table.slots.size(); i++){
+      if(table.slots[i].count >= minWordCount){
+        words.push_back(pair<string,U64>(table.Key(table.slots[i]),table.slots[i].count));
+        if(table.slots[i].len < SHORT_WORD_LEN){
+          shortTotal += table.slots[i].count;
+        }
+      }
+    }
+  }
+  std::sort(words.begin(),words.end(),ByCountDesc);
+
+  path = outDir + PATH_ESCAPE + "vocabModel.txt";
+  vocabFile = fopen(path.c_str(),"w");
+  path = outDir + PATH_ESCAPE + "wordCounts.txt";
+  countFile = fopen(path.c_str(),"w");
+  path = outDir + PATH_ESCAPE + "checkThese.txt";
+  checkFile = fopen(path.c_str(),"w");
+  if(vocabFile == NULL || countFile == NULL || checkFile == NULL){
+    cout << "ERROR could not open vocab output files in " << outDir << endl;
+    return;
+  }
+
+  for(i = 0; i < words.size(); i++){
+    fprintf(countFile,"%s\t%llu\n",words[i].first.c_str(),words[i].second);
+    if(words[i].first.size() < SHORT_WORD_LEN){
+      logProb = -log2((double)words[i].second / shortTotal);
+      if(logProb >= SHORT_WORD_LOG_THRESHOLD){
+        fprintf(checkFile,"%s\t%g\n",words[i].first.c_str(),logProb);
+        nCheck++;
+        continue;
+      }
+    }
+    fprintf(vocabFile,"%s\n",words[i].first.c_str());
+    nVocab++;
+  }
+
+  fclose(vocabFile);
+  fclose(countFile);
+  fclose(checkFile);
+  cout << " > wrote " << nVocab << " vocab words (" << nCheck << " short words to check) to " << outDir << endl;
+}
+
+bool NgramCounter::Run(const string& corpusFile, const string& outDir)
+{
+  int t, fd;
+  size_t begin;
+  struct stat st;
+  struct timespec t0, t1, t2;
+  vector<std::thread> threads;
+  vector<size_t> bounds;
+  U64 tokens = 0, valid = 0, distinct = 0;
+
+  fd = open(corpusFile.c_str(),O_RDONLY);
+  if(fd < 0 || fstat(fd,&st) != 0 || st.st_size == 0){
+    cout << "ERROR could not open (or empty) corpus file: " << corpusFile << endl;
+    if(fd >= 0){
+      close(fd);
+    }
+    return false;
+  }
+  corpusSize = st.st_size;
+  corpus = (const char*)mmap(NULL,corpusSize,PROT_READ,MAP_PRIVATE,fd,0);
+  close(fd);
+  if(corpus == MAP_FAILED){
+    cout << "ERROR could not mmap corpus file: " << corpusFile << endl;
+    corpus = NULL;
+    return false;
+  }
+  //each thread reads its slice front to back, so let the kernel read ahead aggressively
+  madvise((void*)corpus,corpusSize,MADV_SEQUENTIAL);
+
+  //cut the corpus into one slice per thread, moving each cut forward to whitespace so no token is split
+  bounds.push_back(0);
+  for(t = 1; t < numThreads; t++){
+    begin = corpusSize / numThreads * t;
+    if(begin < bounds.back()){
+      begin = bounds.back();
+    }
+    for( ; begin < corpusSize && (U8)corpus[begin] > ' '; begin++);
+    bounds.push_back(begin);
+  }
+  bounds.push_back(corpusSize);
+
+  cout << "Counting words in " << corpusFile << " (" << (corpusSize >> 20) << "MB) with " << numThreads << " threads..." << endl;
+  clock_gettime(CLOCK_MONOTONIC,&t0);
+  for(t = 0; t < numThreads; t++){
+    threads.push_back(std::thread(&NgramCounter::CountSlice,this,t,bounds[t],bounds[t+1]));
+  }
+  for(t = 0; t < numThreads; t++){
+    threads[t].join();
+    tokens += tokenCounts[t];
+    valid += validCounts[t];
+  }
+  clock_gettime(CLOCK_MONOTONIC,&t1);
+  cout << "...complete, " << tokens << " tokens, " << valid << " valid words in " << DiffTimeSpecs(&t0,&t1) << " (s), "
+       << ((double)corpusSize / 1048576.0 / DiffTimeSpecs(&t0,&t1)) << " MB/s" << endl;
+
+  threads.clear();
+  for(t = 0; t < numThreads; t++){
+    threads.push_back(std::thread(&NgramCounter::MergeShard,this,t));
+  }
+  for(t = 0; t < numThreads; t++){
+    threads[t].join();
+    distinct += mergedShards[t].used;
+  }
+  clock_gettime(CLOCK_MONOTONIC,&t2);
+  cout << "Merged " << distinct << " distinct words and counted char-grams in " << DiffTimeSpecs(&t1,&t2) << " (s)" << endl;
+
+  WriteGrams(outDir);
+  WriteVocab(outDir);
+
+  return true;
+}
+
+int main(int argc, char* argv[])
+{
+  int numThreads = std::thread::hardware_concurrency();
+  U64 minWordCount = 1;
+  string outDir = ".";
+
+  if(argc < 2){
+    cout << "usage: " << argv[0] << " corpusFile [outputDir=.] [numThreads=" << numThreads << "] [minWordCount=1]" << endl;
+    return 1;
+  }
+  if(argc >= 3){
+    outDir = argv[2];
+  }
+  if(argc >= 4){
+    numThreads = atoi(argv[3]);
+  }
+  if(argc >= 5){
+    minWordCount = strtoull(argv[4],NULL,10);
+  }
+  if(numThreads <= 0){
+    numThreads = 1;
+  }
+
+  NgramCounter counter(numThreads,minWordCount);
+  return counter.Run(argv[1],outDir) ? 0 : 1;
+}
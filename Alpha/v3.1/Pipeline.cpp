@@ -0,0 +1,147 @@
+#include "Controller.hpp"
+
+/*
+  Pipelined decoding for one continuous typing session. Controller::TestWordStream and DecodeSession::Decode run a
+  word's stages strictly in sequence, so while a word is being ranked nothing else happens. Here each stage runs on
+  its own thread, and the stages are linked by bounded queues:
+
+    Submit -> clusterQueue -> [cluster] -> candidateQueue -> [candidates] -> rescoreQueue -> [rescore] -> outputQueue -> Next
+
+  The next word is clustered while the previous one is still being searched or rescored, so sustained words per
+  second is bounded by the slowest stage rather than by the sum of the stages. A single word's latency doesn't improve,
+  and gets a little worse from the hand-offs.
+
+  Each stage thread owns the component it runs (the clusterer, lattice builder and search engine are members here),
+  and the language model and vocabulary are the shared, read-only DecoderModels (see Session.cpp). Words stay in
+  submission order, since every stage is a single thread reading a FIFO.
+
+  The queues give backpressure: Submit blocks while the cluster queue is full, and the stages block while the queue
+  after them is full, so a consumer that stops calling Next eventually stalls Submit. Feed and consume from different
+  threads, or interleave them.
+*/
+
+DecodePipeline::DecodePipeline(DecoderModels* modelsPtr, int decodePath, int queueDepth)
+  : sb(0,modelsPtr->layoutManager->GetWidth(),0,modelsPtr->layoutManager->GetHeight(),modelsPtr->layoutManager), lb(modelsPtr->layoutManager),
+    clusterQueue(queueDepth), candidateQueue(queueDepth), rescoreQueue(queueDepth), outputQueue(queueDepth)
+{
+  models = modelsPtr;
+  path = decodePath;
+  nextSeq = 0;
+  sb.SetParameters(models->clusterParams);
+  filtering = GAZE_FILTER_DEFAULT;
+
+  stages.push_back(std::thread(&DecodePipeline::ClusterStage,this));
+  stages.push_back(std::thread(&DecodePipeline::CandidateStage,this));
+  stages.push_back(std::thread(&DecodePipeline::RescoreStage,this));
+}
+
+//finishes the words already submitted, and deletes any the caller didn't collect
+DecodePipeline::~DecodePipeline()
+{
+  PipelineWord* word;
+
+  Close();
+  while(outputQueue.Pop(word)){  //keeps the last stage from blocking on a full output queue
+    delete word;
+  }
+  for(int i = 0; i < stages.size(); i++){
+    stages[i].join();
+  }
+}
+
+//queues a copy of a word's points; blocks while the pipeline is full. False if the pipeline is closed.
+bool DecodePipeline::Submit(const vector<Point>& points)
+{
+  PipelineWord* word = new PipelineWord();
+
+  word->seq = nextSeq++;
+  word->points = points;
+  for(int i = 0; i < NUM_PIPELINE_STAGES; i++){
+    word->stageUs[i] = 0.0;
+  }
+
+  if(!clusterQueue.Push(word)){
+    delete word;
+    return false;
+  }
+
+  return true;
+}
+
+//end of input. The words already submitted still flow through, and Next returns false after the last one.
+void DecodePipeline::Close(void)
+{
+  clusterQueue.Close();
+}
+
+//blocks for the next finished word, in submission order. The caller owns (deletes) it. False once closed and drained.
+bool DecodePipeline::Next(PipelineWord*& word)
+{
+  return outputQueue.Pop(word);
+}
+
+void DecodePipeline::ClusterStage(void)
+{
+  PipelineWord* word;
+  struct timespec begin, end;
+
+  while(clusterQueue.Pop(word)){
+    clock_gettime(CLOCK_MONOTONIC,&begin);
+    if(word->points.size() > 0 && filtering){
+      filter.FilterWord(word->points,1000000 / GAZE_FILTER_SAMPLE_HZ,word->points);  //in place; each sample only reads its own raw value
+      sb.Process3(word->points,word->pointMeans);
+    }
+    else if(word->points.size() > 0){
+      sb.Process3(word->points,word->pointMeans);
+    }
+    clock_gettime(CLOCK_MONOTONIC,&end);
+    word->stageUs[PIPELINE_CLUSTER] = DiffTimeSpecs(&begin,&end) * 1.0e6;
+
+    candidateQueue.Push(word);
+  }
+  candidateQueue.Close();
+}
+
+void DecodePipeline::CandidateStage(void)
+{
+  PipelineWord* word;
+  Lattice lattice;
+  struct timespec begin, end;
+
+  while(candidateQueue.Pop(word)){
+    clock_gettime(CLOCK_MONOTONIC,&begin);
+    if(word->pointMeans.size() > 0){
+      if(path == DECODE_LATTICE_LM){
+        lattice.clear();
+        lb.BuildStaticLattice(word->pointMeans,lattice);
+        se.Process(lattice,word->results);
+      }
+      else{
+        models->di->Process(word->pointMeans,word->results);
+      }
+    }
+    clock_gettime(CLOCK_MONOTONIC,&end);
+    word->stageUs[PIPELINE_CANDIDATES] = DiffTimeSpecs(&begin,&end) * 1.0e6;
+
+    rescoreQueue.Push(word);
+  }
+  rescoreQueue.Close();
+}
+
+void DecodePipeline::RescoreStage(void)
+{
+  PipelineWord* word;
+  struct timespec begin, end;
+
+  while(rescoreQueue.Pop(word)){
+    clock_gettime(CLOCK_MONOTONIC,&begin);
+    if(path == DECODE_LATTICE_LM && word->results.size() > 0){
+      models->lm->Process(word->results);
+    }
+    clock_gettime(CLOCK_MONOTONIC,&end);
+    word->stageUs[PIPELINE_RESCORE] = DiffTimeSpecs(&begin,&end) * 1.0e6;
+
+    outputQueue.Push(word);
+  }
+  outputQueue.Close();
+}
@@ -0,0 +1,230 @@
+#include "Controller.hpp"
+
+/*
+  Speculative ("so far") decoding along the direct path. DirectInference::VectorDistInference scores the whole
+  vocabulary against a word's clusters once the word ends, which puts the entire scan on the end-of-word latency and
+  gives nothing to show while the trace is still going. But SumDistMetric_Aligned walks the clusters and the candidate's
+  chars left to right, only ever adding non-negative distances, and its only lookahead is one cluster (the insertion
+  check reads pointMeans[i+1]). So each candidate's walk can be suspended when it runs out of clusters and resumed when
+  the next one arrives, and the sum it has so far is a lower bound on its final distance.
+
+  A PrefixDecoder keeps that suspended state (PrefixCandidate) for every word that can still be a result:
+
+    Push(mu)        advances every live candidate over the new cluster, as far as the lookahead allows, and drops the
+                    candidates that can no longer be results: those already at DIRECT_MAX_DISTANCE, and those shorter
+                    than the clusters by more than DIRECT_MAX_LENGTH_DIFF. Both are exact, since neither can recover.
+    Completions(k)  the k best words so far, ranking each live candidate by its distance with the clusters pushed
+                    taken as the whole input, but without charging its unmatched chars, so longer words complete a
+                    prefix. Ties go to the shorter word.
+    Finish()        the word's results: runs out each candidate's walk and tails, and applies the length and distance
+                    filters, giving exactly VectorDistInference's results, in the same order.
+
+  Each push only touches the live set, which shrinks quickly once a few clusters are in, and the end of the word only
+  has the last cluster or two left to align, rather than a full scan. Distances come from the clusters' rows of
+  LayoutManager::KeyDistances, as in VectorDistInference.
+
+  The clusters pushed must be the word's final clusters: a clusterer may still move or merge the last cluster or two it
+  found as more samples come in, so callers push a cluster only once PREFIX_SETTLE_CLUSTERS more follow it, and Resync
+  with the final clusters at the end of the word, which falls back to starting over if an earlier cluster did change.
+*/
+
+PrefixDecoder::PrefixDecoder(DirectInference* diPtr)
+{
+  di = diPtr;
+  layoutManager = di->layoutManager;
+  words = &di->stringKernels.words;
+  Reset();
+}
+
+PrefixDecoder::~PrefixDecoder()
+{
+  //nada
+}
+
+//starts a new word: every vocabulary word is live, with nothing aligned
+void PrefixDecoder::Reset(void)
+{
+  PrefixCandidate c = {0,0,0,0,0.0};
+
+  means.clear();
+  keyDists.clear();
+  live.resize(words->size());
+  for(size_t w = 0; w < words->size(); w++){
+    c.wordId = w;
+    live[w] = c;
+  }
+  numUpdates = 0;
+}
+
+//appends the next cluster of the word and advances the live set over it
+void PrefixDecoder::Push(const PointMu& mu)
+{
+  means.push_back(mu);
+  Advance();
+}
+
+//advances every live candidate over the clusters pushed so far, dropping those that can no longer be results
+void PrefixDecoder::Advance(void)
+{
+  size_t kept = 0;
+  size_t n = means.size();
+
+  //the new clusters' key distances
+  for(size_t i = keyDists.size() / KEY_TABLE_SIZE; i < n; i++){
+    keyDists.resize((i + 1) * KEY_TABLE_SIZE);
+    layoutManager->KeyDistances(means[i].pt,&keyDists[i * KEY_TABLE_SIZE]);
+  }
+  numUpdates += live.size();
+  for(size_t k = 0; k < live.size(); k++){
+    PrefixCandidate& c = live[k];
+    Align(c,false);
+    if(c.sumDist < DIRECT_MAX_DISTANCE && n <= (*words)[c.wordId].size() + DIRECT_MAX_LENGTH_DIFF){
+      live[kept++] = c;
+    }
+  }
+  live.resize(kept);
+}
+
+/*
+  The word's final clusters. Pushes those after the ones already pushed, if they're still the same; otherwise, the
+  clusterer changed its mind about an earlier cluster, so starts over with all of them. Returns false if it started over.
+*/
+bool PrefixDecoder::Resync(const vector<PointMu>& finalMeans)
+{
+  size_t i;
+  bool same = means.size() <= finalMeans.size();
+
+  for(i = 0; same && i < means.size(); i++){
+    same = means[i].alpha == finalMeans[i].alpha && means[i].pt.X == finalMeans[i].pt.X && means[i].pt.Y == finalMeans[i].pt.Y;
+  }
+  if(!same){
+    Reset();
+  }
+  if(means.size() < finalMeans.size()){
+    means.insert(means.end(),finalMeans.begin() + means.size(),finalMeans.end());
+    Advance();
+  }
+
+  return same;
+}
+
+/*
+  The main loop of SumDistMetric_Aligned, resumed from where c left off. An iteration needs the cluster after it (for
+  the insertion check), so the last cluster is only aligned once final says no more are coming. Once the candidate's
+  chars run out, every further cluster is charged against its last char, as the first of the metric's tails does.
+*/
+void PrefixDecoder::Align(PrefixCandidate& c, bool final)
+{
+  const string& candidate = (*words)[c.wordId];
+  size_t n = means.size(), len = candidate.size();
+  U32 i = c.i, j = c.j;
+
+  while(j < len && (i + 1 < n || (final && i < n))){
+    if(means[i].alpha != candidate[j]){
+      //insertion error: the cluster after this one realigns
+      if(i + 1 < n && means[i+1].alpha == candidate[j]){
+        if(j > 0){
+          c.sumDist += di->InsertionError(means[i].pt, layoutManager->GetPoint(candidate[j-1]), layoutManager->GetPoint(candidate[j]));
+        }
+        else{
+          c.sumDist += keyDists[i * KEY_TABLE_SIZE + (U8)candidate[j]];
+        }
+        i++;
+      }
+      //deletion error: the candidate's next char realigns
+      else if(j + 1 < len && means[i].alpha == candidate[j+1]){
+        if(i > 0 && n > 1){
+          c.sumDist += keyDists[(i-1) * KEY_TABLE_SIZE + (U8)candidate[j]];
+        }
+        else{
+          c.sumDist += keyDists[i * KEY_TABLE_SIZE + (U8)candidate[j]];
+        }
+        j++;
+      }
+      else{
+        c.sumDist += keyDists[i * KEY_TABLE_SIZE + (U8)candidate[j]];
+      }
+    }
+
+    //advance over repeated chars
+    if(j < len - 1 && candidate[j] == candidate[j+1]){
+      j++;
+      c.rpts++;
+    }
+    i++;
+    j++;
+  }
+
+  //the candidate is used up: the clusters left over are charged against its last char
+  while(j >= len && i < n){
+    c.sumDist += keyDists[i * KEY_TABLE_SIZE + (U8)candidate[j-1]];
+    i++;
+  }
+
+  c.i = i;
+  c.j = j;
+}
+
+//the k best completions of the clusters so far, best first
+void PrefixDecoder::Completions(size_t k, vector<SearchResult>& completions)
+{
+  vector<pair<pair<double,size_t>,U32> > ranked;  //((distance, length), word id)
+
+  completions.clear();
+  if(means.empty()){
+    return;
+  }
+
+  ranked.reserve(live.size());
+  for(size_t w = 0; w < live.size(); w++){
+    PrefixCandidate c = live[w];
+    Align(c,true);
+    ranked.push_back(std::make_pair(std::make_pair(c.sumDist + (double)c.rpts * layoutManager->minKeyRadius * 0.15,(*words)[c.wordId].size()),c.wordId));
+  }
+
+  k = std::min(k,ranked.size());
+  std::partial_sort(ranked.begin(),ranked.begin() + k,ranked.end());
+  for(size_t r = 0; r < k; r++){
+    completions.push_back(SearchResult((*words)[ranked[r].second],ranked[r].first.first));
+  }
+}
+
+/*
+  Completes every live candidate against the clusters pushed, which must now be the whole word: the last cluster, the
+  metric's second tail (the candidate's unmatched chars, charged against the last cluster), its repeat penalty, and
+  VectorDistance's length filter. The survivors are pushed in vocabulary order and stably sorted, as
+  VectorDistInference does, so the results match it exactly.
+*/
+void PrefixDecoder::Finish(SearchResults& results)
+{
+  size_t n = means.size();
+  double dist;
+
+  results.clear();
+  if(n == 0){
+    return;
+  }
+
+  for(size_t w = 0; w < live.size(); w++){
+    PrefixCandidate& c = live[w];
+    const string& candidate = (*words)[c.wordId];
+    size_t len = candidate.size();
+
+    Align(c,true);
+    dist = c.sumDist;
+    for(size_t j = c.j; j < len; j++){
+      dist += keyDists[(n-1) * KEY_TABLE_SIZE + (U8)candidate[j]];
+      while(j < len - 1 && candidate[j] == candidate[j+1]){  //chew up repeated chars
+        j++;
+        c.rpts++;
+      }
+    }
+    dist += (double)c.rpts * layoutManager->minKeyRadius * 0.15;
+
+    if(layoutManager->AbsDiff(n,len) <= DIRECT_MAX_LENGTH_DIFF && dist < DIRECT_MAX_DISTANCE){
+      results.push_back(SearchResult(candidate,dist));
+    }
+  }
+  METRICS_COUNT(COUNTER_CANDIDATES_SCORED,live.size());
+  results.sort(ByDistance);
+}
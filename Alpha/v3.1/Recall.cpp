@@ -0,0 +1,367 @@
+#include "Controller.hpp"
+
+/*
+  Accuracy-plus-latency regression runner. The traces themselves carry no expected word, so the intended words live in
+  a labels manifest (one "trace<TAB>word" per line, trace paths relative to the manifest, '#' comments, '-' for no label).
+  Every labeled trace is clustered once with SingularityBuilder::Process3, then decoded by each decoder path:
+
+    VectorDistInference   DirectInference::VectorDistInference
+    StringDistInference   DirectInference::StringDistInference
+    MergeInference        DirectInference::MergeInference
+    Lattice+LM            LatticeBuilder::BuildStaticLattice -> SearchEngine::Process -> LanguageModel::Process
+
+  For each path, reports top-1/top-5/top-20 recall over all labeled traces, the mean rank (1-based) of the true word over
+  the traces where it was found at all, and the median/mean decode latency per word (clustering excluded; it's shared, and
+  reported on its own line). Labels that aren't in the vocabulary can never be recalled by the vocabulary-based paths,
+  so they're counted separately to keep them from being mistaken for a regression.
+
+  Before the traces, the edit substitution of the Lattice+LM path is checked on its own: each of EDIT_RANK_CASES is a
+  misspelled lattice path, run through LanguageModel::Process, and the word it's a misspelling of must rank no lower
+  than the case says, and in the same order on a second run. A failed case fails the run.
+
+  Usage: recall [labelsFile=../TestInput/EyeInputs/labels.txt] [outFile=recall.json]
+*/
+
+#define NUM_RECALL_PATHS 4
+#define RECALL_NOT_FOUND 0
+
+static const char* RECALL_PATHS[NUM_RECALL_PATHS] = {"VectorDistInference", "StringDistInference", "MergeInference", "Lattice+LM"};
+
+//a lattice path that isn't a word, the word it should be corrected to, and the lowest rank (1-based) that word may have
+struct EditRankCase{
+  const char* path;
+  const char* word;
+  U32 maxRank;
+};
+
+static const EditRankCase EDIT_RANK_CASES[] = {
+  {"THW",        "THE",         1},   //substitution
+  {"HELLP",      "HELP",        1},   //insertion
+  {"MISSISIPPI", "MISSISSIPPI", 1},   //deletion, in a long word
+  {"WORKD",      "WORK",        2}    //insertion, with WORD equally near
+};
+static const int NUM_EDIT_RANK_CASES = sizeof(EDIT_RANK_CASES) / sizeof(EditRankCase);
+
+class Recall{
+  public:
+    LayoutManager* layoutManager;
+    SingularityBuilder* sb;
+    DirectInference* di;
+    LatticeBuilder* lb;
+    SearchEngine* se;
+    LanguageModel* lm;
+    vector<string> traces;
+    vector<string> labels;
+    vector<U32> ranks[NUM_RECALL_PATHS];        //1-based rank of the label in each path's results per trace, or RECALL_NOT_FOUND
+    vector<double> latencies[NUM_RECALL_PATHS];  //in microseconds
+    vector<double> clusterLatencies;
+    int numOutOfVocab;
+
+    Recall(const string& keyMapFile);
+    ~Recall();
+
+    bool LoadLabels(const string& labelsFile);
+    int CheckEditRanks(void);
+    U32 RankOf(SearchResults& results, const string& label);  //SearchResults and LatticePaths are the same type
+    void RunTrace(int index);
+    void Run(void);
+    double Median(vector<double> samples);
+    double Mean(const vector<double>& samples);
+    double RecallAt(int path, U32 k);
+    double MeanRank(int path);
+    bool WriteReport(const string& jsonFile);
+};
+
+Recall::Recall(const string& keyMapFile)
+{
+  layoutManager = new LayoutManager(keyMapFile);
+  sb = new SingularityBuilder(0,layoutManager->GetWidth(),0,layoutManager->GetHeight(),layoutManager);
+  sb->LoadParameters(CLUSTER_PARAMS_FILE);
+  lb = new LatticeBuilder(layoutManager);
+  se = new SearchEngine();
+  lm = new LanguageModel();
+  lm->BuildModels();
+  string vocab = "../vocabModel.txt";
+  di = new DirectInference(vocab,layoutManager);
+  di->BuildEditIndex(MAX_EDIT_DIST);
+  lm->SetEditIndex(&di->editIndex);
+  numOutOfVocab = 0;
+
+}
+
+Recall::~Recall()
+{
+  delete sb;
+  delete lb;
+  delete se;
+  delete lm;
+  delete di;
+  delete layoutManager;
+}
+
+//reads the manifest; traces are resolved relative to the manifest's directory
+bool Recall::LoadLabels(const string& labelsFile)
+{
+  char buf[BUFSIZE];
+  char* tokens[BUFSIZE];
+  string dir, label;
+  std::ifstream infile(labelsFile.c_str());
+
+  if(!infile.is_open()){
+    cout << "ERROR could not open labels file: " << labelsFile << endl;
+    return false;
+  }
+  if(labelsFile.rfind(PATH_ESCAPE) != string::npos){
+    dir = labelsFile.substr(0,labelsFile.rfind(PATH_ESCAPE) + 1);
+  }
+
+  while(infile.getline(buf,BUFSIZE)){
+    if(buf[0] == '#' || buf[0] == '\0' || Tokenize(tokens,buf,"\t\r") != 2){
+      continue;
+    }
+    StrToUpper(tokens[1]);
+    label = tokens[1];
+    if(label == "-"){
+      continue;
+    }
+    traces.push_back(dir + tokens[0]);
+    labels.push_back(label);
+    if(di->wordModel.find(label) == di->wordModel.end()){
+      numOutOfVocab++;
+    }
+  }
+
+  if(traces.empty()){
+    cout << "ERROR no labeled traces in " << labelsFile << endl;
+    return false;
+  }
+
+  return true;
+}
+
+//runs EDIT_RANK_CASES; returns the number that failed
+int Recall::CheckEditRanks(void)
+{
+  int i, failures = 0;
+  U32 rank;
+  bool stable;
+  LatticePaths first, second;
+  LatticePathsIt it1, it2;
+
+  for(i = 0; i < NUM_EDIT_RANK_CASES; i++){
+    first.clear();
+    second.clear();
+    first.push_back(LatticePath(EDIT_RANK_CASES[i].path,0.0));
+    second.push_back(LatticePath(EDIT_RANK_CASES[i].path,0.0));
+    Silence(true);
+    lm->Process(first);
+    lm->Process(second);
+    Silence(false);
+
+    stable = first.size() == second.size();
+    for(it1 = first.begin(), it2 = second.begin(); stable && it1 != first.end(); ++it1, ++it2){
+      stable = it1->first == it2->first && it1->second == it2->second;
+    }
+    rank = RankOf(first,EDIT_RANK_CASES[i].word);
+    if(rank == RECALL_NOT_FOUND || rank > EDIT_RANK_CASES[i].maxRank || !stable){
+      failures++;
+      printf("ERROR edit rank: %s -> %s ranked %u (at most %u)%s\n",EDIT_RANK_CASES[i].path,EDIT_RANK_CASES[i].word,rank,EDIT_RANK_CASES[i].maxRank,
+        stable ? "" : ", and the order changed between runs");
+    }
+  }
+  printf("edit ranks: %d of %d cases passed\n\n",NUM_EDIT_RANK_CASES - failures,NUM_EDIT_RANK_CASES);
+
+  return failures;
+}
+
+U32 Recall::RankOf(SearchResults& results, const string& label)
+{
+  U32 rank = 1;
+
+  for(SearchResultIt it = results.begin(); it != results.end(); ++it, rank++){
+    if(it->first == label){
+      return rank;
+    }
+  }
+
+  return RECALL_NOT_FOUND;
+}
+
+//clusters trace 'index' and runs it through every decoder path, recording ranks and latencies
+void Recall::RunTrace(int index)
+{
+  int path;
+  vector<Point> sensorData;
+  vector<PointMu> pointMeans;
+  SearchResults results;
+  Lattice lattice;
+  LatticePaths strings;
+  string delimiter = "\t";
+  struct timespec begin, end;
+
+  sb->BuildTestData(traces[index],sensorData,delimiter);
+  clock_gettime(CLOCK_MONOTONIC,&begin);
+  sb->Process3(sensorData,pointMeans);
+  clock_gettime(CLOCK_MONOTONIC,&end);
+  clusterLatencies.push_back(DiffTimeSpecs(&begin,&end) * 1.0e6);
+
+  for(path = 0; path < NUM_RECALL_PATHS; path++){
+    results.clear();
+    lattice.clear();
+    strings.clear();
+
+    clock_gettime(CLOCK_MONOTONIC,&begin);
+    if(pointMeans.size() > 0){
+      switch(path){
+        case 0:
+            di->VectorDistInference(pointMeans,results);
+          break;
+        case 1:
+            di->StringDistInference(pointMeans,results);
+          break;
+        case 2:
+            di->MergeInference(pointMeans,results);
+          break;
+        case 3:
+            lb->BuildStaticLattice(pointMeans,lattice);
+            se->Process(lattice,strings);
+            lm->Process(strings);
+          break;
+      }
+    }
+    clock_gettime(CLOCK_MONOTONIC,&end);
+
+    latencies[path].push_back(DiffTimeSpecs(&begin,&end) * 1.0e6);
+    ranks[path].push_back(RankOf((path == 3) ? strings : results,labels[index]));
+  }
+}
+
+void Recall::Run(void)
+{
+  int i, path;
+
+  printf("%-40s %-12s","trace","label");
+  for(path = 0; path < NUM_RECALL_PATHS; path++){
+    printf(" %20s",RECALL_PATHS[path]);
+  }
+  printf("\n");
+
+  for(i = 0; i < traces.size(); i++){
+    Silence(true);
+    RunTrace(i);
+    Silence(false);
+
+    printf("%-40s %-12s",traces[i].c_str(),labels[i].c_str());
+    for(path = 0; path < NUM_RECALL_PATHS; path++){
+      if(ranks[path][i] == RECALL_NOT_FOUND){
+        printf(" %20s","-");
+      }
+      else{
+        printf(" %20u",ranks[path][i]);
+      }
+    }
+    printf("\n");
+  }
+}
+
+double Recall::Median(vector<double> samples)
+{
+  if(samples.empty()){
+    return 0.0;
+  }
+  std::sort(samples.begin(),samples.end());
+  return samples[(samples.size() - 1) / 2];
+}
+
+double Recall::Mean(const vector<double>& samples)
+{
+  double sum = 0.0;
+
+  for(int i = 0; i < samples.size(); i++){
+    sum += samples[i];
+  }
+
+  return samples.empty() ? 0.0 : (sum / samples.size());
+}
+
+//fraction of labeled traces whose true word ranked in the top k
+double Recall::RecallAt(int path, U32 k)
+{
+  int hits = 0;
+
+  for(int i = 0; i < ranks[path].size(); i++){
+    if(ranks[path][i] != RECALL_NOT_FOUND && ranks[path][i] <= k){
+      hits++;
+    }
+  }
+
+  return ranks[path].empty() ? 0.0 : ((double)hits / ranks[path].size());
+}
+
+//mean 1-based rank of the true word, over the traces where it was found
+double Recall::MeanRank(int path)
+{
+  int found = 0;
+  double sum = 0.0;
+
+  for(int i = 0; i < ranks[path].size(); i++){
+    if(ranks[path][i] != RECALL_NOT_FOUND){
+      sum += ranks[path][i];
+      found++;
+    }
+  }
+
+  return (found > 0) ? (sum / found) : 0.0;
+}
+
+bool Recall::WriteReport(const string& jsonFile)
+{
+  int path;
+  FILE* ofile;
+
+  printf("\n%d labeled traces, %d with labels not in the vocabulary\n",(int)traces.size(),numOutOfVocab);
+  printf("%-20s %8s %8s %8s %10s %14s %14s\n","path","top1","top5","top20","mean rank","median (us)","mean (us)");
+  for(path = 0; path < NUM_RECALL_PATHS; path++){
+    printf("%-20s %8.3f %8.3f %8.3f %10.2f %14.1f %14.1f\n",RECALL_PATHS[path],RecallAt(path,1),RecallAt(path,5),RecallAt(path,20),MeanRank(path),Median(latencies[path]),Mean(latencies[path]));
+  }
+  printf("%-20s %8s %8s %8s %10s %14.1f %14.1f\n","(Process3)","","","","",Median(clusterLatencies),Mean(clusterLatencies));
+
+  ofile = fopen(jsonFile.c_str(),"w");
+  if(ofile == NULL){
+    cout << "ERROR could not open file: " << jsonFile << endl;
+    return false;
+  }
+  fprintf(ofile,"{\n  \"traces\": %d,\n  \"out_of_vocab\": %d,\n  \"cluster_median_us\": %.3f,\n  \"paths\": [\n",(int)traces.size(),numOutOfVocab,Median(clusterLatencies));
+  for(path = 0; path < NUM_RECALL_PATHS; path++){
+    fprintf(ofile,"    {\"path\": \"%s\", \"top1\": %.4f, \"top5\": %.4f, \"top20\": %.4f, \"mean_rank\": %.3f, \"median_us\": %.3f, \"mean_us\": %.3f}%s\n",
+      RECALL_PATHS[path],RecallAt(path,1),RecallAt(path,5),RecallAt(path,20),MeanRank(path),Median(latencies[path]),Mean(latencies[path]),(path < NUM_RECALL_PATHS - 1) ? "," : "");
+  }
+  fprintf(ofile,"  ]\n}\n");
+  fclose(ofile);
+
+  cout << "wrote " << jsonFile << endl;
+  return true;
+}
+
+int main(int argc, char* argv[])
+{
+  string labelsFile = "../TestInput/EyeInputs/labels.txt";
+  string jsonFile = "recall.json";
+  int editFailures;
+
+  if(argc >= 2){
+    labelsFile = argv[1];
+  }
+  if(argc >= 3){
+    jsonFile = argv[2];
+  }
+
+  Recall recall("../TestInput/EyeInputs/Test1/keyMap.txt");
+  if(!recall.LoadLabels(labelsFile)){
+    return 1;
+  }
+  editFailures = recall.CheckEditRanks();
+  recall.Run();
+
+  return (recall.WriteReport(jsonFile) && editFailures == 0) ? 0 : 1;
+}
@@ -0,0 +1,322 @@
+#include "Controller.hpp"
+
+/*
+  Replays recorded (or generated) sessions from a gaze trace file into the engine on their own timeline, the way a
+  production deployment sees them, instead of handing each word to Process3 as fast as possible.
+
+  Every session in the file becomes a DecodeSession on a SessionPool, optionally several copies of it (staggered, as
+  independent users). A word is submitted when its last sample would have arrived, at speed times real time, and its
+  latency is measured from that moment to its results: the end-of-word-to-result delay a user would see, including
+  any time spent queued behind other words. The backlog (words submitted but not yet decoded) is sampled at every
+  submission.
+
+    replay file.gzt [speed=1] [path=direct|lattice] [copies=1] [threads=cores] [budgetMs=REPLAY_BUDGET_MS]
+
+  speed is a multiple of real time (1, 10, 0.5...), or:
+    max     submit every word at once; reports throughput, and the speed-up over real time that it implies
+    sweep   finds the highest speed-up at which the p99 latency stays within budgetMs: starts from a fraction of the
+            max run's implied speed-up, doubles until the budget is blown, then bisects
+*/
+
+#define REPLAY_BUDGET_MS 100.0  //default p99 end-of-word-to-result latency a run must stay within to keep up
+#define REPLAY_BISECT_STEPS 4
+
+//one word's submission, in due order
+struct ReplayEvent{
+  U64 dueUs;    //end of the word, on the replay's timeline at 1x
+  U32 session;  //index into the run's sessions: copy * numSessions + sessionId
+  U32 word;     //index into trace.words
+};
+
+struct ReplayRun{
+  double speed;  //0 for max
+  double wallSeconds;
+  vector<double> latenciesUs;
+  double meanBacklog;
+  U64 maxBacklog;
+};
+
+class Replay{
+  public:
+    DecoderModels* models;
+    GazeTraceFile trace;
+    int path;
+    int copies;
+    int numThreads;
+    double budgetMs;
+    vector<ReplayEvent> events;
+    U64 timelineUs;  //due time of the last word
+    //written by the pool's workers during a run
+    std::mutex mutex;
+    U64 completed;
+    vector<double> latenciesUs;
+
+    Replay(int decodePath, int numCopies, int threads, double budget);
+    ~Replay();
+
+    bool Load(const string& traceFile);
+    void Run(double speed, ReplayRun& run);
+    void Completed(struct timespec due);
+    bool KeepsUp(ReplayRun& run);
+    void Print(ReplayRun& run);
+    void Sweep(void);
+};
+
+static bool ByDue(const ReplayEvent& left, const ReplayEvent& right)
+{
+  return left.dueUs < right.dueUs;
+}
+
+Replay::Replay(int decodePath, int numCopies, int threads, double budget)
+{
+  path = decodePath;
+  copies = numCopies;
+  numThreads = threads;
+  budgetMs = budget;
+  timelineUs = 0;
+  completed = 0;
+
+  Silence(true);
+  models = new DecoderModels("../TestInput/EyeInputs/Test1/keyMap.txt","../vocabModel.txt");
+  Silence(false);
+}
+
+Replay::~Replay()
+{
+  delete models;
+}
+
+/*
+  Maps the trace and builds the schedule. Each session's timeline starts at its first word's first sample; copy c of
+  every session is delayed by c/copies of the first word's length, so the copies don't all finish words in lockstep.
+*/
+bool Replay::Load(const string& traceFile)
+{
+  U32 i, numSessions;
+  int c;
+  U64 wordUs;
+  size_t j;
+  vector<U64> sessionStartUs;
+  vector<U64> staggerUs;
+  ReplayEvent event;
+
+  if(!trace.Open(traceFile)){
+    return false;
+  }
+  numSessions = trace.header.numSessions;
+  sessionStartUs.assign(numSessions,~0ULL);
+  staggerUs.assign(numSessions,0);
+
+  for(i = 0; i < trace.words.size(); i++){
+    const GazeWord& word = trace.words[i];
+    if(word.startUs < sessionStartUs[word.sessionId]){
+      sessionStartUs[word.sessionId] = word.startUs;
+    }
+  }
+
+  for(i = 0; i < trace.words.size(); i++){
+    const GazeWord& word = trace.words[i];
+    wordUs = 0;
+    for(j = 0; j < word.points.size(); j++){
+      wordUs += word.deltaUs[j];
+    }
+    if(staggerUs[word.sessionId] == 0){
+      staggerUs[word.sessionId] = wordUs / copies;
+    }
+    for(c = 0; c < copies; c++){
+      event.dueUs = word.startUs - sessionStartUs[word.sessionId] + wordUs + c * staggerUs[word.sessionId];
+      event.session = c * numSessions + word.sessionId;
+      event.word = i;
+      events.push_back(event);
+      timelineUs = std::max(timelineUs,event.dueUs);
+    }
+  }
+  std::stable_sort(events.begin(),events.end(),ByDue);  //stable, so a session's words stay in order
+
+  if(events.empty()){
+    cout << "ERROR no words in " << traceFile << endl;
+    return false;
+  }
+
+  return true;
+}
+
+//a pool callback: the latency of a word due at due
+void Replay::Completed(struct timespec due)
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC,&now);
+  std::lock_guard<std::mutex> lock(mutex);
+  latenciesUs.push_back(DiffTimeSpecs(&due,&now) * 1.0e6);
+  completed++;
+}
+
+//replays every event at speed times real time, or all at once if speed is 0
+void Replay::Run(double speed, ReplayRun& run)
+{
+  U32 i;
+  U64 backlog, submitted = 0, offsetNs;
+  double backlogSum = 0.0;
+  struct timespec begin, due, end;
+  vector<DecodeSession*> sessions;
+
+  completed = 0;
+  latenciesUs.clear();
+  latenciesUs.reserve(events.size());
+  run.speed = speed;
+  run.maxBacklog = 0;
+
+  Silence(true);
+  SessionPool pool(models,numThreads);
+  for(i = 0; i < trace.header.numSessions * copies; i++){
+    sessions.push_back(pool.OpenSession());
+  }
+
+  clock_gettime(CLOCK_MONOTONIC,&begin);
+  for(i = 0; i < events.size(); i++){
+    const ReplayEvent& event = events[i];
+    if(speed > 0.0){
+      offsetNs = (U64)(event.dueUs * 1000.0 / speed);
+      due.tv_sec = begin.tv_sec + (begin.tv_nsec + offsetNs) / 1000000000ULL;
+      due.tv_nsec = (begin.tv_nsec + offsetNs) % 1000000000ULL;
+      clock_nanosleep(CLOCK_MONOTONIC,TIMER_ABSTIME,&due,NULL);
+    }
+    else{
+      clock_gettime(CLOCK_MONOTONIC,&due);
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      backlog = submitted - completed;
+    }
+    backlogSum += backlog;
+    run.maxBacklog = std::max(run.maxBacklog,backlog);
+    submitted++;
+    pool.Submit(sessions[event.session],trace.words[event.word].points,path,[this,due](DecodeSession*, SearchResults&){
+      Completed(due);
+    });
+  }
+  pool.Drain();
+  clock_gettime(CLOCK_MONOTONIC,&end);
+  Silence(false);
+
+  run.wallSeconds = DiffTimeSpecs(&begin,&end);
+  run.meanBacklog = backlogSum / events.size();
+  run.latenciesUs = latenciesUs;
+}
+
+bool Replay::KeepsUp(ReplayRun& run)
+{
+  return Percentile(run.latenciesUs,0.99) <= budgetMs * 1000.0;
+}
+
+void Replay::Print(ReplayRun& run)
+{
+  char speed[SMALL_BUFSIZE];
+
+  if(run.speed > 0.0){
+    snprintf(speed,SMALL_BUFSIZE,"%.2fx",run.speed);
+  }
+  else{
+    snprintf(speed,SMALL_BUFSIZE,"max (%.1fx)",timelineUs / 1.0e6 / run.wallSeconds);
+  }
+  printf("%-14s %8.3f s  %9.1f words/s  latency ms p50 %8.2f  p90 %8.2f  p99 %8.2f  max %8.2f  backlog mean %6.2f max %4llu%s\n",
+    speed,run.wallSeconds,events.size() / run.wallSeconds,Percentile(run.latenciesUs,0.5) / 1000.0,Percentile(run.latenciesUs,0.9) / 1000.0,
+    Percentile(run.latenciesUs,0.99) / 1000.0,Percentile(run.latenciesUs,1.0) / 1000.0,run.meanBacklog,run.maxBacklog,
+    (run.speed > 0.0 && !KeepsUp(run)) ? "  BEHIND" : "");
+  fflush(stdout);
+}
+
+//the highest speed-up whose p99 latency stays within budget, to within 1/2^REPLAY_BISECT_STEPS of the last doubling
+void Replay::Sweep(void)
+{
+  int i;
+  double estimate, speed, good = 0.0, bad = 0.0;
+  ReplayRun run;
+
+  Run(0.0,run);
+  Print(run);
+  estimate = timelineUs / 1.0e6 / run.wallSeconds;
+
+  //the max run's rate is an upper bound; latency gives out somewhat below it
+  for(speed = estimate / 4.0; bad == 0.0 && speed < estimate * 4.0; speed *= 2.0){
+    Run(speed,run);
+    Print(run);
+    if(KeepsUp(run)){
+      good = speed;
+    }
+    else{
+      bad = speed;
+    }
+  }
+  if(bad == 0.0){
+    bad = speed;
+  }
+
+  for(i = 0; i < REPLAY_BISECT_STEPS; i++){
+    speed = (good > 0.0) ? (good + bad) / 2.0 : bad / 2.0;
+    Run(speed,run);
+    Print(run);
+    if(KeepsUp(run)){
+      good = speed;
+    }
+    else{
+      bad = speed;
+    }
+  }
+
+  if(good > 0.0){
+    printf("max sustainable speed-up %.2fx (p99 within %.1f ms)\n",good,budgetMs);
+  }
+  else{
+    printf("can't keep up even at %.2fx (p99 within %.1f ms)\n",bad,budgetMs);
+  }
+}
+
+int main(int argc, char* argv[])
+{
+  int copies = 1, numThreads = 0, path = DECODE_DIRECT;
+  double budgetMs = REPLAY_BUDGET_MS, speed = 1.0;
+  string mode = "1";
+  ReplayRun run;
+
+  if(argc >= 3){
+    mode = argv[2];
+  }
+  if(argc >= 4){
+    path = strcmp(argv[3],"lattice") ? DECODE_DIRECT : DECODE_LATTICE_LM;
+  }
+  if(argc >= 5){
+    copies = atoi(argv[4]);
+  }
+  if(argc >= 6){
+    numThreads = atoi(argv[5]);
+  }
+  if(argc >= 7){
+    budgetMs = atof(argv[6]);
+  }
+  if(mode != "max" && mode != "sweep"){
+    speed = atof(mode.c_str());
+  }
+  if(argc < 2 || copies <= 0 || budgetMs <= 0.0 || speed <= 0.0){
+    cout << "usage: " << argv[0] << " file" << GAZE_TRACE_EXT << " [speed=1|<multiple>|max|sweep] [path=direct|lattice] [copies=1] [threads=cores] [budgetMs=" << REPLAY_BUDGET_MS << "]" << endl;
+    return 1;
+  }
+
+  Replay replay(path,copies,numThreads,budgetMs);
+  if(!replay.Load(argv[1])){
+    return 1;
+  }
+  printf("replaying %zu words (%u sessions x %d copies, %.1f s of gaze) on the %s path\n",replay.events.size(),replay.trace.header.numSessions,copies,
+    replay.timelineUs / 1.0e6,(path == DECODE_LATTICE_LM) ? "lattice+lm" : "direct");
+
+  if(mode == "sweep"){
+    replay.Sweep();
+    return 0;
+  }
+  replay.Run((mode == "max") ? 0.0 : speed,run);
+  replay.Print(run);
+
+  return 0;
+}
@@ -21,6 +21,7 @@ SearchEngine::~SearchEngine()
 */
 void SearchEngine::Process(Lattice& lattice, LatticePaths& wordList)
 {
+  METRICS_SCOPE(STAGE_SEARCH);
   //double maxArc;
 
   //PrintLattice(lattice);
@@ -32,6 +33,7 @@ void SearchEngine::Process(Lattice& lattice, LatticePaths& wordList)
   //SortArcs(lattice);
   
   SimpleViterbi(lattice,wordList);
+  TRACE_EVENT(TRACE_SEARCH_DONE,wordList.size(),wordList.empty() ? 0.0 : wordList.begin()->second);
 
   //run SearchEngine algorithm. Currently only returns the single most-likely word, instead of some permutation of the input code.
   //RunViterbi(lattice, wordList);
@@ -55,6 +57,7 @@ void SearchEngine::DFS(State* curState, char prefix[256], double cumulativeProb,
     //path.first += curState->symbol;
     path.second = cumulativeProb;
     resultList.push_back(path);
+    METRICS_COUNT(COUNTER_PATHS_ENUMERATED,1);
     //cout << "pushed: " << path.first << ":" << path.second << " at curDepth==depthBound==" << depthBound << endl;
   }
   else{
@@ -119,7 +122,7 @@ double SearchEngine::WorstBestHeuristic(Lattice& lattice)
       worstBestPath += lattice[i].alphas[worstState].pState;
     }
   }
-  cout << "returning worstBestPath=" << worstBestPath << " i=" << i << " lattice.size()=" << lattice.size() << endl;
+  LOG_DEBUG("returning worstBestPath=" << worstBestPath << " i=" << i << " lattice.size()=" << lattice.size());
 
   return worstBestPath;
 }
@@ -150,6 +153,7 @@ void SearchEngine::PrunedDFS(State* curState, char prefix[256], double cumulativ
     path.first = prefix;
     path.second = cumulativeProb;
     resultList.push_back(path);
+    METRICS_COUNT(COUNTER_PATHS_ENUMERATED,1);
     //cout << "pushed: " << path.first << ":" << path.second << " at curDepth==depthBound==" << depthBound << endl;
   }
   else{
@@ -339,6 +343,7 @@ void SearchEngine::RunExhaustiveSearch(Lattice& lattice, LatticePaths& results,
           path.first += lattice[i].alphas[j].arcs[k].dest->symbol;
           path.second += lattice[i].alphas[j].arcs[k].pArc;
           results.push_back(path);
+          METRICS_COUNT(COUNTER_PATHS_ENUMERATED,1);
         }
       }
 */
@@ -374,7 +379,7 @@ void SearchEngine::SimpleViterbi(Lattice& lattice, LatticePaths& results)
   LatticePath message;
   message.second = 0.0; 
 
-  cout << "Running SimpleViterbi, assuming max state is the last row-entry in each column..." << endl;
+  LOG_DEBUG("Running SimpleViterbi, assuming max state is the last row-entry in each column...");
   for(i = 0; i < lattice.size(); i++){
     message.first += lattice[i].alphas[lattice[i].alphas.size()-1].symbol; //take vals of last state directly (!)
     message.second += lattice[i].alphas[lattice[i].alphas.size()-1].pState;
@@ -382,6 +387,7 @@ void SearchEngine::SimpleViterbi(Lattice& lattice, LatticePaths& results)
   }
   //cout << "done..." << endl;
   results.push_front(message);
+  METRICS_COUNT(COUNTER_PATHS_ENUMERATED,1);
 }
 
 
@@ -436,7 +442,7 @@ void SearchEngine::RunViterbi(Lattice& lattice, LatticePaths& results)
           //left-hand operands are states in the next right column. Dont be fooled by i-indices: following the pointer, its an i+1 state.
           lattice[i].alphas[j].arcs[k].dest->viterbiMax = lattice[i].alphas[j].arcs[k].pArc;
           lattice[i].alphas[j].arcs[k].dest->maxPrev = &lattice[i].alphas[j];
-          cout << "here" << endl;
+          LOG_TRACE("here");
         }
       }
     }
@@ -475,6 +481,7 @@ void SearchEngine::RunViterbi(Lattice& lattice, LatticePaths& results)
   message.second = 1.0;
 
   results.push_front(message);
+  METRICS_COUNT(COUNTER_PATHS_ENUMERATED,1);
 }
 
 //Comparison function for sorting arc's by probability, in ascending order, min item first. 
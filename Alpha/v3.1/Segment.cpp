@@ -0,0 +1,240 @@
+#include "Controller.hpp"
+
+/*
+  Decodes whole sessions of a gaze trace file as continuous streams. Each session's words are played back to back as
+  one stream of samples, on the file's clock, through a WordSegmenter (see Segmenter.cpp), and each segment it cuts is
+  submitted to the session's DecodeSession on a SessionPool while the stream keeps flowing. The sentence decoded from
+  the stream is printed against the labels, and against the same session decoded a word at a time from the file's
+  own word boundaries, which is what every other driver does.
+
+    segment file.gzt [path=direct|lattice] [speed=max|<multiple>] [threads=cores] [dwellMs=SEGMENT_DWELL_MS] [minWordMs=SEGMENT_MIN_WORD_MS]
+
+  At speed max the stream is pushed as fast as the segmenter takes it; at a multiple of real time the feeder sleeps to
+  the samples' times, so decoding overlaps ingestion the way it would live.
+*/
+
+//one session's stream, and what came out of it
+struct SegmentedSession{
+  U32 id;
+  DecodeSession* session;       //decodes the segments
+  DecodeSession* wordSession;   //decodes the file's words, for comparison
+  vector<string> labels;
+  vector<string> segmentTops;   //top result of each segment, in stream order
+  vector<string> wordTops;      //top result of each of the file's words
+};
+
+class Segment{
+  public:
+    DecoderModels* models;
+    GazeTraceFile trace;
+    int path;
+    int numThreads;
+    U64 dwellMs;
+    U64 minWordMs;
+    std::mutex mutex;  //guards the sessions' results, written by the pool's workers
+    vector<SegmentedSession> sessions;
+
+    Segment(int decodePath, int threads, U64 dwell, U64 minWord);
+    ~Segment();
+
+    bool Run(const string& traceFile, double speed);
+    void Print(double streamSeconds, double ingestSeconds, double tailSeconds);
+    int WordErrors(const vector<string>& hyp, const vector<string>& ref);
+    string Join(const vector<string>& words);
+};
+
+Segment::Segment(int decodePath, int threads, U64 dwell, U64 minWord)
+{
+  path = decodePath;
+  numThreads = threads;
+  dwellMs = dwell;
+  minWordMs = minWord;
+
+  Silence(true);
+  models = new DecoderModels("../TestInput/EyeInputs/Test1/keyMap.txt","../vocabModel.txt");
+  Silence(false);
+}
+
+Segment::~Segment()
+{
+  delete models;
+}
+
+bool Segment::Run(const string& traceFile, double speed)
+{
+  U32 i, s;
+  size_t j, k;
+  U64 timeUs, firstUs = 0, lastUs = 0, offsetNs;
+  struct timespec begin, due, ingested, end;
+  SegmentedSession* current;
+
+  if(!trace.Open(traceFile)){
+    return false;
+  }
+
+  Silence(true);
+  SessionPool pool(models,numThreads);
+  SingularityBuilder sb(0,models->layoutManager->GetWidth(),0,models->layoutManager->GetHeight(),models->layoutManager);  //only its InBounds
+  sessions.resize(trace.header.numSessions);
+  for(s = 0; s < sessions.size(); s++){
+    sessions[s].id = s;
+    sessions[s].session = pool.OpenSession();
+    sessions[s].wordSession = pool.OpenSession();
+  }
+
+  //the file's own word boundaries
+  for(i = 0; i < trace.words.size(); i++){
+    const GazeWord& word = trace.words[i];
+    current = &sessions[word.sessionId];
+    k = current->labels.size();
+    current->labels.push_back(word.label[0] ? word.label : "-");
+    current->wordTops.push_back("");
+    pool.Submit(current->wordSession,word.points,path,[this,current,k](DecodeSession*, SearchResults& results){
+      std::lock_guard<std::mutex> lock(mutex);
+      current->wordTops[k] = results.empty() ? "" : results.begin()->first;
+    });
+  }
+  pool.Drain();
+
+  //the sessions as streams, one after the other, on the file's clock
+  current = NULL;
+  WordSegmenter segmenter(&sb,[this,&pool,&current](const PointSpan& points, U64, U64){
+    size_t n;
+    SegmentedSession* segmented = current;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      n = segmented->segmentTops.size();
+      segmented->segmentTops.push_back("");
+    }
+    pool.Submit(segmented->session,points,path,[this,segmented,n](DecodeSession*, SearchResults& results){
+      std::lock_guard<std::mutex> lock(mutex);
+      segmented->segmentTops[n] = results.empty() ? "" : results.begin()->first;
+    });
+  },dwellMs,minWordMs);
+
+  clock_gettime(CLOCK_MONOTONIC,&begin);
+  for(i = 0; i < trace.words.size(); i++){
+    const GazeWord& word = trace.words[i];
+    if(current != &sessions[word.sessionId]){
+      if(current != NULL){
+        segmenter.Flush();
+      }
+      current = &sessions[word.sessionId];
+      firstUs = word.startUs;
+    }
+    timeUs = word.startUs;
+    for(j = 0; j < word.points.size(); j++){
+      timeUs += word.deltaUs[j];
+      if(speed > 0.0){
+        offsetNs = (U64)((lastUs + timeUs - firstUs) * 1000.0 / speed);
+        due.tv_sec = begin.tv_sec + (begin.tv_nsec + offsetNs) / 1000000000ULL;
+        due.tv_nsec = (begin.tv_nsec + offsetNs) % 1000000000ULL;
+        clock_nanosleep(CLOCK_MONOTONIC,TIMER_ABSTIME,&due,NULL);
+      }
+      segmenter.Push(word.points[j],timeUs);
+    }
+    if(i + 1 == trace.words.size() || trace.words[i+1].sessionId != word.sessionId){
+      lastUs += timeUs - firstUs;  //the next session's stream starts where this one ended
+    }
+  }
+  if(current != NULL){
+    segmenter.Flush();
+  }
+  clock_gettime(CLOCK_MONOTONIC,&ingested);
+  pool.Drain();
+  clock_gettime(CLOCK_MONOTONIC,&end);
+  Silence(false);
+
+  Print(lastUs / 1.0e6,DiffTimeSpecs(&begin,&ingested),DiffTimeSpecs(&ingested,&end));
+
+  return true;
+}
+
+void Segment::Print(double streamSeconds, double ingestSeconds, double tailSeconds)
+{
+  int segmentErrors = 0, wordErrors = 0, numLabels = 0, numSegments = 0;
+
+  for(int s = 0; s < sessions.size(); s++){
+    SegmentedSession& segmented = sessions[s];
+    printf("session %u \"%s\": %zu words, %zu segments\n",segmented.id,trace.sessionNames[segmented.id],segmented.labels.size(),segmented.segmentTops.size());
+    printf("  labels     %s\n",Join(segmented.labels).c_str());
+    printf("  per word   %s  (%d word errors)\n",Join(segmented.wordTops).c_str(),WordErrors(segmented.wordTops,segmented.labels));
+    printf("  segmented  %s  (%d word errors, %d vs per word)\n",Join(segmented.segmentTops).c_str(),WordErrors(segmented.segmentTops,segmented.labels),
+      WordErrors(segmented.segmentTops,segmented.wordTops));
+    wordErrors += WordErrors(segmented.wordTops,segmented.labels);
+    segmentErrors += WordErrors(segmented.segmentTops,segmented.labels);
+    numLabels += segmented.labels.size() - std::count(segmented.labels.begin(),segmented.labels.end(),string("-"));
+    numSegments += segmented.segmentTops.size();
+  }
+
+  printf("%d labeled words, %d segments; word errors per word %d, segmented %d\n",numLabels,numSegments,wordErrors,segmentErrors);
+  printf("%.1f s of gaze streamed in %.3f s; the last segment was decoded %.2f ms after the stream ended\n",streamSeconds,ingestSeconds,tailSeconds * 1000.0);
+}
+
+/*
+  Word-level edit distance: the substitutions, insertions and deletions that turn hyp into ref. An unlabeled word
+  ("-") in ref isn't an error however it's decoded: it matches any one hyp word, and can be dropped, for free. So it
+  still holds its place in the alignment, but only labeled words are counted.
+*/
+int Segment::WordErrors(const vector<string>& hyp, const vector<string>& ref)
+{
+  vector<int> prev(ref.size() + 1), cur(ref.size() + 1);
+  int labeled;
+
+  prev[0] = 0;
+  for(size_t j = 1; j <= ref.size(); j++){
+    prev[j] = prev[j-1] + (ref[j-1] != "-");
+  }
+  for(size_t i = 1; i <= hyp.size(); i++){
+    cur[0] = i;
+    for(size_t j = 1; j <= ref.size(); j++){
+      labeled = ref[j-1] != "-";
+      cur[j] = std::min(std::min(prev[j] + 1,cur[j-1] + labeled),prev[j-1] + (hyp[i-1] == ref[j-1] ? 0 : labeled));
+    }
+    prev.swap(cur);
+  }
+
+  return prev[ref.size()];
+}
+
+string Segment::Join(const vector<string>& words)
+{
+  string sentence;
+
+  for(size_t i = 0; i < words.size(); i++){
+    sentence += (i > 0) ? " " : "";
+    sentence += words[i].empty() ? "?" : words[i];
+  }
+
+  return sentence;
+}
+
+int main(int argc, char* argv[])
+{
+  int numThreads = 0, path = DECODE_DIRECT;
+  U64 dwellMs = SEGMENT_DWELL_MS, minWordMs = SEGMENT_MIN_WORD_MS;
+  double speed = 0.0;
+
+  if(argc >= 3){
+    path = strcmp(argv[2],"lattice") ? DECODE_DIRECT : DECODE_LATTICE_LM;
+  }
+  if(argc >= 4 && strcmp(argv[3],"max")){
+    speed = atof(argv[3]);
+  }
+  if(argc >= 5){
+    numThreads = atoi(argv[4]);
+  }
+  if(argc >= 6){
+    dwellMs = atoi(argv[5]);
+  }
+  if(argc >= 7){
+    minWordMs = atoi(argv[6]);
+  }
+  if(argc < 2 || speed < 0.0){
+    cout << "usage: " << argv[0] << " file" << GAZE_TRACE_EXT << " [path=direct|lattice] [speed=max|<multiple>] [threads=cores] [dwellMs=" << SEGMENT_DWELL_MS << "] [minWordMs=" << SEGMENT_MIN_WORD_MS << "]" << endl;
+    return 1;
+  }
+
+  Segment segment(path,numThreads,dwellMs,minWordMs);
+  return segment.Run(argv[1],speed) ? 0 : 1;
+}
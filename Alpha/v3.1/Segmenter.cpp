@@ -0,0 +1,104 @@
+#include "Controller.hpp"
+
+/*
+  Word segmentation of a continuous sensor stream. Every trace the engine has been fed so far holds exactly one word,
+  cut by hand (or by the recording tool) at the space bar; a user typing a sentence produces one unbroken stream. The
+  space bar sits below the keys, outside the active region SingularityBuilder::InBounds checks, so between words the
+  gaze rests off the keys: on the space bar, or off the layout altogether. The segmenter watches for that:
+
+    -the first sample inside the keys' region starts a word
+    -the word ends once the gaze has stayed off the keys for dwellUs; shorter excursions (a saccade that clips the
+     edge of the region, tracker noise) stay part of the word
+    -a word whose in-region samples span less than minWordUs was a stray glance, and is dropped
+
+  A word is handed to the callback with the dwell that ended it, and the dwell (at most its last dwellUs) is also kept
+  as the lead of the next word, so each segment starts and ends off the keys like the recorded traces do. Process3
+  skips the out-of-region samples, so they cost nothing but a few comparisons.
+
+  The callback runs on the pushing thread as soon as a word is cut, so a caller that submits it to a SessionPool keeps
+  ingesting while the word decodes. If the user misses the space bar and goes straight to the next word's first key
+  (the "brownfox" case in the Java README), there is no dwell, and the two words come out as one segment.
+*/
+
+WordSegmenter::WordSegmenter(SingularityBuilder* sbPtr, SegmentCallback callback, U64 dwellMs, U64 minWordMs)
+{
+  sb = sbPtr;
+  done = callback;
+  dwellUs = dwellMs * 1000;
+  minWordUs = minWordMs * 1000;
+  numWords = 0;
+  Reset();
+}
+
+//the next sample of the stream; times must not decrease
+void WordSegmenter::Push(const Point& p, U64 timeUs)
+{
+  samples.push_back(p);
+  timesUs.push_back(timeUs);
+
+  if(sb->InBounds(p)){
+    if(!inWord){
+      inWord = true;
+      wordStartUs = timeUs;
+    }
+    wordEndUs = timeUs;
+    outStart = samples.size();
+    return;
+  }
+
+  //between words, only the last dwellUs of the stream is kept, as the next word's lead
+  if(!inWord){
+    TrimLead(timeUs);
+    return;
+  }
+
+  if(timeUs - timesUs[outStart] >= dwellUs){
+    if(wordEndUs - wordStartUs >= minWordUs){
+      Cut(samples.size());
+    }
+    samples.erase(samples.begin(),samples.begin() + outStart);
+    timesUs.erase(timesUs.begin(),timesUs.begin() + outStart);
+    outStart = 0;
+    inWord = false;
+  }
+}
+
+//end of the stream: a word still in progress is cut without waiting for its dwell
+void WordSegmenter::Flush(void)
+{
+  if(inWord && wordEndUs - wordStartUs >= minWordUs){
+    Cut(samples.size());
+  }
+  Reset();
+}
+
+void WordSegmenter::Reset(void)
+{
+  samples.clear();
+  timesUs.clear();
+  inWord = false;
+  wordStartUs = wordEndUs = 0;
+  outStart = 0;
+}
+
+//hands samples [0,end) to the callback
+void WordSegmenter::Cut(size_t end)
+{
+  numWords++;
+  done(PointSpan(&samples[0],end),timesUs[0],timesUs[end-1]);
+}
+
+//drops the samples older than dwellUs before nowUs
+void WordSegmenter::TrimLead(U64 nowUs)
+{
+  size_t n = 0;
+
+  while(n < timesUs.size() && timesUs[n] + dwellUs < nowUs){
+    n++;
+  }
+  if(n > 0){
+    samples.erase(samples.begin(),samples.begin() + n);
+    timesUs.erase(timesUs.begin(),timesUs.begin() + n);
+    outStart -= std::min(n,outStart);
+  }
+}
@@ -0,0 +1,479 @@
+#include "Controller.hpp"
+#include <cassert>
+#include <fcntl.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <linux/input.h>
+#ifdef SENSOR_X11
+#include <X11/Xlib.h>
+#endif
+
+/*
+  Live input. listenerTesting/xLibListener.c and mouseListener.py only print pointer coordinates, and twitch only reads
+  text files of them, so testing with a live pointer meant recording a file first. Here a SensorSource is a thread that
+  captures samples from one device or file, stamps each one on CLOCK_MONOTONIC as it's captured, and pushes it into a
+  GazeStream's queue; the stream's own thread cuts the samples into words (WordSegmenter) and decodes each word on a
+  SessionPool as soon as it's cut.
+
+    source thread --Emit--> GazeStream::queue --> [GazeStream::Consume: WordSegmenter] --Submit--> SessionPool
+
+  The queue is bounded, so a stream that falls behind blocks its sources rather than growing without bound; input
+  devices buffer in the kernel meanwhile. Sources blocked on input wake every SENSOR_POLL_MS to check for Stop.
+
+  The sources that replay samples (a gaze trace file, the synthetic generator) stamp them on the gaze clock from when
+  the source started, whatever speed they're paced at, so the segmenter's dwell times mean the same thing at any speed.
+*/
+
+GazeStream::GazeStream(SessionPool* poolPtr, int decodePath, StreamCallback callback)
+  : sb(0,poolPtr->models->layoutManager->GetWidth(),0,poolPtr->models->layoutManager->GetHeight(),poolPtr->models->layoutManager),
+    segmenter(&sb,[this](const PointSpan& points, U64 startUs, U64 endUs){
+      U64 cutUs = SensorSource::NowUs();
+      pool->Submit(session,points,path,[this,startUs,endUs,cutUs](DecodeSession*, SearchResults& results){
+        done(results,startUs,endUs,cutUs);
+      });
+    }),
+    queue(SENSOR_QUEUE_DEPTH)
+{
+  pool = poolPtr;
+  path = decodePath;
+  done = callback;
+  numSamples = 0;
+  filtering = GAZE_FILTER_DEFAULT;
+  session = pool->OpenSession();
+  session->filtering = false;
+  consumer = std::thread(&GazeStream::Consume,this);
+}
+
+GazeStream::~GazeStream()
+{
+  Close();
+  pool->CloseSession(session);
+}
+
+//end of input: cuts the word in progress, and waits for every word to be decoded. Stop the sources first.
+void GazeStream::Close(void)
+{
+  queue.Close();
+  if(consumer.joinable()){
+    consumer.join();
+  }
+  pool->WaitIdle(session);
+}
+
+void GazeStream::Consume(void)
+{
+  SensorSample sample;
+
+  while(queue.Pop(sample)){
+    numSamples++;
+    segmenter.Push(filtering ? filter.Filter(sample.point,sample.timeUs) : sample.point,sample.timeUs);
+  }
+  segmenter.Flush();
+}
+
+SensorSource::SensorSource()
+{
+  queue = NULL;
+  stopping = false;
+  numSamples = 0;
+}
+
+//the subclass's destructor has already stopped the thread: it ran the subclass's Capture, so it can't outlive the subclass
+SensorSource::~SensorSource()
+{
+  assert(!thread.joinable());
+}
+
+//opens the input, then captures from it on a new thread. False, with no thread started, if the input can't be opened.
+bool SensorSource::Start(BoundedQueue<SensorSample>* ingestQueue)
+{
+  queue = ingestQueue;
+  stopping = false;
+  if(!Open()){
+    return false;
+  }
+  thread = std::thread([this](){
+    Capture();
+    Close();
+  });
+
+  return true;
+}
+
+void SensorSource::Stop(void)
+{
+  stopping = true;
+  Join();
+}
+
+//waits for the input to end on its own (end of file, or of the replay)
+void SensorSource::Join(void)
+{
+  if(thread.joinable()){
+    thread.join();
+  }
+}
+
+//pushes a sample; blocks while the queue is full. False once the queue is closed, and the source should stop.
+bool SensorSource::Emit(const Point& p, U64 timeUs)
+{
+  SensorSample sample;
+
+  sample.point = p;
+  sample.timeUs = timeUs;
+  numSamples++;
+
+  return queue->Push(sample);
+}
+
+U64 SensorSource::NowUs(void)
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC,&now);
+  return (U64)now.tv_sec * 1000000ULL + now.tv_nsec / 1000;
+}
+
+//sleeps until timeUs on the NowUs clock
+void SensorSource::SleepUntil(U64 timeUs)
+{
+  struct timespec due;
+
+  due.tv_sec = timeUs / 1000000ULL;
+  due.tv_nsec = (timeUs % 1000000ULL) * 1000;
+  clock_nanosleep(CLOCK_MONOTONIC,TIMER_ABSTIME,&due,NULL);
+}
+
+//true once fd has input (or an error, or end of file) to read; false after SENSOR_POLL_MS without
+bool SensorSource::WaitReadable(int fd)
+{
+  struct pollfd pfd;
+
+  pfd.fd = fd;
+  pfd.events = POLLIN;
+  pfd.revents = 0;
+
+  return poll(&pfd,1,SENSOR_POLL_MS) > 0;
+}
+
+StdinSensorSource::StdinSensorSource(int inputFd)
+{
+  fd = inputFd;
+}
+
+StdinSensorSource::~StdinSensorSource()
+{
+  Stop();
+}
+
+bool StdinSensorSource::Open(void)
+{
+  if(fcntl(fd,F_GETFD) < 0){
+    cout << "ERROR StdinSensorSource has no input on fd " << fd << endl;
+    return false;
+  }
+
+  return true;
+}
+
+void StdinSensorSource::Capture(void)
+{
+  char buf[BUFSIZE];
+  ssize_t n;
+  size_t eol;
+  Point p;
+
+  while(!stopping){
+    if(!WaitReadable(fd)){
+      continue;
+    }
+    n = read(fd,buf,BUFSIZE);
+    if(n <= 0){
+      break;
+    }
+    pending.append(buf,n);
+    while((eol = pending.find('\n')) != string::npos){
+      if(ParseLine(pending.substr(0,eol),p) && !Emit(p,NowUs())){
+        return;
+      }
+      pending.erase(0,eol + 1);
+    }
+  }
+}
+
+//the first two integers on the line are x and y; anything else is ignored
+bool StdinSensorSource::ParseLine(const string& line, Point& p)
+{
+  long coords[2];
+  int n = 0;
+  const char* c = line.c_str();
+  char* end;
+
+  while(*c != '\0' && n < 2){
+    if(isdigit(*c) || (*c == '-' && isdigit(c[1]))){
+      coords[n++] = strtol(c,&end,10);
+      c = end;
+    }
+    else{
+      c++;
+    }
+  }
+  if(n < 2){
+    return false;
+  }
+  p.X = (short int)coords[0];
+  p.Y = (short int)coords[1];
+
+  return true;
+}
+
+GazeTraceSensorSource::GazeTraceSensorSource(const string& traceFile, double replaySpeed)
+{
+  fname = traceFile;
+  speed = replaySpeed;
+}
+
+GazeTraceSensorSource::~GazeTraceSensorSource()
+{
+  Stop();
+}
+
+bool GazeTraceSensorSource::Open(void)
+{
+  return trace.Open(fname);
+}
+
+//every session back to back, each starting where the last one ended; gaps between a session's words are kept
+void GazeTraceSensorSource::Capture(void)
+{
+  U64 beginUs = NowUs(), streamUs = 0, sessionUs = 0, sampleUs;
+  U32 sessionId = ~0U;
+
+  for(size_t i = 0; i < trace.words.size() && !stopping; i++){
+    const GazeWord& word = trace.words[i];
+    if(word.sessionId != sessionId){
+      sessionId = word.sessionId;
+      sessionUs = streamUs - word.startUs;  //maps this session's clock onto the stream's
+    }
+    sampleUs = word.startUs;
+    for(size_t j = 0; j < word.points.size() && !stopping; j++){
+      sampleUs += word.deltaUs[j];
+      streamUs = std::max(streamUs,sessionUs + sampleUs);
+      if(speed > 0.0){
+        SleepUntil(beginUs + (U64)(streamUs / speed));
+      }
+      if(!Emit(word.points[j],beginUs + streamUs)){
+        return;
+      }
+    }
+  }
+}
+
+SyntheticSensorSource::SyntheticSensorSource(LayoutManager* layoutManager, const TraceGenParams& params, U32 seed, const vector<string>& wordList, double replaySpeed)
+  : generator(layoutManager,params,seed)
+{
+  words = wordList;
+  speed = replaySpeed;
+}
+
+SyntheticSensorSource::~SyntheticSensorSource()
+{
+  Stop();
+}
+
+bool SyntheticSensorSource::Open(void)
+{
+  for(int i = 0; i < words.size(); i++){
+    if(!generator.OnLayout(words[i])){
+      cout << "ERROR SyntheticSensorSource can't type >" << words[i] << "< on this layout" << endl;
+      return false;
+    }
+  }
+
+  return true;
+}
+
+//each word's trace starts and ends on the space bar, so back to back they make one stream
+void SyntheticSensorSource::Capture(void)
+{
+  U64 beginUs = NowUs(), streamUs = 0, periodUs = (U64)(1.0e6 / generator.params.sampleHz);
+  vector<Point> points;
+
+  for(int i = 0; i < words.size() && !stopping; i++){
+    points.clear();
+    generator.Generate(words[i],points);
+    for(size_t j = 0; j < points.size() && !stopping; j++){
+      streamUs += periodUs;
+      if(speed > 0.0){
+        SleepUntil(beginUs + (U64)(streamUs / speed));
+      }
+      if(!Emit(points[j],beginUs + streamUs)){
+        return;
+      }
+    }
+  }
+}
+
+EvdevSensorSource::EvdevSensorSource(const string& devicePath, int screenWidth, int screenHeight)
+{
+  device = devicePath;
+  width = screenWidth;
+  height = screenHeight;
+  fd = -1;
+  absMin[0] = absMin[1] = absMax[0] = absMax[1] = 0;
+  stampOnRead = false;
+}
+
+EvdevSensorSource::~EvdevSensorSource()
+{
+  Stop();
+}
+
+bool EvdevSensorSource::Open(void)
+{
+  int clockId = CLOCK_MONOTONIC;
+  struct input_absinfo absInfo;
+
+  fd = open(device.c_str(),O_RDONLY | O_NONBLOCK);
+  if(fd < 0){
+    cout << "ERROR could not open input device (is it readable by this user?): " << device << endl;
+    return false;
+  }
+  //stamp events on the same clock as the other sources, at the time the kernel saw them
+  stampOnRead = ioctl(fd,EVIOCSCLOCKID,&clockId) != 0;
+  if(stampOnRead){
+    LOG_WARN("input device doesn't take a clock id, stamping samples when they're read: " << device);
+  }
+  if(ioctl(fd,EVIOCGABS(ABS_X),&absInfo) == 0){
+    absMin[0] = absInfo.minimum;
+    absMax[0] = absInfo.maximum;
+  }
+  if(ioctl(fd,EVIOCGABS(ABS_Y),&absInfo) == 0){
+    absMin[1] = absInfo.minimum;
+    absMax[1] = absInfo.maximum;
+  }
+
+  return true;
+}
+
+//motion accumulates over an event packet, and is emitted at its SYN_REPORT
+void EvdevSensorSource::Capture(void)
+{
+  struct input_event events[64];
+  ssize_t n;
+  double x = width / 2.0, y = height / 2.0;
+  bool moved = false;
+  U64 timeUs;
+
+  while(!stopping){
+    if(!WaitReadable(fd)){
+      continue;
+    }
+    n = read(fd,events,sizeof(events));
+    if(n < 0 && (errno == EAGAIN || errno == EINTR)){
+      continue;
+    }
+    if(n <= 0){
+      break;
+    }
+    for(int i = 0; i < n / sizeof(struct input_event); i++){
+      const struct input_event& ev = events[i];
+      if(ev.type == EV_REL && (ev.code == REL_X || ev.code == REL_Y)){
+        (ev.code == REL_X ? x : y) += ev.value;
+        moved = true;
+      }
+      else if(ev.type == EV_ABS && (ev.code == ABS_X || ev.code == ABS_Y)){
+        int axis = (ev.code == ABS_X) ? 0 : 1;
+        if(absMax[axis] > absMin[axis]){
+          (axis == 0 ? x : y) = (double)(ev.value - absMin[axis]) / (absMax[axis] - absMin[axis]) * (axis == 0 ? width : height);
+          moved = true;
+        }
+      }
+      else if(ev.type == EV_SYN && ev.code == SYN_REPORT && moved){
+        x = std::min(std::max(x,0.0),(double)width);
+        y = std::min(std::max(y,0.0),(double)height);
+        timeUs = stampOnRead ? NowUs() : (U64)ev.time.tv_sec * 1000000ULL + ev.time.tv_usec;
+        if(!Emit(Point((short int)x,(short int)y),timeUs)){
+          return;
+        }
+        moved = false;
+      }
+    }
+  }
+}
+
+void EvdevSensorSource::Close(void)
+{
+  if(fd >= 0){
+    close(fd);
+  }
+  fd = -1;
+}
+
+X11SensorSource::X11SensorSource()
+{
+  display = NULL;
+}
+
+X11SensorSource::~X11SensorSource()
+{
+  Stop();
+}
+
+#ifdef SENSOR_X11
+bool X11SensorSource::Open(void)
+{
+  Display* d = XOpenDisplay(NULL);
+
+  if(d == NULL){
+    cout << "ERROR could not open the X display (is DISPLAY set?)" << endl;
+    return false;
+  }
+  XSelectInput(d,XRootWindow(d,0),PointerMotionMask);
+  display = d;
+
+  return true;
+}
+
+//xLibListener.c's event loop, without blocking in XNextEvent so Stop is noticed
+void X11SensorSource::Capture(void)
+{
+  Display* d = (Display*)display;
+  XEvent event;
+
+  while(!stopping){
+    if(XPending(d) == 0){
+      WaitReadable(ConnectionNumber(d));
+      continue;
+    }
+    XNextEvent(d,&event);
+    if(event.type == MotionNotify && !Emit(Point(event.xmotion.x_root,event.xmotion.y_root),NowUs())){
+      return;
+    }
+  }
+}
+
+void X11SensorSource::Close(void)
+{
+  if(display != NULL){
+    XCloseDisplay((Display*)display);
+  }
+  display = NULL;
+}
+#else
+bool X11SensorSource::Open(void)
+{
+  cout << "ERROR built without X11 support; rebuild with SENSORFLAGS=\"-DSENSOR_X11 -lX11\" (see makefile)" << endl;
+  return false;
+}
+
+void X11SensorSource::Capture(void)
+{
+}
+
+void X11SensorSource::Close(void)
+{
+}
+#endif
@@ -0,0 +1,261 @@
+#include "Controller.hpp"
+
+/*
+  Multi-session decoding. DecoderModels holds everything that's expensive to build and read-only afterwards (the key
+  layout, the vocabulary with its edit index and string kernels, and the char-gram models). A DecodeSession holds the
+  per-user state a decode writes to: the clusterer, lattice builder and search engine (whose only members are
+  parameters), and the point, cluster and lattice buffers, reused across the session's requests. Any number of
+  sessions share one DecoderModels without copying it.
+
+  The models are safe to share because the decode paths only read them. The few places that used to write shared
+  state during a decode are now per-call or per-thread: LanguageModel's majority-vote char map is a local, EditIndex's
+  dedupe stamps are thread-local, and LayoutManager's lookups use find() instead of an inserting keyMap[]. Viterbi's
+  State::viterbiMax is written during search, but it lives in the lattice, which belongs to the session. Stage
+  metrics and the trace ring can already be recorded from any thread.
+
+  SessionPool runs the sessions' requests on a fixed set of worker threads. A session is single-user, so its requests
+  run in the order submitted and never two at once, while different sessions decode in parallel. The pool queues
+  sessions rather than requests: a session with pending requests is queued once, and a worker runs one of its
+  requests and then requeues it at the back if it has more, so one session's backlog can't starve the others.
+*/
+
+DecoderModels::DecoderModels(const string& keyMapFile, const string& vocabFile)
+{
+  layoutManager = new LayoutManager(keyMapFile);
+  lm = new LanguageModel();
+  lm->BuildModels();
+  di = new DirectInference(vocabFile,layoutManager);
+  di->BuildEditIndex(MAX_EDIT_DIST);
+  lm->SetEditIndex(&di->editIndex);
+  clusterParams.Load(CLUSTER_PARAMS_FILE);
+}
+
+DecoderModels::~DecoderModels()
+{
+  delete lm;
+  delete di;
+  delete layoutManager;
+}
+
+DecodeSession::DecodeSession(DecoderModels* modelsPtr, U32 sessionId)
+  : sb(0,modelsPtr->layoutManager->GetWidth(),0,modelsPtr->layoutManager->GetHeight(),modelsPtr->layoutManager), lb(modelsPtr->layoutManager),
+    lattice(ArenaAllocator<Cluster>(NULL)), results(ArenaAllocator<SearchResult>(&arena))
+{
+  id = sessionId;
+  models = modelsPtr;
+  sb.SetParameters(models->clusterParams);
+  clusterer = ClusterRegistry::Find(DEFAULT_CLUSTER_STRATEGY);
+  filtering = GAZE_FILTER_DEFAULT;
+  lastDecodeUs = 0.0;
+  lastClusterUs = 0.0;
+  numDecodes = 0;
+  scheduled = false;
+}
+
+DecodeSession::~DecodeSession()
+{
+  //nada
+}
+
+//sets the clusterer, by its ClusterRegistry name, for the session's next decodes; an unknown name leaves it unchanged
+bool DecodeSession::SetClusterStrategy(const string& name)
+{
+  const ClusterStrategy* strategy = ClusterRegistry::Find(name);
+
+  if(strategy == NULL){
+    cout << "ERROR unknown cluster strategy: " << name << endl;
+    return false;
+  }
+  clusterer = strategy;
+
+  return true;
+}
+
+/*
+  Clusters points (smoothed, if filtering) with the session's clusterer and decodes them along path (a DecodePath) into results; the same
+  sequence as Controller::TestWordStream. The points are only read, in place, so they can be a vector or a mapped trace
+  file. The last word's lattice and results are released before the arena is reset, since they point into it; the
+  lattice's column vector itself is on the heap, so its capacity carries over.
+*/
+void DecodeSession::Decode(const PointSpan& points, int path)
+{
+  struct timespec begin, clustered, end;
+
+  clock_gettime(CLOCK_MONOTONIC,&begin);
+  pointMeans.clear();
+  if(points.size() > 0 && filtering){
+    filter.FilterWord(points,1000000 / GAZE_FILTER_SAMPLE_HZ,filtered);
+    clusterer->cluster(&sb,filtered,pointMeans);
+  }
+  else if(points.size() > 0){
+    clusterer->cluster(&sb,points,pointMeans);
+  }
+  clock_gettime(CLOCK_MONOTONIC,&clustered);
+  DecodeClusters(path);
+  clock_gettime(CLOCK_MONOTONIC,&end);
+
+  lastDecodeUs = DiffTimeSpecs(&begin,&end) * 1.0e6;
+  lastClusterUs = DiffTimeSpecs(&begin,&clustered) * 1.0e6;
+  numDecodes++;
+}
+
+//decodes the clusters already in pointMeans into results, without timing or counting it as a decode
+void DecodeSession::DecodeClusters(int path)
+{
+  lattice.clear();
+  results.clear();
+
+  ArenaScope scope(&arena);
+  if(pointMeans.size() > 0){
+    if(path == DECODE_LATTICE_LM){
+      lb.BuildStaticLattice(pointMeans,lattice);
+      se.Process(lattice,results);
+      models->lm->Process(results);
+    }
+    else{
+      models->di->Process(pointMeans,results);
+    }
+  }
+}
+
+//decodes the points already in sensorData, for callers that write their samples straight into it
+void DecodeSession::DecodeSensorData(int path)
+{
+  Decode(sensorData,path);
+}
+
+//numThreads <= 0 uses one thread per core
+SessionPool::SessionPool(DecoderModels* modelsPtr, int numThreads)
+{
+  models = modelsPtr;
+  nextSessionId = 0;
+  busySessions = 0;
+  stopping = false;
+
+  if(numThreads <= 0){
+    numThreads = std::max(1u,std::thread::hardware_concurrency());
+  }
+  for(int i = 0; i < numThreads; i++){
+    workers.push_back(std::thread(&SessionPool::Worker,this));
+  }
+}
+
+//runs every request already submitted, then stops the workers and deletes any sessions still open
+SessionPool::~SessionPool()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  workReady.notify_all();
+  for(int i = 0; i < workers.size(); i++){
+    workers[i].join();
+  }
+
+  for(set<DecodeSession*>::iterator it = sessions.begin(); it != sessions.end(); ++it){
+    delete *it;
+  }
+}
+
+DecodeSession* SessionPool::OpenSession(void)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  DecodeSession* session = new DecodeSession(models,nextSessionId++);
+
+  sessions.insert(session);
+
+  return session;
+}
+
+//waits for the session's pending requests to finish, then deletes it
+void SessionPool::CloseSession(DecodeSession* session)
+{
+  WaitIdle(session);
+
+  std::lock_guard<std::mutex> lock(mutex);
+  sessions.erase(session);
+  delete session;
+}
+
+//queues a decode of a copy of points on session; done is called from a worker thread once it's decoded
+void SessionPool::Submit(DecodeSession* session, const PointSpan& points, int path, DecodeCallback done)
+{
+  DecodeJob job;
+
+  job.points.assign(points.data,points.data + points.size());
+  job.path = path;
+  job.done = done;
+
+  std::lock_guard<std::mutex> lock(mutex);
+  session->pending.push_back(job);
+  if(!session->scheduled){
+    session->scheduled = true;
+    busySessions++;
+    readySessions.push_back(session);
+    workReady.notify_one();
+  }
+}
+
+void SessionPool::WaitIdle(DecodeSession* session)
+{
+  std::unique_lock<std::mutex> lock(mutex);
+
+  while(session->scheduled){
+    sessionIdle.wait(lock);
+  }
+}
+
+//waits until every session's requests have finished
+void SessionPool::Drain(void)
+{
+  std::unique_lock<std::mutex> lock(mutex);
+
+  while(busySessions > 0){
+    sessionIdle.wait(lock);
+  }
+}
+
+int SessionPool::NumThreads(void)
+{
+  return workers.size();
+}
+
+void SessionPool::Worker(void)
+{
+  DecodeSession* session;
+  DecodeJob job;
+
+  while(true){
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      while(readySessions.empty() && !stopping){
+        workReady.wait(lock);
+      }
+      if(readySessions.empty()){  //stopping, and nothing left to run
+        return;
+      }
+      session = readySessions.front();
+      readySessions.pop_front();
+      job = session->pending.front();
+      session->pending.pop_front();
+    }
+
+    session->Decode(job.points,job.path);
+    if(job.done){
+      job.done(session,session->results);
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      if(!session->pending.empty()){
+        readySessions.push_back(session);
+        workReady.notify_one();
+      }
+      else{
+        session->scheduled = false;
+        busySessions--;
+        sessionIdle.notify_all();
+      }
+    }
+  }
+}
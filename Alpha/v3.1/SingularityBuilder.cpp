@@ -4,7 +4,7 @@
 SingularityBuilder::SingularityBuilder()
 {
   //streaming clustering. still reliant on a tick input, but should be near realtime
-  SetEventParameters(14,16,4);
+  SetParameters(ClusterParams());
 
   //inData.reserve(1000);   //32k
   //outData.reserve(64);
@@ -21,7 +21,7 @@ SingularityBuilder::SingularityBuilder()
 SingularityBuilder::SingularityBuilder(int left, int right, int top, int bottom, LayoutManager* layoutManagerPtr)
 {
   //streaming clustering. still reliant on a tick input, but should be near realtime
-  SetEventParameters(14,16,4);
+  SetParameters(ClusterParams());
   
   //inData.reserve(1000);   //32k
   //outData.reserve(64);
@@ -53,6 +53,41 @@ void SingularityBuilder::SetEventParameters(int dxThresh, int innerDxThresh, int
   triggerThreshold = triggerThresh;   // receive this many triggers before throwing. may also need to correlate these as consecutive triggers.
 }
 
+void SingularityBuilder::SetParameters(const ClusterParams& params)
+{
+  SetEventParameters(params.dxThreshold,params.innerDxThreshold,params.triggerThreshold);
+  highFocus = params.highFocus;
+  stDev_HardTrigger = params.stDevHardTrigger;
+  stDev_SoftTrigger = params.stDevSoftTrigger;
+}
+
+ClusterParams SingularityBuilder::GetParameters(void)
+{
+  ClusterParams params;
+
+  params.dxThreshold = dxThreshold;
+  params.innerDxThreshold = innerDxThreshold;
+  params.triggerThreshold = triggerThreshold;
+  params.highFocus = highFocus;
+  params.stDevHardTrigger = stDev_HardTrigger;
+  params.stDevSoftTrigger = stDev_SoftTrigger;
+
+  return params;
+}
+
+//applies the parameters in fname, if there is one; otherwise the current ones stand
+bool SingularityBuilder::LoadParameters(const string& fname)
+{
+  ClusterParams params = GetParameters();
+
+  if(!params.Load(fname)){
+    return false;
+  }
+  SetParameters(params);
+
+  return true;
+}
+
 void SingularityBuilder::SetUiBoundaries(int left, int right, int top, int bottom)
 {
   activeRegion_Left = left;
@@ -61,6 +96,106 @@ void SingularityBuilder::SetUiBoundaries(int left, int right, int top, int botto
   activeRegion_Bottom = bottom;
 }
 
+ClusterParams::ClusterParams()
+{
+  dxThreshold = CLUSTER_DX_THRESHOLD;
+  innerDxThreshold = CLUSTER_INNER_DX_THRESHOLD;
+  triggerThreshold = CLUSTER_TRIGGER_THRESHOLD;
+  highFocus = CLUSTER_HIGH_FOCUS;
+  stDevHardTrigger = CLUSTER_STDEV_HARD_TRIGGER;
+  stDevSoftTrigger = CLUSTER_STDEV_SOFT_TRIGGER;
+}
+
+/*
+  Reads a parameter file: "name<TAB>value" lines, with # comments, as written by Save. Parameters the file doesn't
+  name keep their values, so a file can set just some of them.
+*/
+bool ClusterParams::Load(const string& fname)
+{
+  int ntoks, loaded = 0;
+  char buf[BUFSIZE];
+  char* tokens[8] = {NULL,NULL,NULL,NULL,NULL,NULL,NULL,NULL};
+  fstream infile(fname.c_str(), ios::in);
+  string delims = "\t", name;
+
+  if(!infile){
+    cout << " > no cluster parameter file " << fname << ", using default event parameters" << endl;
+    return false;
+  }
+
+  while(infile.getline(buf,BUFSIZE)){
+    if(buf[0] == '#' || buf[0] == '\0'){
+      continue;
+    }
+    ntoks = Tokenize(tokens,buf,delims);
+    if(ntoks != 2){
+      cout << "WARNING incorrect number of tokens found in cluster parameter file: " << fname << endl;
+      continue;
+    }
+    name = tokens[0];
+    loaded++;
+    if(name == "dxThreshold"){
+      dxThreshold = atoi(tokens[1]);
+    }
+    else if(name == "innerDxThreshold"){
+      innerDxThreshold = atoi(tokens[1]);
+    }
+    else if(name == "triggerThreshold"){
+      triggerThreshold = atoi(tokens[1]);
+    }
+    else if(name == "highFocus"){
+      highFocus = atoi(tokens[1]);
+    }
+    else if(name == "stDevHardTrigger"){
+      stDevHardTrigger = atof(tokens[1]);
+    }
+    else if(name == "stDevSoftTrigger"){
+      stDevSoftTrigger = atof(tokens[1]);
+    }
+    else{
+      cout << "WARNING unknown parameter " << name << " in cluster parameter file: " << fname << endl;
+      loaded--;
+    }
+  }
+  infile.close();
+
+  cout << " > loaded " << loaded << " event parameters from " << fname << ": " << ToString() << endl;
+
+  return loaded > 0;
+}
+
+bool ClusterParams::Save(const string& fname)
+{
+  fstream outfile(fname.c_str(), ios::out);
+
+  if(!outfile){
+    cout << "ERROR could not open file: " << fname << endl;
+    return false;
+  }
+
+  outfile.precision(10);
+  outfile << "#SingularityBuilder event parameters: name<TAB>value" << endl;
+  outfile << "dxThreshold\t" << dxThreshold << endl;
+  outfile << "innerDxThreshold\t" << innerDxThreshold << endl;
+  outfile << "triggerThreshold\t" << triggerThreshold << endl;
+  outfile << "highFocus\t" << highFocus << endl;
+  outfile << "stDevHardTrigger\t" << stDevHardTrigger << endl;
+  outfile << "stDevSoftTrigger\t" << stDevSoftTrigger << endl;
+  outfile.close();
+
+  return true;
+}
+
+string ClusterParams::ToString(void)
+{
+  std::ostringstream ss;
+
+  ss << "dx " << dxThreshold << ", innerDx " << innerDxThreshold << ", trigger " << triggerThreshold << ", highFocus " << highFocus
+     << ", hard " << stDevHardTrigger << ", soft " << stDevSoftTrigger;
+
+  return ss.str();
+}
+
 /*
   Calls test repeatedly for a hard-coded source directory.
   The test files are sequences of x/y mouse coordinates, generated
@@ -249,10 +384,10 @@ bool SingularityBuilder::InBounds(const Point& p)
 bool SingularityBuilder::MinSeparation(const PointMu& mu1, const PointMu& mu2)
 {
   if(mu1.alpha != mu2.alpha){  //TODO: this is redundant with a check in Process(). Oh well.
-    if(layoutManager->DoubleDistance(mu1.pt,mu2.pt) < (layoutManager->GetMinKeyDiameter() * 1.5)){
+    if(layoutManager->SquaredDistance(mu1.pt,mu2.pt) < layoutManager->minSeparationSq){  //under 1.5 key diameters
 	    if(mu1.ticks <= 4 || mu2.ticks <= 4){  //time separation is INF for now
-				cout << "minkeyrad: " << layoutManager->GetMinKeyRadius() << " dist: " << layoutManager->DoubleDistance(mu1.pt,mu2.pt) <<  endl;
-				cout << "mindist failed, ticks are (" << mu1.alpha << "," <<  mu1.ticks << ")  (" << mu2.alpha << "," << mu2.ticks << ")" << endl;
+				LOG_DEBUG("minkeyrad: " << layoutManager->GetMinKeyRadius() << " squared dist: " << layoutManager->SquaredDistance(mu1.pt,mu2.pt));
+				LOG_DEBUG("mindist failed, ticks are (" << mu1.alpha << "," <<  mu1.ticks << ")  (" << mu2.alpha << "," << mu2.ticks << ")");
 				return false;
 			}
 		}
@@ -281,7 +416,7 @@ void SingularityBuilder::MergeClusters(vector<PointMu>& rawClusters, vector<Poin
     }
     //else, forward-accumulate the reflexive likelihood to preserve repeat char info
     else{
-      cout << "merged clusters " << (i-1) << "/" << (i) << endl;
+      LOG_DEBUG("merged clusters " << (i-1) << "/" << (i));
       //identical alphas, so just merge the dupes, for instance, merge "AA" to "A"
       if(rawClusters[i-1].alpha == rawClusters[i].alpha){
         rawClusters[i-1].ticks += rawClusters[i].ticks;
@@ -339,13 +474,16 @@ void SingularityBuilder::MergeClusters(vector<PointMu>& rawClusters, vector<Poin
 
   TODO: recode this using int32, not short. Cast to short where needed.
 */
-void SingularityBuilder::Process(vector<Point>& inData, vector<PointMu>& outData)
+void SingularityBuilder::Process(const PointSpan& inData, vector<PointMu>& outData)
 {
   //char c;
   vector<PointMu> midData;
   int i, trigger, dx, eventStart, eventEnd;
 
-  cout << "processing " << inData.size() << " data points in sb.process()" << endl;
+  LOG_DEBUG("processing " << inData.size() << " data points in sb.process()");
+  if(inData.size() < 4){  //the loop bound below is unsigned
+    return;
+  }
 
   //TODO: sleep if no data
   trigger = 0;
@@ -354,14 +492,8 @@ void SingularityBuilder::Process(vector<Point>& inData, vector<PointMu>& outData
     if(InBounds(inData[i]) && InBounds(inData[i+3])){
       dx = layoutManager->IntDistance(inData[i],inData[i+3]);
 
-      /*
       //debug output, to view how data vals change
-      cout << "dx: " << dx;
-      if(dx > 0){
-        cout << "  1/dx: " << (1.0f / (float)dx);
-      }
-      cout << endl;
-      */
+      LOG_TRACEF("dx: %d  1/dx: %f\n",dx,(dx > 0) ? (1.0f / (float)dx) : 0.0f);
 
       //TODO: advancing the index i below is done without InBounds() checks
       if(dx < dxThreshold){  //determine velocity: distance of points three ticks apart
@@ -382,7 +514,7 @@ void SingularityBuilder::Process(vector<Point>& inData, vector<PointMu>& outData
           PointMu outPoint;
           //outPoint.ticks = eventEnd - eventStart;
           CalculateMean(eventStart,eventEnd,inData,outPoint);
-          cout << "hit mean" << endl;
+          LOG_DEBUG("hit mean");
           outPoint.alpha = layoutManager->FindNearestKey(outPoint.pt);
 
           //NOTE A new cluster is appended only if it is a unique letter; this prevents repeated chars.
@@ -401,8 +533,10 @@ void SingularityBuilder::Process(vector<Point>& inData, vector<PointMu>& outData
     }
   }
 
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
   cout << "clusters before merging..." << endl;
   PrintOutData(midData);
+#endif
   MergeClusters(midData,outData);
   //dbg
   //PrintOutData(outData);
@@ -418,7 +552,7 @@ void SingularityBuilder::Process(vector<Point>& inData, vector<PointMu>& outData
 
   This starts with analysis, to figure out what parameters look meaningful, by the data
 */
-void SingularityBuilder::Process2(vector<Point>& inData, vector<PointMu>& outData)
+void SingularityBuilder::Process2(const PointSpan& inData, vector<PointMu>& outData)
 {
   bool trig = false;
   //char c;
@@ -430,10 +564,16 @@ void SingularityBuilder::Process2(vector<Point>& inData, vector<PointMu>& outDat
   sampleRate = 1;  //sample every two ticks. Thus, there will be n/2 analyses
   segmentWidth = 3; //every two ticks, grab next four point for analysis
   lastTheta = dTheta = avgTheta = 0.0;
+  dist = 0.0;
+  stDevTrigger = 0;
 
   double stDevThreshold = 30;
 
-  cout << "processing " << inData.size() << " data points in sb.process(), dxThreshold=" << dxThreshold << endl;
+  LOG_DEBUG("processing " << inData.size() << " data points in sb.process(), dxThreshold=" << dxThreshold);
+  if(inData.size() < segmentWidth + 1){  //the loop bound below is unsigned
+    return;
+  }
+  features.Compute(inData,segmentWidth,FEATURE_STDEV | FEATURE_DISTANCE | FEATURE_THETA);  //every window's statistics, in one pass
 
   //TODO: sleep if no data
   trigger = 0;
@@ -444,15 +584,15 @@ void SingularityBuilder::Process2(vector<Point>& inData, vector<PointMu>& outDat
       lastDist = dist;
       dist = layoutManager->DoubleDistance(inData[i],inData[i+segmentWidth-1]);
       dx = dist - lastDist;
-      avgDist = layoutManager->AvgDistance(inData,i,segmentWidth);
+      avgDist = features.avgDistance[i];
       //measures clustering of a group of points, but only the points themselves
       //coVar = layoutManager->CoVariance(inData,i,segmentWidth);
-      stDev = layoutManager->CoStdDeviation(inData,i,segmentWidth); //(sigmaX*sigmaY)^2
+      stDev = features.coStdDev[i]; //(sigmaX*sigmaY)^2
 
       //only update theta when on the move (bounds should be the same as event capture)
       if(stDev > 100){ //stop capturing a little ahead of event capture. capture only at med/hi velocity
 		    lastTheta = avgTheta;
-		    avgTheta = layoutManager->AvgTheta(inData,i,segmentWidth);  //get the avg direction for a sequence of points
+		    avgTheta = features.avgTheta[i];  //get the avg direction for a sequence of points
 		    dTheta = (avgTheta - lastTheta) / 2.0;
       }
       else{
@@ -464,7 +604,7 @@ void SingularityBuilder::Process2(vector<Point>& inData, vector<PointMu>& outDat
       //cout << "(x,y) (" << inData[i].X << "," << inData[i].Y << ")" << endl;
       //cout << "stDev, dx, 1/dx, coVar, 1/coVar:  " << (int)stDev << "  " << (int)dx << "  " << (dx == 0 ? 0 : (1/dx)) << "  " << (int)coVar << "  " << (coVar == 0 ? 0 : (1/coVar)) << endl;
       //cout << "pt. stDev, avgDist, dx, avgTheta:  " << (int)stDev << "  " << avgDist << " " << (int)dx << " " << avgTheta << endl;
-      printf("pt. stDev, avgDist, dist, dx, avgTheta, dTheta: %9.3f  %9.3f  %9.3f  %9.3f  %9.3f  %9.3f\n",stDev,avgDist,dist,dx,avgTheta,dTheta);
+      LOG_TRACEF("pt. stDev, avgDist, dist, dx, avgTheta, dTheta: %9.3f  %9.3f  %9.3f  %9.3f  %9.3f  %9.3f\n",stDev,avgDist,dist,dx,avgTheta,dTheta);
       //cout << "stDev:  " << (int)stDev << endl;
 
       if(stDev < stDevThreshold){
@@ -475,8 +615,8 @@ void SingularityBuilder::Process2(vector<Point>& inData, vector<PointMu>& outDat
           i++;
           //stDev = layoutManager->CoStdDeviation(inData,i,segmentWidth);
           while(i < inData.size() && stDev < stDevThreshold){
-            stDev = layoutManager->CoStdDeviation(inData,i,segmentWidth);
-            printf("pt. stDev, avgDist, dist, dx, avgTheta, dTheta: %9.3f\n",stDev);
+            stDev = features.coStdDev[i];
+            LOG_TRACEF("pt. stDev, avgDist, dist, dx, avgTheta, dTheta: %9.3f\n",stDev);
             i++;
           }
           eventEnd = i;
@@ -486,7 +626,7 @@ void SingularityBuilder::Process2(vector<Point>& inData, vector<PointMu>& outDat
           outPoint.ticks = eventEnd - eventStart;
           CalculateMean(eventStart,eventEnd,inData,outPoint);
           outPoint.alpha = layoutManager->FindNearestKey(outPoint.pt);
-          cout << "hit mean for " << outPoint.alpha << endl;
+          LOG_DEBUG("hit mean for " << outPoint.alpha);
 
           //NOTE A new cluster is appended only if it is a unique letter; this prevents repeated chars.
           if(midData.empty()){  //this is just an exception check, so we don't deref a -1 index in the next if-stmt, when the vec is empty
@@ -511,15 +651,8 @@ void SingularityBuilder::Process2(vector<Point>& inData, vector<PointMu>& outDat
       }
 */
 
-      /*
       //debug output, to view how data vals change
-      cout << "dx: " << dx;
-      if(dx > 0){
-        cout << "  1/dx: " << (1.0f / (float)dx);
-
-      }
-      cout << endl;
-      */
+      LOG_TRACEF("dx: %f  1/dx: %f\n",dx,(dx > 0) ? (1.0 / dx) : 0.0);
       /*
       //TODO: advancing the index i below is done without InBounds() checks
       if(dx < dxThreshold){  //determine velocity: distance of points three ticks apart
@@ -560,8 +693,10 @@ void SingularityBuilder::Process2(vector<Point>& inData, vector<PointMu>& outDat
     }
   }
 
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
   cout << "clusters before merging..." << endl;
   PrintOutData(midData);
+#endif
   MergeClusters(midData,outData);
   //dbg
   //PrintOutData(outData);
@@ -577,26 +712,27 @@ void SingularityBuilder::Process2(vector<Point>& inData, vector<PointMu>& outDat
   The only event parameter is stDev; other attributes tend to lead stDev, so a better trigger function
   could probably be devised.
 */
-void SingularityBuilder::Process3(vector<Point>& inData, vector<PointMu>& outData)
+void SingularityBuilder::Process3(const PointSpan& inData, vector<PointMu>& outData)
 {
+  METRICS_SCOPE(STAGE_CLUSTERING);
   bool trig = false;
   //char c;
-  vector<PointMu> midData;
   int i, sampleRate, segmentWidth, trigger, eventStart, eventEnd, stDevTrigger;
   double dDist, dist, dydx, lastDist, coVar, stDev, nKeyHits, avgDist, avgTheta, lastTheta, dTheta; 
   char currentAlpha = '!', prevAlpha = '!';
 
+  midData.clear();  //a member, so its capacity carries over from the last word
+
   //segment width is the sample radius for assessing a trigger
   sampleRate = 1;  //sample every two ticks. Thus, there will be n/2 analyses
   segmentWidth = 3; //every k ticks, grab next k point for analysis
   lastTheta = dTheta = avgTheta = 0.0;
 
-  int triggerThreshold = 4;
-  int highFocus = 45;
-  double stDev_HardTrigger = 225;
-  double stDev_SoftTrigger = 14;
-
-  cout << "processing " << inData.size() << " data points in sb.process(), dxThreshold=" << dxThreshold << endl;
+  LOG_DEBUG("processing " << inData.size() << " data points in sb.process(), dxThreshold=" << dxThreshold);
+  if(inData.size() < segmentWidth + 1){  //the loop bound below is unsigned
+    return;
+  }
+  features.Compute(inData,segmentWidth,FEATURE_STDEV);  //every window's stDev, in one pass; a member, so its buffers carry over
 
   //TODO: sleep if no data
   trigger = 0;
@@ -612,7 +748,7 @@ void SingularityBuilder::Process3(vector<Point>& inData, vector<PointMu>& outDat
       //avgDist = layoutManager->AvgDistance(inData,i,segmentWidth);
       //measures clustering of a group of points, but only the points themselves
       //coVar = layoutManager->CoVariance(inData,i,segmentWidth);
-      stDev = layoutManager->CoStdDeviation(inData,i,segmentWidth); //(sigmaX*sigmaY)^2
+      stDev = features.coStdDev[i]; //(sigmaX*sigmaY)^2
 	    //lastTheta = avgTheta;
 	    //avgTheta = layoutManager->AvgTheta(inData,i,segmentWidth);  //get the avg direction for a sequence of points
 	    //dTheta = (avgTheta - lastTheta) / 2.0;
@@ -620,10 +756,10 @@ void SingularityBuilder::Process3(vector<Point>& inData, vector<PointMu>& outDat
       currentAlpha = layoutManager->FindNearestKey(inData[i]);
 
       if(stDev < stDev_HardTrigger){
-        printf("curAlpha, prevAlpha, pt-stDev: %c  %c  %9.3f  %d  %d  pretrig\n",currentAlpha,prevAlpha,stDev,inData[i].X,inData[i].Y);
+        LOG_TRACEF("curAlpha, prevAlpha, pt-stDev: %c  %c  %9.3f  %d  %d  pretrig\n",currentAlpha,prevAlpha,stDev,inData[i].X,inData[i].Y);
       }
       else{
-        printf("curAlpha, prevAlpha, pt-stDev: %c  %c  %9.3f  %d  %d\n",currentAlpha,prevAlpha,stDev,inData[i].X,inData[i].Y);
+        LOG_TRACEF("curAlpha, prevAlpha, pt-stDev: %c  %c  %9.3f  %d  %d\n",currentAlpha,prevAlpha,stDev,inData[i].X,inData[i].Y);
       }
       /*
         Implements an event oriented state machine in which it is easier to exit states than enter them.
@@ -641,20 +777,20 @@ void SingularityBuilder::Process3(vector<Point>& inData, vector<PointMu>& outDat
         
         //trigger and collect event
         if(trigger > triggerThreshold){
-          cout << "trig" << endl;
+          LOG_TRACE("trig");
           //this optimistically assumes current position has (intentional) focus on some key
           prevAlpha = currentAlpha = layoutManager->FindNearestKey(inData[i]);
           eventStart = i;
           i++;
-          stDev = layoutManager->CoStdDeviation(inData,i,segmentWidth);
+          stDev = features.coStdDev[i];
           //hold state, unless there is a stDev change and an alpha change. Only if both alpha changes and stDev throws, will we exit.
           // A new event will immediately be thrown to catch the neighbor key event.
           while(i < inData.size() && (stDev < stDev_SoftTrigger || prevAlpha == currentAlpha) && (stDev < stDev_HardTrigger)){
           //while(i < inData.size() && (stDev < stDev_SoftTrigger && prevAlpha == currentAlpha) && (stDev < stDev_HardTrigger)){
           //while(i < inData.size() && (stDev < stDev_SoftTrigger || prevAlpha == currentAlpha) && (stDev < stDev_HardTrigger)){
-            stDev = layoutManager->CoStdDeviation(inData,i,segmentWidth);
+            stDev = features.coStdDev[i];
             currentAlpha = layoutManager->FindNearestKey(inData[i]);
-            printf("curAlpha, prevAlpha, pt-stDev: %c  %c  %9.3f  trig\n",currentAlpha,prevAlpha,stDev);
+            LOG_TRACEF("curAlpha, prevAlpha, pt-stDev: %c  %c  %9.3f  trig\n",currentAlpha,prevAlpha,stDev);
             i++;
           }
           //exit state either by hard/fast exit, or soft-exit to an adjacent key
@@ -666,7 +802,8 @@ void SingularityBuilder::Process3(vector<Point>& inData, vector<PointMu>& outDat
           outPoint.ticks = eventEnd - eventStart + trigger; //ticks can be used as a confidence measure of the event
           CalculateMean(eventStart,eventEnd,inData,outPoint);
           outPoint.alpha = layoutManager->FindNearestKey(outPoint.pt);
-          cout << "hit mean for " << outPoint.alpha << " ticks: " << outPoint.ticks << endl;
+          LOG_DEBUG("hit mean for " << outPoint.alpha << " ticks: " << outPoint.ticks);
+          TRACE_EVENT(TRACE_CLUSTER_HIT,outPoint.alpha,outPoint.ticks);
           trigger = 0;
           //NOTE A new cluster is appended only if it is a unique letter; this prevents repeated chars.
           if(midData.empty()){  //this is just an exception check, so we don't deref a -1 index in the next if-stmt, when the vec is empty
@@ -687,9 +824,12 @@ void SingularityBuilder::Process3(vector<Point>& inData, vector<PointMu>& outDat
     }
   }
 
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
   cout << "clusters before merging..." << endl;
   PrintOutData(midData);
+#endif
   MergeClusters(midData,outData);
+  TRACE_EVENT(TRACE_CLUSTERS_MERGED,midData.size(),outData.size());
   //dbg
   //PrintOutData(outData);
 }
@@ -748,7 +888,7 @@ void SingularityBuilder::PrintOutData(vector<PointMu>& outData)
   metrics).
 
 */
-void SingularityBuilder::SimpleClustering(vector<Point>& inData, vector<PointMu>& outData)
+void SingularityBuilder::SimpleClustering(const PointSpan& inData, vector<PointMu>& outData)
 {
   int i, j, ct;
   U32 key, nearest;
@@ -768,7 +908,7 @@ void SingularityBuilder::SimpleClustering(vector<Point>& inData, vector<PointMu>
   }
 
   for(ct = 0; ct < 20; ct++){
-    cout << "iteration " << ct << ", means: " << clusters.size() << endl;
+    LOG_DEBUG("iteration " << ct << ", means: " << clusters.size());
     //assign all points to their nearest neighbor, w/in some tick radius of eachother
     //the purpose of the tick radius is not to divide clusters, but just to limit the search distance; no
     //point can be in the same cluster as a point that is k-ticks away
@@ -776,6 +916,7 @@ void SingularityBuilder::SimpleClustering(vector<Point>& inData, vector<PointMu>
       //find this point's nearest mean
       minDist = 9999;
       key = (U32)inData[i].X << 16 | (U32)inData[i].Y;
+      nearest = key;  //a lone mean is its own nearest
       for(it = clusters.begin(); it != clusters.end(); ++it){
         if(it->first != key){  //verifies we dont compare point with itself
           dist = layoutManager->DoubleDistance(inData[i],Point((short int)(it->first & 0xFFFF0000),(short int)(it->first & 0x0000FFFF)));
@@ -801,9 +942,18 @@ void SingularityBuilder::SimpleClustering(vector<Point>& inData, vector<PointMu>
       muY /= (double)i;
       key = ((short int)muX << 16) | ((short int)muY & 0x0000FFFF);
       means.push_back(key);
-      cout << it->second.size() << " ";
+      LOG_TRACEF("%zu ",it->second.size());
+      //the last iteration's dense clusters are the output, in key order rather than time order
+      if(ct == 19 && it->second.size() > 4){
+        PointMu outPoint;
+        outPoint.pt.X = (short int)muX;
+        outPoint.pt.Y = (short int)muY;
+        outPoint.ticks = it->second.size();
+        outPoint.alpha = layoutManager->FindNearestKey(outPoint.pt);
+        outData.push_back(outPoint);
+      }
     }
-    cout << endl;
+    LOG_TRACEF("\n");
     clusters.clear();
 
     //copy in the new means
@@ -815,6 +965,7 @@ void SingularityBuilder::SimpleClustering(vector<Point>& inData, vector<PointMu>
     }
   }
 
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
   cout << "cluster sizes: " << endl;
   for(it = clusters.begin(); it != clusters.end(); ++it){
       cout << it->second.size() << " ";
@@ -831,13 +982,14 @@ void SingularityBuilder::SimpleClustering(vector<Point>& inData, vector<PointMu>
     }
   }
   cout << endl;
+#endif
 }
 
 /*
   A clustering based method of event detection. This assumes all the data is known in advance, although
   streaming clustering algorithms do exist.
 */
-void SingularityBuilder::Process4(vector<Point>& inData, vector<PointMu>& outData)
+void SingularityBuilder::Process4(const PointSpan& inData, vector<PointMu>& outData)
 {
   SimpleClustering(inData,outData);
 }
@@ -854,7 +1006,7 @@ void SingularityBuilder::Process4(vector<Point>& inData, vector<PointMu>& outDat
   if its even a problem--it mainly depends on the resolution (in Hz) of the sensor. Its also an argument
   for more geometrically-based point analysis, as opposed to this, which is essentially cluster oriented.
 */
-void SingularityBuilder::CalculateMean(int begin, int end, const vector<Point>& coorList, PointMu& pointMean)
+void SingularityBuilder::CalculateMean(int begin, int end, const PointSpan& coorList, PointMu& pointMean)
 {
   U32 sumX = 0; //ints are fine, since pixel math is all integer based
   U32 sumY = 0;
@@ -887,6 +1039,92 @@ void SingularityBuilder::CalculateMean(int begin, int end, const vector<Point>&
   }
 }
 
+/*
+  The clustering strategies, by name, so a DecodeSession (or a benchmark) can pick one at runtime instead of calling a
+  Process function directly. A strategy is a std::function over the session's SingularityBuilder, so one that keeps
+  state between words keeps it in the builder, per session. The built-in ones wrap the Process functions above; any
+  other code can Register more. Strategies live in a map and are never removed, so the pointers Find returns stay
+  valid.
+*/
+static map<string,ClusterStrategy> BuiltInStrategies(void)
+{
+  map<string,ClusterStrategy> strategies;
+  ClusterStrategy strategy;
+
+  strategy.name = "process";
+  strategy.description = "velocity trigger: distance between samples three apart";
+  strategy.cluster = [](SingularityBuilder* sb, const PointSpan& inData, vector<PointMu>& outData){ sb->Process(inData,outData); };
+  strategies[strategy.name] = strategy;
+
+  strategy.name = "process2";
+  strategy.description = "multi-attribute event detector, triggered on the windows' spread";
+  strategy.cluster = [](SingularityBuilder* sb, const PointSpan& inData, vector<PointMu>& outData){ sb->Process2(inData,outData); };
+  strategies[strategy.name] = strategy;
+
+  strategy.name = "process3";
+  strategy.description = "spread state machine with hard and soft triggers (the default)";
+  strategy.cluster = [](SingularityBuilder* sb, const PointSpan& inData, vector<PointMu>& outData){ sb->Process3(inData,outData); };
+  strategies[strategy.name] = strategy;
+
+  strategy.name = "process4";
+  strategy.description = "offline clustering of the whole word (SimpleClustering)";
+  strategy.cluster = [](SingularityBuilder* sb, const PointSpan& inData, vector<PointMu>& outData){ sb->Process4(inData,outData); };
+  strategies[strategy.name] = strategy;
+
+  strategy.name = "simple";
+  strategy.description = "iterated nearest-mean clustering; clusters come out in key order, not time order";
+  strategy.cluster = [](SingularityBuilder* sb, const PointSpan& inData, vector<PointMu>& outData){ sb->SimpleClustering(inData,outData); };
+  strategies[strategy.name] = strategy;
+
+  return strategies;
+}
+
+map<string,ClusterStrategy>& ClusterRegistry::Strategies(void)
+{
+  static map<string,ClusterStrategy> strategies = BuiltInStrategies();
+  return strategies;
+}
 
+std::mutex& ClusterRegistry::Mutex(void)
+{
+  static std::mutex mutex;
+  return mutex;
+}
+
+bool ClusterRegistry::Register(const string& name, const string& description, ClusterFunction cluster)
+{
+  std::lock_guard<std::mutex> lock(Mutex());
+  map<string,ClusterStrategy>& strategies = Strategies();
 
+  if(strategies.find(name) != strategies.end()){
+    cout << "ERROR cluster strategy already registered: " << name << endl;
+    return false;
+  }
+  ClusterStrategy& strategy = strategies[name];
+  strategy.name = name;
+  strategy.description = description;
+  strategy.cluster = cluster;
 
+  return true;
+}
+
+const ClusterStrategy* ClusterRegistry::Find(const string& name)
+{
+  std::lock_guard<std::mutex> lock(Mutex());
+  map<string,ClusterStrategy>& strategies = Strategies();
+  map<string,ClusterStrategy>::iterator it = strategies.find(name);
+
+  return (it == strategies.end()) ? NULL : &it->second;
+}
+
+vector<string> ClusterRegistry::Names(void)
+{
+  std::lock_guard<std::mutex> lock(Mutex());
+  vector<string> names;
+
+  for(map<string,ClusterStrategy>::iterator it = Strategies().begin(); it != Strategies().end(); ++it){
+    names.push_back(it->first);
+  }
+
+  return names;
+}
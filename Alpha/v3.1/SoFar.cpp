@@ -0,0 +1,204 @@
+#include "Controller.hpp"
+
+/*
+  Replays the words of a gaze trace file through a PrefixDecoder, as a live trace would feed it, and checks it against
+  the batch decode. Each word's samples arrive one at a time; after each, the prefix so far is clustered with the
+  session's clusterer, and a cluster is pushed once PREFIX_SETTLE_CLUSTERS more follow it, printing the completions
+  so far. At the end of the word, the whole word is clustered and the decoder resynced and finished, and that is timed
+  against DecodeSession::Decode on the direct path, whose results it must match exactly.
+
+    soFar file.gzt [topN=PREFIX_TOP_N] [quiet]
+
+  quiet only prints each word's end-of-word line and the summary. Points are decoded unfiltered. Re-clustering each
+  prefix from scratch is the tool's simulation of a streaming clusterer, so its cost isn't counted in either latency.
+*/
+
+class SoFar{
+  public:
+    DecoderModels* models;
+    DecodeSession* session;
+    PrefixDecoder* decoder;
+    GazeTraceFile trace;
+    size_t topN;
+    bool quiet;
+    //totals
+    U64 numWords;
+    U64 numMismatches;
+    U64 numResets;
+    U64 numLabeled;
+    U64 numFound;        //labeled words whose label made the completions before the word ended
+    U64 foundClusters;   //the clusters pushed when they first did
+    U64 foundOf;         //out of the word's clusters
+    U64 numUpdates;
+    double batchUs;
+    double prefixUs;
+
+    SoFar(size_t n, bool quietOutput);
+    ~SoFar();
+
+    bool Run(const string& traceFile);
+    void RunWord(const GazeWord& word, std::ostringstream& report);
+    bool SameResults(SearchResults& r1, SearchResults& r2);
+};
+
+SoFar::SoFar(size_t n, bool quietOutput)
+{
+  topN = n;
+  quiet = quietOutput;
+  numWords = numMismatches = numResets = numLabeled = numFound = foundClusters = foundOf = numUpdates = 0;
+  batchUs = prefixUs = 0.0;
+
+  Silence(true);
+  models = new DecoderModels("../TestInput/EyeInputs/Test1/keyMap.txt","../vocabModel.txt");
+  Silence(false);
+  session = new DecodeSession(models,0);
+  session->filtering = false;
+  decoder = new PrefixDecoder(models->di);
+}
+
+SoFar::~SoFar()
+{
+  delete decoder;
+  delete session;
+  delete models;
+}
+
+bool SoFar::Run(const string& traceFile)
+{
+  if(!trace.Open(traceFile)){
+    return false;
+  }
+
+  //the clusterers print as they go, so each word's report is printed after it
+  for(size_t i = 0; i < trace.words.size(); i++){
+    std::ostringstream report;
+    Silence(true);
+    RunWord(trace.words[i],report);
+    Silence(false);
+    cout << report.str();
+  }
+
+  double words = std::max((U64)1,numWords);
+  cout << numWords << " words, " << numMismatches << " results mismatched the batch decode, " << numResets << " resyncs started over" << endl;
+  cout << "end of word: batch " << (batchUs / words) << "us, prefix " << (prefixUs / words) << "us per word; " << (numUpdates / words) << " candidate updates per word" << endl;
+  if(numLabeled > 0){
+    cout << numFound << " of " << numLabeled << " labels were in the top " << topN << " before the word ended";
+    if(numFound > 0){
+      cout << ", first after " << ((double)foundClusters / numFound) << " of " << ((double)foundOf / numFound) << " clusters on average";
+    }
+    cout << endl;
+  }
+
+  return true;
+}
+
+void SoFar::RunWord(const GazeWord& word, std::ostringstream& report)
+{
+  struct timespec begin, end;
+  vector<PointMu> prefixMeans, settled, finalMeans;
+  vector<SearchResult> completions;
+  SearchResults results;
+  bool found = false, same;
+  size_t foundAt = 0;
+  string alphas;
+
+  report << (word.label[0] ? word.label : "?") << " (" << word.points.size() << " samples)" << endl;
+  decoder->Reset();
+  for(size_t s = 1; s <= word.points.size(); s++){
+    prefixMeans.clear();
+    session->clusterer->cluster(&session->sb,PointSpan(word.points.data,s),prefixMeans);
+    if(prefixMeans.size() <= decoder->means.size() + PREFIX_SETTLE_CLUSTERS){
+      continue;
+    }
+
+    settled.assign(prefixMeans.begin(),prefixMeans.end() - PREFIX_SETTLE_CLUSTERS);
+    if(!decoder->Resync(settled)){
+      numResets++;
+    }
+    decoder->Completions(topN,completions);
+    alphas.clear();
+    for(size_t i = 0; i < decoder->means.size(); i++){
+      alphas += decoder->means[i].alpha;
+    }
+    if(!quiet){
+      report << "  " << alphas << ":";
+    }
+    for(size_t i = 0; i < completions.size(); i++){
+      if(!quiet){
+        report << " " << completions[i].first;
+      }
+      if(!found && word.label[0] && completions[i].first == word.label){
+        found = true;
+        foundAt = decoder->means.size();
+      }
+    }
+    if(!quiet){
+      report << endl;
+    }
+  }
+
+  //end of word: the prefix decoder only has the unsettled clusters left
+  clock_gettime(CLOCK_MONOTONIC,&begin);
+  if(word.points.size() > 0){
+    session->clusterer->cluster(&session->sb,word.points,finalMeans);
+  }
+  same = decoder->Resync(finalMeans);
+  decoder->Finish(results);
+  clock_gettime(CLOCK_MONOTONIC,&end);
+  prefixUs += DiffTimeSpecs(&begin,&end) * 1.0e6;
+  numResets += !same;
+  numUpdates += decoder->numUpdates;
+
+  session->Decode(word.points,DECODE_DIRECT);
+  batchUs += session->lastDecodeUs;
+  numWords++;
+
+  if(!SameResults(results,session->results)){
+    numMismatches++;
+    report << "  MISMATCH: " << results.size() << " results vs " << session->results.size() << " from the batch decode" << endl;
+  }
+  report << "  end: " << (results.empty() ? "-" : results.begin()->first) << ", " << finalMeans.size() << " clusters, batch " << session->lastDecodeUs
+         << "us, prefix " << (DiffTimeSpecs(&begin,&end) * 1.0e6) << "us" << (same ? "" : ", resync started over") << endl;
+
+  if(word.label[0]){
+    numLabeled++;
+    if(found){
+      numFound++;
+      foundClusters += foundAt;
+      foundOf += finalMeans.size();
+    }
+  }
+}
+
+//same words with the same distances, in the same order
+bool SoFar::SameResults(SearchResults& r1, SearchResults& r2)
+{
+  SearchResultIt it1, it2;
+
+  if(r1.size() != r2.size()){
+    return false;
+  }
+  for(it1 = r1.begin(), it2 = r2.begin(); it1 != r1.end(); ++it1, ++it2){
+    if(it1->first != it2->first || it1->second != it2->second){
+      return false;
+    }
+  }
+
+  return true;
+}
+
+int main(int argc, char* argv[])
+{
+  int topN = PREFIX_TOP_N;
+
+  if(argc >= 3){
+    topN = atoi(argv[2]);
+  }
+  if(argc < 2 || topN < 1){
+    cout << "usage: " << argv[0] << " file" << GAZE_TRACE_EXT << " [topN=" << PREFIX_TOP_N << "] [quiet]" << endl;
+    return 1;
+  }
+
+  SoFar soFar(topN,argc >= 4 && !strcmp(argv[3],"quiet"));
+  return soFar.Run(argv[1]) ? 0 : 1;
+}
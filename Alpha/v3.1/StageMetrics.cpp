@@ -0,0 +1,192 @@
+#include "Controller.hpp"
+
+/*
+  Per-stage latency histograms and work counters, for the dashboards. The stages time themselves with METRICS_SCOPE,
+  and count work with METRICS_COUNT; both compile to nothing if USE_STAGE_METRICS is 0.
+
+  Each thread records into its own StageMetrics block, created and registered on its first use, so the hot path never
+  takes a lock or does an atomic read-modify-write: every field has exactly one writer, which does a relaxed load and
+  store. The atomics are only there so that Snapshot() can read the blocks from another thread at any time; a snapshot
+  merges every block ever registered (blocks outlive their threads, so no samples are lost).
+
+  Histograms are log-linear over nanoseconds: four sub-buckets per power of two, so a percentile is reported as its
+  bucket's midpoint and is within 12.5% of the true value. 256 buckets cover the full U64 range. Max and mean are exact.
+*/
+
+static const char* STAGE_NAMES[NUM_METRIC_STAGES] = {"clustering", "lattice build", "search", "lm rescoring", "direct inference"};
+static const char* COUNTER_NAMES[NUM_METRIC_COUNTERS] = {"candidates scored", "paths enumerated"};
+
+static std::mutex registryMutex;
+static vector<StageMetrics*> registry;
+
+StageMetrics::StageMetrics()
+{
+  Clear();
+}
+
+void StageMetrics::Clear(void)
+{
+  int i, j;
+
+  for(i = 0; i < NUM_METRIC_STAGES; i++){
+    for(j = 0; j < METRICS_HISTOGRAM_BUCKETS; j++){
+      buckets[i][j].store(0,std::memory_order_relaxed);
+    }
+    counts[i].store(0,std::memory_order_relaxed);
+    totalNs[i].store(0,std::memory_order_relaxed);
+    maxNs[i].store(0,std::memory_order_relaxed);
+  }
+  for(i = 0; i < NUM_METRIC_COUNTERS; i++){
+    counters[i].store(0,std::memory_order_relaxed);
+  }
+}
+
+//the calling thread's block
+StageMetrics& StageMetrics::Local(void)
+{
+  static thread_local StageMetrics* local = NULL;
+
+  if(local == NULL){
+    local = new StageMetrics();
+    std::lock_guard<std::mutex> lock(registryMutex);
+    registry.push_back(local);
+  }
+
+  return *local;
+}
+
+//bucket index: values below 8 get their own bucket; above that, the top three bits (leading one plus two) select one of four sub-buckets per power of two
+int StageMetrics::BucketOf(U64 ns)
+{
+  int msb;
+
+  if(ns < 8){
+    return (int)ns;
+  }
+  msb = 63 - __builtin_clzll(ns);
+
+  return msb * 4 + (int)((ns >> (msb - 2)) & 3);
+}
+
+//midpoint of the values falling into bucket
+double StageMetrics::BucketValue(int bucket)
+{
+  int msb, sub;
+  double width;
+
+  if(bucket < 8){
+    return (double)bucket;
+  }
+  msb = bucket / 4;
+  sub = bucket % 4;
+  width = pow(2.0,msb - 2);
+
+  return (4 + sub) * width + (width - 1.0) / 2.0;
+}
+
+void StageMetrics::Record(int stage, U64 ns)
+{
+  std::atomic<U64>& bucket = buckets[stage][BucketOf(ns)];
+
+  bucket.store(bucket.load(std::memory_order_relaxed) + 1,std::memory_order_relaxed);
+  counts[stage].store(counts[stage].load(std::memory_order_relaxed) + 1,std::memory_order_relaxed);
+  totalNs[stage].store(totalNs[stage].load(std::memory_order_relaxed) + ns,std::memory_order_relaxed);
+  if(ns > maxNs[stage].load(std::memory_order_relaxed)){
+    maxNs[stage].store(ns,std::memory_order_relaxed);
+  }
+}
+
+void StageMetrics::Count(int counter, U64 n)
+{
+  counters[counter].store(counters[counter].load(std::memory_order_relaxed) + n,std::memory_order_relaxed);
+}
+
+const char* StageMetrics::StageName(int stage)
+{
+  return STAGE_NAMES[stage];
+}
+
+const char* StageMetrics::CounterName(int counter)
+{
+  return COUNTER_NAMES[counter];
+}
+
+/*
+  Merges every thread's block into snapshot. Safe to call while other threads are recording; a sample being recorded
+  concurrently may be partly included (eg, in count but not yet in its bucket), which is harmless for a dashboard.
+*/
+void StageMetrics::Snapshot(MetricsSnapshot& snapshot)
+{
+  int i, j, s;
+  U64 merged[METRICS_HISTOGRAM_BUCKETS], seen, count, total, max;
+  double percentiles[3] = {0.50, 0.90, 0.99};
+  double* outputs[3];
+  std::lock_guard<std::mutex> lock(registryMutex);
+
+  for(s = 0; s < NUM_METRIC_STAGES; s++){
+    count = total = max = 0;
+    for(j = 0; j < METRICS_HISTOGRAM_BUCKETS; j++){
+      merged[j] = 0;
+    }
+    for(i = 0; i < registry.size(); i++){
+      for(j = 0; j < METRICS_HISTOGRAM_BUCKETS; j++){
+        merged[j] += registry[i]->buckets[s][j].load(std::memory_order_relaxed);
+      }
+      total += registry[i]->totalNs[s].load(std::memory_order_relaxed);
+      max = std::max(max,registry[i]->maxNs[s].load(std::memory_order_relaxed));
+    }
+    for(j = 0; j < METRICS_HISTOGRAM_BUCKETS; j++){
+      count += merged[j];
+    }
+
+    StageSnapshot& out = snapshot.stages[s];
+    out.count = count;
+    out.meanUs = (count > 0) ? (total / 1000.0 / count) : 0.0;
+    out.maxUs = max / 1000.0;
+    out.p50Us = out.p90Us = out.p99Us = 0.0;
+    outputs[0] = &out.p50Us;
+    outputs[1] = &out.p90Us;
+    outputs[2] = &out.p99Us;
+    for(i = 0; i < 3 && count > 0; i++){
+      seen = 0;
+      for(j = 0; j < METRICS_HISTOGRAM_BUCKETS; j++){
+        seen += merged[j];
+        if(seen >= (U64)ceil(percentiles[i] * count)){
+          *outputs[i] = std::min(BucketValue(j),(double)max) / 1000.0;  //the top bucket's midpoint can overshoot the exact max
+          break;
+        }
+      }
+    }
+  }
+
+  for(i = 0; i < NUM_METRIC_COUNTERS; i++){
+    snapshot.counters[i] = 0;
+    for(j = 0; j < registry.size(); j++){
+      snapshot.counters[i] += registry[j]->counters[i].load(std::memory_order_relaxed);
+    }
+  }
+}
+
+//zeroes every thread's block. Only call this while no stage is running, since it races with the single-writer updates.
+void StageMetrics::Reset(void)
+{
+  std::lock_guard<std::mutex> lock(registryMutex);
+
+  for(int i = 0; i < registry.size(); i++){
+    registry[i]->Clear();
+  }
+}
+
+StageTimer::StageTimer(int stageIndex)
+{
+  stage = stageIndex;
+  clock_gettime(CLOCK_MONOTONIC,&begin);
+}
+
+StageTimer::~StageTimer()
+{
+  struct timespec end;
+
+  clock_gettime(CLOCK_MONOTONIC,&end);
+  StageMetrics::Local().Record(stage,(U64)(end.tv_sec - begin.tv_sec) * 1000000000ULL + (U64)end.tv_nsec - (U64)begin.tv_nsec);
+}
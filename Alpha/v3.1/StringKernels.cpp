@@ -0,0 +1,391 @@
+#include "Controller.hpp"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/*
+  Batch versions of the DirectInference string distance functions, which score an input string against every word
+  in the vocabulary at once, instead of one word at a time in a branchy char-by-char loop.
+
+  The trick for the Hamming functions is that all the per-word branching (skipping repeated chars) depends only on the
+  vocabulary word, never on the input, so it can be done once at build time:
+    -StringDist_HammingFwd/Bkwd skip only one repeat per step, so a run of k equal chars in a word is compared as ceil(k/2)
+     chars: "MISSISSIPPI" is compared as "MISISISIPI" ("halved"). Fwd compares this left-aligned, Bkwd right-aligned.
+    -StringDist_HammingSkipChar skips the whole run, so words are compared in fully collapsed form ("MISISIPI"), plus
+     a length-remainder term that depends on where in the raw word the comparison stopped (see HammingSkipChar).
+  After that, each function is just a plain mismatch count against a preprocessed word, which vectorizes.
+
+  Data model: words are stored in blocks of KERNEL_LANES words, column-major and zero-padded, so row r of a block holds
+  char r of each of its words. Scoring a block is then one compare per row for all KERNEL_LANES words, with a zero
+  compare to mask out the padding. A word's lane and block come directly from its id (its WordModel order), so scores are
+  written to scores[id] and callers can still iterate results in the same order as the scalar loops.
+
+  Edit distance (Levenshtein) has no fixed alignment, so it uses Myers' bit-parallel algorithm instead: the input
+  string is the pattern, and each word is run through it one char at a time, computing a whole DP column per step
+  with a few 64-bit ops. Inputs longer than 64 chars fall back to the scalar DP.
+
+  Every kernel returns exactly what the scalar function in DirectInference returns for the same strings; the scores
+  are small integers, so there is no floating point difference either. DirectInference::TestStringKernels checks this.
+*/
+
+StringKernels::StringKernels()
+{
+  numWords = 0;
+  numBlocks = 0;
+}
+
+StringKernels::StringKernels(WordModel& wordModel)
+{
+  Build(wordModel);
+}
+
+StringKernels::~StringKernels()
+{
+  Clear();
+}
+
+void StringKernels::Clear(void)
+{
+  numWords = 0;
+  numBlocks = 0;
+  words.clear();
+  collapsedWords.clear();
+  fwdColumns.clear();
+  bkwdColumns.clear();
+  skipColumns.clear();
+  fwdOffsets.clear();
+  bkwdOffsets.clear();
+  skipOffsets.clear();
+  collapsedLengths.clear();
+  runEnds.clear();
+  runEndOffsets.clear();
+}
+
+//the sequence of chars StringDist_HammingFwd/Bkwd actually compare: each run of k repeated chars becomes ceil(k/2) chars
+string StringKernels::HalveRepeats(const string& s)
+{
+  int i, run;
+  string halved;
+
+  if(!SKIPCHAR){
+    return s;
+  }
+
+  halved.reserve(s.size());
+  for(i = 0; i < s.size(); i += run){
+    for(run = 1; i + run < s.size() && s[i+run] == s[i]; run++);
+    halved.append((run + 1) / 2, s[i]);
+  }
+
+  return halved;
+}
+
+string StringKernels::CollapseRepeats(const string& s)
+{
+  string collapsed;
+
+  collapsed.reserve(s.size());
+  for(int i = 0; i < s.size(); i++){
+    if(i == 0 || s[i] != s[i-1]){
+      collapsed += s[i];
+    }
+  }
+
+  return collapsed;
+}
+
+/*
+  Appends a block-column-major copy of each string in strs (KERNEL_LANES strings per block, zero padded to the longest
+  string in the block) to columns, optionally with each string reversed. offsets receives the start of each block,
+  plus a final end offset, so block b has (offsets[b+1] - offsets[b]) / KERNEL_LANES rows.
+*/
+void StringKernels::BuildColumns(const vector<string>& strs, bool reversed, vector<U8>& columns, vector<U32>& offsets)
+{
+  U32 block, lane, id, rows, r, base;
+  const string* s;
+
+  columns.clear();
+  offsets.clear();
+  for(block = 0; block < numBlocks; block++){
+    rows = 0;
+    for(lane = 0, id = block * KERNEL_LANES; lane < KERNEL_LANES && id < strs.size(); lane++, id++){
+      if(strs[id].size() > rows){
+        rows = strs[id].size();
+      }
+    }
+
+    base = columns.size();
+    offsets.push_back(base);
+    columns.resize(base + rows * KERNEL_LANES, 0);
+    for(lane = 0, id = block * KERNEL_LANES; lane < KERNEL_LANES && id < strs.size(); lane++, id++){
+      s = &strs[id];
+      for(r = 0; r < s->size(); r++){
+        columns[base + r * KERNEL_LANES + lane] = reversed ? (*s)[s->size() - 1 - r] : (*s)[r];
+      }
+    }
+  }
+  offsets.push_back(columns.size());
+}
+
+/*
+  Builds all the kernel buffers from the vocabulary. Word ids are assigned in WordModel (set) order, the same as EditIndex.
+*/
+void StringKernels::Build(WordModel& wordModel)
+{
+  U32 id, i;
+  vector<string> halvedWords;
+
+  Clear();
+
+  words.reserve(wordModel.size());
+  for(WordModelIt it = wordModel.begin(); it != wordModel.end(); ++it){
+    words.push_back(*it);
+  }
+  numWords = words.size();
+  numBlocks = (numWords + KERNEL_LANES - 1) / KERNEL_LANES;
+
+  halvedWords.reserve(numWords);
+  collapsedWords.reserve(numWords);
+  collapsedLengths.reserve(numWords);
+  runEndOffsets.reserve(numWords + 1);
+  for(id = 0; id < numWords; id++){
+    halvedWords.push_back(HalveRepeats(words[id]));
+    collapsedWords.push_back(CollapseRepeats(words[id]));
+    collapsedLengths.push_back(collapsedWords[id].size());
+
+    //runEnds[k] is the raw index just past the k-th run of the word; runEnds[0] = 0
+    runEndOffsets.push_back(runEnds.size());
+    runEnds.push_back(0);
+    for(i = 0; i < words[id].size(); i++){
+      if(i == words[id].size() - 1 || words[id][i] != words[id][i+1]){
+        runEnds.push_back(i + 1);
+      }
+    }
+  }
+  runEndOffsets.push_back(runEnds.size());
+
+  BuildColumns(halvedWords,false,fwdColumns,fwdOffsets);
+  BuildColumns(halvedWords,true,bkwdColumns,bkwdOffsets);
+  BuildColumns(collapsedWords,false,skipColumns,skipOffsets);
+}
+
+//approximate heap footprint of the kernel buffers, in bytes
+size_t StringKernels::MemoryUsage(void)
+{
+  size_t bytes = 0;
+
+  bytes += fwdColumns.capacity() + bkwdColumns.capacity() + skipColumns.capacity();
+  bytes += (fwdOffsets.capacity() + bkwdOffsets.capacity() + skipOffsets.capacity() + runEndOffsets.capacity()) * sizeof(U32);
+  bytes += (collapsedLengths.capacity() + runEnds.capacity()) * sizeof(U16);
+  for(U32 i = 0; i < numWords; i++){
+    bytes += sizeof(string) * 2 + words[i].capacity() + collapsedWords[i].capacity();
+  }
+
+  return bytes;
+}
+
+/*
+  The core Hamming kernel. For every word in the buffer, adds to scores[id] the number of positions r < |query|
+  where the word has a (non-padding) char that differs from query[r]. Positions past the end of either string are
+  not compared, exactly as the scalar loops stop at the shorter string.
+
+  Lane counters are bytes, so they are flushed to the U16 scores every 255 rows to keep this exact for any length.
+*/
+void StringKernels::MismatchKernel(const vector<U8>& columns, const vector<U32>& offsets, const string& query, vector<U16>& scores)
+{
+  U32 block, lane, id, rows, r, chunkEnd, base;
+  U8 counts[KERNEL_LANES];
+  const U8* row;
+
+  for(block = 0; block < numBlocks; block++){
+    base = offsets[block];
+    rows = (offsets[block+1] - base) / KERNEL_LANES;
+    if(rows > query.size()){
+      rows = query.size();
+    }
+
+    for(r = 0; r < rows; r = chunkEnd){
+      chunkEnd = (rows - r > 255) ? (r + 255) : rows;
+      row = &columns[base + r * KERNEL_LANES];
+
+#if defined(__AVX2__)
+      __m256i zero = _mm256_setzero_si256();
+      __m256i acc = _mm256_setzero_si256();
+      for(U32 k = r; k < chunkEnd; k++, row += KERNEL_LANES){
+        __m256i v = _mm256_loadu_si256((const __m256i*)row);
+        __m256i q = _mm256_set1_epi8(query[k]);
+        //skip = (v == q) | (v == 0); a mismatch is ~skip, which is -1 in each byte, so subtracting it counts up
+        __m256i skip = _mm256_or_si256(_mm256_cmpeq_epi8(v,q),_mm256_cmpeq_epi8(v,zero));
+        acc = _mm256_sub_epi8(acc,_mm256_andnot_si256(skip,_mm256_set1_epi8(-1)));
+      }
+      _mm256_storeu_si256((__m256i*)counts,acc);
+#elif defined(__SSE2__)
+      __m128i zero = _mm_setzero_si128();
+      __m128i ones = _mm_set1_epi8(-1);
+      __m128i acc0 = _mm_setzero_si128();
+      __m128i acc1 = _mm_setzero_si128();
+      for(U32 k = r; k < chunkEnd; k++, row += KERNEL_LANES){
+        __m128i q = _mm_set1_epi8(query[k]);
+        __m128i v0 = _mm_loadu_si128((const __m128i*)row);
+        __m128i v1 = _mm_loadu_si128((const __m128i*)(row + 16));
+        __m128i skip0 = _mm_or_si128(_mm_cmpeq_epi8(v0,q),_mm_cmpeq_epi8(v0,zero));
+        __m128i skip1 = _mm_or_si128(_mm_cmpeq_epi8(v1,q),_mm_cmpeq_epi8(v1,zero));
+        acc0 = _mm_sub_epi8(acc0,_mm_andnot_si128(skip0,ones));
+        acc1 = _mm_sub_epi8(acc1,_mm_andnot_si128(skip1,ones));
+      }
+      _mm_storeu_si128((__m128i*)counts,acc0);
+      _mm_storeu_si128((__m128i*)(counts + 16),acc1);
+#else
+      //portable fallback: same column layout, the compiler can still unroll/vectorize the lane loop
+      for(lane = 0; lane < KERNEL_LANES; lane++){
+        counts[lane] = 0;
+      }
+      for(U32 k = r; k < chunkEnd; k++, row += KERNEL_LANES){
+        for(lane = 0; lane < KERNEL_LANES; lane++){
+          counts[lane] += (row[lane] != 0 && row[lane] != (U8)query[k]);
+        }
+      }
+#endif
+
+      for(lane = 0, id = block * KERNEL_LANES; lane < KERNEL_LANES && id < numWords; lane++, id++){
+        scores[id] += counts[lane];
+      }
+    }
+  }
+}
+
+//batch StringDist_HammingFwd(query,word) for every word; scores is indexed by word id
+void StringKernels::HammingFwd(const string& query, vector<U16>& scores)
+{
+  scores.assign(numWords,0);
+  MismatchKernel(fwdColumns,fwdOffsets,query,scores);
+}
+
+//batch StringDist_HammingBkwd(query,word): the same kernel over right-aligned (reversed) words and a reversed query
+void StringKernels::HammingBkwd(const string& query, vector<U16>& scores)
+{
+  string reversed(query.rbegin(),query.rend());
+
+  scores.assign(numWords,0);
+  MismatchKernel(bkwdColumns,bkwdOffsets,reversed,scores);
+}
+
+//batch StringDist_HammingFwdBkwd(query,word)
+void StringKernels::HammingFwdBkwd(const string& query, vector<U16>& scores)
+{
+  string reversed(query.rbegin(),query.rend());
+
+  scores.assign(numWords,0);
+  MismatchKernel(fwdColumns,fwdOffsets,query,scores);
+  MismatchKernel(bkwdColumns,bkwdOffsets,reversed,scores);
+}
+
+/*
+  Batch StringDist_HammingSkipChar(query,word). The mismatch count is over the collapsed word, then the scalar
+  function adds AbsDiff(|query|-i, |word|-j), where i and j are where its loop stopped. If the collapsed word ran
+  out first, i = |collapsed| and j = |word|; otherwise i = |query| and j is the raw index just past the
+  |query|-th run of the word, which is what runEnds stores.
+*/
+void StringKernels::HammingSkipChar(const string& query, vector<U16>& scores)
+{
+  U32 id;
+
+  scores.assign(numWords,0);
+  MismatchKernel(skipColumns,skipOffsets,query,scores);
+
+  for(id = 0; id < numWords; id++){
+    if(query.size() >= collapsedLengths[id]){
+      scores[id] += query.size() - collapsedLengths[id];
+    }
+    else{
+      scores[id] += words[id].size() - runEnds[runEndOffsets[id] + query.size()];
+    }
+  }
+}
+
+/*
+  Batch Levenshtein distance between query and every repeat-collapsed word (as EditIndex compares them),
+  via Myers' bit-parallel algorithm (Hyyro's formulation for global distance). Bit i of the vertical/horizontal delta
+  vectors is the +1/-1 difference between DP cells in row i; the bottom row's score is tracked as each word char
+  is consumed. Queries longer than 64 chars use the scalar DP.
+*/
+void StringKernels::Levenshtein(const string& query, vector<U16>& scores)
+{
+  U32 id, j, m;
+  U64 peq[256], pv, mv, ph, mh, xv, xh, eq, last;
+  int score;
+  const string* w;
+
+  scores.assign(numWords,0);
+  m = query.size();
+  if(m == 0){
+    for(id = 0; id < numWords; id++){
+      scores[id] = collapsedLengths[id];
+    }
+    return;
+  }
+  if(m > 64){
+    for(id = 0; id < numWords; id++){
+      scores[id] = ScalarLevenshtein(query,collapsedWords[id]);
+    }
+    return;
+  }
+
+  for(j = 0; j < 256; j++){
+    peq[j] = 0;
+  }
+  for(j = 0; j < m; j++){
+    peq[(U8)query[j]] |= (1ULL << j);
+  }
+  last = 1ULL << (m - 1);
+
+  for(id = 0; id < numWords; id++){
+    w = &collapsedWords[id];
+    pv = ~0ULL;
+    mv = 0;
+    score = m;
+    for(j = 0; j < w->size(); j++){
+      eq = peq[(U8)(*w)[j]];
+      xv = eq | mv;
+      xh = (((eq & pv) + pv) ^ pv) | eq;
+      ph = mv | ~(xh | pv);
+      mh = pv & xh;
+      if(ph & last){
+        score++;
+      }
+      else if(mh & last){
+        score--;
+      }
+      //the top row of the DP is 0,1,2..., so every horizontal delta entering row 0 is +1
+      ph = (ph << 1) | 1;
+      mh <<= 1;
+      pv = mh | ~(xv | ph);
+      mv = ph & xv;
+    }
+    scores[id] = score;
+  }
+}
+
+//plain two-row DP; only used for queries too long for the bit-parallel kernel
+int StringKernels::ScalarLevenshtein(const string& s1, const string& s2)
+{
+  int i, j, cost;
+  vector<int> prev(s2.size() + 1), cur(s2.size() + 1);
+
+  for(j = 0; j <= s2.size(); j++){
+    prev[j] = j;
+  }
+  for(i = 1; i <= s1.size(); i++){
+    cur[0] = i;
+    for(j = 1; j <= s2.size(); j++){
+      cost = (s1[i-1] == s2[j-1]) ? 0 : 1;
+      cur[j] = std::min(prev[j-1] + cost, std::min(prev[j] + 1, cur[j-1] + 1));
+    }
+    prev.swap(cur);
+  }
+
+  return prev[s2.size()];
+}
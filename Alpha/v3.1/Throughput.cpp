@@ -0,0 +1,193 @@
+#include "Controller.hpp"
+
+/*
+  Sustained words-per-second of a continuous typing session, decoded sequentially (DecodeSession::Decode, one word
+  after the other) versus pipelined (DecodePipeline, with the stages on their own threads). Every trace in
+  THROUGHPUT_TRACE_DIRS is loaded once, and the whole set is fed 'repeats' times as one long stream of words. The
+  pipelined run's top results are checked against the sequential run's, word by word.
+
+  Also reports each pipeline stage's mean time per word. Pipelined throughput is bounded by the slowest stage, and
+  needs a core per stage to get there; on fewer cores the stages just take turns.
+
+  Usage: throughput [repeats=10] [path=direct|lattice] [queueDepth=PIPELINE_QUEUE_DEPTH]
+*/
+
+static const char* THROUGHPUT_TRACE_DIRS[] = {"../TestInput/EyeInputs/Test1/", "../TestInput/EyeInputs/Test2/"};
+static const int NUM_THROUGHPUT_TRACE_DIRS = sizeof(THROUGHPUT_TRACE_DIRS) / sizeof(char*);
+static const char* PIPELINE_STAGE_NAMES[NUM_PIPELINE_STAGES] = {"cluster", "candidates", "rescore"};
+
+class Throughput{
+  public:
+    DecoderModels* models;
+    int path;
+    int repeats;
+    int queueDepth;
+    vector<vector<Point> > words;    //every trace, in feed order
+    vector<string> sequentialTops;   //top result of each fed word (words.size() * repeats)
+    vector<string> pipelinedTops;
+    double stageUs[NUM_PIPELINE_STAGES];  //summed over the pipelined run
+
+    Throughput(const string& keyMapFile, int decodePath, int numRepeats, int depth);
+    ~Throughput();
+
+    void LoadTraces(const string& dir);
+    double RunSequential(void);
+    double RunPipelined(void);
+    void Collect(DecodePipeline* pipeline);
+    int CountMismatches(void);
+};
+
+Throughput::Throughput(const string& keyMapFile, int decodePath, int numRepeats, int depth)
+{
+  path = decodePath;
+  repeats = numRepeats;
+  queueDepth = depth;
+  models = new DecoderModels(keyMapFile,"../vocabModel.txt");
+  for(int i = 0; i < NUM_PIPELINE_STAGES; i++){
+    stageUs[i] = 0.0;
+  }
+
+}
+
+Throughput::~Throughput()
+{
+  delete models;
+}
+
+//appends the points of dir/word1.txt, dir/word2.txt... up to the first missing one
+void Throughput::LoadTraces(const string& dir)
+{
+  string fname, delimiter = "\t";
+  std::ifstream probe;
+  vector<Point> points;
+  SingularityBuilder sb(0,models->layoutManager->GetWidth(),0,models->layoutManager->GetHeight(),models->layoutManager);
+
+  for(int i = 1; ; i++){
+    fname = dir + "word" + std::to_string(i) + ".txt";
+    probe.open(fname.c_str());
+    if(!probe.is_open()){
+      break;
+    }
+    probe.close();
+    points.clear();
+    sb.BuildTestData(fname,points,delimiter);
+    words.push_back(points);
+  }
+}
+
+//returns words per second
+double Throughput::RunSequential(void)
+{
+  int i, j;
+  DecodeSession session(models,0);
+  struct timespec begin, end;
+
+  clock_gettime(CLOCK_MONOTONIC,&begin);
+  for(i = 0; i < repeats; i++){
+    for(j = 0; j < words.size(); j++){
+      session.Decode(words[j],path);
+      sequentialTops.push_back(session.results.empty() ? "" : session.results.begin()->first);
+    }
+  }
+  clock_gettime(CLOCK_MONOTONIC,&end);
+
+  return (repeats * words.size()) / (double)DiffTimeSpecs(&begin,&end);
+}
+
+//the consumer side of the pipelined run, on its own thread
+void Throughput::Collect(DecodePipeline* pipeline)
+{
+  PipelineWord* word;
+
+  while(pipeline->Next(word)){
+    pipelinedTops.push_back(word->results.empty() ? "" : word->results.begin()->first);
+    for(int i = 0; i < NUM_PIPELINE_STAGES; i++){
+      stageUs[i] += word->stageUs[i];
+    }
+    delete word;
+  }
+}
+
+//returns words per second
+double Throughput::RunPipelined(void)
+{
+  int i, j;
+  DecodePipeline pipeline(models,path,queueDepth);
+  struct timespec begin, end;
+
+  clock_gettime(CLOCK_MONOTONIC,&begin);
+  std::thread consumer(&Throughput::Collect,this,&pipeline);
+  for(i = 0; i < repeats; i++){
+    for(j = 0; j < words.size(); j++){
+      pipeline.Submit(words[j]);
+    }
+  }
+  pipeline.Close();
+  consumer.join();
+  clock_gettime(CLOCK_MONOTONIC,&end);
+
+  return (repeats * words.size()) / (double)DiffTimeSpecs(&begin,&end);
+}
+
+int Throughput::CountMismatches(void)
+{
+  int mismatches = std::abs((int)sequentialTops.size() - (int)pipelinedTops.size());
+
+  for(int i = 0; i < sequentialTops.size() && i < pipelinedTops.size(); i++){
+    if(sequentialTops[i] != pipelinedTops[i]){
+      mismatches++;
+    }
+  }
+
+  return mismatches;
+}
+
+int main(int argc, char* argv[])
+{
+  int i, repeats = 10, path = DECODE_DIRECT, queueDepth = PIPELINE_QUEUE_DEPTH, mismatches;
+  double sequential, pipelined, numWords;
+
+  if(argc >= 2){
+    repeats = atoi(argv[1]);
+  }
+  if(argc >= 3){
+    path = strcmp(argv[2],"lattice") ? DECODE_DIRECT : DECODE_LATTICE_LM;
+  }
+  if(argc >= 4){
+    queueDepth = atoi(argv[3]);
+  }
+  if(repeats <= 0 || queueDepth <= 0){
+    cout << "usage: " << argv[0] << " [repeats=10] [path=direct|lattice] [queueDepth=" << PIPELINE_QUEUE_DEPTH << "]" << endl;
+    return 1;
+  }
+
+  Throughput throughput("../TestInput/EyeInputs/Test1/keyMap.txt",path,repeats,queueDepth);
+  Silence(true);
+  for(i = 0; i < NUM_THROUGHPUT_TRACE_DIRS; i++){
+    throughput.LoadTraces(THROUGHPUT_TRACE_DIRS[i]);
+  }
+  Silence(false);
+  numWords = repeats * throughput.words.size();
+  cout << "decoding " << (int)numWords << " words (" << throughput.words.size() << " traces x " << repeats << ") on the "
+       << ((path == DECODE_LATTICE_LM) ? "lattice+lm" : "direct") << " path, " << std::thread::hardware_concurrency() << " cores" << endl;
+
+  Silence(true);
+  sequential = throughput.RunSequential();
+  pipelined = throughput.RunPipelined();
+  Silence(false);
+
+  printf("%-12s %10.1f words/s\n","sequential",sequential);
+  printf("%-12s %10.1f words/s  (%.2fx, queue depth %d)\n","pipelined",pipelined,pipelined / sequential,queueDepth);
+  for(i = 0; i < NUM_PIPELINE_STAGES; i++){
+    printf("  %-10s %10.1f us/word\n",PIPELINE_STAGE_NAMES[i],throughput.stageUs[i] / numWords);
+  }
+
+  mismatches = throughput.CountMismatches();
+  if(mismatches > 0){
+    cout << "ERROR " << mismatches << " pipelined results differ from the sequential ones" << endl;
+    return 1;
+  }
+  cout << "pipelined results match the sequential ones" << endl;
+
+  return 0;
+}
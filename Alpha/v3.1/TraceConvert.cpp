@@ -0,0 +1,212 @@
+#include "Controller.hpp"
+#include <sys/stat.h>
+
+/*
+  Converts text traces into a gaze trace file (see GazeTrace.cpp), and describes gaze trace files.
+
+    traceConvert convert labelsFile out.gzt [sampleHz=TRACE_GEN_SAMPLE_HZ]
+      Every trace in a labels manifest (the format recall reads; '-' labels are kept, as unlabeled words) is parsed
+      with SingularityBuilder::BuildTestData, the same parser the engine uses, and written in manifest order. Each
+      directory becomes a session. The text traces have no timestamps, so samples are stamped 1/sampleHz apart on one
+      clock per session. The output is then mapped and checked sample for sample against the text, and the time to
+      parse the text is reported against the time to map the file and read every sample.
+
+    traceConvert info file.gzt
+      Prints the file's sessions and words.
+*/
+
+class TraceConvert{
+  public:
+    vector<string> traces;
+    vector<string> labels;
+
+    TraceConvert();
+    ~TraceConvert();
+
+    bool LoadLabels(const string& labelsFile);
+    bool Convert(const string& outFile, double sampleHz);
+    bool Info(const string& inFile);
+};
+
+TraceConvert::TraceConvert()
+{
+  //nada
+}
+
+TraceConvert::~TraceConvert()
+{
+  //nada
+}
+
+//reads the manifest; traces are resolved relative to the manifest's directory
+bool TraceConvert::LoadLabels(const string& labelsFile)
+{
+  char buf[BUFSIZE];
+  char* tokens[BUFSIZE];
+  string dir, label;
+  std::ifstream infile(labelsFile.c_str());
+
+  if(!infile.is_open()){
+    cout << "ERROR could not open labels file: " << labelsFile << endl;
+    return false;
+  }
+  if(labelsFile.rfind(PATH_ESCAPE) != string::npos){
+    dir = labelsFile.substr(0,labelsFile.rfind(PATH_ESCAPE) + 1);
+  }
+
+  while(infile.getline(buf,BUFSIZE)){
+    if(buf[0] == '#' || buf[0] == '\0' || Tokenize(tokens,buf,"\t\r") != 2){
+      continue;
+    }
+    StrToUpper(tokens[1]);
+    label = tokens[1];
+    traces.push_back(dir + tokens[0]);
+    labels.push_back((label == "-") ? "" : label);
+  }
+
+  if(traces.empty()){
+    cout << "ERROR no traces in " << labelsFile << endl;
+    return false;
+  }
+
+  return true;
+}
+
+bool TraceConvert::Convert(const string& outFile, double sampleHz)
+{
+  int i;
+  size_t j, textBytes = 0;
+  U64 clockUs = 0, checksum = 0, mappedChecksum = 0;
+  double parseSeconds, mapSeconds;
+  string dir, lastDir = "\n", delimiter = "\t";
+  vector<vector<Point> > words;
+  vector<U64> timesUs;
+  struct stat st;
+  struct timespec begin, end;
+  GazeTraceWriter writer;
+  GazeTraceFile mapped;
+  SingularityBuilder sb(0,0,0,0,NULL);  //only its parser
+
+  Silence(true);
+  words.resize(traces.size());
+  clock_gettime(CLOCK_MONOTONIC,&begin);
+  for(i = 0; i < traces.size(); i++){
+    sb.BuildTestData(traces[i],words[i],delimiter);
+    for(j = 0; j < words[i].size(); j++){
+      checksum += (U16)words[i][j].X + (U16)words[i][j].Y;
+    }
+  }
+  clock_gettime(CLOCK_MONOTONIC,&end);
+  parseSeconds = DiffTimeSpecs(&begin,&end);
+  Silence(false);
+
+  if(!writer.Open(outFile)){
+    return false;
+  }
+  for(i = 0; i < traces.size(); i++){
+    if(stat(traces[i].c_str(),&st) == 0){
+      textBytes += st.st_size;
+    }
+    dir = traces[i].substr(0,traces[i].rfind(PATH_ESCAPE) + 1);
+    if(dir != lastDir){
+      clockUs = 0;
+      writer.BeginSession(dir,clockUs);
+      lastDir = dir;
+    }
+    timesUs.resize(words[i].size());
+    for(j = 0; j < words[i].size(); j++){
+      timesUs[j] = clockUs;
+      clockUs += (U64)(1.0e6 / sampleHz);
+    }
+    if(!writer.AppendWord(labels[i],words[i],timesUs.empty() ? NULL : &timesUs[0])){
+      cout << "ERROR failed writing " << outFile << endl;
+      return false;
+    }
+  }
+  if(!writer.Close()){
+    return false;
+  }
+
+  clock_gettime(CLOCK_MONOTONIC,&begin);
+  if(!mapped.Open(outFile)){
+    return false;
+  }
+  for(i = 0; i < mapped.words.size(); i++){
+    const PointSpan& points = mapped.words[i].points;
+    for(j = 0; j < points.size(); j++){
+      mappedChecksum += (U16)points[j].X + (U16)points[j].Y;
+    }
+  }
+  clock_gettime(CLOCK_MONOTONIC,&end);
+  mapSeconds = DiffTimeSpecs(&begin,&end);
+
+  for(i = 0; i < traces.size(); i++){
+    const PointSpan& points = mapped.words[i].points;
+    for(j = 0; j < points.size() && points.size() == words[i].size(); j++){
+      if(points[j].X != words[i][j].X || points[j].Y != words[i][j].Y){
+        break;
+      }
+    }
+    if(points.size() != words[i].size() || j != points.size()){
+      cout << "ERROR " << outFile << " doesn't match " << traces[i] << " at sample " << j << endl;
+      return false;
+    }
+  }
+
+  printf("wrote %s: %u sessions, %u words, %llu samples\n",outFile.c_str(),mapped.header.numSessions,mapped.header.numWords,mapped.header.numSamples);
+  printf("  text       %10zu bytes  parsed in      %10.1f us\n",textBytes,parseSeconds * 1.0e6);
+  printf("  gaze trace %10zu bytes  mapped+read in %10.1f us  (checksums %s)\n",mapped.length,mapSeconds * 1.0e6,(checksum == mappedChecksum) ? "match" : "DIFFER");
+
+  return checksum == mappedChecksum;
+}
+
+bool TraceConvert::Info(const string& inFile)
+{
+  int i;
+  U64 durationUs;
+  GazeTraceFile mapped;
+
+  if(!mapped.Open(inFile)){
+    return false;
+  }
+
+  printf("%s: %zu bytes, %u sessions, %u words, %llu samples\n",inFile.c_str(),mapped.length,mapped.header.numSessions,mapped.header.numWords,mapped.header.numSamples);
+  for(i = 0; i < mapped.words.size(); i++){
+    const GazeWord& word = mapped.words[i];
+    if(i == 0 || word.sessionId != mapped.words[i-1].sessionId){
+      printf("session %u \"%s\"\n",word.sessionId,mapped.sessionNames[word.sessionId]);
+    }
+    durationUs = 0;
+    for(size_t j = 0; j < word.points.size(); j++){
+      durationUs += word.deltaUs[j];
+    }
+    printf("  %12.3f s  %5zu samples  %8.1f ms  %s\n",word.startUs / 1.0e6,word.points.size(),durationUs / 1000.0,word.label[0] ? word.label : "-");
+  }
+
+  return true;
+}
+
+int main(int argc, char* argv[])
+{
+  double sampleHz = TRACE_GEN_SAMPLE_HZ;
+  string mode = (argc >= 2) ? argv[1] : "";
+  TraceConvert traceConvert;
+
+  if(mode == "convert" && argc >= 4){
+    if(argc >= 5){
+      sampleHz = atof(argv[4]);
+    }
+    if(sampleHz <= 0.0){
+      cout << "ERROR sampleHz must be positive" << endl;
+      return 1;
+    }
+    return (traceConvert.LoadLabels(argv[2]) && traceConvert.Convert(argv[3],sampleHz)) ? 0 : 1;
+  }
+  if(mode == "info" && argc >= 3){
+    return traceConvert.Info(argv[2]) ? 0 : 1;
+  }
+
+  cout << "usage: " << argv[0] << " convert labelsFile out" << GAZE_TRACE_EXT << " [sampleHz=" << TRACE_GEN_SAMPLE_HZ << "]" << endl;
+  cout << "       " << argv[0] << " info file" << GAZE_TRACE_EXT << endl;
+  return 1;
+}
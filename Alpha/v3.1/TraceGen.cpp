@@ -0,0 +1,313 @@
+#include "Controller.hpp"
+#include <sys/stat.h>
+
+/*
+  Synthetic trace generator and load driver, over TraceGenerator. Words are drawn uniformly (with a seed) from a word
+  list, one word per line (the vocabulary by default), keeping those that can be typed on the layout.
+
+    traceGen write outDir count [seed=1] [wordList=../vocabModel.txt]
+      Writes outDir/word1.txt... in the recorded traces' x<TAB>y format, plus outDir/labels.txt, a manifest in the
+      format recall reads, so 'recall outDir/labels.txt' scores the decoder on them. If outDir ends in .gzt, writes one
+      gaze trace file instead (see GazeTrace.cpp): a single session, stamped at the generator's sample rate.
+
+    traceGen stress sessions wordsPerSession [threads=cores] [path=direct|lattice] [seed=1] [wordList=../vocabModel.txt]
+      Generates traces straight into a SessionPool, round-robin over the sessions, with at most
+      STRESS_BACKLOG_PER_SESSION words outstanding per session. Reports the generation and decode rates, mean
+      decode time, and the top-1/top-5 hit rate of the generated words.
+
+  Any argument name=value sets that TraceGenParams knob instead (eg dwellMs=300 jitterPx=8 insertionProb=0.1), and
+  isn't counted as a positional argument.
+*/
+
+#define STRESS_BACKLOG_PER_SESSION 4
+
+class TraceGen{
+  public:
+    LayoutManager* layoutManager;
+    TraceGenerator* generator;
+    vector<string> words;
+    //stress tallies, written from the pool's workers
+    std::mutex mutex;
+    std::condition_variable decoded;
+    U64 outstanding;
+    std::atomic<U64> top1Hits;
+    std::atomic<U64> top5Hits;
+    std::atomic<U64> decodeNs;
+
+    TraceGen(const string& keyMapFile, const TraceGenParams& params, U32 seed);
+    ~TraceGen();
+
+    bool LoadWords(const string& wordList);
+    const string& RandomWord(void);
+    bool Write(const string& outDir, int count);
+    bool WriteGazeTrace(const string& outFile, int count);
+    void Stress(int numSessions, int wordsPerSession, int numThreads, int path);
+    void Tally(DecodeSession* session, SearchResults& results, const string& word);
+};
+
+TraceGen::TraceGen(const string& keyMapFile, const TraceGenParams& params, U32 seed)
+{
+
+  Silence(true);
+  layoutManager = new LayoutManager(keyMapFile);
+  Silence(false);
+  generator = new TraceGenerator(layoutManager,params,seed);
+  outstanding = 0;
+  top1Hits = 0;
+  top5Hits = 0;
+  decodeNs = 0;
+}
+
+TraceGen::~TraceGen()
+{
+  delete generator;
+  delete layoutManager;
+}
+
+//first tab-separated column of each line, upper-cased
+bool TraceGen::LoadWords(const string& wordList)
+{
+  char buf[BUFSIZE];
+  char* tokens[BUFSIZE];
+  std::ifstream infile(wordList.c_str());
+
+  if(!infile.is_open()){
+    cout << "ERROR could not open word list: " << wordList << endl;
+    return false;
+  }
+
+  while(infile.getline(buf,BUFSIZE)){
+    if(Tokenize(tokens,buf,"\t\r") < 1){
+      continue;
+    }
+    StrToUpper(tokens[0]);
+    if(generator->OnLayout(tokens[0])){
+      words.push_back(tokens[0]);
+    }
+  }
+
+  if(words.empty()){
+    cout << "ERROR no words in " << wordList << " can be typed on this layout" << endl;
+    return false;
+  }
+
+  return true;
+}
+
+const string& TraceGen::RandomWord(void)
+{
+  return words[generator->rng() % words.size()];
+}
+
+bool TraceGen::Write(const string& outDir, int count)
+{
+  int i, j;
+  U64 numSamples = 0;
+  string dir = outDir, fname;
+  vector<Point> points;
+  FILE* ofile;
+  FILE* labels;
+  struct timespec begin, end;
+
+  if(dir[dir.size() - 1] != PATH_ESCAPE){
+    dir += PATH_ESCAPE;
+  }
+  mkdir(dir.c_str(),0755);
+  labels = fopen((dir + "labels.txt").c_str(),"w");
+  if(labels == NULL){
+    cout << "ERROR could not open file: " << dir << "labels.txt" << endl;
+    return false;
+  }
+  fprintf(labels,"#synthetic traces from traceGen: trace<TAB>intended word\n");
+
+  clock_gettime(CLOCK_MONOTONIC,&begin);
+  for(i = 1; i <= count; i++){
+    const string& word = RandomWord();
+    points.clear();
+    generator->Generate(word,points);
+    numSamples += points.size();
+
+    fname = "word" + std::to_string(i) + ".txt";
+    ofile = fopen((dir + fname).c_str(),"w");
+    if(ofile == NULL){
+      cout << "ERROR could not open file: " << dir << fname << endl;
+      fclose(labels);
+      return false;
+    }
+    for(j = 0; j < points.size(); j++){
+      fprintf(ofile,"%d\t%d\n",points[j].X,points[j].Y);
+    }
+    fclose(ofile);
+    fprintf(labels,"%s\t%s\n",fname.c_str(),word.c_str());
+  }
+  clock_gettime(CLOCK_MONOTONIC,&end);
+  fclose(labels);
+
+  printf("wrote %d traces (%.1f samples/trace) to %s in %.3f s\n",count,(double)numSamples / count,dir.c_str(),(double)DiffTimeSpecs(&begin,&end));
+  return true;
+}
+
+bool TraceGen::WriteGazeTrace(const string& outFile, int count)
+{
+  int i;
+  size_t j;
+  U64 clockUs = 0;
+  vector<Point> points;
+  vector<U64> timesUs;
+  GazeTraceWriter writer;
+  struct timespec begin, end;
+
+  clock_gettime(CLOCK_MONOTONIC,&begin);
+  if(!writer.Open(outFile) || !writer.BeginSession("traceGen",0)){
+    return false;
+  }
+  for(i = 0; i < count; i++){
+    const string& word = RandomWord();
+    points.clear();
+    generator->Generate(word,points);
+    timesUs.resize(points.size());
+    for(j = 0; j < points.size(); j++){
+      timesUs[j] = clockUs;
+      clockUs += (U64)(1.0e6 / generator->params.sampleHz);
+    }
+    if(!writer.AppendWord(word,points,&timesUs[0])){
+      cout << "ERROR failed writing " << outFile << endl;
+      return false;
+    }
+  }
+  if(!writer.Close()){
+    return false;
+  }
+  clock_gettime(CLOCK_MONOTONIC,&end);
+
+  printf("wrote %d words (%.1f samples/word, %.1f s of gaze) to %s in %.3f s\n",count,(double)writer.header.numSamples / count,clockUs / 1.0e6,outFile.c_str(),(double)DiffTimeSpecs(&begin,&end));
+  return true;
+}
+
+//a pool callback: scores the decode of word, and lets Stress submit another
+void TraceGen::Tally(DecodeSession* session, SearchResults& results, const string& word)
+{
+  int rank = 1;
+
+  for(SearchResultIt it = results.begin(); it != results.end() && rank <= 5; ++it, rank++){
+    if(it->first == word){
+      if(rank == 1){
+        top1Hits++;
+      }
+      top5Hits++;
+      break;
+    }
+  }
+  decodeNs += (U64)(session->lastDecodeUs * 1000.0);
+
+  std::lock_guard<std::mutex> lock(mutex);
+  outstanding--;
+  decoded.notify_one();
+}
+
+void TraceGen::Stress(int numSessions, int wordsPerSession, int numThreads, int path)
+{
+  int i, j;
+  U64 numWords = (U64)numSessions * wordsPerSession, numSamples = 0;
+  double genSeconds = 0.0, totalSeconds;
+  vector<Point> points;
+  vector<DecodeSession*> sessions;
+  struct timespec begin, end, genBegin, genEnd;
+
+  Silence(true);
+  DecoderModels models("../TestInput/EyeInputs/Test1/keyMap.txt","../vocabModel.txt");
+  SessionPool pool(&models,numThreads);
+  for(i = 0; i < numSessions; i++){
+    sessions.push_back(pool.OpenSession());
+  }
+
+  clock_gettime(CLOCK_MONOTONIC,&begin);
+  for(j = 0; j < wordsPerSession; j++){
+    for(i = 0; i < numSessions; i++){
+      string word = RandomWord();
+      clock_gettime(CLOCK_MONOTONIC,&genBegin);
+      points.clear();
+      generator->Generate(word,points);
+      clock_gettime(CLOCK_MONOTONIC,&genEnd);
+      genSeconds += DiffTimeSpecs(&genBegin,&genEnd);
+      numSamples += points.size();
+
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        while(outstanding >= (U64)numSessions * STRESS_BACKLOG_PER_SESSION){
+          decoded.wait(lock);
+        }
+        outstanding++;
+      }
+      pool.Submit(sessions[i],points,path,[this,word](DecodeSession* session, SearchResults& results){
+        Tally(session,results,word);
+      });
+    }
+  }
+  pool.Drain();
+  clock_gettime(CLOCK_MONOTONIC,&end);
+  Silence(false);
+
+  totalSeconds = DiffTimeSpecs(&begin,&end);
+  printf("%llu words over %d sessions on %d threads, %s path, %.1f samples/word\n",numWords,numSessions,pool.NumThreads(),
+    (path == DECODE_LATTICE_LM) ? "lattice+lm" : "direct",(double)numSamples / numWords);
+  printf("%-10s %12.1f words/s\n","generated",numWords / genSeconds);
+  printf("%-10s %12.1f words/s  mean decode %.1f us\n","decoded",numWords / totalSeconds,decodeNs / 1000.0 / numWords);
+  printf("top-1 %.3f  top-5 %.3f\n",(double)top1Hits / numWords,(double)top5Hits / numWords);
+}
+
+int main(int argc, char* argv[])
+{
+  int numThreads = 0, path = DECODE_DIRECT;
+  U32 seed = 1;
+  string wordList = "../vocabModel.txt";
+  vector<string> args;
+  TraceGenParams params;
+  const char* eq;
+
+  for(int i = 1; i < argc; i++){
+    if((eq = strchr(argv[i],'=')) == NULL){
+      args.push_back(argv[i]);
+    }
+    else if(!params.Set(string(argv[i],eq - argv[i]),atof(eq + 1))){
+      cout << "ERROR unknown trace parameter: " << argv[i] << endl;
+      return 1;
+    }
+  }
+
+  if(args.size() >= 3 && args[0] == "write" && atoi(args[2].c_str()) > 0){
+    args.resize(5);  //missing optional args are empty
+  }
+  else if(args.size() >= 3 && args[0] == "stress" && atoi(args[1].c_str()) > 0 && atoi(args[2].c_str()) > 0){
+    args.resize(7);
+    numThreads = atoi(args[3].c_str());
+    path = (args[4] == "lattice") ? DECODE_LATTICE_LM : DECODE_DIRECT;
+    args.erase(args.begin() + 3,args.begin() + 5);  //seed and wordList follow, as for write
+  }
+  else{
+    cout << "usage: " << argv[0] << " write outDir count [seed=1] [wordList=../vocabModel.txt] [param=value...]" << endl;
+    cout << "       " << argv[0] << " stress sessions wordsPerSession [threads=cores] [path=direct|lattice] [seed=1] [wordList=../vocabModel.txt] [param=value...]" << endl;
+    return 1;
+  }
+  if(!args[3].empty()){
+    seed = (U32)atoi(args[3].c_str());
+  }
+  if(!args[4].empty()){
+    wordList = args[4];
+  }
+
+  TraceGen traceGen("../TestInput/EyeInputs/Test1/keyMap.txt",params,seed);
+  if(!traceGen.LoadWords(wordList)){
+    return 1;
+  }
+
+  if(args[0] == "write" && args[1].size() > strlen(GAZE_TRACE_EXT) && args[1].compare(args[1].size() - strlen(GAZE_TRACE_EXT),string::npos,GAZE_TRACE_EXT) == 0){
+    return traceGen.WriteGazeTrace(args[1],atoi(args[2].c_str())) ? 0 : 1;
+  }
+  if(args[0] == "write"){
+    return traceGen.Write(args[1],atoi(args[2].c_str())) ? 0 : 1;
+  }
+  traceGen.Stress(atoi(args[1].c_str()),atoi(args[2].c_str()),numThreads,path);
+
+  return 0;
+}
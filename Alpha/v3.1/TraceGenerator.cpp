@@ -0,0 +1,179 @@
+#include "Controller.hpp"
+
+/*
+  Synthetic gaze traces, for load and scale testing. There are only a few dozen recorded traces; this turns any word
+  into a trace over the same key layout, in the same form the recorded ones are parsed into (a vector of Points at a
+  fixed sample rate), so any number of them can be fed to the engine, or written out like the recordings.
+
+  The model follows what the recordings look like (and what signalGenerator.py and SingularityBuilder::RandomizeVal
+  only approximated): the eye fixates on the space bar, then for each char makes a saccade to its key and fixates
+  there, and ends back on the space bar.
+
+    -a fixation lasts a gaussian dwell time, lands a gaussian fixation error off the key center, and every sample in it
+     carries gaussian tracker jitter
+    -a saccade moves at a fixed speed, so a long one leaves a few samples in transit and a short one may leave none
+    -a saccade may overshoot its key along the direction of travel, and correct after a couple of samples
+    -before a key, the eye may glance at one of its neighbors first (an insertion error)
+    -a repeated char is a single longer fixation, since the eye doesn't move
+
+  Generation is deterministic per seed. Each generator owns its random state, so use one per thread.
+*/
+
+TraceGenParams::TraceGenParams()
+{
+  sampleHz = TRACE_GEN_SAMPLE_HZ;
+  dwellMs = 450.0;
+  dwellStdMs = 120.0;
+  edgeDwellMs = 300.0;
+  saccadePxPerSec = 12000.0;
+  fixationErrorPx = 12.0;
+  jitterPx = 5.0;
+  overshootProb = 0.15;
+  overshootFrac = 0.15;
+  insertionProb = 0.05;
+  insertionDwellMs = 120.0;
+}
+
+//sets the knob named like the member, eg Set("jitterPx",8). False for an unknown name.
+bool TraceGenParams::Set(const string& name, double value)
+{
+  double* knobs[] = {&sampleHz, &dwellMs, &dwellStdMs, &edgeDwellMs, &saccadePxPerSec, &fixationErrorPx, &jitterPx,
+                     &overshootProb, &overshootFrac, &insertionProb, &insertionDwellMs};
+  const char* names[] = {"sampleHz", "dwellMs", "dwellStdMs", "edgeDwellMs", "saccadePxPerSec", "fixationErrorPx", "jitterPx",
+                         "overshootProb", "overshootFrac", "insertionProb", "insertionDwellMs"};
+
+  for(int i = 0; i < sizeof(names) / sizeof(char*); i++){
+    if(name == names[i]){
+      *knobs[i] = value;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+TraceGenerator::TraceGenerator(LayoutManager* layoutManagerPtr, const TraceGenParams& genParams, U32 seed)
+  : rng(seed)
+{
+  layoutManager = layoutManagerPtr;
+  params = genParams;
+}
+
+//true if every char of word (case-insensitive), and the space bar, has a key
+bool TraceGenerator::OnLayout(const string& word)
+{
+  if(word.empty() || layoutManager->keyMap.find(' ') == layoutManager->keyMap.end()){
+    return false;
+  }
+  for(int i = 0; i < word.size(); i++){
+    if(layoutManager->keyMap.find((char)toupper(word[i])) == layoutManager->keyMap.end()){
+      return false;
+    }
+  }
+
+  return true;
+}
+
+//appends a trace of word to points. False if word can't be typed on the layout.
+bool TraceGenerator::Generate(const string& word, vector<Point>& points)
+{
+  char c, prevChar = '\0';
+  Point space, prev, target, over, stray;
+  vector<char>* neighbors;
+  std::uniform_real_distribution<double> uniform(0.0,1.0);
+
+  if(!OnLayout(word)){
+    cout << "ERROR TraceGenerator can't type >" << word << "< on this layout" << endl;
+    return false;
+  }
+
+  space = layoutManager->GetPoint(' ');
+  Fixate(space,params.edgeDwellMs,points);
+  prev = space;
+
+  for(int i = 0; i < word.size(); i++){
+    c = (char)toupper(word[i]);
+    target = layoutManager->GetPoint(c);
+
+    //a repeated char: keep looking at the key, for about twice as long
+    if(c == prevChar){
+      Fixate(target,Gaussian(params.dwellMs,params.dwellStdMs),points);
+      continue;
+    }
+
+    if(uniform(rng) < params.insertionProb){
+      neighbors = layoutManager->GetNeighborPtr(c);
+      if(!neighbors->empty()){
+        stray = layoutManager->GetPoint((*neighbors)[rng() % neighbors->size()]);
+        Saccade(prev,stray,points);
+        Fixate(stray,params.insertionDwellMs,points);
+        prev = stray;
+      }
+    }
+
+    if(uniform(rng) < params.overshootProb){
+      over = Clamp(target.X + (target.X - prev.X) * params.overshootFrac, target.Y + (target.Y - prev.Y) * params.overshootFrac);
+      Saccade(prev,over,points);
+      Fixate(over,2000.0 / params.sampleHz,points);  //two samples, then the corrective saccade
+      prev = over;
+    }
+
+    Saccade(prev,target,points);
+    Fixate(target,Gaussian(params.dwellMs,params.dwellStdMs),points);
+    prev = target;
+    prevChar = c;
+  }
+
+  Saccade(prev,space,points);
+  Fixate(space,params.edgeDwellMs,points);
+
+  return true;
+}
+
+//the samples taken while the eye travels from one fixation to the next; none if it gets there within a sample
+void TraceGenerator::Saccade(const Point& from, const Point& to, vector<Point>& points)
+{
+  double dx = to.X - from.X, dy = to.Y - from.Y, frac;
+  int n = (int)(sqrt(dx * dx + dy * dy) / (params.saccadePxPerSec / params.sampleHz));
+
+  for(int i = 1; i <= n; i++){
+    frac = (double)i / (n + 1);
+    points.push_back(Clamp(Gaussian(from.X + dx * frac,params.jitterPx),Gaussian(from.Y + dy * frac,params.jitterPx)));
+  }
+}
+
+//ms worth of samples around a point near key
+void TraceGenerator::Fixate(const Point& key, double ms, vector<Point>& points)
+{
+  double x = Gaussian(key.X,params.fixationErrorPx), y = Gaussian(key.Y,params.fixationErrorPx);
+
+  for(int i = Samples(ms); i > 0; i--){
+    points.push_back(Clamp(Gaussian(x,params.jitterPx),Gaussian(y,params.jitterPx)));
+  }
+}
+
+//number of samples in ms, at least one
+int TraceGenerator::Samples(double ms)
+{
+  int n = (int)(ms * params.sampleHz / 1000.0 + 0.5);
+
+  return (n < 1) ? 1 : n;
+}
+
+double TraceGenerator::Gaussian(double mean, double stdDev)
+{
+  if(stdDev <= 0.0){
+    return mean;
+  }
+
+  return std::normal_distribution<double>(mean,stdDev)(rng);
+}
+
+//screen coordinates are non-negative
+Point TraceGenerator::Clamp(double x, double y)
+{
+  x = std::min(std::max(x,0.0),32767.0);
+  y = std::min(std::max(y,0.0),32767.0);
+
+  return Point((short int)(x + 0.5),(short int)(y + 0.5));
+}
@@ -0,0 +1,104 @@
+#include "Controller.hpp"
+
+/*
+  Binary trace events, for seeing what the pipeline did on some query without paying for console output on every
+  query. TRACE_EVENT(id,a,b) stamps the time and writes a fixed-size TraceEvent into a process-wide ring of the last
+  TRACE_RING_SIZE events; nothing is formatted until someone asks for it with Dump() or Print().
+
+  Writers claim a slot with one relaxed fetch_add, so any thread can record without a lock. The ring overwrites its
+  oldest events, and a dump taken while other threads are recording may catch a slot mid-write; dump between queries
+  if that matters.
+
+  Dump file layout: TraceFileHeader | TraceEvent events[count], oldest first.
+*/
+
+#define TRACE_FILE_MAGIC 0x45435254  //"TRCE"
+
+struct TraceFileHeader{
+  U32 magic;
+  U32 count;
+  U32 eventSize;  //sizeof(TraceEvent), so a reader can detect a layout change
+  U32 reserved;
+};
+
+static const char* TRACE_EVENT_NAMES[NUM_TRACE_EVENTS] = {"cluster hit", "clusters merged", "lattice built", "search done", "lm done", "di done"};
+
+static TraceEvent ring[TRACE_RING_SIZE];
+static std::atomic<U64> head(0);  //total events ever recorded; the next one goes to ring[head % TRACE_RING_SIZE]
+
+void TraceRing::Record(U32 event, U32 a, double b)
+{
+  struct timespec now;
+  TraceEvent& slot = ring[head.fetch_add(1,std::memory_order_relaxed) & (TRACE_RING_SIZE - 1)];
+
+  clock_gettime(CLOCK_MONOTONIC,&now);
+  slot.timestampNs = (U64)now.tv_sec * 1000000000ULL + (U64)now.tv_nsec;
+  slot.event = event;
+  slot.a = a;
+  slot.b = b;
+}
+
+//copies the ring's events into events, oldest first. Returns the number of events dropped since the start (overwritten).
+U64 TraceRing::Snapshot(vector<TraceEvent>& events)
+{
+  U64 i, end = head.load(std::memory_order_acquire);
+  U64 begin = (end > TRACE_RING_SIZE) ? (end - TRACE_RING_SIZE) : 0;
+
+  events.clear();
+  events.reserve(end - begin);
+  for(i = begin; i < end; i++){
+    events.push_back(ring[i & (TRACE_RING_SIZE - 1)]);
+  }
+
+  return begin;
+}
+
+bool TraceRing::Dump(const string& traceFile)
+{
+  vector<TraceEvent> events;
+  TraceFileHeader header;
+  FILE* ofile;
+  bool written;
+
+  Snapshot(events);
+  ofile = fopen(traceFile.c_str(),"wb");
+  if(ofile == NULL){
+    cout << "ERROR could not open file: " << traceFile << endl;
+    return false;
+  }
+
+  memset(&header,0,sizeof(header));
+  header.magic = TRACE_FILE_MAGIC;
+  header.count = events.size();
+  header.eventSize = sizeof(TraceEvent);
+  written = fwrite(&header,sizeof(header),1,ofile) == 1;
+  if(!events.empty()){
+    written = written && fwrite(&events[0],sizeof(TraceEvent),events.size(),ofile) == events.size();
+  }
+  written = (fclose(ofile) == 0) && written;
+  if(!written){
+    cout << "ERROR could not write file: " << traceFile << endl;
+    return false;
+  }
+
+  return true;
+}
+
+//prints the ring, with times relative to the oldest event
+void TraceRing::Print(void)
+{
+  U64 dropped;
+  vector<TraceEvent> events;
+
+  dropped = Snapshot(events);
+  cout << events.size() << " trace events (" << dropped << " older events overwritten):" << endl;
+  for(U32 i = 0; i < events.size(); i++){
+    printf("  %12.3f us  %-16s a=%-8u b=%.3f\n",(events[i].timestampNs - events[0].timestampNs) / 1000.0,EventName(events[i].event),events[i].a,events[i].b);
+  }
+  fflush(stdout);
+}
+
+const char* TraceRing::EventName(U32 event)
+{
+  return (event < NUM_TRACE_EVENTS) ? TRACE_EVENT_NAMES[event] : "unknown";
+}
@@ -0,0 +1,98 @@
+#ifndef FASTKEY_H
+#define FASTKEY_H
+
+/*
+  libfastkey: C ABI for embedding the decoder in another process (eg, the UI), instead of running twitch and
+  scraping its output. Built by 'make libfastkey.so'; implemented in FastKey.cpp.
+
+  An engine loads the key layout, vocabulary and language models once (the char-gram files are read from "../",
+  like twitch), and then decodes one word at a time: feed the word's gaze samples, call fk_end_word, then copy
+  out the ranked results.
+
+    fk_engine* engine = fk_create("keyMap.txt","vocabModel.txt",FK_PATH_LATTICE_LM);
+    fk_feed_points(engine,samples,numSamples);      //any number of times per word
+    n = fk_end_word(engine);
+    n = fk_get_results(engine,results,10);
+    fk_destroy(engine);
+
+  To avoid even the one copy fk_feed_points makes, a producer can write samples straight into the engine's own
+  point buffer: fk_point_buffer(engine,n) returns room for n points, and fk_commit_points(engine,k) adds the first
+  k of them to the word. A producer that already has the whole word in its own buffer can skip the engine's buffer:
+  fk_decode_points(engine,samples,numSamples) decodes them where they are, in place of the feed and fk_end_word.
+
+  Functions returning int return a count (>= 0) or an fk_status (< 0); fk_last_error describes the last failure.
+  An engine must not be used from two threads at once; separate engines are independent.
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define FK_ABI_VERSION 1
+#define FK_MAX_WORD_LENGTH 64  /* including the terminating null; longer words are truncated */
+
+typedef struct fk_engine fk_engine;
+
+/* one gaze sample in screen coordinates; layout-compatible with the engine's Point */
+typedef struct fk_point{
+  int16_t x;
+  int16_t y;
+} fk_point;
+
+typedef struct fk_result{
+  char word[FK_MAX_WORD_LENGTH];
+  float score;  /* -log2 probability; lower is better */
+} fk_result;
+
+typedef enum fk_status{
+  FK_OK = 0,
+  FK_ERROR_ARGUMENT = -1,  /* null engine or buffer, or a bad count */
+  FK_ERROR_INTERNAL = -2   /* the decoder threw; see fk_last_error */
+} fk_status;
+
+typedef enum fk_path{
+  FK_PATH_DIRECT = 0,      /* DirectInference::Process */
+  FK_PATH_LATTICE_LM = 1   /* LatticeBuilder -> SearchEngine -> LanguageModel */
+} fk_path;
+
+int fk_abi_version(void);
+
+/* NULL on failure, including a path that isn't an fk_path */
+fk_engine* fk_create(const char* keyMapFile, const char* vocabFile, int path);
+void fk_destroy(fk_engine* engine);
+
+/* appends count samples (copied) to the current word */
+int fk_feed_points(fk_engine* engine, const fk_point* points, size_t count);
+
+/* room for count more samples in the engine's buffer, valid until the next call on the engine. NULL on failure. */
+fk_point* fk_point_buffer(fk_engine* engine, size_t count);
+/* adds the first count samples written to the last fk_point_buffer to the current word */
+int fk_commit_points(fk_engine* engine, size_t count);
+
+/* discards the current word's samples */
+int fk_reset_word(fk_engine* engine);
+
+/* decodes the current word and starts a new one. Returns the number of results available. */
+int fk_end_word(fk_engine* engine);
+
+/* decodes count samples as one word, reading them from the caller's buffer without copying them, and starts a new
+   word; any samples already fed are discarded. Returns the number of results available, as fk_end_word does. */
+int fk_decode_points(fk_engine* engine, const fk_point* points, size_t count);
+
+/* copies the best min(maxResults, available) results of the last word into results. Returns the number copied. */
+int fk_get_results(fk_engine* engine, fk_result* results, size_t maxResults);
+
+/* decode time of the last word, in microseconds */
+double fk_last_decode_us(fk_engine* engine);
+
+/* never NULL; empty if nothing has failed */
+const char* fk_last_error(fk_engine* engine);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif